@@ -2,42 +2,51 @@
 
 #include "batch_request.h"
 
+#include <utility>
+
 #include "error.h"
 
 namespace json_rpc {
 
-Status BatchRequest::ParseJson(const std::string& json_str) {
+Status BatchRequest::ParseJson(const std::string& json_str, const ParseLimits& limits) {
   Json json;
-  try {
-    json = Json::parse(json_str);
-  } catch (const nlohmann::detail::parse_error& e) {
-    return {kParseError, "Parse error"};
-  } catch (const std::exception& e) {
-    return {kInvalidRequest, "Invalid Request"};
-  } catch (...) {
-    return {kInvalidRequest, "Invalid Request"};
+  if (auto status = ParseJsonText(json_str, limits, &json); !status.Ok()) {
+    return status;
   }
-  return ParseJson(json);
+  return ParseJson(std::move(json));
 }
 
-Status BatchRequest::ParseJson(const Json& json) {
+// Shared by both ParseJson(); items of a const JSON are copied, those of an rvalue one moved.
+template <typename J>
+Status BatchRequest::Parse(J&& json) {
   if (json.is_array()) {
+    is_batch_ = true;
     if (json.empty()) {
       return {kInvalidRequest, "Invalid Request"};
     }
-    for (const auto& item : json) {
+    requests_.reserve(requests_.size() + json.size());
+    for (auto&& item : json) {
       Request request;
-      const auto status = request.ParseJson(item);
-      requests_.emplace_back(request, status);
+      // Binds to Request::ParseJson(const Json&) when json is const.
+      auto status = request.ParseJson(std::move(item));
+      requests_.emplace_back(std::move(request), std::move(status));
     }
   } else if (json.is_object()) {
     Request request;
-    auto status = request.ParseJson(json);
-    requests_.emplace_back(request, status);
+    auto status = request.ParseJson(std::forward<J>(json));
+    requests_.emplace_back(std::move(request), std::move(status));
   } else {
     return {kInvalidRequest, "Invalid Request"};
   }
   return {kSuccess, ""};
 }
 
+Status BatchRequest::ParseJson(const Json& json) {
+  return Parse(json);
+}
+
+Status BatchRequest::ParseJson(Json&& json) {
+  return Parse(std::move(json));
+}
+
 }  // namespace json_rpc
@@ -3,6 +3,7 @@
 
 #include <vector>
 
+#include "parse_limits.h"
 #include "request.h"
 
 namespace json_rpc {
@@ -16,22 +17,44 @@ class BatchRequest {
 
   /// @brief Parses a JSON string into a batch request.
   /// @param json_str The JSON string to parse.
-  /// @return A Status object indicating success or failure.
-  Status ParseJson(const std::string& json_str);
+  /// @param limits The limits enforced while parsing the string.
+  /// @return A Status object indicating success or failure, kInvalidRequest if a limit is exceeded.
+  Status ParseJson(const std::string& json_str, const ParseLimits& limits = ParseLimits());
 
   /// @brief Parses a JSON object into a batch request.
   /// @param json The JSON object to parse.
   /// @return A Status object indicating success or failure.
   Status ParseJson(const Json& json);
 
+  /// @brief Parses a JSON object into a batch request, moving the params out of it.
+  /// @param json The JSON object to parse.
+  /// @return A Status object indicating success or failure.
+  Status ParseJson(Json&& json);
+
   /// @brief Gets the list of requests and their parsing statuses.
   /// @return A constant reference to the vector of request-status pairs.
   [[nodiscard]] const std::vector<std::pair<Request, Status>>& Requests() const {
     return requests_;
   }
 
+  /// @brief Gets the list of requests and their parsing statuses.
+  /// @return A reference to the vector of request-status pairs.
+  [[nodiscard]] std::vector<std::pair<Request, Status>>& Requests() {
+    return requests_;
+  }
+
+  /// @brief Checks if the parsed JSON was an array rather than a single Request object.
+  /// @return true if the requests were sent as a batch, otherwise false.
+  [[nodiscard]] bool IsBatch() const {
+    return is_batch_;
+  }
+
  private:
+  template <typename J>
+  Status Parse(J&& json);
+
   std::vector<std::pair<Request, Status>> requests_;
+  bool is_batch_ = false;
 };
 
 }  // namespace json_rpc
@@ -1,18 +1,48 @@
 
 #include "batch_response.h"
 
+#include <utility>
+
 namespace json_rpc {
 
 void BatchResponse::AddResponse(const Response& response) {
   responses_.emplace_back(response);
 }
 
-Json BatchResponse::ToJson() const {
+void BatchResponse::AddResponse(Response&& response) {
+  responses_.emplace_back(std::move(response));
+}
+
+Json BatchResponse::ToJson() const& {
   Json array = Json::array();
+  auto& values = array.get_ref<Json::array_t&>();
+  values.reserve(responses_.size());
   for (const auto& response : responses_) {
-    array.emplace_back(response.ToJson());
+    values.emplace_back(response.ToJson());
   }
   return array;
 }
 
+Json BatchResponse::ToJson() && {
+  Json array = Json::array();
+  auto& values = array.get_ref<Json::array_t&>();
+  values.reserve(responses_.size());
+  for (auto& response : responses_) {
+    values.emplace_back(std::move(response).ToJson());
+  }
+  responses_.clear();
+  return array;
+}
+
+void BatchResponse::AppendTo(std::string* out) const {
+  out->push_back('[');
+  for (size_t i = 0; i < responses_.size(); ++i) {
+    if (i != 0) {
+      out->push_back(',');
+    }
+    responses_[i].AppendTo(out);
+  }
+  out->push_back(']');
+}
+
 }  // namespace json_rpc
\ No newline at end of file
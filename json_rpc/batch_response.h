@@ -1,6 +1,9 @@
 
 #pragma once
 
+#include <cstddef>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "response.h"
@@ -30,9 +33,28 @@ class BatchResponse {
   /// @param response The response to add to the batch.
   void AddResponse(const Response& response);
 
+  /// @brief Adds a response to the batch, moving it.
+  /// @param response The response to add to the batch.
+  void AddResponse(Response&& response);
+
+  /// @brief Reserves room for a number of responses, such as the size of the batch request.
+  /// @param count The number of responses.
+  void Reserve(size_t count) {
+    responses_.reserve(count);
+  }
+
   /// @brief Converts the batch response to a JSON object.
   /// @return A JSON representation of the batch response.
-  [[nodiscard]] Json ToJson() const;
+  [[nodiscard]] Json ToJson() const&;
+
+  /// @brief Converts the batch response to a JSON object, moving the results into it.
+  /// @return A JSON representation of the batch response.
+  [[nodiscard]] Json ToJson() &&;
+
+  /// @brief Serializes the batch response compactly, as ToJson().dump() does, appending to a
+  /// string. Typed and raw results are written straight from their values.
+  /// @param out The string to append to.
+  void AppendTo(std::string* out) const;
 
   /// @brief Gets the list of responses in the batch.
   /// @return A constant reference to the vector of responses.
@@ -40,6 +62,19 @@ class BatchResponse {
     return responses_;
   }
 
+  /// @brief Moves the responses out of the batch, leaving it empty.
+  /// @return The vector of responses.
+  [[nodiscard]] std::vector<Response> TakeResponses() {
+    auto responses = std::move(responses_);
+    responses_.clear();
+    return responses;
+  }
+
+  /// @brief Removes the responses from the batch, keeping the capacity of its vector.
+  void Clear() {
+    responses_.clear();
+  }
+
  private:
   std::vector<Response> responses_;
 };
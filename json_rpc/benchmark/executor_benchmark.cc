@@ -0,0 +1,100 @@
+
+// Throughput of Dispatcher::HandleMessage() run by an Executor, against the mutex and condition
+// variable queue of a Scheduler, from one to N worker threads.
+//
+// Usage: executor_benchmark [max_threads] [messages]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "json_rpc/executor.h"
+#include "json_rpc/scheduler.h"
+
+namespace {
+
+using json_rpc::Dispatcher;
+using json_rpc::Executor;
+using json_rpc::Request;
+using json_rpc::Response;
+using json_rpc::Scheduler;
+
+constexpr auto kMessage = R"({"jsonrpc":"2.0","method":"subtract","params":[42,23],"id":1})";
+
+void RegisterMethods(Dispatcher* dispatcher) {
+  dispatcher->RegisterMethod("subtract", [](const Request& request) {
+    Response response(request.Id());
+    response.SetResult(request.Params().Get<int>(0) - request.Params().Get<int>(1));
+    return response;
+  });
+}
+
+template <typename F>
+double MessagesPerSecond(const size_t messages, F&& run) {
+  const auto begin = std::chrono::steady_clock::now();
+  run();
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  return static_cast<double>(messages) / elapsed.count();
+}
+
+double RunExecutor(Dispatcher* dispatcher, const size_t threads, const size_t messages) {
+  std::atomic<size_t> replied{0};
+  return MessagesPerSecond(messages, [&] {
+    Executor executor(threads, true);
+    const std::string message = kMessage;
+    for (size_t i = 0; i < messages; ++i) {
+      // Submitted from outside the workers, as an I/O thread would.
+      while (!executor
+                  .Submit([&] {
+                    if (!dispatcher->HandleMessage(message).empty()) {
+                      replied.fetch_add(1, std::memory_order_relaxed);
+                    }
+                  })
+                  .Ok()) {
+        std::this_thread::yield();
+      }
+    }
+    executor.Stop();
+  });
+}
+
+double RunScheduler(Dispatcher* dispatcher, const size_t threads, const size_t messages) {
+  std::atomic<size_t> replied{0};
+  return MessagesPerSecond(messages, [&] {
+    Scheduler scheduler(dispatcher, threads);
+    const std::string message = kMessage;
+    for (size_t i = 0; i < messages; ++i) {
+      static_cast<void>(scheduler.Submit(message, [&](const std::string& response) {
+        if (!response.empty()) {
+          replied.fetch_add(1, std::memory_order_relaxed);
+        }
+      }));
+    }
+    scheduler.Stop();
+  });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const size_t max_threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                                      : std::max(1u, std::thread::hardware_concurrency());
+  const size_t messages = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000;
+
+  Dispatcher dispatcher;
+  RegisterMethods(&dispatcher);
+  std::printf("%8s %16s %16s\n", "threads", "executor msg/s", "scheduler msg/s");
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    const auto executor = RunExecutor(&dispatcher, threads, messages);
+    const auto scheduler = RunScheduler(&dispatcher, threads, messages);
+    std::printf("%8zu %16.0f %16.0f\n", threads, executor, scheduler);
+    if (threads < max_threads && threads * 2 > max_threads) {
+      threads = max_threads / 2;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,131 @@
+
+// Loopback throughput of a ShardedServer from one to N shards. Each shard is served by two client
+// threads, each keeping a window of pipelined requests in flight on its own connection.
+//
+// Usage: sharded_server_benchmark [max_shards] [seconds] [pipeline]
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json_rpc/sharded_server.h"
+
+namespace {
+
+using json_rpc::Dispatcher;
+using json_rpc::Request;
+using json_rpc::Response;
+using json_rpc::ShardedServer;
+
+constexpr size_t kClientsPerShard = 2;
+
+void Setup(size_t /*shard*/, Dispatcher* dispatcher) {
+  dispatcher->RegisterMethod("subtract", [](const Request& request) {
+    Response response(request.Id());
+    response.SetResult(request.Params().Get<int>(0) - request.Params().Get<int>(1));
+    return response;
+  });
+}
+
+int Connect(const uint16_t port) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  const int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+  if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Sends windows of pipelined requests until stopped, counting the responses.
+void Client(const uint16_t port, const size_t pipeline, const std::atomic<bool>* stop,
+            std::atomic<uint64_t>* responses) {
+  const int fd = Connect(port);
+  if (fd < 0) {
+    return;
+  }
+  std::string window;
+  for (size_t i = 0; i < pipeline; ++i) {
+    window += R"({"jsonrpc":"2.0","method":"subtract","params":[42,23],"id":)" +
+              std::to_string(i) + "}\n";
+  }
+  char buffer[64 * 1024];
+  uint64_t count = 0;
+  while (!stop->load(std::memory_order_relaxed)) {
+    if (send(fd, window.data(), window.size(), MSG_NOSIGNAL) !=
+        static_cast<ssize_t>(window.size())) {
+      break;
+    }
+    size_t lines = 0;
+    while (lines < pipeline) {
+      const auto n = recv(fd, buffer, sizeof(buffer), 0);
+      if (n <= 0) {
+        close(fd);
+        responses->fetch_add(count);
+        return;
+      }
+      lines += static_cast<size_t>(std::count(buffer, buffer + n, '\n'));
+    }
+    count += lines;
+  }
+  close(fd);
+  responses->fetch_add(count);
+}
+
+double MessagesPerSecond(const size_t shards, const double seconds, const size_t pipeline) {
+  ShardedServer server(shards, Setup, true);
+  if (const auto status = server.StartTcp("127.0.0.1", 0); !status.Ok()) {
+    std::fprintf(stderr, "%s\n", status.Message().c_str());
+    std::exit(1);
+  }
+  std::atomic<bool> stop{false};
+  std::atomic<uint64_t> responses{0};
+  std::vector<std::thread> clients;
+  const auto begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < shards * kClientsPerShard; ++i) {
+    clients.emplace_back(Client, server.Port(), pipeline, &stop, &responses);
+  }
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop = true;
+  for (auto& client : clients) {
+    client.join();
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  server.Stop();
+  return static_cast<double>(responses.load()) / elapsed.count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const size_t max_shards = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                                     : std::max(1u, std::thread::hardware_concurrency());
+  const double seconds = argc > 2 ? std::strtod(argv[2], nullptr) : 2.0;
+  const size_t pipeline = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 16;
+
+  std::printf("%8s %14s %10s\n", "shards", "msg/s", "per shard");
+  for (size_t shards = 1; shards <= max_shards; shards *= 2) {
+    const auto rate = MessagesPerSecond(shards, seconds, pipeline);
+    std::printf("%8zu %14.0f %10.0f\n", shards, rate, rate / static_cast<double>(shards));
+    if (shards < max_shards && shards * 2 > max_shards) {
+      shards = max_shards / 2;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,124 @@
+
+// Round-trip latency of small calls through a ShmChannel, against the same calls over a Unix
+// socket served by a ShardedServer. One call in flight at a time.
+//
+// Usage: shm_benchmark [calls]
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "json_rpc/sharded_server.h"
+#include "json_rpc/shm_transport.h"
+
+namespace {
+
+using json_rpc::Dispatcher;
+using json_rpc::Request;
+using json_rpc::Response;
+using Clock = std::chrono::steady_clock;
+
+const std::string kRequest = R"({"jsonrpc":"2.0","method":"subtract","params":[42,23],"id":1})";
+
+void Setup(size_t /*shard*/, Dispatcher* dispatcher) {
+  dispatcher->RegisterMethod("subtract", [](const Request& request) {
+    Response response(request.Id());
+    response.SetResult(request.Params().Get<int>(0) - request.Params().Get<int>(1));
+    return response;
+  });
+}
+
+void Report(const char* name, std::vector<double>* latencies_us) {
+  std::sort(latencies_us->begin(), latencies_us->end());
+  const auto at = [latencies_us](const double p) {
+    return (*latencies_us)[static_cast<size_t>(p * static_cast<double>(latencies_us->size() - 1))];
+  };
+  std::printf("%-12s p50 %7.2f us  p99 %7.2f us  p999 %7.2f us\n", name, at(0.5), at(0.99),
+              at(0.999));
+}
+
+template <typename Call>
+std::vector<double> Measure(const size_t calls, Call call) {
+  std::vector<double> latencies_us;
+  latencies_us.reserve(calls);
+  for (size_t i = 0; i < calls; ++i) {
+    const auto begin = Clock::now();
+    if (!call()) {
+      std::fprintf(stderr, "call failed\n");
+      std::exit(1);
+    }
+    latencies_us.push_back(
+        std::chrono::duration<double, std::micro>(Clock::now() - begin).count());
+  }
+  return latencies_us;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const size_t calls = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+
+  {
+    Dispatcher dispatcher;
+    Setup(0, &dispatcher);
+    json_rpc::ShmChannel channel;
+    if (!channel.Create("").Ok()) {
+      std::fprintf(stderr, "cannot create channel\n");
+      return 1;
+    }
+    json_rpc::ShmServer server(&dispatcher);
+    server.Serve(&channel);
+    json_rpc::ShmClient client(&channel);
+    std::string response;
+    auto latencies = Measure(calls, [&] { return client.Call(kRequest, &response).Ok(); });
+    Report("shm", &latencies);
+    channel.Close();
+  }
+
+  {
+    const std::string path = "/tmp/json_rpc_shm_benchmark.sock";
+    json_rpc::ShardedServer server(1, Setup);
+    if (!server.StartUnix(path).Ok()) {
+      std::fprintf(stderr, "cannot listen on %s\n", path.c_str());
+      return 1;
+    }
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+      std::fprintf(stderr, "cannot connect to %s\n", path.c_str());
+      return 1;
+    }
+    const auto line = kRequest + "\n";
+    char buffer[4096];
+    auto latencies = Measure(calls, [&] {
+      if (send(fd, line.data(), line.size(), 0) != static_cast<ssize_t>(line.size())) {
+        return false;
+      }
+      // The response is one short line, read whole.
+      for (size_t read = 0;;) {
+        const auto n = recv(fd, buffer + read, sizeof(buffer) - read, 0);
+        if (n <= 0) {
+          return false;
+        }
+        read += static_cast<size_t>(n);
+        if (buffer[read - 1] == '\n') {
+          return true;
+        }
+      }
+    });
+    Report("unix socket", &latencies);
+    close(fd);
+    server.Stop();
+  }
+  return 0;
+}
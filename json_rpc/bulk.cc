@@ -0,0 +1,190 @@
+
+#include "bulk.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "error.h"
+#include "executor.h"
+
+namespace json_rpc {
+
+namespace {
+
+// The chunks in flight per thread, which bounds the responses buffered ahead of the output.
+constexpr size_t kChunksPerThread = 4;
+
+struct Chunk {
+  std::string_view input;
+  std::string output;
+  size_t messages = 0;
+  size_t responses = 0;
+  bool done = false;
+};
+
+// Splits the input after the first newline at or past every chunk_bytes.
+std::vector<Chunk> Split(const std::string_view input, const size_t chunk_bytes) {
+  std::vector<Chunk> chunks;
+  size_t begin = 0;
+  while (begin < input.size()) {
+    const auto target = std::min(begin + std::max<size_t>(chunk_bytes, 1), input.size());
+    auto end = input.find('\n', target - 1);
+    end = end == std::string_view::npos ? input.size() : end + 1;
+    chunks.emplace_back().input = input.substr(begin, end - begin);
+    begin = end;
+  }
+  return chunks;
+}
+
+void Handle(Dispatcher* dispatcher, Chunk* chunk) {
+  const auto input = chunk->input;
+  for (size_t begin = 0; begin < input.size();) {
+    auto end = input.find('\n', begin);
+    if (end == std::string_view::npos) {
+      end = input.size();
+    }
+    auto line = input.substr(begin, end - begin);
+    begin = end + 1;
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    if (line.empty()) {
+      continue;
+    }
+    ++chunk->messages;
+    const auto response = dispatcher->HandleMessage(line);
+    if (!response.empty()) {
+      chunk->output.append(response);
+      chunk->output.push_back('\n');
+      ++chunk->responses;
+    }
+  }
+}
+
+Status WriteAll(const int fd, const std::string& data, const std::string& path) {
+  for (size_t written = 0; written < data.size();) {
+    const auto n = write(fd, data.data() + written, data.size() - written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return {kInternalError, "cannot write " + path + ": " + std::strerror(errno)};
+    }
+    written += static_cast<size_t>(n);
+  }
+  return {kSuccess, ""};
+}
+
+// Owns the descriptor and the mapping of the input file.
+class MappedFile {
+ public:
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      munmap(data_, size_);
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  Status Open(const std::string& path) {
+    fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat stat {};
+    if (fd_ < 0 || fstat(fd_, &stat) != 0) {
+      return {kInternalError, "cannot open " + path + ": " + std::strerror(errno)};
+    }
+    size_ = static_cast<size_t>(stat.st_size);
+    if (size_ == 0) {
+      return {kSuccess, ""};
+    }
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (data == MAP_FAILED) {
+      return {kInternalError, "cannot map " + path + ": " + std::strerror(errno)};
+    }
+    data_ = data;
+    // The file is read once front to back.
+    madvise(data_, size_, MADV_SEQUENTIAL);
+    return {kSuccess, ""};
+  }
+
+  [[nodiscard]] std::string_view View() const {
+    return {static_cast<const char*>(data_), data_ != nullptr ? size_ : 0};
+  }
+
+ private:
+  int fd_ = -1;
+  void* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+}  // namespace
+
+Status ProcessNdjsonFile(const std::string& input_path, const std::string& output_path,
+                         Dispatcher* dispatcher, const BulkOptions& options, BulkReport* report) {
+  MappedFile input;
+  if (auto status = input.Open(input_path); !status.Ok()) {
+    return status;
+  }
+  const int output = open(output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (output < 0) {
+    return {kInternalError, "cannot create " + output_path + ": " + std::strerror(errno)};
+  }
+
+  auto chunks = Split(input.View(), options.chunk_bytes);
+  std::mutex mutex;
+  std::condition_variable finished;
+  Status status{kSuccess, ""};
+  BulkReport counts;
+  {
+    Executor executor(options.threads);
+    const auto window = executor.Threads() * kChunksPerThread;
+    size_t submitted = 0;
+    for (size_t next = 0; next < chunks.size(); ++next) {
+      // Keeps the window ahead of the output filled.
+      for (; submitted < chunks.size() && submitted < next + window; ++submitted) {
+        auto* chunk = &chunks[submitted];
+        auto task = [dispatcher, chunk, &mutex, &finished] {
+          Handle(dispatcher, chunk);
+          std::lock_guard<std::mutex> lock(mutex);
+          chunk->done = true;
+          finished.notify_all();
+        };
+        if (!executor.Submit(task).Ok()) {
+          task();
+        }
+      }
+      auto& chunk = chunks[next];
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&chunk] { return chunk.done; });
+      }
+      counts.messages += chunk.messages;
+      counts.responses += chunk.responses;
+      status = WriteAll(output, chunk.output, output_path);
+      if (!status.Ok()) {
+        // The executor still finishes the chunks in flight before they go away.
+        break;
+      }
+      std::string().swap(chunk.output);
+    }
+  }
+  if (close(output) != 0 && status.Ok()) {
+    status = {kInternalError, "cannot write " + output_path + ": " + std::strerror(errno)};
+  }
+  if (report != nullptr) {
+    *report = counts;
+  }
+  return status;
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "dispatcher.h"
+#include "status.h"
+
+namespace json_rpc {
+
+/// Options of ProcessNdjsonFile().
+struct BulkOptions {
+  /// The number of threads dispatching the chunks, or zero for one per hardware thread.
+  size_t threads = 0;
+  /// The approximate size of a chunk of the input; chunks end on line boundaries.
+  size_t chunk_bytes = 4 * 1024 * 1024;
+};
+
+/// Counts of ProcessNdjsonFile().
+struct BulkReport {
+  /// The number of non-empty lines of the input.
+  size_t messages = 0;
+  /// The number of lines written to the output.
+  size_t responses = 0;
+};
+
+/// @brief Handles a file of newline-delimited JSON-RPC messages in parallel, for offline backfills.
+///
+/// The input is memory-mapped and split into chunks on line boundaries. The chunks are handled
+/// in parallel on an Executor, each line by Dispatcher::HandleMessage(), and their responses are
+/// written to the output in the order of the input: the response of a line comes before those of
+/// the lines after it. Lines without a response, such as notifications, write nothing. Only a few
+/// chunks per thread are in flight at once, so memory stays bounded whatever the size of the file.
+///
+/// @param input_path The path of the input file.
+/// @param output_path The path of the output file, replaced if it exists.
+/// @param dispatcher The dispatcher handling the messages.
+/// @param options The parallelism and chunk size.
+/// @param report Receives the counts of messages and responses; may be nullptr.
+/// @return A Status object indicating failure if a file cannot be read or written.
+Status ProcessNdjsonFile(const std::string& input_path, const std::string& output_path,
+                         Dispatcher* dispatcher, const BulkOptions& options = BulkOptions(),
+                         BulkReport* report = nullptr);
+
+}  // namespace json_rpc
@@ -0,0 +1,90 @@
+
+#include "cancellation.h"
+
+#include <algorithm>
+
+namespace json_rpc {
+
+CancellationToken CancellationToken::Create() {
+  CancellationToken token;
+  token.state_ = std::make_shared<State>();
+  return token;
+}
+
+void CancellationToken::Cancel() const {
+  if (state_ == nullptr || state_->cancelled.exchange(true, std::memory_order_acq_rel)) {
+    return;
+  }
+  std::vector<std::pair<CallbackId, std::function<void()>>> callbacks;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    callbacks.swap(state_->callbacks);
+  }
+  for (auto& [id, callback] : callbacks) {
+    callback();
+  }
+}
+
+CancellationToken::CallbackId CancellationToken::OnCancel(std::function<void()> callback) const {
+  if (state_ == nullptr) {
+    return 0;
+  }
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    // Checked under the lock: Cancel() sets the flag before taking the callbacks, so a callback
+    // added here after that would never run.
+    if (!state_->cancelled.load(std::memory_order_acquire)) {
+      const auto id = state_->next_id++;
+      state_->callbacks.emplace_back(id, std::move(callback));
+      return id;
+    }
+  }
+  callback();
+  return 0;
+}
+
+void CancellationToken::RemoveCallback(const CallbackId id) const {
+  if (state_ == nullptr) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  auto& callbacks = state_->callbacks;
+  callbacks.erase(std::remove_if(callbacks.begin(), callbacks.end(),
+                                 [id](const auto& entry) { return entry.first == id; }),
+                  callbacks.end());
+}
+
+CancellationToken CancellationRegistry::Register(const Identifier& id) {
+  auto token = CancellationToken::Create();
+  std::lock_guard<std::mutex> lock(mutex_);
+  tokens_[id] = token;
+  return token;
+}
+
+void CancellationRegistry::Unregister(const Identifier& id, const CancellationToken& token) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (const auto it = tokens_.find(id); it != tokens_.end() && it->second == token) {
+    tokens_.erase(it);
+  }
+}
+
+bool CancellationRegistry::Cancel(const Identifier& id) {
+  CancellationToken token;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = tokens_.find(id);
+    if (it == tokens_.end()) {
+      return false;
+    }
+    token = it->second;
+  }
+  token.Cancel();
+  return true;
+}
+
+size_t CancellationRegistry::Size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return tokens_.size();
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "identifier.h"
+
+namespace json_rpc {
+
+/// Cooperative cancellation flag of one in-flight request. Copies share the same flag.
+///
+/// Handlers either poll IsCancelled() between units of work or register a callback that aborts
+/// blocking work. A default constructed token can never be cancelled and costs no allocation.
+class CancellationToken {
+ public:
+  using CallbackId = uint64_t;
+
+  /// @brief Default constructor, a token that is never cancelled.
+  CancellationToken() = default;
+
+  /// @brief Creates a token that can be cancelled.
+  /// @return A new token, not cancelled yet.
+  static CancellationToken Create();
+
+  /// @brief Checks if the request was cancelled.
+  /// @return true if Cancel() was called on any copy of the token, otherwise false.
+  [[nodiscard]] bool IsCancelled() const {
+    return state_ != nullptr && state_->cancelled.load(std::memory_order_acquire);
+  }
+
+  /// @brief Checks if the token can be cancelled at all.
+  /// @return false for a default constructed token, otherwise true.
+  [[nodiscard]] bool Cancellable() const {
+    return state_ != nullptr;
+  }
+
+  /// @brief Cancels the request and runs the registered callbacks, once.
+  void Cancel() const;
+
+  /// @brief Registers a callback run on cancellation, immediately if already cancelled.
+  /// @param callback The callback, run on the thread calling Cancel().
+  /// @return An identifier for RemoveCallback(), or 0 if the token can never be cancelled.
+  CallbackId OnCancel(std::function<void()> callback) const;
+
+  /// @brief Removes a callback that has not run yet.
+  /// @param id The identifier returned by OnCancel().
+  void RemoveCallback(CallbackId id) const;
+
+  /// @brief Checks if two tokens share the same flag.
+  bool operator==(const CancellationToken& other) const {
+    return state_ == other.state_;
+  }
+
+ private:
+  struct State {
+    std::atomic<bool> cancelled{false};
+    std::mutex mutex;
+    CallbackId next_id = 1;
+    std::vector<std::pair<CallbackId, std::function<void()>>> callbacks;
+  };
+
+  std::shared_ptr<State> state_;
+};
+
+/// The tokens of the requests in flight, keyed by their Identifier, so that a cancel notification
+/// naming a request id can reach the handler working on it. Thread-safe.
+class CancellationRegistry {
+ public:
+  /// @brief Creates and registers the token of a request that starts running.
+  /// @param id The identifier of the request.
+  /// @return The token to attach to the request.
+  CancellationToken Register(const Identifier& id);
+
+  /// @brief Removes the token of a request that finished, unless the id was reused meanwhile.
+  /// @param id The identifier of the request.
+  /// @param token The token returned by Register().
+  void Unregister(const Identifier& id, const CancellationToken& token);
+
+  /// @brief Cancels the request in flight with the given id.
+  /// @param id The identifier of the request.
+  /// @return true if a request was in flight, otherwise false.
+  bool Cancel(const Identifier& id);
+
+  /// @brief Gets the number of requests in flight.
+  /// @return The number of registered tokens.
+  [[nodiscard]] size_t Size() const;
+
+ private:
+  mutable std::mutex mutex_;
+  std::unordered_map<Identifier, CancellationToken> tokens_;
+};
+
+}  // namespace json_rpc
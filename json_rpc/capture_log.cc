@@ -0,0 +1,170 @@
+
+#include "capture_log.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include "error.h"
+
+namespace json_rpc {
+
+namespace {
+
+constexpr char kMagic[8] = {'J', 'R', 'P', 'C', 'C', 'A', 'P', '1'};
+
+// Records start on 8-byte boundaries.
+size_t Align(const size_t size) {
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+
+}  // namespace
+
+CaptureLog::~CaptureLog() {
+  static_cast<void>(Close());
+}
+
+Status CaptureLog::Map(const std::string& path, const size_t size, const bool writable) {
+  void* data = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd_,
+                    0);
+  if (data == MAP_FAILED) {
+    close(fd_);
+    fd_ = -1;
+    return {kInternalError, "cannot map " + path + ": " + std::strerror(errno)};
+  }
+  data_ = static_cast<char*>(data);
+  capacity_ = size;
+  writable_ = writable;
+  write_offset_.store(kHeaderSize, std::memory_order_relaxed);
+  dropped_.store(0, std::memory_order_relaxed);
+  read_offset_ = kHeaderSize;
+  return {kSuccess, ""};
+}
+
+Status CaptureLog::Create(const std::string& path, const size_t capacity) {
+  if (data_ != nullptr) {
+    return {kInternalError, "capture log already open"};
+  }
+  if (capacity < kHeaderSize) {
+    return {kInvalidParams, "capture log capacity too small"};
+  }
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    return {kInternalError, "cannot create " + path + ": " + std::strerror(errno)};
+  }
+  // The file is sparse: pages are only allocated as records reach them.
+  if (ftruncate(fd_, static_cast<off_t>(capacity)) != 0) {
+    close(fd_);
+    fd_ = -1;
+    return {kInternalError, "cannot size " + path + ": " + std::strerror(errno)};
+  }
+  if (auto status = Map(path, capacity, true); !status.Ok()) {
+    return status;
+  }
+  std::memcpy(data_, kMagic, sizeof(kMagic));
+  return {kSuccess, ""};
+}
+
+Status CaptureLog::Open(const std::string& path) {
+  if (data_ != nullptr) {
+    return {kInternalError, "capture log already open"};
+  }
+  fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) {
+    return {kInternalError, "cannot open " + path + ": " + std::strerror(errno)};
+  }
+  struct stat stat {};
+  if (fstat(fd_, &stat) != 0 || static_cast<size_t>(stat.st_size) < kHeaderSize) {
+    close(fd_);
+    fd_ = -1;
+    return {kInvalidParams, path + " is not a capture log"};
+  }
+  if (auto status = Map(path, static_cast<size_t>(stat.st_size), false); !status.Ok()) {
+    return status;
+  }
+  if (std::memcmp(data_, kMagic, sizeof(kMagic)) != 0) {
+    Close();
+    return {kInvalidParams, path + " is not a capture log"};
+  }
+  return {kSuccess, ""};
+}
+
+bool CaptureLog::Append(const Kind kind, const uint64_t connection, const std::string_view data,
+                        uint64_t timestamp_ns) {
+  if (!writable_ || data.size() > UINT32_MAX) {
+    return false;
+  }
+  if (timestamp_ns == 0) {
+    timestamp_ns = Now();
+  }
+  const auto size = Align(kRecordHeaderSize + data.size());
+  const auto offset = write_offset_.fetch_add(size, std::memory_order_relaxed);
+  if (offset > capacity_ || capacity_ - offset < size) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  // Record header: size, kind, three bytes of padding, connection, timestamp.
+  char* record = data_ + offset;
+  const auto length = static_cast<uint32_t>(data.size());
+  std::memcpy(record, &length, sizeof(length));
+  record[4] = static_cast<char>(kind);
+  std::memcpy(record + 8, &connection, sizeof(connection));
+  std::memcpy(record + 16, &timestamp_ns, sizeof(timestamp_ns));
+  std::memcpy(record + kRecordHeaderSize, data.data(), data.size());
+  return true;
+}
+
+bool CaptureLog::Next(Record* record) {
+  if (data_ == nullptr || writable_ || capacity_ - read_offset_ < kRecordHeaderSize) {
+    return false;
+  }
+  const char* header = data_ + read_offset_;
+  uint32_t length = 0;
+  std::memcpy(&length, header, sizeof(length));
+  const auto kind = static_cast<uint8_t>(header[4]);
+  // A zero kind marks space reserved by a writer that never filled it, or the end of the records.
+  if (kind == 0 || capacity_ - read_offset_ - kRecordHeaderSize < length) {
+    return false;
+  }
+  record->kind = static_cast<Kind>(kind);
+  std::memcpy(&record->connection, header + 8, sizeof(record->connection));
+  std::memcpy(&record->timestamp_ns, header + 16, sizeof(record->timestamp_ns));
+  record->data = std::string_view(header + kRecordHeaderSize, length);
+  read_offset_ += std::min(Align(kRecordHeaderSize + length), capacity_ - read_offset_);
+  return true;
+}
+
+Status CaptureLog::Close() {
+  if (data_ == nullptr) {
+    return {kSuccess, ""};
+  }
+  Status status(kSuccess, "");
+  munmap(data_, capacity_);
+  if (writable_) {
+    const auto size = std::min(write_offset_.load(std::memory_order_relaxed), capacity_);
+    if (ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+      status = {kInternalError,
+                std::string("cannot truncate capture log: ") + std::strerror(errno)};
+    }
+  }
+  close(fd_);
+  data_ = nullptr;
+  capacity_ = 0;
+  fd_ = -1;
+  writable_ = false;
+  return status;
+}
+
+uint64_t CaptureLog::Now() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count());
+}
+
+}  // namespace json_rpc
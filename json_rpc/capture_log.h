@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "status.h"
+
+namespace json_rpc {
+
+/// Append-only log of the messages of a server, written to a memory-mapped file so that it can be
+/// replayed later, see Replay().
+///
+/// The file starts with a header followed by records, each made of a fixed-size record header and
+/// the raw bytes of one message. Writers reserve the space of a record with a single atomic add and
+/// copy it into the mapping, so capturing takes no lock and no system call. The file has a fixed
+/// capacity; records that do not fit anymore are dropped and counted.
+///
+/// Timestamps are nanoseconds of std::chrono::steady_clock, only meaningful relative to each other.
+class CaptureLog {
+ public:
+  /// The kind of a captured message.
+  enum class Kind : uint8_t {
+    kRequest = 1,
+    kResponse = 2,
+  };
+
+  /// A record read back from a log.
+  struct Record {
+    Kind kind = Kind::kRequest;
+    /// The connection the message was received or sent on.
+    uint64_t connection = 0;
+    /// The time the message was received or sent, in nanoseconds.
+    uint64_t timestamp_ns = 0;
+    /// The bytes of the message, pointing into the mapping of the log.
+    std::string_view data;
+  };
+
+  static constexpr size_t kDefaultCapacity = 256 * 1024 * 1024;
+
+  CaptureLog() = default;
+
+  CaptureLog(const CaptureLog&) = delete;
+  CaptureLog& operator=(const CaptureLog&) = delete;
+
+  /// @brief Destructor, closes the log.
+  ~CaptureLog();
+
+  /// @brief Creates a log file to append to, replacing an existing file.
+  /// @param path The path of the file.
+  /// @param capacity The maximum size of the file in bytes.
+  /// @return A Status object indicating failure if the file cannot be created or mapped.
+  Status Create(const std::string& path, size_t capacity = kDefaultCapacity);
+
+  /// @brief Opens an existing log file to read with Next().
+  /// @param path The path of the file.
+  /// @return A Status object indicating failure if the file cannot be mapped or is not a log.
+  Status Open(const std::string& path);
+
+  /// @brief Appends a message. Thread-safe, and does nothing if the log is not created.
+  /// @param kind Whether the message is a request or a response.
+  /// @param connection The connection of the message.
+  /// @param data The bytes of the message.
+  /// @param timestamp_ns The time of the message, or zero for now.
+  /// @return Whether the message was recorded, false if the log is full.
+  bool Append(Kind kind, uint64_t connection, std::string_view data, uint64_t timestamp_ns = 0);
+
+  /// @brief Reads the next record of an opened log. Not thread-safe.
+  /// @param record Receives the record, valid until the log is closed.
+  /// @return Whether a record was read, false at the end of the log.
+  bool Next(Record* record);
+
+  /// @brief Rewinds an opened log to its first record.
+  void Rewind() {
+    read_offset_ = kHeaderSize;
+  }
+
+  /// @brief Unmaps the log. A created file is truncated to the records it holds. Appending must
+  /// have stopped.
+  /// @return A Status object indicating failure if a created file could not be truncated, in which
+  /// case it still ends with unused space; the log is closed either way.
+  Status Close();
+
+  /// @brief Gets the number of messages dropped because the log was full.
+  /// @return The number of dropped messages.
+  [[nodiscard]] uint64_t Dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  /// @brief Gets the current time in the unit of the timestamps.
+  /// @return The time in nanoseconds.
+  static uint64_t Now();
+
+ private:
+  static constexpr size_t kHeaderSize = 16;
+  static constexpr size_t kRecordHeaderSize = 24;
+
+  Status Map(const std::string& path, size_t size, bool writable);
+
+  char* data_ = nullptr;
+  size_t capacity_ = 0;
+  int fd_ = -1;
+  bool writable_ = false;
+  std::atomic<size_t> write_offset_{kHeaderSize};
+  std::atomic<uint64_t> dropped_{0};
+  size_t read_offset_ = kHeaderSize;
+};
+
+}  // namespace json_rpc
@@ -0,0 +1,187 @@
+
+#include "coalescing_client.h"
+
+#include <algorithm>
+#include <future>
+#include <unordered_map>
+#include <utility>
+
+#include "error.h"
+#include "json.h"
+
+namespace json_rpc {
+
+CoalescingClient::CoalescingClient(Transport transport, CoalescingOptions options)
+    : transport_(std::move(transport)), options_(std::move(options)) {
+  thread_ = std::thread([this] { Run(); });
+}
+
+CoalescingClient::~CoalescingClient() {
+  Stop();
+}
+
+Status CoalescingClient::Submit(const Request& request, ResponseCallback done) {
+  Pending call;
+  call.id = request.Id();
+  auto json = request.ToJson();
+  if (!request.IsNotification()) {
+    call.wire_id = next_id_.fetch_add(1, std::memory_order_relaxed);
+    call.done = std::move(done);
+    json[kIdName] = call.wire_id;
+  }
+  AppendJson(json, &call.text);
+  call.queued = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) {
+      return {kInternalError, "client stopped"};
+    }
+    queue_.push_back(std::move(call));
+    // The thread waits for a first call, then for the window to pass or the batch to fill.
+    if (queue_.size() != 1 && queue_.size() != options_.max_calls) {
+      return {kSuccess, ""};
+    }
+  }
+  cv_.notify_one();
+  return {kSuccess, ""};
+}
+
+Response CoalescingClient::Call(const Request& request) {
+  if (request.IsNotification()) {
+    Response response;
+    response.SetError({kInvalidRequest, "a notification has no response"});
+    return response;
+  }
+  std::promise<Response> promise;
+  const auto status =
+      Submit(request, [&promise](Response response) { promise.set_value(std::move(response)); });
+  if (!status.Ok()) {
+    Response response(request.Id());
+    response.SetError({status.Code(), status.Message()});
+    return response;
+  }
+  return promise.get_future().get();
+}
+
+void CoalescingClient::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  cv_.notify_one();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+uint64_t CoalescingClient::MessagesSent() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return messages_sent_;
+}
+
+void CoalescingClient::Run() {
+  const auto max_calls = std::max<size_t>(1, options_.max_calls);
+  std::vector<Pending> calls;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return stopped_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      return;
+    }
+    // Once stopped, the queued calls leave without waiting.
+    cv_.wait_until(lock, queue_.front().queued + options_.window,
+                   [this, max_calls] { return stopped_ || queue_.size() >= max_calls; });
+    const auto count = std::min(queue_.size(), max_calls);
+    calls.clear();
+    std::move(queue_.begin(), queue_.begin() + static_cast<ptrdiff_t>(count),
+              std::back_inserter(calls));
+    queue_.erase(queue_.begin(), queue_.begin() + static_cast<ptrdiff_t>(count));
+    ++messages_sent_;
+    lock.unlock();
+    Send(&calls);
+    lock.lock();
+  }
+}
+
+void CoalescingClient::Send(std::vector<Pending>* calls) {
+  std::string message;
+  if (calls->size() == 1) {
+    message = std::move(calls->front().text);
+  } else {
+    message.push_back('[');
+    for (const auto& call : *calls) {
+      if (message.size() > 1) {
+        message.push_back(',');
+      }
+      message.append(call.text);
+    }
+    message.push_back(']');
+  }
+
+  std::string reply;
+  auto status = transport_(message, &reply);
+  std::unordered_map<int64_t, Pending*> waiting;
+  for (auto& call : *calls) {
+    if (call.wire_id >= 0) {
+      waiting.emplace(call.wire_id, &call);
+    }
+  }
+  if (waiting.empty()) {
+    return;
+  }
+
+  // The error answering the whole message, if the server could not read it as a batch.
+  Error failure(kInternalError, "no response");
+  const auto deliver = [&](Json&& json) {
+    Response response;
+    if (!response.ParseJson(std::move(json)).Ok()) {
+      return;
+    }
+    if (response.Id().Type() == Identifier::IdType::kNull) {
+      if (response.Err().Code() != kSuccess) {
+        failure = response.Err();
+      }
+      return;
+    }
+    if (response.Id().Type() != Identifier::IdType::kNumber) {
+      return;
+    }
+    const auto it = waiting.find(response.Id().IntId());
+    if (it == waiting.end()) {
+      return;
+    }
+    auto& call = *it->second;
+    waiting.erase(it);
+    response.SetId(std::move(call.id));
+    if (call.done) {
+      call.done(std::move(response));
+    }
+  };
+  Json json;
+  if (status.Ok() && !reply.empty()) {
+    status = ParseJsonText(reply, options_.limits, &json);
+  }
+  if (!status.Ok()) {
+    failure = Error(kInternalError, status.Message());
+  } else if (json.is_array()) {
+    for (auto& element : json) {
+      deliver(std::move(element));
+    }
+  } else if (!json.is_null()) {
+    deliver(std::move(json));
+  }
+
+  // The calls left unanswered, in the order they were made.
+  for (auto& call : *calls) {
+    if (waiting.count(call.wire_id) == 0) {
+      continue;
+    }
+    Response response(std::move(call.id));
+    response.SetError(failure);
+    if (call.done) {
+      call.done(std::move(response));
+    }
+  }
+}
+
+}  // namespace json_rpc
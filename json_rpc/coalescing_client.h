@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "parse_limits.h"
+#include "request.h"
+#include "response.h"
+#include "status.h"
+
+namespace json_rpc {
+
+/// Sends the JSON text of a message and waits for the JSON text of its response, which is empty if
+/// nothing came back, e.g. for a batch of notifications. A blocking call over any connection, such
+/// as ShmClient::Call().
+using Transport = std::function<Status(std::string_view message, std::string* response)>;
+
+struct CoalescingOptions {
+  /// How long the first call of a batch waits for others to join it.
+  std::chrono::microseconds window{200};
+  /// The number of calls sending a batch without waiting for the rest of the window.
+  size_t max_calls = 64;
+  /// The limits enforced while parsing the responses.
+  ParseLimits limits;
+};
+
+/// Gathers calls made within a short window, from any number of threads, into one batch request,
+/// so a burst of small calls costs one round trip instead of one each.
+///
+/// Each call gets an id of the client on the wire, unique among the calls in flight, so the
+/// responses of the batch, which may come back in any order, are matched to their callers by id
+/// whatever ids the callers chose. A caller receives its response with its own id. A single call is
+/// sent as is rather than as a batch of one.
+///
+/// Batches are sent one at a time by a thread of the client, on which the callbacks run; calls made
+/// meanwhile gather into the next batch, as with Nagle's algorithm.
+class CoalescingClient {
+ public:
+  /// Receives the response to a call. Called on the thread of the client.
+  using ResponseCallback = std::function<void(Response response)>;
+
+  /// @brief Constructor, starts the thread sending the batches.
+  /// @param transport The transport the batches are sent over.
+  /// @param options The batching window and limits.
+  explicit CoalescingClient(Transport transport, CoalescingOptions options = CoalescingOptions());
+
+  CoalescingClient(const CoalescingClient&) = delete;
+  CoalescingClient& operator=(const CoalescingClient&) = delete;
+
+  /// @brief Destructor, sends the queued calls and stops the thread.
+  ~CoalescingClient();
+
+  /// @brief Queues a call or notification for the next batch.
+  /// @param request The request; a notification is sent without waiting for a response.
+  /// @param done The callback receiving the response to a call, unused for a notification. An error
+  /// response with kInternalError is delivered if the transport failed or the server did not answer
+  /// the call.
+  /// @return A Status object indicating failure if the client is stopped, in which case done is not
+  /// called.
+  Status Submit(const Request& request, ResponseCallback done);
+
+  /// @brief Makes a call and waits for its response. Must not be called from a callback.
+  /// @param request The request, which must not be a notification.
+  /// @return The response, an error response if the call failed.
+  Response Call(const Request& request);
+
+  /// @brief Sends the queued calls and stops the thread. Later calls are refused. Must not be
+  /// called from a callback.
+  void Stop();
+
+  /// @brief Gets the number of messages sent, to see how well calls are coalesced.
+  /// @return The number of messages handed to the transport.
+  [[nodiscard]] uint64_t MessagesSent() const;
+
+ private:
+  struct Pending {
+    std::string text;
+    Identifier id;
+    // The id on the wire, or -1 for a notification.
+    int64_t wire_id = -1;
+    ResponseCallback done;
+    std::chrono::steady_clock::time_point queued;
+  };
+
+  void Run();
+
+  void Send(std::vector<Pending>* calls);
+
+  Transport transport_;
+  const CoalescingOptions options_;
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Pending> queue_;
+  std::atomic<int64_t> next_id_{0};
+  uint64_t messages_sent_ = 0;
+  bool stopped_ = false;
+  std::thread thread_;
+};
+
+}  // namespace json_rpc
@@ -0,0 +1,137 @@
+
+#include "compression.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <limits>
+
+#include "error.h"
+
+namespace json_rpc {
+
+namespace {
+
+// Raw deflate, as negative window bits tell zlib.
+constexpr int kRawDeflateWindowBits = -15;
+constexpr size_t kInflateStep = 64 * 1024;
+
+}  // namespace
+
+void AppendFrameHeader(const Codec codec, const size_t payload_size, std::string* output) {
+  const auto size = static_cast<uint32_t>(payload_size);
+  const char header[kFrameHeaderSize] = {
+      kFrameMarker,
+      static_cast<char>(codec),
+      static_cast<char>(size >> 24),
+      static_cast<char>(size >> 16),
+      static_cast<char>(size >> 8),
+      static_cast<char>(size),
+  };
+  output->append(header, kFrameHeaderSize);
+}
+
+bool ParseFrameHeader(const std::string_view data, Codec* codec, size_t* payload_size) {
+  if (data.size() < kFrameHeaderSize) {
+    return false;
+  }
+  *codec = static_cast<Codec>(data[1]);
+  uint32_t size = 0;
+  for (size_t i = 2; i < kFrameHeaderSize; ++i) {
+    size = (size << 8) | static_cast<uint8_t>(data[i]);
+  }
+  *payload_size = size;
+  return true;
+}
+
+Status AppendCompressedFrame(const Codec codec, const std::string_view message, const int level,
+                             std::string* output) {
+  if (codec != Codec::kDeflate) {
+    return {kInternalError, "unsupported codec"};
+  }
+  z_stream stream{};
+  if (deflateInit2(&stream, level, Z_DEFLATED, kRawDeflateWindowBits, 8, Z_DEFAULT_STRATEGY) !=
+      Z_OK) {
+    return {kInternalError, "deflate failed"};
+  }
+  const auto header = output->size();
+  const auto bound = deflateBound(&stream, static_cast<uLong>(message.size()));
+  // The payload is compressed straight after its header, which is patched with its size.
+  output->resize(header + kFrameHeaderSize + bound);
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(message.data()));
+  stream.avail_in = static_cast<uInt>(message.size());
+  stream.next_out = reinterpret_cast<Bytef*>(output->data() + header + kFrameHeaderSize);
+  stream.avail_out = static_cast<uInt>(bound);
+  const auto result = deflate(&stream, Z_FINISH);
+  const auto size = static_cast<size_t>(stream.total_out);
+  deflateEnd(&stream);
+  if (result != Z_STREAM_END) {
+    output->resize(header);
+    return {kInternalError, "deflate failed"};
+  }
+  std::string frame_header;
+  AppendFrameHeader(codec, size, &frame_header);
+  output->replace(header, kFrameHeaderSize, frame_header);
+  output->resize(header + kFrameHeaderSize + size);
+  return {kSuccess, ""};
+}
+
+void AppendMessage(const Codec codec, const std::string_view message,
+                   const CompressionOptions& options, std::string* output) {
+  if (codec != Codec::kNone && message.size() >= options.threshold &&
+      message.size() <= std::numeric_limits<uInt>::max() &&
+      AppendCompressedFrame(codec, message, options.level, output).Ok()) {
+    return;
+  }
+  output->append(message);
+  output->push_back('\n');
+}
+
+Status Decompress(const Codec codec, const std::string_view payload, const size_t max_size,
+                  std::string* message) {
+  if (codec != Codec::kDeflate) {
+    return {kInvalidRequest, "Invalid Request: unsupported codec"};
+  }
+  z_stream stream{};
+  if (inflateInit2(&stream, kRawDeflateWindowBits) != Z_OK) {
+    return {kInternalError, "inflate failed"};
+  }
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(payload.data()));
+  stream.avail_in = static_cast<uInt>(payload.size());
+  message->clear();
+  int result = Z_OK;
+  while (result == Z_OK) {
+    const auto size = message->size();
+    if (size >= max_size + 1) {
+      break;
+    }
+    // Grows by steps, never past one byte more than allowed, which tells a message exceeding the
+    // limit apart from one reaching it.
+    const auto step = std::min(std::max(kInflateStep, size), max_size + 1 - size);
+    message->resize(size + step);
+    stream.next_out = reinterpret_cast<Bytef*>(message->data() + size);
+    stream.avail_out = static_cast<uInt>(step);
+    result = inflate(&stream, Z_NO_FLUSH);
+    message->resize(size + step - stream.avail_out);
+    if (result == Z_BUF_ERROR && stream.avail_in == 0) {
+      // The payload ended before the end of the stream.
+      result = Z_DATA_ERROR;
+    }
+  }
+  inflateEnd(&stream);
+  if (message->size() > max_size) {
+    message->clear();
+    return {kInvalidRequest, "Invalid Request: message too large"};
+  }
+  if (result != Z_STREAM_END) {
+    message->clear();
+    return {kParseError, "Parse error"};
+  }
+  return {kSuccess, ""};
+}
+
+bool CodecSupported(const Codec codec) {
+  return codec == Codec::kDeflate;
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "status.h"
+
+namespace json_rpc {
+
+/// Per-message compression of newline-delimited stream transports, see
+/// ShardedServer::SetCompression().
+///
+/// A compressed message is sent as a binary frame instead of a line. A frame starts with a NUL
+/// byte, which cannot start a line of JSON, followed by the codec and the size of the payload:
+///
+///     0x00 | codec (1 byte) | payload size (4 bytes, big-endian) | payload
+///
+/// A frame with codec kNone is a hello negotiating the codec of a connection: the client lists the
+/// codecs it accepts, one byte each, and the server answers with a hello holding the codec it
+/// picked, or nothing if it compresses nothing. From then on either side may send messages of at
+/// least the threshold size as frames of that codec, and the other messages as lines.
+enum class Codec : uint8_t {
+  kNone = 0,
+  /// Raw deflate (RFC 1951) through zlib, without the zlib header and checksum.
+  kDeflate = 1,
+};
+
+/// Options of the compression of a transport.
+struct CompressionOptions {
+  /// Whether the codec is negotiated with the clients asking for it.
+  bool enabled = false;
+  /// The size from which messages are compressed; smaller ones do not pay off.
+  size_t threshold = 1024;
+  /// The compression level, 1 (fastest) to 9 (smallest).
+  int level = 6;
+};
+
+constexpr char kFrameMarker = '\0';
+constexpr size_t kFrameHeaderSize = 6;
+
+/// @brief Appends the header of a frame.
+/// @param codec The codec of the payload, or kNone for a hello.
+/// @param payload_size The size of the payload.
+/// @param output The buffer to append to.
+void AppendFrameHeader(Codec codec, size_t payload_size, std::string* output);
+
+/// @brief Reads the header of a frame.
+/// @param data The bytes of the frame, starting with kFrameMarker.
+/// @param codec Receives the codec of the payload.
+/// @param payload_size Receives the size of the payload.
+/// @return Whether the header is complete.
+bool ParseFrameHeader(std::string_view data, Codec* codec, size_t* payload_size);
+
+/// @brief Compresses a message into a frame, without copying it through an intermediate buffer.
+/// @param codec The codec.
+/// @param message The message.
+/// @param level The compression level.
+/// @param output The buffer the frame is appended to.
+/// @return A Status object indicating failure if the codec is not supported.
+Status AppendCompressedFrame(Codec codec, std::string_view message, int level,
+                             std::string* output);
+
+/// @brief Appends a message to the output of a connection: as a frame if the connection has a
+/// codec and the message is at least the threshold size, as a line otherwise.
+/// @param codec The codec of the connection.
+/// @param message The message.
+/// @param options The compression options.
+/// @param output The buffer the message is appended to.
+void AppendMessage(Codec codec, std::string_view message, const CompressionOptions& options,
+                   std::string* output);
+
+/// @brief Decompresses the payload of a frame, streaming it into a buffer whose capacity is reused
+/// from message to message.
+/// @param codec The codec of the payload.
+/// @param payload The payload.
+/// @param max_size The maximum size of the message, which bounds the memory of a hostile payload.
+/// @param message Receives the message.
+/// @return A Status object with kParseError if the payload is corrupt, or kInvalidRequest if the
+/// codec is not supported or the message is larger than max_size.
+Status Decompress(Codec codec, std::string_view payload, size_t max_size, std::string* message);
+
+/// @brief Gets whether a codec is supported.
+/// @param codec The codec.
+/// @return Whether the codec is supported.
+bool CodecSupported(Codec codec);
+
+}  // namespace json_rpc
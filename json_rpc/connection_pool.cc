@@ -0,0 +1,761 @@
+
+#include "connection_pool.h"
+
+#include <algorithm>
+#include <future>
+#include <map>
+#include <random>
+#include <utility>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#endif
+
+#include "dispatcher.h"
+#include "error.h"
+#include "parse_limits.h"
+
+namespace json_rpc {
+
+namespace {
+
+// The number of recent latencies the hedging delay is taken from.
+constexpr size_t kLatencyWindow = 256;
+// The number of latencies between two updates of the hedging delay, and before the first one.
+constexpr size_t kHedgeUpdate = 16;
+
+int64_t RandomFirstId() {
+  std::random_device random;
+  const auto bits = (static_cast<uint64_t>(random()) << 32) | random();
+  // Leaves room for the ids to count up without overflowing.
+  return static_cast<int64_t>(bits >> 2);
+}
+
+}  // namespace
+
+struct ConnectionPool::Connection {
+  // Writes as much of the output as the socket takes without blocking, first finishing a connect
+  // in progress. Called with the mutex held.
+  // @return False if the connection failed, with errno set.
+  bool WriteOutput();
+
+  struct Waiter {
+    Identifier id;
+    ResponseCallback done;
+    Clock::time_point sent;
+  };
+
+  size_t endpoint = 0;
+  std::mutex mutex;
+  int fd = -1;
+  // The calls in flight by id of the pool, in the order they were sent.
+  std::map<int64_t, Waiter> waiters;
+  std::atomic<size_t> outstanding{0};
+  // Bytes of an incomplete response, touched by the thread of the pool only.
+  std::string input;
+  // Requests and cancellations not written yet, flushed by the thread of the pool or by the next
+  // call.
+  std::string output;
+  // Whether the socket is still connecting, and since when.
+  bool connecting = false;
+  Clock::time_point connect_started;
+};
+
+struct ConnectionPool::HedgedCall {
+  std::mutex mutex;
+  Identifier id;
+  // The callback of the caller, null once an attempt won.
+  ResponseCallback done;
+  // The request, whose id each attempt replaces.
+  Json request;
+  Clock::time_point hedge_at;
+  // The connection and id of each attempt, unset until it is sent.
+  Connection* connections[2] = {nullptr, nullptr};
+  int64_t wire_ids[2] = {-1, -1};
+};
+
+Response ConnectionPool::Call(const Request& request) {
+  Response response(request.Id());
+  if (request.IsNotification()) {
+    response.SetError({kInvalidRequest, "a notification has no response"});
+    return response;
+  }
+  std::promise<Response> promise;
+  const auto status =
+      Submit(request, [&promise](Response response) { promise.set_value(std::move(response)); });
+  if (!status.Ok()) {
+    response.SetError({status.Code(), status.Message()});
+    return response;
+  }
+  return promise.get_future().get();
+}
+
+size_t ConnectionPool::Outstanding(const size_t endpoint) const {
+  size_t outstanding = 0;
+  for (const auto& connection : connections_) {
+    if (connection->endpoint == endpoint) {
+      outstanding += connection->outstanding.load(std::memory_order_relaxed);
+    }
+  }
+  return outstanding;
+}
+
+bool ConnectionPool::Ejected(const size_t endpoint) const {
+  std::lock_guard<std::mutex> lock(health_mutex_);
+  return Clock::now() < health_.at(endpoint).ejected_until;
+}
+
+Status ConnectionPool::Submit(const Request& request, ResponseCallback done) {
+  if (stopped_.load(std::memory_order_acquire)) {
+    return {kInternalError, "connection pool stopped"};
+  }
+  auto json = request.ToJson();
+  if (!request.IsNotification() && options_.hedge_percentile > 0 &&
+      hedge_delay_ns_.load(std::memory_order_relaxed) > 0 &&
+      options_.idempotent_methods.count(request.Method()) != 0) {
+    return SendHedged(request, std::move(json), std::move(done));
+  }
+  auto* callback = request.IsNotification() ? nullptr : &done;
+  Status status(kInternalError, "no endpoint");
+  // A failing endpoint gets ejected after a few attempts, so another one is tried next.
+  for (size_t attempt = 0; attempt < connections_.size(); ++attempt) {
+    auto* connection = Pick();
+    if (connection == nullptr) {
+      break;
+    }
+    status = Send(connection, &json, request.Id(), callback);
+    if (status.Ok()) {
+      return status;
+    }
+    RecordFailure(connection->endpoint);
+  }
+  return status;
+}
+
+Status ConnectionPool::SendHedged(const Request& request, Json json, ResponseCallback done) {
+  auto call = std::make_shared<HedgedCall>();
+  call->id = request.Id();
+  call->done = std::move(done);
+  call->request = std::move(json);
+  Status status(kInternalError, "no endpoint");
+  for (size_t attempt = 0; attempt < connections_.size(); ++attempt) {
+    auto* connection = Pick();
+    if (connection == nullptr) {
+      break;
+    }
+    ResponseCallback first = [this, call](Response response) {
+      Settle(call, 0, std::move(response));
+    };
+    int64_t wire_id;
+    // Locked first, so that a response arriving right away sees which attempt it answers.
+    std::unique_lock<std::mutex> lock(call->mutex);
+    status = Send(connection, &call->request, call->id, &first, &wire_id);
+    if (status.Ok()) {
+      call->connections[0] = connection;
+      call->wire_ids[0] = wire_id;
+      call->hedge_at =
+          Clock::now() + std::chrono::nanoseconds(hedge_delay_ns_.load(std::memory_order_relaxed));
+      lock.unlock();
+      {
+        std::lock_guard<std::mutex> hedges_lock(hedge_mutex_);
+        hedges_.push_back(std::move(call));
+      }
+      Wake();
+      return status;
+    }
+    lock.unlock();
+    RecordFailure(connection->endpoint);
+  }
+  return status;
+}
+
+void ConnectionPool::Hedge(const std::shared_ptr<HedgedCall>& call) {
+  Connection* first;
+  {
+    std::lock_guard<std::mutex> lock(call->mutex);
+    if (!call->done) {
+      return;
+    }
+    first = call->connections[0];
+  }
+  auto* connection = Pick(first);
+  if (connection == nullptr) {
+    return;
+  }
+  ResponseCallback second = [this, call](Response response) {
+    Settle(call, 1, std::move(response));
+  };
+  int64_t wire_id;
+  std::unique_lock<std::mutex> lock(call->mutex);
+  if (!call->done) {
+    return;
+  }
+  if (!Send(connection, &call->request, call->id, &second, &wire_id).Ok()) {
+    lock.unlock();
+    RecordFailure(connection->endpoint);
+    return;
+  }
+  hedged_.fetch_add(1, std::memory_order_relaxed);
+  call->connections[1] = connection;
+  call->wire_ids[1] = wire_id;
+}
+
+void ConnectionPool::Settle(const std::shared_ptr<HedgedCall>& call, const size_t attempt,
+                            Response response) {
+  ResponseCallback done;
+  Connection* loser;
+  int64_t loser_id;
+  {
+    std::lock_guard<std::mutex> lock(call->mutex);
+    if (!call->done) {
+      return;
+    }
+    done = std::move(call->done);
+    call->done = nullptr;
+    loser = call->connections[1 - attempt];
+    loser_id = call->wire_ids[1 - attempt];
+  }
+  if (loser != nullptr) {
+    Cancel(loser, loser_id);
+  }
+  done(std::move(response));
+}
+
+ConnectionPool::Connection* ConnectionPool::Pick(const Connection* excluded) {
+  std::vector<Connection*> candidates;
+  candidates.reserve(connections_.size());
+  {
+    std::lock_guard<std::mutex> lock(health_mutex_);
+    const auto now = Clock::now();
+    const auto healthy = [&](const Connection* connection) {
+      return now >= health_[connection->endpoint].ejected_until && connection != excluded;
+    };
+    // A hedge goes to another endpoint if there is a healthy one, since the slow one is most
+    // likely the endpoint rather than the connection.
+    for (const auto& connection : connections_) {
+      if (healthy(connection.get()) &&
+          (excluded == nullptr || connection->endpoint != excluded->endpoint)) {
+        candidates.push_back(connection.get());
+      }
+    }
+    if (candidates.empty() && excluded != nullptr) {
+      for (const auto& connection : connections_) {
+        if (healthy(connection.get())) {
+          candidates.push_back(connection.get());
+        }
+      }
+    }
+  }
+  if (candidates.empty()) {
+    // Better to try an ejected endpoint than to fail every call.
+    for (const auto& connection : connections_) {
+      if (connection.get() != excluded) {
+        candidates.push_back(connection.get());
+      }
+    }
+  }
+  if (candidates.empty()) {
+    return nullptr;
+  }
+  const auto load = [](const Connection* connection) {
+    return connection->outstanding.load(std::memory_order_relaxed);
+  };
+  if (options_.balancing == Balancing::kPowerOfTwoChoices && candidates.size() > 1) {
+    thread_local std::minstd_rand random(std::random_device{}());
+    std::uniform_int_distribution<size_t> distribution(0, candidates.size() - 1);
+    const auto first = distribution(random);
+    auto second = distribution(random);
+    if (second == first) {
+      second = (first + 1) % candidates.size();
+    }
+    return load(candidates[second]) < load(candidates[first]) ? candidates[second]
+                                                              : candidates[first];
+  }
+  // Ties go round robin, so idle connections share the calls.
+  const auto start = cursor_.fetch_add(1, std::memory_order_relaxed);
+  Connection* best = nullptr;
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    auto* connection = candidates[(start + i) % candidates.size()];
+    if (best == nullptr || load(connection) < load(best)) {
+      best = connection;
+    }
+  }
+  return best;
+}
+
+void ConnectionPool::RecordSuccess(const size_t endpoint, const std::chrono::nanoseconds latency) {
+  std::lock_guard<std::mutex> lock(health_mutex_);
+  auto& health = health_[endpoint];
+  health.failures = 0;
+  health.latency = health.latency.count() == 0 ? latency : (health.latency * 7 + latency) / 8;
+  if (options_.max_latency.count() != 0 && health.latency > options_.max_latency) {
+    // The endpoint starts over once it is tried again.
+    health.latency = std::chrono::nanoseconds(0);
+    health.ejected_until = Clock::now() + options_.ejection_time;
+  }
+
+  if (options_.hedge_percentile <= 0) {
+    return;
+  }
+  if (latencies_.size() < kLatencyWindow) {
+    latencies_.push_back(latency);
+  } else {
+    latencies_[latency_count_ % kLatencyWindow] = latency;
+  }
+  if (++latency_count_ % kHedgeUpdate == 0) {
+    auto sorted = latencies_;
+    const auto rank = std::min(
+        sorted.size() - 1,
+        static_cast<size_t>(options_.hedge_percentile * static_cast<double>(sorted.size())));
+    std::nth_element(sorted.begin(), sorted.begin() + static_cast<ptrdiff_t>(rank), sorted.end());
+    hedge_delay_ns_.store(std::max<int64_t>(1, sorted[rank].count()), std::memory_order_relaxed);
+  }
+}
+
+void ConnectionPool::RecordFailure(const size_t endpoint) {
+  std::lock_guard<std::mutex> lock(health_mutex_);
+  auto& health = health_[endpoint];
+  if (++health.failures >= std::max<size_t>(1, options_.max_failures)) {
+    health.failures = 0;
+    health.latency = std::chrono::nanoseconds(0);
+    health.ejected_until = Clock::now() + options_.ejection_time;
+  }
+}
+
+#ifdef __linux__
+
+namespace {
+
+constexpr size_t kReadSize = 64 * 1024;
+// How often the thread of the pool looks for timed out calls while nothing arrives.
+constexpr std::chrono::milliseconds kPollInterval{10};
+
+Status SystemError(const std::string& what) {
+  return {kInternalError, what + ": " + std::strerror(errno)};
+}
+
+// Starts connecting without blocking: a connection in progress is finished by WriteOutput().
+Status Connect(const Endpoint& endpoint, int* fd, bool* connecting) {
+  if (!endpoint.path.empty()) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (endpoint.path.size() >= sizeof(address.sun_path)) {
+      return {kInvalidParams, "socket path too long: " + endpoint.path};
+    }
+    std::memcpy(address.sun_path, endpoint.path.c_str(), endpoint.path.size() + 1);
+    *fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (*fd < 0) {
+      return SystemError("socket");
+    }
+    // A Unix socket connects at once or fails, even without blocking.
+    if (connect(*fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+      const auto status = SystemError("connect " + endpoint.path);
+      close(*fd);
+      *fd = -1;
+      return status;
+    }
+    *connecting = false;
+    return {kSuccess, ""};
+  }
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(endpoint.port);
+  if (inet_pton(AF_INET, endpoint.host.c_str(), &address.sin_addr) != 1) {
+    return {kInvalidParams, "invalid host: " + endpoint.host};
+  }
+  *fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (*fd < 0) {
+    return SystemError("socket");
+  }
+  *connecting = connect(*fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0;
+  if (*connecting && errno != EINPROGRESS) {
+    const auto status = SystemError("connect " + endpoint.host);
+    close(*fd);
+    *fd = -1;
+    return status;
+  }
+  const int on = 1;
+  setsockopt(*fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  return {kSuccess, ""};
+}
+
+// Appends the notification asking a server to give up on a call.
+void AppendCancel(const int64_t wire_id, std::string* line) {
+  line->append(R"({"jsonrpc":"2.0","method":")")
+      .append(kCancelRequestMethod)
+      .append(R"(","params":{"id":)")
+      .append(std::to_string(wire_id))
+      .append("}}\n");
+}
+
+}  // namespace
+
+bool ConnectionPool::Connection::WriteOutput() {
+  if (connecting) {
+    pollfd connected{fd, POLLOUT, 0};
+    if (poll(&connected, 1, 0) <= 0) {
+      return true;
+    }
+    int error = 0;
+    socklen_t size = sizeof(error);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size) != 0) {
+      return false;
+    }
+    if (error != 0) {
+      errno = error;
+      return false;
+    }
+    connecting = false;
+  }
+  while (!output.empty()) {
+    const auto written = send(fd, output.data(), output.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // The rest waits for the socket to drain.
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    output.erase(0, static_cast<size_t>(written));
+  }
+  return true;
+}
+
+ConnectionPool::ConnectionPool(std::vector<Endpoint> endpoints, PoolOptions options)
+    : endpoints_(std::move(endpoints)),
+      options_(std::move(options)),
+      health_(endpoints_.size()),
+      next_id_(RandomFirstId()) {
+  for (size_t i = 0; i < endpoints_.size(); ++i) {
+    for (size_t j = 0; j < std::max<size_t>(1, options_.connections_per_endpoint); ++j) {
+      connections_.push_back(std::make_unique<Connection>());
+      connections_.back()->endpoint = i;
+    }
+  }
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  thread_ = std::thread([this] { Run(); });
+}
+
+ConnectionPool::~ConnectionPool() {
+  Stop();
+  if (wake_fd_ >= 0) {
+    close(wake_fd_);
+  }
+}
+
+void ConnectionPool::Stop() {
+  if (stopped_.exchange(true)) {
+    return;
+  }
+  Wake();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  for (auto& connection : connections_) {
+    Break(connection.get(), {kInternalError, "connection pool stopped"});
+  }
+  std::lock_guard<std::mutex> lock(hedge_mutex_);
+  hedges_.clear();
+}
+
+void ConnectionPool::Wake() const {
+  const uint64_t one = 1;
+  static_cast<void>(write(wake_fd_, &one, sizeof(one)));
+}
+
+Status ConnectionPool::Send(Connection* connection, Json* request, const Identifier& id,
+                            ResponseCallback* done, int64_t* wire_id) {
+  int64_t call_id = -1;
+  if (done != nullptr) {
+    call_id = next_id_.fetch_add(1, std::memory_order_relaxed);
+    (*request)[kIdName] = call_id;
+  }
+  std::string line;
+  AppendJson(*request, &line);
+  line.push_back('\n');
+
+  // Nothing here blocks, so a slow endpoint never holds up the thread of the pool, which takes the
+  // lock of every connection before it polls.
+  std::lock_guard<std::mutex> lock(connection->mutex);
+  bool wake = false;
+  if (connection->fd < 0) {
+    const auto status =
+        Connect(endpoints_[connection->endpoint], &connection->fd, &connection->connecting);
+    if (!status.Ok()) {
+      return status;
+    }
+    connection->connect_started = Clock::now();
+    wake = true;
+  }
+  if (done != nullptr) {
+    // Registered first, since the response can be read as soon as the request is written.
+    connection->waiters.emplace(call_id, Connection::Waiter{id, std::move(*done), Clock::now()});
+    connection->outstanding.fetch_add(1, std::memory_order_relaxed);
+  }
+  // Queued after what is left of earlier lines, and written as far as the socket takes it.
+  connection->output.append(line);
+  if (!connection->WriteOutput()) {
+    const auto status = SystemError("send");
+    if (done != nullptr) {
+      *done = std::move(connection->waiters.at(call_id).done);
+      connection->waiters.erase(call_id);
+      connection->outstanding.fetch_sub(1, std::memory_order_relaxed);
+    }
+    // The thread of the pool sees the connection close and fails the other calls.
+    shutdown(connection->fd, SHUT_RDWR);
+    return status;
+  }
+  if (wire_id != nullptr) {
+    *wire_id = call_id;
+  }
+  // The thread of the pool polls a new socket, and writes the rest once the socket drains.
+  if (wake || !connection->output.empty()) {
+    Wake();
+  }
+  return {kSuccess, ""};
+}
+
+void ConnectionPool::Cancel(Connection* connection, const int64_t wire_id) {
+  {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    if (connection->waiters.erase(wire_id) == 0) {
+      return;
+    }
+    connection->outstanding.fetch_sub(1, std::memory_order_relaxed);
+    if (connection->fd < 0) {
+      return;
+    }
+    // Queued rather than written here, so a full socket never blocks the caller holding the lock.
+    AppendCancel(wire_id, &connection->output);
+  }
+  Wake();
+}
+
+void ConnectionPool::Flush(Connection* connection) {
+  Error error;
+  {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    if (connection->fd < 0 || (connection->output.empty() && !connection->connecting) ||
+        connection->WriteOutput()) {
+      return;
+    }
+    error = {kInternalError, SystemError(connection->connecting ? "connect" : "send").Message()};
+  }
+  Break(connection, error);
+}
+
+void ConnectionPool::Run() {
+  std::vector<pollfd> fds;
+  std::vector<Connection*> polled;
+  std::vector<std::shared_ptr<HedgedCall>> due;
+  while (!stopped_.load(std::memory_order_acquire)) {
+    fds.assign(1, pollfd{wake_fd_, POLLIN, 0});
+    polled.clear();
+    for (auto& connection : connections_) {
+      std::lock_guard<std::mutex> lock(connection->mutex);
+      if (connection->fd >= 0) {
+        const short events = connection->output.empty() && !connection->connecting
+                                 ? POLLIN
+                                 : POLLIN | POLLOUT;
+        fds.push_back({connection->fd, events, 0});
+        polled.push_back(connection.get());
+      }
+    }
+    Clock::duration wait = kPollInterval;
+    {
+      const auto now = Clock::now();
+      std::lock_guard<std::mutex> lock(hedge_mutex_);
+      for (const auto& call : hedges_) {
+        wait = std::max(Clock::duration::zero(), std::min(wait, call->hedge_at - now));
+      }
+    }
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(wait);
+    const timespec timeout{static_cast<time_t>(seconds.count()),
+                           static_cast<long>(std::chrono::nanoseconds(wait - seconds).count())};
+    if (ppoll(fds.data(), fds.size(), &timeout, nullptr) < 0 && errno != EINTR) {
+      return;
+    }
+    if ((fds[0].revents & POLLIN) != 0) {
+      uint64_t count;
+      static_cast<void>(read(wake_fd_, &count, sizeof(count)));
+    }
+    for (size_t i = 0; i < polled.size(); ++i) {
+      if ((fds[i + 1].revents & ~POLLOUT) != 0) {
+        Receive(polled[i]);
+      }
+    }
+    const auto now = Clock::now();
+    for (auto& connection : connections_) {
+      Expire(connection.get(), now);
+      Flush(connection.get());
+    }
+    {
+      std::lock_guard<std::mutex> lock(hedge_mutex_);
+      const auto pending = std::partition(hedges_.begin(), hedges_.end(),
+                                          [now](const auto& call) { return call->hedge_at > now; });
+      due.assign(std::make_move_iterator(pending), std::make_move_iterator(hedges_.end()));
+      hedges_.erase(pending, hedges_.end());
+    }
+    for (const auto& call : due) {
+      Hedge(call);
+    }
+    due.clear();
+  }
+}
+
+void ConnectionPool::Receive(Connection* connection) {
+  auto& input = connection->input;
+  char buffer[kReadSize];
+  bool closed = false;
+  while (true) {
+    const auto received = recv(connection->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (received > 0) {
+      input.append(buffer, static_cast<size_t>(received));
+      continue;
+    }
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    // The responses read before the end of the stream are still delivered.
+    closed = received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+    break;
+  }
+
+  size_t begin = 0;
+  for (auto end = input.find('\n'); end != std::string::npos; end = input.find('\n', begin)) {
+    const std::string_view line(input.data() + begin, end - begin);
+    begin = end + 1;
+    Response response;
+    Json json;
+    auto status = ParseJsonText(line, ParseLimits(), &json);
+    if (status.Ok()) {
+      status = response.ParseJson(std::move(json));
+    }
+    if (!status.Ok() || response.Id().Type() != Identifier::IdType::kNumber) {
+      // Without an id the response cannot be matched, and the connection cannot be trusted.
+      Break(connection, {kInternalError, "invalid response"});
+      return;
+    }
+    Connection::Waiter waiter;
+    {
+      std::lock_guard<std::mutex> lock(connection->mutex);
+      const auto it = connection->waiters.find(response.Id().IntId());
+      if (it == connection->waiters.end()) {
+        // Cancelled or timed out meanwhile.
+        continue;
+      }
+      waiter = std::move(it->second);
+      connection->waiters.erase(it);
+      connection->outstanding.fetch_sub(1, std::memory_order_relaxed);
+    }
+    RecordSuccess(connection->endpoint, Clock::now() - waiter.sent);
+    response.SetId(std::move(waiter.id));
+    if (waiter.done) {
+      waiter.done(std::move(response));
+    }
+  }
+  input.erase(0, begin);
+  if (closed) {
+    Break(connection, {kInternalError, "connection closed"});
+  }
+}
+
+void ConnectionPool::Expire(Connection* connection, const Clock::time_point now) {
+  std::vector<Connection::Waiter> expired;
+  bool unreachable = false;
+  {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    unreachable = connection->connecting && now - connection->connect_started > options_.timeout;
+    for (auto it = connection->waiters.begin(); it != connection->waiters.end();) {
+      if (now - it->second.sent <= options_.timeout) {
+        ++it;
+        continue;
+      }
+      // The server is asked to give up on the call too, once Run() flushes the cancellations.
+      if (connection->fd >= 0) {
+        AppendCancel(it->first, &connection->output);
+      }
+      expired.push_back(std::move(it->second));
+      it = connection->waiters.erase(it);
+      connection->outstanding.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+  for (auto& waiter : expired) {
+    RecordFailure(connection->endpoint);
+    Response response(std::move(waiter.id));
+    response.SetError({kRequestTimeout, "request timed out"});
+    if (waiter.done) {
+      waiter.done(std::move(response));
+    }
+  }
+  if (unreachable) {
+    Break(connection, {kInternalError, "connect timed out"});
+  }
+}
+
+void ConnectionPool::Break(Connection* connection, const Error& error) {
+  std::map<int64_t, Connection::Waiter> waiters;
+  {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    if (connection->fd < 0) {
+      return;
+    }
+    close(connection->fd);
+    connection->fd = -1;
+    connection->input.clear();
+    connection->output.clear();
+    connection->connecting = false;
+    waiters.swap(connection->waiters);
+    connection->outstanding.store(0, std::memory_order_relaxed);
+  }
+  if (!stopped_.load(std::memory_order_acquire)) {
+    RecordFailure(connection->endpoint);
+  }
+  for (auto& [id, waiter] : waiters) {
+    Response response(std::move(waiter.id));
+    response.SetError(error);
+    if (waiter.done) {
+      waiter.done(std::move(response));
+    }
+  }
+}
+
+#else
+
+ConnectionPool::ConnectionPool(std::vector<Endpoint> endpoints, PoolOptions options)
+    : endpoints_(std::move(endpoints)),
+      options_(std::move(options)),
+      health_(endpoints_.size()),
+      next_id_(RandomFirstId()) {}
+
+ConnectionPool::~ConnectionPool() = default;
+
+void ConnectionPool::Stop() {
+  stopped_ = true;
+}
+
+Status ConnectionPool::Send(Connection* connection, Json* request, const Identifier& id,
+                            ResponseCallback* done, int64_t* wire_id) {
+  return {kInternalError, "ConnectionPool is only supported on Linux"};
+}
+
+void ConnectionPool::Cancel(Connection* connection, const int64_t wire_id) {}
+
+void ConnectionPool::Flush(Connection* connection) {}
+
+void ConnectionPool::Wake() const {}
+
+#endif
+
+}  // namespace json_rpc
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "request.h"
+#include "response.h"
+#include "status.h"
+
+namespace json_rpc {
+
+/// The address of a server speaking newline-delimited JSON, such as a ShardedServer.
+struct Endpoint {
+  /// @brief Makes a TCP endpoint.
+  /// @param host The IPv4 address of the server.
+  /// @param port The port of the server.
+  /// @return The endpoint.
+  static Endpoint Tcp(std::string host, uint16_t port) {
+    Endpoint endpoint;
+    endpoint.host = std::move(host);
+    endpoint.port = port;
+    return endpoint;
+  }
+
+  /// @brief Makes a Unix socket endpoint.
+  /// @param path The path of the socket.
+  /// @return The endpoint.
+  static Endpoint Unix(std::string path) {
+    Endpoint endpoint;
+    endpoint.path = std::move(path);
+    return endpoint;
+  }
+
+  std::string host;
+  uint16_t port = 0;
+  // The path of a Unix socket, empty for TCP.
+  std::string path;
+};
+
+/// How a ConnectionPool picks the connection of a call.
+enum class Balancing : uint8_t {
+  /// The connection with the fewest calls in flight.
+  kLeastOutstanding,
+  /// The less loaded of two connections picked at random, which spreads load nearly as well
+  /// without looking at every connection.
+  kPowerOfTwoChoices,
+};
+
+struct PoolOptions {
+  /// The number of connections kept to each endpoint.
+  size_t connections_per_endpoint = 2;
+  Balancing balancing = Balancing::kLeastOutstanding;
+  /// The longest time to wait for a response, after which the call is cancelled.
+  std::chrono::milliseconds timeout{5000};
+  /// The number of consecutive failures, such as refused connections or timeouts, ejecting an
+  /// endpoint.
+  size_t max_failures = 3;
+  /// The average latency ejecting an endpoint as too slow, or zero to never eject slow endpoints.
+  std::chrono::microseconds max_latency{0};
+  /// How long an ejected endpoint gets no calls before it is tried again.
+  std::chrono::milliseconds ejection_time{10000};
+  /// The methods safe to run twice, whose calls may be hedged.
+  std::unordered_set<std::string> idempotent_methods;
+  /// The percentile of recent latencies, such as 0.95, after which a call of an idempotent method
+  /// still unanswered is sent again on another connection; zero disables hedging.
+  double hedge_percentile = 0;
+};
+
+/// Client keeping several connections to one or more servers, sending each call to the least
+/// loaded connection.
+///
+/// Calls are pipelined: a connection carries any number of calls in flight, one line each, under
+/// ids of the pool by which their responses are matched. The calling thread writes a call as far as
+/// the socket takes it without blocking, and a thread of the pool writes the rest, reads the
+/// responses of every connection and runs the callbacks. Connecting does not block either, so
+/// neither an unreachable endpoint nor a server that stops reading holds up the other connections.
+///
+/// A call of an idempotent method can be hedged: once it waited longer than hedge_percentile of
+/// the recent latencies, a duplicate with another id goes to another connection. The first
+/// response wins and the other attempt is cancelled with a kCancelRequestMethod notification, so a
+/// rare slow backend no longer sets the tail latency.
+///
+/// Endpoints failing max_failures times in a row, or answering slower than max_latency on average,
+/// are ejected for ejection_time, during which calls go to the other endpoints. If every endpoint
+/// is ejected, calls go to all of them rather than failing outright. Connections are opened when
+/// first used and reopened after they broke. Only supported on Linux.
+class ConnectionPool {
+ public:
+  /// Receives the response to a call. Called on the thread of the pool, or on the calling thread
+  /// if the call failed before it was sent.
+  using ResponseCallback = std::function<void(Response response)>;
+
+  /// @brief Constructor, starts the thread of the pool.
+  /// @param endpoints The servers, which need not be up yet.
+  /// @param options The number of connections, balancing and health checking.
+  explicit ConnectionPool(std::vector<Endpoint> endpoints, PoolOptions options = PoolOptions());
+
+  ConnectionPool(const ConnectionPool&) = delete;
+  ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+  /// @brief Destructor, stops the pool.
+  ~ConnectionPool();
+
+  /// @brief Sends a call or notification on the least loaded connection.
+  /// @param request The request.
+  /// @param done The callback receiving the response to a call, unused for a notification. An error
+  /// response with kRequestTimeout is delivered if the call timed out, and cancelled on the
+  /// server; with kInternalError if its connection broke.
+  /// @return A Status object indicating failure if the pool is stopped or no endpoint could be
+  /// connected to, in which case done is not called.
+  Status Submit(const Request& request, ResponseCallback done);
+
+  /// @brief Makes a call and waits for its response. Must not be called from a callback.
+  /// @param request The request, which must not be a notification.
+  /// @return The response, an error response if the call failed.
+  Response Call(const Request& request);
+
+  /// @brief Fails the calls in flight, closes every connection and stops the thread. Idempotent,
+  /// must not be called from a callback.
+  void Stop();
+
+  /// @brief Gets the number of calls in flight to an endpoint.
+  /// @param endpoint The index of the endpoint.
+  /// @return The number of calls sent and not answered yet.
+  [[nodiscard]] size_t Outstanding(size_t endpoint) const;
+
+  /// @brief Gets the number of duplicate calls sent by hedging.
+  /// @return The number of hedged calls.
+  [[nodiscard]] uint64_t Hedged() const {
+    return hedged_.load(std::memory_order_relaxed);
+  }
+
+  /// @brief Gets whether an endpoint is ejected.
+  /// @param endpoint The index of the endpoint.
+  /// @return Whether the endpoint currently gets no calls.
+  [[nodiscard]] bool Ejected(size_t endpoint) const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Connection;
+
+  // The attempts of a hedged call.
+  struct HedgedCall;
+
+  struct Health {
+    size_t failures = 0;
+    // The moving average of the latency, zero before the first response.
+    std::chrono::nanoseconds latency{0};
+    Clock::time_point ejected_until;
+  };
+
+  void Run();
+
+  Connection* Pick(const Connection* excluded = nullptr);
+
+  // Queues a request and writes what the socket takes, replacing the id of a call with an id of
+  // the pool, for which done is taken unless sending failed.
+  Status Send(Connection* connection, Json* request, const Identifier& id, ResponseCallback* done,
+              int64_t* wire_id = nullptr);
+
+  Status SendHedged(const Request& request, Json json, ResponseCallback done);
+
+  void Hedge(const std::shared_ptr<HedgedCall>& call);
+
+  void Settle(const std::shared_ptr<HedgedCall>& call, size_t attempt, Response response);
+
+  void Cancel(Connection* connection, int64_t wire_id);
+
+  // Writes the queued output of a connection as far as its socket takes it, breaking the
+  // connection if it failed.
+  void Flush(Connection* connection);
+
+  void Receive(Connection* connection);
+
+  void Expire(Connection* connection, Clock::time_point now);
+
+  void Break(Connection* connection, const Error& error);
+
+  void RecordSuccess(size_t endpoint, std::chrono::nanoseconds latency);
+
+  void RecordFailure(size_t endpoint);
+
+  void Wake() const;
+
+  std::vector<Endpoint> endpoints_;
+  const PoolOptions options_;
+  std::vector<std::unique_ptr<Connection>> connections_;
+  mutable std::mutex health_mutex_;
+  std::vector<Health> health_;
+  // The latencies of the recent calls, in a ring, and the hedging delay taken from them.
+  std::vector<std::chrono::nanoseconds> latencies_;
+  size_t latency_count_ = 0;
+  std::atomic<int64_t> hedge_delay_ns_{0};
+  std::mutex hedge_mutex_;
+  std::vector<std::shared_ptr<HedgedCall>> hedges_;
+  std::atomic<uint64_t> hedged_{0};
+  // Ids of the pool start at random, since a server matches cancellations across its clients.
+  std::atomic<int64_t> next_id_;
+  std::atomic<size_t> cursor_{0};
+  std::atomic<bool> stopped_{false};
+  int wake_fd_ = -1;
+  std::thread thread_;
+};
+
+}  // namespace json_rpc
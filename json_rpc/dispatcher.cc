@@ -0,0 +1,532 @@
+
+#include "dispatcher.h"
+
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <thread>
+#include <utility>
+
+#include "error.h"
+
+namespace json_rpc {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+uint64_t ElapsedNs(const Clock::time_point begin) {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count());
+}
+
+Status WriteFailed() {
+  return {kInternalError, "failed to write response"};
+}
+
+Error TimeoutError() {
+  return {kRequestTimeout, "Request timed out"};
+}
+
+bool Expired(const Request& request, const Clock::time_point now) {
+  return request.HasDeadline() && now >= request.Deadline();
+}
+
+// Spreads the calling threads over a number of shards, each thread keeping to one.
+size_t ThreadShard(const size_t shards) {
+  thread_local const size_t hash = std::hash<std::thread::id>()(std::this_thread::get_id());
+  return hash % shards;
+}
+
+}  // namespace
+
+/// Keeps the cancellation token of a request registered, and its deadline armed, while the
+/// request is in flight. A token registered while the request was queued is kept. Notifications
+/// cannot be named by a cancel notification, so they only get a token when a deadline may cancel
+/// them.
+class Dispatcher::InFlight {
+ public:
+  InFlight(Dispatcher* dispatcher, Request* request) : dispatcher_(dispatcher), request_(request) {
+    if (!request_->Cancellation().Cancellable()) {
+      if (!request_->IsNotification()) {
+        request_->SetCancellation(dispatcher_->cancellations_.Register(request_->Id()));
+      } else if (request_->HasDeadline()) {
+        request_->SetCancellation(CancellationToken::Create());
+      }
+      owned_ = true;
+    }
+    if (request_->HasDeadline()) {
+      timers_ = &dispatcher_->timers_[ThreadShard(kTimerShards)];
+      std::vector<CancellationToken> expired;
+      {
+        std::lock_guard<std::mutex> lock(timers_->mutex);
+        timer_ = timers_->wheel.Schedule(request_->Deadline(), request_->Cancellation());
+        // Turned under the lock taken anyway, so the threads of a busy shard keep it current.
+        timers_->wheel.Advance(Clock::now(), &expired);
+      }
+      for (const auto& token : expired) {
+        token.Cancel();
+      }
+    }
+  }
+
+  InFlight(const InFlight&) = delete;
+  InFlight& operator=(const InFlight&) = delete;
+
+  ~InFlight() {
+    if (timers_ != nullptr) {
+      std::lock_guard<std::mutex> lock(timers_->mutex);
+      timers_->wheel.Cancel(timer_);
+    }
+    if (!request_->IsNotification()) {
+      dispatcher_->cancellations_.Unregister(request_->Id(), request_->Cancellation());
+    }
+    // A request dispatched again gets a fresh token.
+    if (owned_) {
+      request_->SetCancellation(CancellationToken());
+    }
+  }
+
+ private:
+  Dispatcher* dispatcher_;
+  Request* request_;
+  // The wheel the deadline is armed in, if any.
+  TimerShard* timers_ = nullptr;
+  TimerWheel<CancellationToken>::TimerId timer_ = 0;
+  bool owned_ = false;
+};
+
+Dispatcher::Dispatcher() {
+  RegisterMethod(kMetricsMethod, [this](const Request& request) {
+    Response response(request.Id());
+    response.SetResult(metrics_.ToJson());
+    return response;
+  });
+  const auto cancel = [this](const Request& request) {
+    const auto& params = request.Params();
+    const char* key = params.Has("requestId") ? "requestId" : kIdName;
+    if (Identifier id; params.Has(key) && id.ParseJson(params.Get(key))) {
+      cancellations_.Cancel(id);
+    }
+    return Response(request.Id());
+  };
+  RegisterMethod(kCancelRequestMethod, cancel);
+  RegisterMethod(kCancelledNotification, cancel);
+  for (const auto* method : {kMetricsMethod, kCancelRequestMethod, kCancelledNotification}) {
+    SetPriority(method, Priority::kControl);
+  }
+}
+
+void Dispatcher::RegisterMethod(const std::string& method, MethodHandler handler) {
+  auto& entry = AddMethod(method);
+  entry.handler = std::move(handler);
+  entry.streaming_handler = nullptr;
+  entry.notification_handler = nullptr;
+  entry.params_validator.reset();
+  entry.metrics_slot = metrics_.RegisterMethod(method);
+}
+
+Status Dispatcher::RegisterMethod(const std::string& method, MethodHandler handler,
+                                  const Json& params_schema) {
+  auto validator = std::make_unique<SchemaValidator>();
+  if (auto status = validator->Compile(params_schema); !status.Ok()) {
+    return status;
+  }
+  RegisterMethod(method, std::move(handler));
+  FindMethod(method)->params_validator = std::move(validator);
+  return {kSuccess, ""};
+}
+
+void Dispatcher::RegisterStreamingMethod(const std::string& method, StreamingHandler handler) {
+  auto& entry = AddMethod(method);
+  entry.handler = nullptr;
+  entry.streaming_handler = std::move(handler);
+  entry.notification_handler = nullptr;
+  entry.params_validator.reset();
+  entry.metrics_slot = metrics_.RegisterMethod(method);
+}
+
+void Dispatcher::RegisterNotification(const std::string& method, NotificationHandler handler) {
+  auto& entry = AddMethod(method);
+  entry.handler = nullptr;
+  entry.streaming_handler = nullptr;
+  entry.notification_handler = std::move(handler);
+  entry.params_validator.reset();
+  entry.metrics_slot = metrics_.RegisterMethod(method);
+}
+
+bool Dispatcher::SetTimeout(const std::string& method, const std::chrono::milliseconds timeout) {
+  auto* entry = FindMethod(method);
+  if (entry == nullptr) {
+    return false;
+  }
+  entry->timeout = timeout;
+  return true;
+}
+
+bool Dispatcher::SetPriority(const std::string& method, const Priority priority) {
+  auto* entry = FindMethod(method);
+  if (entry == nullptr) {
+    return false;
+  }
+  entry->priority = priority;
+  return true;
+}
+
+bool Dispatcher::SetCoalescing(const std::string& method, const Coalescing coalescing,
+                               const std::string& key) {
+  auto* entry = FindMethod(method);
+  if (entry == nullptr) {
+    return false;
+  }
+  entry->coalescing = coalescing;
+  entry->coalescing_key = key;
+  return true;
+}
+
+bool Dispatcher::CoalescingKey(const Request& request, std::string* key) const {
+  const auto* method = FindMethod(request);
+  if (!request.IsNotification() || method == nullptr || method->coalescing == Coalescing::kNone) {
+    return false;
+  }
+  // The index of the method keeps the keys of different methods apart.
+  *key = std::to_string(method - methods_.data());
+  if (!method->coalescing_key.empty()) {
+    if (!request.Params().Has(method->coalescing_key)) {
+      return false;
+    }
+    key->push_back(':');
+    key->append(request.Params().Get(method->coalescing_key).dump());
+  }
+  return true;
+}
+
+void Dispatcher::Tick() {
+  std::vector<CancellationToken> expired;
+  const auto now = Clock::now();
+  for (auto& timers : timers_) {
+    std::lock_guard<std::mutex> lock(timers.mutex);
+    timers.wheel.Advance(now, &expired);
+  }
+  // Cancelled outside of the lock, since cancellation callbacks may dispatch again.
+  for (const auto& token : expired) {
+    token.Cancel();
+  }
+}
+
+const Dispatcher::Method* Dispatcher::FindMethod(const Request& request) const {
+  auto id = request.MethodAtom();
+  if (id == kUnknownMethodId) {
+    // Requests built before their method was interned, or for a method no one registered.
+    id = MethodTable::Global().Find(request.Method());
+  }
+  if (id >= methods_.size() || !methods_[id].Registered()) {
+    return nullptr;
+  }
+  return &methods_[id];
+}
+
+Dispatcher::Method* Dispatcher::FindMethod(const std::string& method) {
+  const auto id = MethodTable::Global().Find(method);
+  if (id >= methods_.size() || !methods_[id].Registered()) {
+    return nullptr;
+  }
+  return &methods_[id];
+}
+
+Dispatcher::Method& Dispatcher::AddMethod(const std::string& method) {
+  const auto id = MethodTable::Global().Intern(method);
+  if (id >= methods_.size()) {
+    methods_.resize(id + 1);
+  }
+  return methods_[id];
+}
+
+void Dispatcher::ApplyTimeout(const Method* method, const Clock::time_point received,
+                              Request* request) {
+  if (method == nullptr || method->timeout.count() <= 0) {
+    return;
+  }
+  const auto deadline = received + method->timeout;
+  if (deadline < request->Deadline()) {
+    request->SetDeadline(deadline);
+  }
+}
+
+bool Dispatcher::Dispatch(const Request& request, Response* response) {
+  return Dispatch(Request(request), response);
+}
+
+bool Dispatcher::Dispatch(Request&& request, Response* response) {
+  const auto begin = Clock::now();
+  const auto* method = FindMethod(request);
+  ApplyTimeout(method, begin, &request);
+  size_t slot = method != nullptr ? method->metrics_slot : Metrics::kUnknownSlot;
+  bool dropped = false;
+  if (method == nullptr) {
+    *response = Response(request.Id());
+    response->SetError({kMethodNotFound, "Method not found"});
+  } else if (Expired(request, begin)) {
+    *response = Response(request.Id());
+    response->SetError(TimeoutError());
+  } else if (method->notification_handler) {
+    if (request.IsNotification()) {
+      const InFlight in_flight(this, &request);
+      *response = Response(request.Id());
+      if (!InvokeNotification(*method, request)) {
+        response->SetError({kInternalError, "Internal error"});
+      }
+    } else {
+      *response = Response(request.Id());
+      response->SetError({kInvalidRequest, "Method only accepts notifications"});
+    }
+  } else if (method->streaming_handler) {
+    const InFlight in_flight(this, &request);
+    // A whole Response is asked for, so the streamed result is buffered without a chunk limit,
+    // which keeps errors expressible, and read back.
+    std::string buffer;
+    auto outcome = StreamOutcome::kResult;
+    const auto status = Stream(
+        *method, request,
+        [&buffer](std::string_view chunk) {
+          buffer.append(chunk);
+          return true;
+        },
+        std::numeric_limits<size_t>::max(), &outcome);
+    *response = Response(request.Id());
+    dropped = outcome == StreamOutcome::kDropped;
+    if (!status.Ok()) {
+      response->SetError({kInternalError, "Internal error"});
+    } else if (!dropped) {
+      auto json = Json::parse(buffer);
+      if (outcome == StreamOutcome::kError) {
+        const auto& err = json.at(kErrorName);
+        response->SetError({err.at(kCodeName).get<int>(), err.at(kMessageName).get<std::string>(),
+                            err.value(kDataName, Json())});
+      } else {
+        response->SetResult(std::move(json.at(kResultName)));
+      }
+    }
+  } else {
+    const InFlight in_flight(this, &request);
+    Invoke(*method, request, response);
+    if (request.Cancellation().IsCancelled()) {
+      if (Expired(request, Clock::now())) {
+        *response = Response(request.Id());
+        response->SetError(TimeoutError());
+      } else {
+        dropped = true;
+      }
+    }
+  }
+  metrics_.RecordCall(slot, request.IsNotification(),
+                      !dropped && response->Err().Code() != kSuccess, ElapsedNs(begin));
+  return !request.IsNotification() && !dropped;
+}
+
+void Dispatcher::Notify(Request& request) {
+  const auto begin = Clock::now();
+  const auto* method = FindMethod(request);
+  if (method == nullptr || !method->notification_handler || !request.IsNotification()) {
+    Response response;
+    Dispatch(std::move(request), &response);
+    return;
+  }
+  ApplyTimeout(method, begin, &request);
+  // An expired notification is dropped, counted as failed as Dispatch() does.
+  bool failed = Expired(request, begin);
+  if (!failed) {
+    const InFlight in_flight(this, &request);
+    failed = !InvokeNotification(*method, request);
+  }
+  metrics_.RecordCall(method->metrics_slot, true, failed, ElapsedNs(begin));
+}
+
+bool Dispatcher::InvokeNotification(const Method& method, const Request& request) {
+  try {
+    method.notification_handler(request);
+    return true;
+  } catch (...) {
+    return false;
+  }
+}
+
+void Dispatcher::Invoke(const Method& method, const Request& request, Response* response) {
+  if (method.params_validator) {
+    if (auto error = method.params_validator->Validate(request.Params());
+        error.Code() != kSuccess) {
+      *response = Response(request.Id());
+      response->SetError(std::move(error));
+      return;
+    }
+  }
+  try {
+    *response = method.handler(request);
+  } catch (...) {
+    *response = Response(request.Id());
+    response->SetError({kInternalError, "Internal error"});
+  }
+}
+
+Status Dispatcher::Stream(const Method& method, const Request& request, const ChunkSink& sink,
+                          const size_t chunk_size, StreamOutcome* outcome) const {
+  ResultWriter writer(request.Id(), sink, chunk_size);
+  *outcome = StreamOutcome::kError;
+  if (method.params_validator) {
+    if (auto validation = method.params_validator->Validate(request.Params());
+        validation.Code() != kSuccess) {
+      return writer.Fail(validation);
+    }
+  }
+  Status status(kSuccess, "");
+  try {
+    status = method.streaming_handler(request, &writer);
+  } catch (...) {
+    status = {kInternalError, "Internal error"};
+  }
+  // Once a chunk went out the response has to be completed, cancelled or not.
+  if (request.Cancellation().IsCancelled() && !writer.Started()) {
+    if (Expired(request, Clock::now())) {
+      return writer.Fail(TimeoutError());
+    }
+    *outcome = StreamOutcome::kDropped;
+    return {kSuccess, ""};
+  }
+  if (!status.Ok()) {
+    return writer.Finished() ? status : writer.Fail({status.Code(), status.Message()});
+  }
+  *outcome = StreamOutcome::kResult;
+  if (writer.Finished()) {
+    return status;
+  }
+  status = writer.Finish();
+  if (!status.Ok() && !writer.Started()) {
+    // The handler left the result incomplete, or wrote none: answered all the same.
+    *outcome = StreamOutcome::kError;
+    return writer.Fail({kInternalError, "Internal error"});
+  }
+  return status;
+}
+
+std::string Dispatcher::HandleMessage(const std::string_view message) {
+  std::string text;
+  // The whole response is buffered anyway, so streamed results are not cut into chunks and a
+  // failing streaming handler can still be answered with an error.
+  Handle(
+      message,
+      [&text](std::string_view chunk) {
+        text.append(chunk);
+        return true;
+      },
+      std::numeric_limits<size_t>::max());
+  return text;
+}
+
+Status Dispatcher::HandleMessage(const std::string_view message, const ChunkSink& sink) {
+  return Handle(message, sink, chunk_size_);
+}
+
+Status Dispatcher::Handle(const std::string_view message, const ChunkSink& sink,
+                          const size_t chunk_size) {
+  const auto received = Clock::now();
+  auto begin = received;
+  BatchRequest batch_request;
+  Json json;
+  auto status = ParseJsonText(message, parse_limits_, &json);
+  if (status.Ok()) {
+    status = batch_request.ParseJson(std::move(json));
+  }
+  const auto parse_ns = ElapsedNs(begin);
+  if (!status.Ok()) {
+    metrics_.RecordParse(Metrics::kUnknownSlot, parse_ns);
+    metrics_.RecordCall(Metrics::kUnknownSlot, false, true, 0);
+    Response response{Identifier()};
+    response.SetError({status.Code(), status.Message()});
+    return sink(response.ToJson().dump()) ? Status(kSuccess, "") : WriteFailed();
+  }
+
+  // Responses of a batch are separated as they are written. The array is opened lazily, since a
+  // batch of notifications is answered with nothing at all.
+  bool array_opened = false;
+  const auto begin_response = [&]() {
+    if (!batch_request.IsBatch()) {
+      return true;
+    }
+    const bool written = sink(array_opened ? "," : "[");
+    array_opened = true;
+    return written;
+  };
+  const auto discard = [](std::string_view chunk) { return true; };
+
+  // Parsing happens once for the whole message, so its cost is shared evenly between the
+  // requests it contains.
+  auto& requests = batch_request.Requests();
+  const uint64_t parse_share_ns = parse_ns / requests.size();
+  std::string text;
+  for (auto& [request, request_status] : requests) {
+    Response response;
+    size_t slot = Metrics::kUnknownSlot;
+    if (!request_status.Ok()) {
+      metrics_.RecordParse(slot, parse_share_ns);
+      metrics_.RecordCall(slot, false, true, 0);
+      response.SetError({request_status.Code(), request_status.Message()});
+    } else {
+      const auto* method = FindMethod(request);
+      slot = method != nullptr ? method->metrics_slot : Metrics::kUnknownSlot;
+      metrics_.RecordParse(slot, parse_share_ns);
+      // Later entries of a batch wait for the earlier ones, so default deadlines count from the
+      // arrival of the message.
+      ApplyTimeout(method, received, &request);
+      begin = Clock::now();
+      if (method != nullptr && method->streaming_handler && !Expired(request, begin)) {
+        const InFlight in_flight(this, &request);
+        const bool notification = request.IsNotification();
+        // The response is framed on its first chunk, since a cancelled one never gets any. The
+        // result is serialized while the handler runs, so only the time spent writing it out is
+        // told apart.
+        bool framed = false;
+        uint64_t serialize_ns = 0;
+        const auto framed_sink = [&](std::string_view chunk) {
+          const auto written = Clock::now();
+          if (!framed) {
+            framed = true;
+            if (!begin_response()) {
+              return false;
+            }
+          }
+          const bool delivered = sink(chunk);
+          serialize_ns += ElapsedNs(written);
+          return delivered;
+        };
+        auto outcome = StreamOutcome::kResult;
+        const auto stream_status =
+            Stream(*method, request, notification ? ChunkSink(discard) : ChunkSink(framed_sink),
+                   chunk_size, &outcome);
+        metrics_.RecordCall(slot, notification, outcome == StreamOutcome::kError, ElapsedNs(begin));
+        if (framed) {
+          metrics_.RecordSerialize(slot, serialize_ns);
+        }
+        if (!stream_status.Ok()) {
+          return stream_status;
+        }
+        continue;
+      }
+      if (!Dispatch(std::move(request), &response)) {
+        continue;
+      }
+    }
+    begin = Clock::now();
+    text.clear();
+    response.AppendTo(&text);
+    if (!begin_response() || !sink(text)) {
+      return WriteFailed();
+    }
+    metrics_.RecordSerialize(slot, ElapsedNs(begin));
+  }
+  if (array_opened && !sink("]")) {
+    return WriteFailed();
+  }
+  return {kSuccess, ""};
+}
+
+}  // namespace json_rpc
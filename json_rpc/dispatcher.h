@@ -0,0 +1,298 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "batch_request.h"
+#include "batch_response.h"
+#include "cancellation.h"
+#include "method_table.h"
+#include "metrics.h"
+#include "parse_limits.h"
+#include "request.h"
+#include "response.h"
+#include "result_writer.h"
+#include "schema_validator.h"
+#include "timer_wheel.h"
+
+namespace json_rpc {
+
+/// Reserved internal method returning the Metrics of the dispatcher.
+constexpr auto kMetricsMethod = "rpc.metrics";
+
+/// Notification cancelling a request in flight, as sent by LSP clients: params {"id": ...}.
+constexpr auto kCancelRequestMethod = "$/cancelRequest";
+
+/// Notification cancelling a request in flight, as sent by MCP clients: params {"requestId": ...}.
+constexpr auto kCancelledNotification = "notifications/cancelled";
+
+/// Scheduling class of a method, from the most to the least urgent. Schedulers serve the classes
+/// from separate queues.
+enum class Priority : int {
+  /// Requests that keep the session alive, such as initialize, ping or cancellation.
+  kControl = 0,
+  kDefault = 1,
+  /// Heavy requests that may wait behind everything else.
+  kBulk = 2,
+};
+
+/// The number of Priority classes.
+constexpr size_t kPriorityCount = 3;
+
+/// How the notifications of a method queued in a Scheduler are coalesced.
+enum class Coalescing : int {
+  /// Every notification runs.
+  kNone = 0,
+  /// A notification replaces the queued one with the same key, taking its place in the queue, so
+  /// only the latest of a flood runs, e.g. of progress notifications.
+  kLatestWins = 1,
+};
+
+/// Handler of one method. The returned Response is discarded for notifications.
+using MethodHandler = std::function<Response(const Request&)>;
+
+/// Handler of a method only sent as notifications, run without building a Response.
+using NotificationHandler = std::function<void(const Request&)>;
+
+/// Handler of one method writing its result incrementally. Returning an error Status before the
+/// result is finished answers the request with that error if nothing was flushed yet.
+using StreamingHandler = std::function<Status(const Request&, ResultWriter*)>;
+
+/// Routes Request objects to the handlers registered for their method and records per-method
+/// Metrics around parsing, handling and serialization. Method names are interned in
+/// MethodTable::Global() as they are registered, so requests are routed by their MethodId.
+///
+/// Methods are registered before the dispatcher starts serving; Dispatch() and HandleMessage() may
+/// then be called from any number of threads at once.
+///
+/// Every request in flight carries a CancellationToken, registered under its id until the handler
+/// returns. The kCancelRequestMethod and kCancelledNotification notifications cancel the token of
+/// the request they name; handlers poll it or register callbacks on it, and a request cancelled
+/// before its response was started gets no response at all. Request ids are matched across every
+/// caller of the dispatcher, so connections with overlapping ids should use their own dispatcher.
+///
+/// A request may carry a deadline, sent by the client or derived from the default timeout of its
+/// method when the message is received. A request whose deadline passed before it was dispatched
+/// is answered with kRequestTimeout without running its handler; one that runs past its deadline
+/// is cancelled, and answered with kRequestTimeout unless part of its response was already sent.
+/// Deadlines are tracked in TimerWheels sharded by thread, so that threads dispatching at once do
+/// not contend on one lock; each wheel is turned as requests arrive on its threads, and all of them
+/// by Tick().
+class Dispatcher {
+ public:
+  /// @brief Default constructor, registers the kMetricsMethod internal method and the
+  /// kCancelRequestMethod and kCancelledNotification notifications, all of them kControl.
+  Dispatcher();
+
+  Dispatcher(const Dispatcher&) = delete;
+  Dispatcher& operator=(const Dispatcher&) = delete;
+
+  /// @brief Registers the handler of a method, replacing any previous handler.
+  /// @param method The method name.
+  /// @param handler The handler invoked for requests of the method.
+  void RegisterMethod(const std::string& method, MethodHandler handler);
+
+  /// @brief Registers the handler of a method whose params must match a JSON Schema. The schema is
+  /// compiled once here; requests with mismatching params are answered with kInvalidParams without
+  /// invoking the handler.
+  /// @param method The method name.
+  /// @param handler The handler invoked for requests of the method.
+  /// @param params_schema The JSON Schema of the params.
+  /// @return A Status object indicating a kInvalidParams failure if the schema does not compile, in
+  /// which case the method is not registered.
+  Status RegisterMethod(const std::string& method, MethodHandler handler,
+                        const Json& params_schema);
+
+  /// @brief Registers a method whose handler streams its result through a ResultWriter, replacing
+  /// any previous handler.
+  /// @param method The method name.
+  /// @param handler The handler invoked for requests of the method.
+  void RegisterStreamingMethod(const std::string& method, StreamingHandler handler);
+
+  /// @brief Registers the handler of a method only sent as notifications, replacing any previous
+  /// handler. Notifications of the method skip the Response a MethodHandler returns; calls of it
+  /// are answered with kInvalidRequest.
+  /// @param method The method name.
+  /// @param handler The handler invoked for notifications of the method.
+  void RegisterNotification(const std::string& method, NotificationHandler handler);
+
+  /// @brief Sets the timeout of the requests of a method that carry no earlier deadline.
+  /// @param method The method name.
+  /// @param timeout The timeout from the time the request is received, or zero for none.
+  /// @return false if the method is not registered, otherwise true.
+  bool SetTimeout(const std::string& method, std::chrono::milliseconds timeout);
+
+  /// @brief Applies the default timeout of the method of a request, counted from now, unless the
+  /// request has an earlier deadline. HandleMessage() does this as a message arrives; callers
+  /// queuing requests before Dispatch() should do it as they are received.
+  /// @param request The request.
+  void ApplyTimeout(Request* request) const {
+    ApplyTimeout(FindMethod(*request), Request::Clock::now(), request);
+  }
+
+  /// @brief Sets the scheduling class of a method, kDefault unless set.
+  /// @param method The method name.
+  /// @param priority The scheduling class.
+  /// @return false if the method is not registered, otherwise true.
+  bool SetPriority(const std::string& method, Priority priority);
+
+  /// @brief Sets how the queued notifications of a method are coalesced, kNone unless set.
+  /// @param method The method name.
+  /// @param coalescing The coalescing policy.
+  /// @param key The params member whose value keys the notifications, so that e.g. the progress of
+  /// each token is coalesced separately; notifications without it are not coalesced. If empty,
+  /// all notifications of the method share one key.
+  /// @return false if the method is not registered, otherwise true.
+  bool SetCoalescing(const std::string& method, Coalescing coalescing, const std::string& key = "");
+
+  /// @brief Gets the key under which a queued notification is coalesced.
+  /// @param request The request.
+  /// @param key Receives the key, unique across methods.
+  /// @return false if the request is not coalesced, e.g. is a call or its method has no policy.
+  bool CoalescingKey(const Request& request, std::string* key) const;
+
+  /// @brief Gets the scheduling class of a request, from its method.
+  /// @param request The request.
+  /// @return The scheduling class, kDefault for unknown methods.
+  [[nodiscard]] Priority GetPriority(const Request& request) const {
+    const auto* method = FindMethod(request);
+    return method != nullptr ? method->priority : Priority::kDefault;
+  }
+
+  /// @brief Cancels the requests in flight whose deadline passed. Requests arriving do this too
+  /// for the requests of their shard, so a timer thread only needs to call it regularly for
+  /// handlers that would otherwise be left running while no request arrives on their threads.
+  void Tick();
+
+  /// @brief Sets the number of bytes a ResultWriter buffers before flushing to the sink.
+  /// @param chunk_size The chunk size in bytes.
+  void SetChunkSize(size_t chunk_size) {
+    chunk_size_ = chunk_size;
+  }
+
+  /// @brief Sets the limits enforced while parsing messages. Messages exceeding them are answered
+  /// with kInvalidRequest. Must be called before the dispatcher starts serving.
+  /// @param limits The parse limits.
+  void SetParseLimits(const ParseLimits& limits) {
+    parse_limits_ = limits;
+  }
+
+  /// @brief Gets the limits enforced while parsing messages.
+  /// @return The parse limits.
+  [[nodiscard]] const ParseLimits& GetParseLimits() const {
+    return parse_limits_;
+  }
+
+  /// @brief Handles a parsed request. The result of a streaming method is buffered in full.
+  /// @param request The request to handle, copied so that its cancellation token can be attached.
+  /// @param response Receives the response of the handler, or a kMethodNotFound, kInvalidParams or
+  /// kInternalError response.
+  /// @return true if the response must be sent, false for notifications and cancelled requests.
+  bool Dispatch(const Request& request, Response* response);
+
+  /// @brief Handles a parsed request in place, without copying it. The result of a streaming
+  /// method is buffered in full.
+  /// @param request The request to handle; its cancellation token is attached while it runs.
+  /// @param response Receives the response of the handler, or a kMethodNotFound, kInvalidParams or
+  /// kInternalError response.
+  /// @return true if the response must be sent, false for notifications and cancelled requests.
+  bool Dispatch(Request&& request, Response* response);
+
+  /// @brief Handles a parsed notification without building a Response, unless its method was
+  /// registered with a MethodHandler.
+  /// @param request The notification to handle.
+  void Notify(Request& request);
+
+  /// @brief Parses a single or batch request, dispatches it, and serializes the response.
+  /// @param message The JSON text of the request, parsed in place.
+  /// @return The JSON text of the response, or an empty string if nothing must be sent.
+  std::string HandleMessage(std::string_view message);
+
+  /// @brief Parses a single or batch request, dispatches it, and writes the response to a sink as
+  /// it is produced. Results of streaming methods reach the sink chunk by chunk.
+  /// @param message The JSON text of the request.
+  /// @param sink The sink receiving the JSON text of the response; it is not called if nothing
+  /// must be sent.
+  /// @return A Status object indicating failure if the sink failed or a streaming handler failed
+  /// after part of its result was sent, in which case the output is truncated.
+  Status HandleMessage(std::string_view message, const ChunkSink& sink);
+
+  /// @brief Gets the per-method metrics of the dispatcher.
+  /// @return The metrics object.
+  [[nodiscard]] const Metrics& GetMetrics() const {
+    return metrics_;
+  }
+
+  /// @brief Gets the registry of the requests in flight, to cancel them from outside a message.
+  /// @return The registry object.
+  [[nodiscard]] CancellationRegistry& Cancellations() {
+    return cancellations_;
+  }
+
+ private:
+  struct Method {
+    MethodHandler handler;
+    StreamingHandler streaming_handler;
+    NotificationHandler notification_handler;
+    std::unique_ptr<SchemaValidator> params_validator;
+    size_t metrics_slot = Metrics::kUnknownSlot;
+    std::chrono::milliseconds timeout{0};
+    Priority priority = Priority::kDefault;
+    Coalescing coalescing = Coalescing::kNone;
+    std::string coalescing_key;
+
+    [[nodiscard]] bool Registered() const {
+      return handler != nullptr || streaming_handler != nullptr ||
+             notification_handler != nullptr;
+    }
+  };
+
+  class InFlight;
+
+  // The deadlines of the requests of the threads mapped to one shard.
+  struct alignas(64) TimerShard {
+    std::mutex mutex;
+    TimerWheel<CancellationToken> wheel;
+  };
+
+  static constexpr size_t kTimerShards = 8;
+
+  /// How a streaming handler was answered.
+  enum class StreamOutcome { kResult, kError, kDropped };
+
+  [[nodiscard]] const Method* FindMethod(const Request& request) const;
+
+  Method* FindMethod(const std::string& method);
+
+  Method& AddMethod(const std::string& method);
+
+  static void ApplyTimeout(const Method* method, Request::Clock::time_point received,
+                           Request* request);
+
+  static void Invoke(const Method& method, const Request& request, Response* response);
+
+  // Runs a NotificationHandler, returning false if it threw.
+  static bool InvokeNotification(const Method& method, const Request& request);
+
+  Status Stream(const Method& method, const Request& request, const ChunkSink& sink,
+                size_t chunk_size, StreamOutcome* outcome) const;
+
+  Status Handle(std::string_view message, const ChunkSink& sink, size_t chunk_size);
+
+  Metrics metrics_;
+  CancellationRegistry cancellations_;
+  std::array<TimerShard, kTimerShards> timers_;
+  // Indexed by MethodId, entries of methods registered with other dispatchers stay empty.
+  std::vector<Method> methods_;
+  size_t chunk_size_ = ResultWriter::kDefaultChunkSize;
+  ParseLimits parse_limits_;
+};
+
+}  // namespace json_rpc
@@ -18,6 +18,7 @@ enum ErrorCode {
 
   // -32000 to -32099	Server error
   // Reserved for implementation-defined server-errors.
+  kRequestTimeout = -32001,
 };
 
 /// Error object
@@ -98,6 +99,13 @@ class Error {
   /// @return A JSON representation of the error.
   [[nodiscard]] Json ToJson() const;
 
+  /// @brief Resets the error to none, keeping the capacity of its message.
+  void Clear() {
+    code_ = kSuccess;
+    message_.clear();
+    data_ = nullptr;
+  }
+
  private:
   int code_ = kSuccess;
   std::string message_;
@@ -0,0 +1,200 @@
+
+#include "executor.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "error.h"
+#include "thread_affinity.h"
+
+namespace json_rpc {
+
+namespace {
+
+// Rounds of looking for work an idle worker spins before going to sleep.
+constexpr int kSpins = 64;
+
+// The executor and worker the current thread belongs to, if any.
+thread_local const Executor* current_executor = nullptr;
+thread_local size_t current_worker = 0;
+
+uint64_t NextRandom(uint64_t* seed) {
+  // xorshift64, enough to spread the victims of stealing.
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 7;
+  *seed ^= *seed << 17;
+  return *seed;
+}
+
+}  // namespace
+
+Executor::Executor(size_t threads, const bool pin_threads, const size_t queue_capacity)
+    : injected_(queue_capacity) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  // Every deque exists before any worker may steal from it.
+  workers_.reserve(threads);
+  for (size_t i = 0; i < threads; ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    workers_[i]->thread = std::thread([this, i] { Run(i); });
+    if (pin_threads) {
+      internal::PinThread(&workers_[i]->thread, i);
+    }
+  }
+}
+
+Executor::~Executor() {
+  Stop();
+}
+
+Status Executor::Submit(Task task) {
+  if (current_executor == this) {
+    // Tasks keep submitting while the executor drains. The task runs before the worker can exit,
+    // since the worker looks at its own deque first.
+    auto& worker = *workers_[current_worker];
+    worker.submitted.store(worker.submitted.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+    worker.deque.Push(new Task(std::move(task)));
+    Wake();
+    return {kSuccess, ""};
+  }
+  // Counted before checking, so that Stop() either refuses the task or waits for it to be queued.
+  injecting_.fetch_add(1, std::memory_order_seq_cst);
+  if (stopping_.load(std::memory_order_seq_cst)) {
+    injecting_.fetch_sub(1, std::memory_order_seq_cst);
+    return {kInternalError, "executor stopped"};
+  }
+  auto* owned = new Task(std::move(task));
+  if (auto* injected = owned; !injected_.TryPush(std::move(injected))) {
+    injecting_.fetch_sub(1, std::memory_order_seq_cst);
+    delete owned;
+    return {kInternalError, "executor queue full"};
+  }
+  injected_count_.fetch_add(1, std::memory_order_relaxed);
+  injecting_.fetch_sub(1, std::memory_order_seq_cst);
+  Wake();
+  return {kSuccess, ""};
+}
+
+size_t Executor::Pending() const {
+  auto pending = injected_count_.load(std::memory_order_relaxed);
+  // Wraps around for workers finishing tasks submitted by others, and adds up right.
+  for (const auto& worker : workers_) {
+    pending += worker->submitted.load(std::memory_order_relaxed) -
+               worker->finished.load(std::memory_order_relaxed);
+  }
+  return pending;
+}
+
+void Executor::Stop() {
+  stopping_.store(true, std::memory_order_seq_cst);
+  Wake(true);
+  for (auto& worker : workers_) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+}
+
+void Executor::Run(const size_t index) {
+  current_executor = this;
+  current_worker = index;
+  auto& worker = *workers_[index];
+  const auto drained = [this] {
+    return stopping_.load(std::memory_order_seq_cst) &&
+           injecting_.load(std::memory_order_seq_cst) == 0;
+  };
+  uint64_t seed = 0x9E3779B97F4A7C15ull * (index + 1);
+  int idle = 0;
+  for (;;) {
+    Task* task = nullptr;
+    if (Find(index, &seed, &task)) {
+      idle = 0;
+      Execute(&worker, task);
+      continue;
+    }
+    // Nothing is left to this worker: its own deque is empty, the tasks of the others are run by
+    // them, and no more are injected. A task injected before the check is found by looking again.
+    if (drained()) {
+      if (!Find(index, &seed, &task)) {
+        break;
+      }
+      Execute(&worker, task);
+      continue;
+    }
+    if (++idle < kSpins) {
+      std::this_thread::yield();
+      continue;
+    }
+    idle = 0;
+    // Counted as a sleeper before looking once more, so a task submitted from now on either is
+    // found here or wakes the worker.
+    const auto epoch = epoch_.load(std::memory_order_seq_cst);
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    if (Find(index, &seed, &task)) {
+      sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+      Execute(&worker, task);
+      continue;
+    }
+    // Stop() may have woken the workers before this one was counted, so it checks again rather
+    // than waiting for a notification that already went out.
+    {
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      wake_.wait(lock, [&] {
+        return epoch_.load(std::memory_order_seq_cst) != epoch || drained();
+      });
+    }
+    sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+  }
+  current_executor = nullptr;
+}
+
+void Executor::Execute(Worker* worker, Task* task) {
+  try {
+    (*task)();
+  } catch (...) {
+    // Tasks report their own failures, such as Dispatcher responses; one that throws is lost
+    // rather than taking the worker down.
+  }
+  delete task;
+  worker->finished.store(worker->finished.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+}
+
+bool Executor::Find(const size_t index, uint64_t* seed, Task** task) {
+  if (workers_[index]->deque.Pop(task) || injected_.TryPop(task)) {
+    return true;
+  }
+  const auto count = workers_.size();
+  const auto start = static_cast<size_t>(NextRandom(seed) % count);
+  for (size_t i = 0; i < count; ++i) {
+    const auto victim = (start + i) % count;
+    if (victim != index && workers_[victim]->deque.Steal(task)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Executor::Wake(const bool all) {
+  // Orders the task just queued before the count of sleepers, which a worker going to sleep raises
+  // before looking for tasks once more: either it finds the task or it is counted here. The epoch
+  // is only touched with sleepers, so a busy executor takes no shared read-modify-write per task.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!all && sleepers_.load(std::memory_order_seq_cst) == 0) {
+    return;
+  }
+  epoch_.fetch_add(1, std::memory_order_seq_cst);
+  // Taking the lock orders the notification after a sleeper checked the epoch.
+  std::lock_guard<std::mutex> lock(sleep_mutex_);
+  if (all) {
+    wake_.notify_all();
+  } else {
+    wake_.notify_one();
+  }
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mpmc_queue.h"
+#include "status.h"
+#include "work_stealing_deque.h"
+
+namespace json_rpc {
+
+/// Work-stealing thread pool for running handlers, such as Dispatcher::HandleMessage() calls.
+///
+/// Each worker owns a WorkStealingDeque. Tasks submitted from a worker, such as the requests of a
+/// batch fanned out by a handler, go to its own deque; tasks submitted from other threads, such as
+/// I/O threads, go to a shared lock-free MpmcQueue. An idle worker takes from its own deque first,
+/// then from the shared queue, then steals the oldest task of another worker, so no lock is taken
+/// while work is available. Workers that find nothing spin briefly and then sleep until a task is
+/// submitted.
+///
+/// Workers may be pinned to one CPU each, among those the process is allowed to run on, which keeps
+/// their deques and caches on one core.
+class Executor {
+ public:
+  using Task = std::function<void()>;
+
+  static constexpr size_t kDefaultQueueCapacity = 1 << 16;
+
+  /// @brief Constructor, starts the worker threads.
+  /// @param threads The number of worker threads, or zero for one per hardware thread.
+  /// @param pin_threads Whether worker i is bound to the i-th CPU, modulo their number, of the
+  /// affinity mask of the process. Only supported on Linux and ignored elsewhere.
+  /// @param queue_capacity The number of tasks the shared queue holds from other threads.
+  explicit Executor(size_t threads = 0, bool pin_threads = false,
+                    size_t queue_capacity = kDefaultQueueCapacity);
+
+  Executor(const Executor&) = delete;
+  Executor& operator=(const Executor&) = delete;
+
+  /// @brief Destructor, runs the submitted tasks and stops the worker threads.
+  ~Executor();
+
+  /// @brief Submits a task. Called by any thread, including from a task.
+  /// @param task The task.
+  /// @return A Status object indicating failure if the executor is stopped, or if the shared queue
+  /// is full, in which case the task is not run.
+  Status Submit(Task task);
+
+  /// @brief Runs the submitted tasks, including those they submit, and stops the worker threads.
+  /// Later tasks are refused. Must not be called from a task.
+  void Stop();
+
+  /// @brief Gets the number of worker threads.
+  /// @return The number of worker threads.
+  [[nodiscard]] size_t Threads() const {
+    return workers_.size();
+  }
+
+  /// @brief Gets the number of tasks submitted and not finished yet, a snapshot while tasks run.
+  /// @return The number of pending tasks.
+  [[nodiscard]] size_t Pending() const;
+
+ private:
+  struct Worker {
+    WorkStealingDeque<Task*> deque;
+    std::thread thread;
+    // Tasks this worker submitted and finished, each only written by the worker, on a cache line of
+    // their own, so counting takes no read-modify-write on memory shared between workers.
+    alignas(64) std::atomic<size_t> submitted{0};
+    std::atomic<size_t> finished{0};
+  };
+
+  void Run(size_t index);
+
+  bool Find(size_t index, uint64_t* seed, Task** task);
+
+  void Execute(Worker* worker, Task* task);
+
+  void Wake(bool all = false);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  MpmcQueue<Task*> injected_;
+  // Tasks submitted from other threads, and those threads still submitting, which Stop() waits
+  // for. Tasks submitted by workers are counted by the workers.
+  std::atomic<size_t> injected_count_{0};
+  std::atomic<size_t> injecting_{0};
+  std::atomic<bool> stopping_{false};
+  // Only used for sleeping workers, off the path of tasks.
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  std::atomic<uint64_t> epoch_{0};
+  std::atomic<size_t> sleepers_{0};
+};
+
+}  // namespace json_rpc
@@ -0,0 +1,76 @@
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include "json_rpc/batch_request.h"
+#include "json_rpc/dispatcher.h"
+#include "json_rpc/parse_limits.h"
+
+namespace {
+
+json_rpc::ParseLimits SmallLimits() {
+  json_rpc::ParseLimits limits;
+  limits.max_message_bytes = 4096;
+  limits.max_depth = 8;
+  limits.max_batch_size = 16;
+  limits.max_string_length = 64;
+  limits.max_object_members = 16;
+  return limits;
+}
+
+// Checks that a parsed value is within the limits.
+void Check(const json_rpc::Json& json, const json_rpc::ParseLimits& limits, const size_t depth) {
+  if (json.is_string() && json.get_ref<const std::string&>().size() > limits.max_string_length) {
+    std::abort();
+  }
+  if (!json.is_structured()) {
+    return;
+  }
+  if (depth > limits.max_depth) {
+    std::abort();
+  }
+  if (json.is_object() && json.size() > limits.max_object_members) {
+    std::abort();
+  }
+  for (auto it = json.begin(); it != json.end(); ++it) {
+    if (json.is_object() && it.key().size() > limits.max_string_length) {
+      std::abort();
+    }
+    Check(*it, limits, depth + 1);
+  }
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  static const auto limits = SmallLimits();
+  static auto* dispatcher = [] {
+    auto* d = new json_rpc::Dispatcher();
+    d->RegisterMethod("echo", [](const json_rpc::Request& request) {
+      json_rpc::Response response(request.Id());
+      response.SetResult(request.Params().ToJson());
+      return response;
+    });
+    d->SetParseLimits(limits);
+    return d;
+  }();
+
+  const std::string text(reinterpret_cast<const char*>(data), size);
+  json_rpc::Json json;
+  if (json_rpc::ParseJsonText(text, limits, &json).Ok()) {
+    if (text.size() > limits.max_message_bytes) {
+      std::abort();
+    }
+    if (json.is_array() && json.size() > limits.max_batch_size) {
+      std::abort();
+    }
+    Check(json, limits, 1);
+  }
+
+  json_rpc::BatchRequest batch;
+  batch.ParseJson(text, limits);
+  dispatcher->HandleMessage(text);
+  return 0;
+}
@@ -31,7 +31,8 @@ bool Identifier::ParseJson(const Json& json) {
   }
   if (json.is_string()) {
     type_ = IdType::kString;
-    string_id_ = json.get<std::string>();
+    // Assigned rather than replaced, so a recycled identifier reuses its buffer.
+    string_id_.assign(json.get_ref<const std::string&>());
     return true;
   }
   return false;
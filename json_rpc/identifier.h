@@ -1,7 +1,9 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <string>
 
 #include "json.h"
@@ -40,6 +42,13 @@ class Identifier {
   /// @return true if the JSON is a valid identifier, otherwise false.
   bool ParseJson(const Json& json);
 
+  /// @brief Resets the identifier to null, keeping the capacity of its string.
+  void Clear() {
+    type_ = IdType::kNull;
+    int_id_ = 0;
+    string_id_.clear();
+  }
+
   /// @brief Gets the type of the identifier.
   /// @return The identifier type (kNull, kNumber, or kString).
   [[nodiscard]] const IdType& Type() const {
@@ -58,6 +67,23 @@ class Identifier {
     return string_id_;
   }
 
+  /// @brief Compares two identifiers by type and value.
+  /// @param other The identifier to compare with.
+  /// @return true if both identifiers have the same type and value, otherwise false.
+  bool operator==(const Identifier& other) const {
+    if (type_ != other.type_) {
+      return false;
+    }
+    if (type_ == IdType::kNumber) {
+      return int_id_ == other.int_id_;
+    }
+    return type_ == IdType::kNull || string_id_ == other.string_id_;
+  }
+
+  bool operator!=(const Identifier& other) const {
+    return !(*this == other);
+  }
+
  protected:
   IdType type_ = IdType::kNull;
   int64_t int_id_ = 0;
@@ -65,3 +91,21 @@ class Identifier {
 };
 
 }  // namespace json_rpc
+
+namespace std {
+
+template <>
+struct hash<json_rpc::Identifier> {
+  size_t operator()(const json_rpc::Identifier& id) const noexcept {
+    switch (id.Type()) {
+      case json_rpc::Identifier::IdType::kNumber:
+        return hash<int64_t>()(id.IntId());
+      case json_rpc::Identifier::IdType::kString:
+        return hash<string>()(id.StringId());
+      default:
+        return 0;
+    }
+  }
+};
+
+}  // namespace std
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "dispatcher.h"
+#include "error.h"
+#include "request.h"
+#include "response.h"
+
+namespace json_rpc {
+
+namespace internal {
+
+template <typename T, typename = void>
+struct HasBefore : std::false_type {};
+
+template <typename T>
+struct HasBefore<T,
+                 std::void_t<decltype(std::declval<T&>().Before(std::declval<const Request&>(),
+                                                                std::declval<Response*>()))>>
+    : std::true_type {};
+
+template <typename T, typename = void>
+struct HasAfter : std::false_type {};
+
+template <typename T>
+struct HasAfter<T,
+                std::void_t<decltype(std::declval<T&>().After(std::declval<const Request&>(),
+                                                              std::declval<Response*>()))>>
+    : std::true_type {};
+
+}  // namespace internal
+
+/// A chain of interceptors run around a method handler, e.g. for authentication, logging, tracing
+/// or validation. An interceptor is any type providing one or both of:
+///
+///   bool Before(const Request& request, Response* response);
+///   void After(const Request& request, Response* response);
+///
+/// Before() runs in chain order ahead of the handler and may stop the call by filling in the
+/// response and returning false. After() runs in reverse order once the response is known, for
+/// every interceptor whose Before() ran, even if a later Before() or the handler threw: the
+/// exception becomes the kInternalError response the Dispatcher answers it with. The response is
+/// created once with the request id and passed by pointer, so no layer copies it.
+///
+/// The chain is a template parameter pack: every layer is inlined into a single call, and wrapping
+/// it into a MethodHandler adds one indirect call for the whole chain rather than one per layer.
+/// A wrapped chain is shared by all threads dispatching its method, so interceptors with state must
+/// synchronize it themselves.
+template <typename... Interceptors>
+class InterceptorChain {
+  static_assert(((internal::HasBefore<Interceptors>::value ||
+                  internal::HasAfter<Interceptors>::value) &&
+                 ...),
+                "an interceptor must provide Before() or After()");
+
+ public:
+  /// @brief Constructor with the interceptors, in the order their Before() runs.
+  /// @param interceptors The interceptors of the chain.
+  explicit InterceptorChain(Interceptors... interceptors)
+      : interceptors_(std::move(interceptors)...) {
+  }
+
+  /// @brief Runs a request through the chain and the handler.
+  /// @param request The request to handle.
+  /// @param handler The handler, invoked as handler(request) and returning a Response.
+  /// @return The response after all interceptors ran.
+  template <typename Handler>
+  Response Invoke(const Request& request, Handler& handler) {
+    Response response(request.Id());
+    Run<0>(request, &response, handler);
+    return response;
+  }
+
+  /// @brief Wraps a handler into a MethodHandler that runs it through the chain.
+  /// @param handler The handler, invoked as handler(request) and returning a Response.
+  /// @return The handler to register with a Dispatcher.
+  template <typename Handler>
+  MethodHandler Wrap(Handler handler) const {
+    return [chain = *this, handler = std::move(handler)](const Request& request) mutable {
+      return chain.Invoke(request, handler);
+    };
+  }
+
+ private:
+  template <size_t I, typename Handler>
+  void Run(const Request& request, Response* response, Handler& handler) {
+    if constexpr (I == sizeof...(Interceptors)) {
+      *response = handler(request);
+    } else {
+      using Interceptor = std::tuple_element_t<I, std::tuple<Interceptors...>>;
+      auto& interceptor = std::get<I>(interceptors_);
+      bool proceed = true;
+      if constexpr (internal::HasBefore<Interceptor>::value) {
+        proceed = interceptor.Before(request, response);
+      }
+      if constexpr (internal::HasAfter<Interceptor>::value) {
+        if (proceed) {
+          try {
+            Run<I + 1>(request, response, handler);
+          } catch (...) {
+            *response = Response(request.Id());
+            response->SetError({kInternalError, "Internal error"});
+          }
+        }
+        interceptor.After(request, response);
+      } else if (proceed) {
+        // Without an After(), an exception is left to the layers around, or to the Dispatcher.
+        Run<I + 1>(request, response, handler);
+      }
+    }
+  }
+
+  std::tuple<Interceptors...> interceptors_;
+};
+
+}  // namespace json_rpc
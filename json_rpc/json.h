@@ -1,6 +1,8 @@
 
 #pragma once
 
+#include <string>
+
 #include "nlohmann/json.hpp"
 
 namespace json_rpc {
@@ -16,5 +18,18 @@ constexpr auto kErrorName = "error";
 constexpr auto kCodeName = "code";
 constexpr auto kMessageName = "message";
 constexpr auto kDataName = "data";
+constexpr auto kTimeoutName = "timeoutMs";
+
+/// @brief Serializes a JSON value compactly with Json::dump(), appending to a string.
+/// @param json The JSON value to serialize.
+/// @param out The string to append to.
+inline void AppendJson(const Json& json, std::string* out) {
+  if (out->empty()) {
+    // Taken over rather than copied.
+    *out = json.dump();
+  } else {
+    out->append(json.dump());
+  }
+}
 
 }  // namespace json_rpc
\ No newline at end of file
@@ -3,5 +3,27 @@
 
 #include "batch_request.h"
 #include "batch_response.h"
+#include "bulk.h"
+#include "cancellation.h"
+#include "capture_log.h"
+#include "coalescing_client.h"
+#include "compression.h"
+#include "connection_pool.h"
+#include "dispatcher.h"
+#include "executor.h"
+#include "interceptor.h"
+#include "method_table.h"
+#include "object_pool.h"
+#include "parse_limits.h"
+#include "peer.h"
+#include "raw_json.h"
+#include "replay.h"
 #include "request.h"
-#include "response.h"
\ No newline at end of file
+#include "response.h"
+#include "result_writer.h"
+#include "scheduler.h"
+#include "schema_validator.h"
+#include "sharded_server.h"
+#include "shm_transport.h"
+#include "subscription.h"
+#include "typed_result.h"
\ No newline at end of file
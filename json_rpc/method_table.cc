@@ -0,0 +1,91 @@
+
+#include "method_table.h"
+
+#include <functional>
+
+namespace json_rpc {
+
+namespace {
+
+constexpr size_t kInitialCapacity = 64;
+
+}  // namespace
+
+MethodTable::Snapshot::Snapshot(const size_t capacity)
+    : capacity(capacity),
+      slots(new std::atomic<MethodId>[capacity]()),
+      names(new const std::string*[capacity / 2]()) {}
+
+MethodId MethodTable::Lookup(const Snapshot& snapshot, const std::string_view name) {
+  const auto mask = snapshot.capacity - 1;
+  // Ends on a free slot at the latest, since the table is at most half full.
+  for (auto i = std::hash<std::string_view>()(name) & mask;; i = (i + 1) & mask) {
+    const auto id = snapshot.slots[i].load(std::memory_order_acquire);
+    if (id == kUnknownMethodId || *snapshot.names[id - 1] == name) {
+      return id;
+    }
+  }
+}
+
+void MethodTable::Insert(Snapshot* snapshot, const std::string* name, const MethodId id) {
+  const auto mask = snapshot->capacity - 1;
+  auto i = std::hash<std::string_view>()(*name) & mask;
+  while (snapshot->slots[i].load(std::memory_order_relaxed) != kUnknownMethodId) {
+    i = (i + 1) & mask;
+  }
+  snapshot->names[id - 1] = name;
+  snapshot->slots[i].store(id, std::memory_order_release);
+  snapshot->size.store(id, std::memory_order_release);
+}
+
+MethodTable& MethodTable::Global() {
+  static MethodTable table;
+  return table;
+}
+
+MethodId MethodTable::Intern(const std::string_view name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto* current = snapshots_.empty() ? nullptr : snapshots_.back().get();
+  if (current != nullptr) {
+    if (const auto id = Lookup(*current, name); id != kUnknownMethodId) {
+      return id;
+    }
+  }
+  const auto& interned = names_.emplace_back(name);
+  const auto id = static_cast<MethodId>(names_.size());
+  if (current != nullptr && 2 * names_.size() <= current->capacity) {
+    Insert(current, &interned, id);
+    return id;
+  }
+  auto next = std::make_unique<Snapshot>(current != nullptr ? 2 * current->capacity
+                                                            : kInitialCapacity);
+  for (size_t i = 0; i < names_.size(); ++i) {
+    Insert(next.get(), &names_[i], static_cast<MethodId>(i + 1));
+  }
+  snapshot_.store(next.get(), std::memory_order_release);
+  snapshots_.push_back(std::move(next));
+  return id;
+}
+
+MethodId MethodTable::Find(const std::string_view name, const std::string** interned) const {
+  const auto* snapshot = snapshot_.load(std::memory_order_acquire);
+  if (snapshot != nullptr) {
+    if (const auto id = Lookup(*snapshot, name); id != kUnknownMethodId) {
+      if (interned != nullptr) {
+        *interned = snapshot->names[id - 1];
+      }
+      return id;
+    }
+  }
+  if (interned != nullptr) {
+    *interned = nullptr;
+  }
+  return kUnknownMethodId;
+}
+
+size_t MethodTable::Size() const {
+  const auto* snapshot = snapshot_.load(std::memory_order_acquire);
+  return snapshot != nullptr ? snapshot->size.load(std::memory_order_acquire) : 0;
+}
+
+}  // namespace json_rpc
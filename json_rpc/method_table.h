@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace json_rpc {
+
+/// Small integer standing for an interned method name.
+using MethodId = uint32_t;
+
+/// The MethodId of a method name that was never interned.
+constexpr MethodId kUnknownMethodId = 0;
+
+/// Interning table of method names, mapping each name to a MethodId.
+///
+/// Methods are interned as they are registered with a Dispatcher, and requests resolve their
+/// method against the table as they are parsed. A request for a known method then refers to the
+/// interned name instead of owning a copy of it, and is routed by indexing an array with its
+/// MethodId. Names are never removed, so ids and references to interned names stay valid for the
+/// lifetime of the process.
+///
+/// Thread-safe. Lookups read an immutable snapshot of the table without locking or writing to
+/// shared memory, so parsing on many cores at once does not bounce a cache line between them.
+/// Intern() adds to the snapshot in place while it has room, and otherwise copies it into one
+/// twice the size, so interning n names takes O(n) time and memory overall.
+class MethodTable {
+ public:
+  /// @brief Gets the table shared by every Request and Dispatcher of the process.
+  /// @return The global table.
+  static MethodTable& Global();
+
+  MethodTable() = default;
+
+  MethodTable(const MethodTable&) = delete;
+  MethodTable& operator=(const MethodTable&) = delete;
+
+  /// @brief Interns a method name.
+  /// @param name The method name.
+  /// @return The id of the name, the same for every call with an equal name.
+  MethodId Intern(std::string_view name);
+
+  /// @brief Looks up an interned method name.
+  /// @param name The method name.
+  /// @param interned Receives the interned copy of the name, or nullptr if it is not interned.
+  /// @return The id of the name, or kUnknownMethodId if it is not interned.
+  MethodId Find(std::string_view name, const std::string** interned = nullptr) const;
+
+  /// @brief Gets the number of interned names.
+  /// @return The number of interned names; ids run from 1 to it.
+  [[nodiscard]] size_t Size() const;
+
+ private:
+  // An open addressing hash table of a fixed capacity, kept at most half full. Each entry is
+  // published by a release store of its slot, so it can be filled while lookups read it.
+  struct Snapshot {
+    explicit Snapshot(size_t capacity);
+
+    size_t capacity;
+    // The id of the name in each slot, kUnknownMethodId for a free slot.
+    std::unique_ptr<std::atomic<MethodId>[]> slots;
+    // The interned name of each id, at index id - 1.
+    std::unique_ptr<const std::string*[]> names;
+    std::atomic<size_t> size{0};
+  };
+
+  static MethodId Lookup(const Snapshot& snapshot, std::string_view name);
+
+  static void Insert(Snapshot* snapshot, const std::string* name, MethodId id);
+
+  std::atomic<const Snapshot*> snapshot_{nullptr};
+  // Guards the members below, only used by Intern().
+  std::mutex mutex_;
+  // A deque never moves its elements, so the views keying the snapshots stay valid.
+  std::deque<std::string> names_;
+  // Snapshots are never freed, since a lookup may still be reading an old one. Each is half the
+  // size of the next, so the old ones take less memory than the current one.
+  std::vector<std::unique_ptr<Snapshot>> snapshots_;
+};
+
+}  // namespace json_rpc
@@ -0,0 +1,330 @@
+
+#include "metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+namespace json_rpc {
+
+namespace {
+
+constexpr uint64_t kMaxHistogramValue = (uint64_t{1} << LatencyHistogram::kMaxExponent) - 1;
+
+// Index of the highest set bit, value must not be zero.
+size_t HighestBit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+  return 63 - static_cast<size_t>(__builtin_clzll(value));
+#else
+  size_t bit = 0;
+  while (value >>= 1) {
+    ++bit;
+  }
+  return bit;
+#endif
+}
+
+// Counters of a shard have a single writer, so a relaxed load and store is enough and avoids the
+// locked read-modify-write a fetch_add would cost.
+void Bump(std::atomic<uint64_t>& counter, uint64_t delta) {
+  counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+std::atomic<uint64_t> next_instance_id{1};
+
+// The Metrics alive, so that threads can drop what they cached for destroyed ones.
+struct Instances {
+  std::mutex mutex;
+  std::unordered_set<uint64_t> live;
+  // Bumped whenever a Metrics is destroyed.
+  std::atomic<uint64_t> retired{0};
+};
+
+// Never destroyed, since Metrics of static storage duration may be destroyed after it otherwise.
+Instances& GetInstances() {
+  static auto* instances = new Instances();
+  return *instances;
+}
+
+}  // namespace
+
+size_t LatencyHistogram::BucketIndex(uint64_t value) {
+  value = std::min(value, kMaxHistogramValue);
+  if (value < kSubBucketCount) {
+    return static_cast<size_t>(value);
+  }
+  const size_t exponent = HighestBit(value);
+  const size_t sub_bucket = (value >> (exponent - kSubBucketBits)) & (kSubBucketCount - 1);
+  return (exponent - kSubBucketBits + 1) * kSubBucketCount + sub_bucket;
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(size_t index) {
+  if (index < kSubBucketCount) {
+    return index;
+  }
+  const size_t exponent = index / kSubBucketCount + kSubBucketBits - 1;
+  const size_t shift = exponent - kSubBucketBits;
+  const uint64_t lower = (kSubBucketCount + index % kSubBucketCount) << shift;
+  return lower + (uint64_t{1} << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t value) {
+  ++buckets_[BucketIndex(value)];
+  ++count_;
+  sum_ += value;
+  max_ = std::max(max_, value);
+}
+
+void LatencyHistogram::AddBucket(size_t index, uint64_t count) {
+  buckets_[index] += count;
+  count_ += count;
+}
+
+void LatencyHistogram::AddTotals(uint64_t sum, uint64_t max) {
+  sum_ += sum;
+  max_ = std::max(max_, max);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    buckets_[i] += other.buckets_[i];
+  }
+  count_ += other.count_;
+  AddTotals(other.sum_, other.max_);
+}
+
+uint64_t LatencyHistogram::Percentile(double quantile) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  quantile = std::clamp(quantile, 0.0, 1.0);
+  const auto rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(quantile * static_cast<double>(count_))));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      return std::min(BucketUpperBound(i), max_);
+    }
+  }
+  return max_;
+}
+
+Json LatencyHistogram::ToJson() const {
+  return Json{{"count", count_},
+              {"sum_ns", sum_},
+              {"max_ns", max_},
+              {"p50_ns", Percentile(0.5)},
+              {"p90_ns", Percentile(0.9)},
+              {"p99_ns", Percentile(0.99)},
+              {"p999_ns", Percentile(0.999)}};
+}
+
+Json MethodStats::ToJson() const {
+  return Json{{"requests", requests},
+              {"notifications", notifications},
+              {"errors", errors},
+              {"parse", parse.ToJson()},
+              {"handle", handle.ToJson()},
+              {"serialize", serialize.ToJson()}};
+}
+
+namespace {
+
+// Histogram written by a single thread and read by snapshots.
+struct ShardHistogram {
+  std::array<std::atomic<uint64_t>, LatencyHistogram::kBucketCount> buckets;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> max;
+
+  void Record(uint64_t value) {
+    value = std::min(value, kMaxHistogramValue);
+    Bump(buckets[LatencyHistogram::BucketIndex(value)], 1);
+    Bump(sum, value);
+    if (value > max.load(std::memory_order_relaxed)) {
+      max.store(value, std::memory_order_relaxed);
+    }
+  }
+
+  void MergeInto(LatencyHistogram* histogram) const {
+    for (size_t i = 0; i < buckets.size(); ++i) {
+      if (const auto count = buckets[i].load(std::memory_order_relaxed); count != 0) {
+        histogram->AddBucket(i, count);
+      }
+    }
+    histogram->AddTotals(sum.load(std::memory_order_relaxed), max.load(std::memory_order_relaxed));
+  }
+};
+
+}  // namespace
+
+struct Metrics::Cell {
+  std::atomic<uint64_t> requests;
+  std::atomic<uint64_t> notifications;
+  std::atomic<uint64_t> errors;
+  ShardHistogram parse;
+  ShardHistogram handle;
+  ShardHistogram serialize;
+};
+
+// Cells are allocated lazily, in chunks of slots, the first time a thread records a method, so a
+// shard only pays for the methods its thread has seen. Slots past the last chunk are recorded as
+// kUnknownSlot.
+struct Metrics::Shard {
+  static constexpr size_t kChunkSize = 64;
+  static constexpr size_t kMaxChunks = 256;
+
+  using Chunk = std::array<std::atomic<Cell*>, kChunkSize>;
+
+  ~Shard() {
+    for (auto& chunk_ptr : chunks) {
+      const auto* chunk = chunk_ptr.load(std::memory_order_acquire);
+      if (chunk == nullptr) {
+        continue;
+      }
+      for (const auto& cell : *chunk) {
+        delete cell.load(std::memory_order_acquire);
+      }
+      delete chunk;
+    }
+  }
+
+  std::array<std::atomic<Chunk*>, kMaxChunks> chunks{};
+};
+
+Metrics::Metrics() : instance_id_(next_instance_id.fetch_add(1)) {
+  methods_.emplace_back(kUnknownMethodName);
+  auto& instances = GetInstances();
+  std::lock_guard<std::mutex> lock(instances.mutex);
+  instances.live.insert(instance_id_);
+}
+
+Metrics::~Metrics() {
+  auto& instances = GetInstances();
+  std::lock_guard<std::mutex> lock(instances.mutex);
+  instances.live.erase(instance_id_);
+  instances.retired.fetch_add(1, std::memory_order_release);
+}
+
+size_t Metrics::RegisterMethod(const std::string& method) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = std::find(methods_.begin(), methods_.end(), method);
+  if (it != methods_.end()) {
+    return static_cast<size_t>(it - methods_.begin());
+  }
+  methods_.push_back(method);
+  return methods_.size() - 1;
+}
+
+Metrics::Cell* Metrics::LocalCell(size_t slot) {
+  struct CachedShard {
+    uint64_t instance_id;
+    Shard* shard;
+  };
+  // Instance ids are never reused, so entries left behind by destroyed Metrics never match; they
+  // are dropped on the next miss.
+  static thread_local std::vector<CachedShard> cache;
+  static thread_local uint64_t pruned_at = 0;
+
+  Shard* shard = nullptr;
+  if (!cache.empty() && cache.back().instance_id == instance_id_) {
+    shard = cache.back().shard;
+  } else {
+    const auto it = std::find_if(cache.begin(), cache.end(), [this](const CachedShard& entry) {
+      return entry.instance_id == instance_id_;
+    });
+    if (it != cache.end()) {
+      shard = it->shard;
+      std::swap(*it, cache.back());
+    } else {
+      auto& instances = GetInstances();
+      if (instances.retired.load(std::memory_order_acquire) != pruned_at) {
+        std::lock_guard<std::mutex> lock(instances.mutex);
+        cache.erase(std::remove_if(cache.begin(), cache.end(),
+                                   [&instances](const CachedShard& entry) {
+                                     return instances.live.count(entry.instance_id) == 0;
+                                   }),
+                    cache.end());
+        pruned_at = instances.retired.load(std::memory_order_relaxed);
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      shard = shards_.emplace_back(std::make_unique<Shard>()).get();
+      cache.push_back({instance_id_, shard});
+    }
+  }
+
+  if (slot >= Shard::kChunkSize * Shard::kMaxChunks) {
+    slot = kUnknownSlot;
+  }
+  auto& chunk_ptr = shard->chunks[slot / Shard::kChunkSize];
+  auto* chunk = chunk_ptr.load(std::memory_order_relaxed);
+  if (chunk == nullptr) {
+    chunk = new Shard::Chunk();
+    chunk_ptr.store(chunk, std::memory_order_release);
+  }
+  auto& cell_ptr = (*chunk)[slot % Shard::kChunkSize];
+  auto* cell = cell_ptr.load(std::memory_order_relaxed);
+  if (cell == nullptr) {
+    cell = new Cell();
+    cell_ptr.store(cell, std::memory_order_release);
+  }
+  return cell;
+}
+
+void Metrics::RecordCall(size_t slot, bool notification, bool error, uint64_t handle_ns) {
+  auto* cell = LocalCell(slot);
+  Bump(notification ? cell->notifications : cell->requests, 1);
+  if (error) {
+    Bump(cell->errors, 1);
+  }
+  cell->handle.Record(handle_ns);
+}
+
+void Metrics::RecordParse(size_t slot, uint64_t parse_ns) {
+  LocalCell(slot)->parse.Record(parse_ns);
+}
+
+void Metrics::RecordSerialize(size_t slot, uint64_t serialize_ns) {
+  LocalCell(slot)->serialize.Record(serialize_ns);
+}
+
+std::vector<MethodStats> Metrics::Snapshot() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<MethodStats> stats(methods_.size());
+  for (size_t slot = 0; slot < methods_.size(); ++slot) {
+    stats[slot].method = methods_[slot];
+  }
+  for (const auto& shard : shards_) {
+    for (size_t chunk_idx = 0; chunk_idx < Shard::kMaxChunks; ++chunk_idx) {
+      const auto* chunk = shard->chunks[chunk_idx].load(std::memory_order_acquire);
+      if (chunk == nullptr) {
+        continue;
+      }
+      for (size_t i = 0; i < Shard::kChunkSize; ++i) {
+        const size_t slot = chunk_idx * Shard::kChunkSize + i;
+        const auto* cell = (*chunk)[i].load(std::memory_order_acquire);
+        if (cell == nullptr || slot >= stats.size()) {
+          continue;
+        }
+        auto& method_stats = stats[slot];
+        method_stats.requests += cell->requests.load(std::memory_order_relaxed);
+        method_stats.notifications += cell->notifications.load(std::memory_order_relaxed);
+        method_stats.errors += cell->errors.load(std::memory_order_relaxed);
+        cell->parse.MergeInto(&method_stats.parse);
+        cell->handle.MergeInto(&method_stats.handle);
+        cell->serialize.MergeInto(&method_stats.serialize);
+      }
+    }
+  }
+  return stats;
+}
+
+Json Metrics::ToJson() const {
+  Json json = Json::object();
+  for (const auto& stats : Snapshot()) {
+    json[stats.method] = stats.ToJson();
+  }
+  return json;
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "json.h"
+
+namespace json_rpc {
+
+/// Log-linear latency histogram. Values below 2^kSubBucketBits are counted exactly, larger values
+/// fall into one of 2^kSubBucketBits linear sub-buckets of their power-of-two range, which bounds
+/// the relative error of any reported percentile to 1/2^kSubBucketBits.
+class LatencyHistogram {
+ public:
+  static constexpr size_t kSubBucketBits = 3;
+  static constexpr size_t kSubBucketCount = size_t{1} << kSubBucketBits;
+  /// Values are clamped to 2^kMaxExponent - 1 nanoseconds (about 18 minutes).
+  static constexpr size_t kMaxExponent = 40;
+  static constexpr size_t kBucketCount = (kMaxExponent - kSubBucketBits + 1) * kSubBucketCount;
+
+  /// @brief Gets the bucket a value is counted in.
+  /// @param value The value to look up.
+  /// @return The bucket index, always less than kBucketCount.
+  static size_t BucketIndex(uint64_t value);
+
+  /// @brief Gets the largest value counted in a bucket.
+  /// @param index The bucket index.
+  /// @return The inclusive upper bound of the bucket.
+  static uint64_t BucketUpperBound(size_t index);
+
+  /// @brief Records one value.
+  /// @param value The value to record.
+  void Record(uint64_t value);
+
+  /// @brief Adds one bucket worth of samples, used when merging shards.
+  /// @param index The bucket index.
+  /// @param count The number of samples in the bucket.
+  void AddBucket(size_t index, uint64_t count);
+
+  /// @brief Adds the sum and maximum of samples recorded elsewhere, used when merging shards.
+  /// @param sum The sum of the samples.
+  /// @param max The maximum of the samples.
+  void AddTotals(uint64_t sum, uint64_t max);
+
+  /// @brief Merges another histogram into this one.
+  /// @param other The histogram to merge.
+  void Merge(const LatencyHistogram& other);
+
+  /// @brief Gets the value at the given quantile.
+  /// @param quantile The quantile in [0, 1].
+  /// @return The upper bound of the bucket holding the quantile, or 0 if the histogram is empty.
+  [[nodiscard]] uint64_t Percentile(double quantile) const;
+
+  /// @brief Gets the number of recorded values.
+  /// @return The number of recorded values.
+  [[nodiscard]] uint64_t Count() const {
+    return count_;
+  }
+
+  /// @brief Gets the sum of recorded values.
+  /// @return The sum of recorded values.
+  [[nodiscard]] uint64_t Sum() const {
+    return sum_;
+  }
+
+  /// @brief Gets the largest recorded value.
+  /// @return The largest recorded value.
+  [[nodiscard]] uint64_t Max() const {
+    return max_;
+  }
+
+  /// @brief Converts the histogram summary to a JSON object.
+  /// @return The count, sum, max and common percentiles, in nanoseconds.
+  [[nodiscard]] Json ToJson() const;
+
+ private:
+  std::array<uint64_t, kBucketCount> buckets_{};
+  uint64_t count_ = 0;
+  uint64_t sum_ = 0;
+  uint64_t max_ = 0;
+};
+
+/// Merged counters and latency histograms of one method.
+struct MethodStats {
+  std::string method;
+  uint64_t requests = 0;
+  uint64_t notifications = 0;
+  uint64_t errors = 0;
+  LatencyHistogram parse;
+  LatencyHistogram handle;
+  LatencyHistogram serialize;
+
+  /// @brief Converts the statistics to a JSON object.
+  /// @return A JSON representation of the statistics.
+  [[nodiscard]] Json ToJson() const;
+};
+
+/// Per-method request, notification and error counters plus parse, handle and serialize latency
+/// histograms.
+///
+/// Every thread records into its own shard, so the recording path takes no lock and performs no
+/// atomic read-modify-write; shards are merged when a snapshot is read. Shards are owned by the
+/// Metrics object and outlive the threads that filled them; a thread drops its cached references to
+/// the shards of destroyed Metrics the next time it records into a Metrics new to it.
+///
+/// Methods are registered up front and referred to by slot. RegisterMethod() and Snapshot() may be
+/// called concurrently with recording.
+class Metrics {
+ public:
+  /// Slot used for requests whose method is not registered.
+  static constexpr size_t kUnknownSlot = 0;
+  /// Name reported for kUnknownSlot.
+  static constexpr auto kUnknownMethodName = "<unknown>";
+
+  /// @brief Default constructor.
+  Metrics();
+
+  ~Metrics();
+
+  Metrics(const Metrics&) = delete;
+  Metrics& operator=(const Metrics&) = delete;
+
+  /// @brief Registers a method, returning the slot it is recorded in.
+  /// @param method The method name.
+  /// @return The slot of the method, the same slot if it was registered before.
+  size_t RegisterMethod(const std::string& method);
+
+  /// @brief Records the handling of one request.
+  /// @param slot The method slot.
+  /// @param notification Whether the request was a notification.
+  /// @param error Whether handling produced an error.
+  /// @param handle_ns The handling time in nanoseconds.
+  void RecordCall(size_t slot, bool notification, bool error, uint64_t handle_ns);
+
+  /// @brief Records the time spent parsing one request.
+  /// @param slot The method slot.
+  /// @param parse_ns The parsing time in nanoseconds.
+  void RecordParse(size_t slot, uint64_t parse_ns);
+
+  /// @brief Records the time spent serializing one response.
+  /// @param slot The method slot.
+  /// @param serialize_ns The serialization time in nanoseconds.
+  void RecordSerialize(size_t slot, uint64_t serialize_ns);
+
+  /// @brief Merges all shards into per-method statistics.
+  /// @return The statistics of every registered method, ordered by slot.
+  [[nodiscard]] std::vector<MethodStats> Snapshot() const;
+
+  /// @brief Converts a snapshot to a JSON object keyed by method name.
+  /// @return A JSON representation of the current statistics.
+  [[nodiscard]] Json ToJson() const;
+
+ private:
+  struct Cell;
+  struct Shard;
+
+  Cell* LocalCell(size_t slot);
+
+  const uint64_t instance_id_;
+  mutable std::mutex mutex_;
+  std::vector<std::string> methods_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+}  // namespace json_rpc
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace json_rpc {
+
+/// Bounded lock-free queue for any number of producers and consumers.
+///
+/// Each cell carries a sequence number telling whether it is ready to be written or read for the
+/// current lap around the ring, so producers and consumers claim cells with a single
+/// compare-and-swap on their own counter and never wait on each other unless the queue is full or
+/// empty.
+template <typename T>
+class MpmcQueue {
+ public:
+  /// @brief Constructor.
+  /// @param capacity The maximum number of values, rounded up to a power of two.
+  explicit MpmcQueue(const size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    mask_ = size - 1;
+    cells_.reset(new Cell[size]);
+    for (size_t i = 0; i < size; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpmcQueue(const MpmcQueue&) = delete;
+  MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+  /// @brief Appends a value unless the queue is full.
+  /// @param value The value; left untouched if the queue is full.
+  /// @return false if the queue is full, otherwise true.
+  bool TryPush(T&& value) {
+    auto position = tail_.load(std::memory_order_relaxed);
+    for (;;) {
+      auto& cell = cells_[position & mask_];
+      const auto sequence = cell.sequence.load(std::memory_order_acquire);
+      const auto lap = static_cast<std::ptrdiff_t>(sequence - position);
+      if (lap == 0) {
+        if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          cell.value = std::move(value);
+          cell.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (lap < 0) {
+        return false;
+      } else {
+        position = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// @brief Takes the oldest value unless the queue is empty.
+  /// @param value Receives the value.
+  /// @return false if the queue is empty, otherwise true.
+  bool TryPop(T* value) {
+    auto position = head_.load(std::memory_order_relaxed);
+    for (;;) {
+      auto& cell = cells_[position & mask_];
+      const auto sequence = cell.sequence.load(std::memory_order_acquire);
+      const auto lap = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+      if (lap == 0) {
+        if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          *value = std::move(cell.value);
+          cell.sequence.store(position + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (lap < 0) {
+        return false;
+      } else {
+        position = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// @brief Gets the number of values in the queue, as seen at some point during the call.
+  /// @return The number of values.
+  [[nodiscard]] size_t Size() const {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    const auto head = head_.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+  }
+
+  /// @brief Gets the maximum number of values.
+  /// @return The capacity.
+  [[nodiscard]] size_t Capacity() const {
+    return mask_ + 1;
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence{0};
+    T value{};
+  };
+
+  size_t mask_ = 0;
+  std::unique_ptr<Cell[]> cells_;
+  // Kept on separate cache lines, since producers write tail_ and consumers head_.
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+};
+
+}  // namespace json_rpc
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace json_rpc {
+
+/// A pool of recyclable objects, such as Request, Response or BatchResponse.
+///
+/// Objects are handed out by Acquire() and come back to the pool when their handle is destroyed,
+/// after a call to their Clear(). Clear() keeps the capacity of the strings and containers of an
+/// object, so once the pool is warm, parsing a request or building a response of a size seen
+/// before reuses the memory of an earlier one instead of allocating.
+///
+/// Not thread-safe: a pool is meant to be owned by one thread or one connection, and must outlive
+/// the handles it gave out.
+template <typename T>
+class ObjectPool {
+ public:
+  static constexpr size_t kDefaultMaxSize = 64;
+
+  /// Returns an object to the pool it came from.
+  class Recycler {
+   public:
+    Recycler() = default;
+
+    explicit Recycler(ObjectPool* pool) : pool_(pool) {}
+
+    void operator()(T* object) const {
+      if (pool_ != nullptr) {
+        pool_->Release(object);
+      } else {
+        delete object;
+      }
+    }
+
+   private:
+    ObjectPool* pool_ = nullptr;
+  };
+
+  using Handle = std::unique_ptr<T, Recycler>;
+
+  /// @brief Constructor.
+  /// @param max_size The number of idle objects kept; objects released beyond it are deleted.
+  explicit ObjectPool(const size_t max_size = kDefaultMaxSize) : max_size_(max_size) {}
+
+  ObjectPool(const ObjectPool&) = delete;
+  ObjectPool& operator=(const ObjectPool&) = delete;
+
+  /// @brief Takes an idle object from the pool, or creates one if there is none.
+  /// @return The object, in the state of a default constructed one.
+  Handle Acquire() {
+    if (idle_.empty()) {
+      return Handle(new T(), Recycler(this));
+    }
+    auto object = std::move(idle_.back());
+    idle_.pop_back();
+    return Handle(object.release(), Recycler(this));
+  }
+
+  /// @brief Gets the number of idle objects in the pool.
+  /// @return The number of idle objects.
+  [[nodiscard]] size_t Size() const {
+    return idle_.size();
+  }
+
+ private:
+  void Release(T* object) {
+    std::unique_ptr<T> owned(object);
+    if (idle_.size() < max_size_) {
+      owned->Clear();
+      idle_.push_back(std::move(owned));
+    }
+  }
+
+  const size_t max_size_;
+  std::vector<std::unique_ptr<T>> idle_;
+};
+
+}  // namespace json_rpc
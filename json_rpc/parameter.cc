@@ -1,12 +1,71 @@
 
 #include "parameter.h"
 
+#include <type_traits>
+#include <utility>
+
 namespace json_rpc {
 
+namespace {
+
+// The value of a member, to be moved when its object is an rvalue.
+template <typename Object, typename Value>
+decltype(auto) ValueOf(Value& value) {
+  if constexpr (std::is_lvalue_reference_v<Object>) {
+    return static_cast<const Json&>(value);
+  } else {
+    return std::move(value);
+  }
+}
+
+// Copies, or moves for an rvalue, the members of a JSON object into an empty map. Nodes are taken
+// from the spare ones before new ones are allocated, so parsing into a recycled parameter does not
+// allocate for objects no larger than the previous ones.
+template <typename Object>
+void AssignObject(Object&& object, std::map<std::string, Json>* map,
+                  std::map<std::string, Json>* spare) {
+  using Source = std::remove_cv_t<std::remove_reference_t<Object>>;
+  if constexpr (std::is_same_v<Source, std::map<std::string, Json>> &&
+                !std::is_lvalue_reference_v<Object>) {
+    *map = std::move(object);
+  } else {
+    // Newer JSON versions use a transparent comparator, so only the values can be moved.
+    for (auto& [key, value] : object) {
+      if (spare->empty()) {
+        map->emplace_hint(map->end(), key, ValueOf<Object>(value));
+        continue;
+      }
+      auto node = spare->extract(spare->begin());
+      node.key().assign(key);
+      node.mapped() = ValueOf<Object>(value);
+      map->insert(map->end(), std::move(node));
+    }
+  }
+}
+
+}  // namespace
+
 Parameter::Parameter(const Json& json) {
   ParseJson(json);
 }
 
+Parameter::Parameter(Json&& json) {
+  ParseJson(std::move(json));
+}
+
+Parameter::Parameter(const Parameter& other)
+    : type_(other.type_), array_(other.array_), map_(other.map_) {}
+
+Parameter& Parameter::operator=(const Parameter& other) {
+  if (this != &other) {
+    type_ = other.type_;
+    array_ = other.array_;
+    RecycleMap();
+    AssignObject(other.map_, &map_, &spare_);
+  }
+  return *this;
+}
+
 Json Parameter::ToJson() const {
   if (type_ == ParamType::kArray) {
     return array_;
@@ -20,20 +79,55 @@ Json Parameter::ToJson() const {
 void Parameter::ParseJson(const Json& json) {
   if (json.is_array()) {
     type_ = ParamType::kArray;
-    array_ = json.get<std::vector<Json>>();
+    const auto& array = json.get_ref<const Json::array_t&>();
+    array_.assign(array.begin(), array.end());
+    RecycleMap();
   } else if (json.is_object()) {
     type_ = ParamType::kMap;
-    map_ = json.get<std::map<std::string, Json>>();
+    RecycleMap();
+    AssignObject(json.get_ref<const Json::object_t&>(), &map_, &spare_);
+    array_.clear();
   } else {
-    type_ = ParamType::kNull;
+    Clear();
+  }
+}
+
+void Parameter::ParseJson(Json&& json) {
+  if (json.is_array()) {
+    type_ = ParamType::kArray;
+    // The array of a JSON value is a std::vector<Json> too, taken over as a whole.
+    array_ = std::move(json.get_ref<Json::array_t&>());
+    RecycleMap();
+  } else if (json.is_object()) {
+    type_ = ParamType::kMap;
+    RecycleMap();
+    AssignObject(std::move(json.get_ref<Json::object_t&>()), &map_, &spare_);
+    array_.clear();
+  } else {
+    Clear();
+  }
+}
+
+void Parameter::Clear() {
+  type_ = ParamType::kNull;
+  array_.clear();
+  RecycleMap();
+}
+
+void Parameter::RecycleMap() {
+  while (!map_.empty()) {
+    auto node = map_.extract(map_.begin());
+    node.mapped() = nullptr;
+    // A node whose key is spare already is released.
+    spare_.insert(std::move(node));
   }
 }
 
-Json Parameter::Get(const std::string& key) const {
+const Json& Parameter::Get(const std::string& key) const {
   return map_.at(key);
 }
 
-Json Parameter::Get(size_t idx) const {
+const Json& Parameter::Get(size_t idx) const {
   return array_.at(idx);
 }
 
@@ -33,6 +33,20 @@ class Parameter {
   /// @param json The JSON object to initialize the parameter.
   explicit Parameter(const Json& json);
 
+  /// @brief Constructor with a JSON object, moving its values.
+  /// @param json The JSON object to initialize the parameter.
+  explicit Parameter(Json&& json);
+
+  /// @brief Copy constructor. The map nodes kept for reuse are not copied.
+  Parameter(const Parameter& other);
+
+  /// @brief Copy assignment, reusing the map nodes of this parameter. The map nodes kept for reuse
+  /// by the other one are not copied.
+  Parameter& operator=(const Parameter& other);
+
+  Parameter(Parameter&&) = default;
+  Parameter& operator=(Parameter&&) = default;
+
   /// @brief Converts the parameter to a JSON object.
   /// @return A JSON representation of the parameter.
   [[nodiscard]] Json ToJson() const;
@@ -41,6 +55,14 @@ class Parameter {
   /// @param json The JSON object to parse.
   void ParseJson(const Json& json);
 
+  /// @brief Parses a JSON object into the parameter, moving its values.
+  /// @param json The JSON object to parse.
+  void ParseJson(Json&& json);
+
+  /// @brief Resets the parameter to null, keeping the capacity of its array and the nodes of its
+  /// map for the next ParseJson().
+  void Clear();
+
   /// @brief Gets the type of the parameter.
   /// @return The parameter type (kNull, kArray, or kMap).
   [[nodiscard]] ParamType Type() const {
@@ -63,13 +85,13 @@ class Parameter {
   /// @param key The key to look up in the map.
   /// @return The JSON value associated with the key.
   /// @note Before using this function, ensure the key exists using `Has(key)` or use `Get(key, default_value)`.
-  [[nodiscard]] Json Get(const std::string& key) const;
+  [[nodiscard]] const Json& Get(const std::string& key) const;
 
   /// @brief Gets a value from the parameter array by index.
   /// @param idx The index to look up in the array.
   /// @return The JSON value at the specified index.
   /// @note Before using this function, ensure the index exists using `Has(idx)` or use `Get(idx, default_value)`.
-  [[nodiscard]] Json Get(size_t idx) const;
+  [[nodiscard]] const Json& Get(size_t idx) const;
 
   /// @brief Checks if a key exists in the parameter map.
   /// @param key The key to check.
@@ -126,9 +148,13 @@ class Parameter {
   }
 
  private:
+  void RecycleMap();
+
   ParamType type_ = ParamType::kNull;
   std::vector<Json> array_;
   std::map<std::string, Json> map_;
+  // Nodes of earlier maps, with null values, reused by the next object parsed.
+  std::map<std::string, Json> spare_;
 };
 
 }  // namespace json_rpc
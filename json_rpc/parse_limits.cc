@@ -0,0 +1,195 @@
+
+#include "parse_limits.h"
+
+#include <utility>
+#include <vector>
+
+#include "error.h"
+
+namespace json_rpc {
+
+namespace {
+
+// SAX handler checking the limits as events arrive, and building the value from the events that
+// pass. Returning false stops the parser right away.
+class LimitedSax {
+ public:
+  LimitedSax(Json* json, const ParseLimits& limits) : root_(json), limits_(limits) {}
+
+  bool null() {
+    return Leaf(nullptr);
+  }
+
+  bool boolean(const bool value) {
+    return Leaf(value);
+  }
+
+  bool number_integer(const Json::number_integer_t value) {
+    return Leaf(value);
+  }
+
+  bool number_unsigned(const Json::number_unsigned_t value) {
+    return Leaf(value);
+  }
+
+  bool number_float(const Json::number_float_t value, const Json::string_t& text) {
+    return Leaf(value);
+  }
+
+  // The lexer starts the next token afresh, so its string can be taken over.
+  bool string(Json::string_t& value) {
+    return CheckString(value) && Leaf(std::move(value));
+  }
+
+  // Not produced by the JSON text parser, only required by the SAX interface of newer versions.
+  template <typename Binary>
+  bool binary(Binary& value) {
+    return false;
+  }
+
+  bool start_object(const size_t length) {
+    if (!Value() || !Enter()) {
+      return false;
+    }
+    members_.push_back(0);
+    open_.push_back(Add(Json::value_t::object));
+    return true;
+  }
+
+  bool key(Json::string_t& value) {
+    if (!CheckString(value)) {
+      return false;
+    }
+    if (++members_.back() > limits_.max_object_members) {
+      return Exceed("too many object members");
+    }
+    // A duplicate key keeps the last value, as Json::parse() does.
+    member_ = &(*open_.back())[std::move(value)];
+    return true;
+  }
+
+  bool end_object() {
+    --depth_;
+    members_.pop_back();
+    open_.pop_back();
+    return true;
+  }
+
+  bool start_array(const size_t length) {
+    if (!Value() || !Enter()) {
+      return false;
+    }
+    if (depth_ == 1) {
+      top_level_array_ = true;
+    }
+    open_.push_back(Add(Json::value_t::array));
+    return true;
+  }
+
+  bool end_array() {
+    --depth_;
+    open_.pop_back();
+    return true;
+  }
+
+  template <typename Exception>
+  bool parse_error(const size_t position, const std::string& token, const Exception& error) {
+    return false;
+  }
+
+  [[nodiscard]] const std::string& Exceeded() const {
+    return exceeded_;
+  }
+
+ private:
+  // Counts the entries of a top-level array as they start.
+  bool Value() {
+    if (depth_ == 1 && top_level_array_ && ++entries_ > limits_.max_batch_size) {
+      return Exceed("batch too large");
+    }
+    return true;
+  }
+
+  bool Enter() {
+    if (++depth_ > limits_.max_depth) {
+      return Exceed("nesting too deep");
+    }
+    return true;
+  }
+
+  bool CheckString(const Json::string_t& value) {
+    if (value.size() > limits_.max_string_length) {
+      return Exceed("string too long");
+    }
+    return true;
+  }
+
+  bool Exceed(const char* what) {
+    exceeded_ = what;
+    return false;
+  }
+
+  template <typename T>
+  bool Leaf(T&& value) {
+    if (!Value()) {
+      return false;
+    }
+    Add(std::forward<T>(value));
+    return true;
+  }
+
+  // Places a value in the innermost open array or object, or at the root.
+  // @return The value placed, which stays put while it is open: its container only grows once it
+  // is closed.
+  template <typename T>
+  Json* Add(T&& value) {
+    if (open_.empty()) {
+      *root_ = Json(std::forward<T>(value));
+      return root_;
+    }
+    auto* parent = open_.back();
+    if (parent->is_array()) {
+      auto& array = parent->get_ref<Json::array_t&>();
+      array.emplace_back(std::forward<T>(value));
+      return &array.back();
+    }
+    *member_ = Json(std::forward<T>(value));
+    return member_;
+  }
+
+  Json* root_;
+  const ParseLimits& limits_;
+  size_t depth_ = 0;
+  size_t entries_ = 0;
+  bool top_level_array_ = false;
+  // The number of members so far of each object being parsed.
+  std::vector<size_t> members_;
+  // The arrays and objects being parsed, innermost last, and the member whose key was just read.
+  std::vector<Json*> open_;
+  Json* member_ = nullptr;
+  std::string exceeded_;
+};
+
+}  // namespace
+
+Status ParseJsonText(const std::string_view text, const ParseLimits& limits, Json* json) {
+  if (text.size() > limits.max_message_bytes) {
+    return {kInvalidRequest, "Invalid Request: message too large"};
+  }
+  LimitedSax sax(json, limits);
+  bool parsed = false;
+  try {
+    parsed = Json::sax_parse(text.data(), text.data() + text.size(), &sax);
+  } catch (const std::exception& e) {
+    return {kParseError, "Parse error"};
+  }
+  if (parsed) {
+    return {kSuccess, ""};
+  }
+  if (!sax.Exceeded().empty()) {
+    return {kInvalidRequest, "Invalid Request: " + sax.Exceeded()};
+  }
+  return {kParseError, "Parse error"};
+}
+
+}  // namespace json_rpc
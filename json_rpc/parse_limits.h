@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "json.h"
+#include "status.h"
+
+namespace json_rpc {
+
+/// Bounds on the JSON text of a message, enforced while it is parsed so that a hostile message is
+/// rejected before the parser builds the oversized structure.
+///
+/// The defaults leave room for large tool calls while keeping a single message from taking more
+/// than a few times max_message_bytes of memory.
+struct ParseLimits {
+  /// Maximum size of the JSON text, checked before parsing starts.
+  size_t max_message_bytes = 16 * 1024 * 1024;
+  /// Maximum nesting of arrays and objects; the top-level value is at depth 1.
+  size_t max_depth = 128;
+  /// Maximum number of entries of a batch, the elements of a top-level array.
+  size_t max_batch_size = 10000;
+  /// Maximum length in bytes of a string value or an object key, after unescaping.
+  size_t max_string_length = 8 * 1024 * 1024;
+  /// Maximum number of members of a single object.
+  size_t max_object_members = 100000;
+};
+
+/// @brief Parses JSON text within limits.
+/// @param text The JSON text.
+/// @param limits The limits of the text.
+/// @param json Receives the parsed value; its content is unspecified on failure.
+/// @return A Status object with kParseError if the text is not valid JSON, or kInvalidRequest if
+/// it exceeds a limit. Parsing stops at the first value exceeding a limit, except that the lexer
+/// reads a whole string before its length is checked.
+Status ParseJsonText(std::string_view text, const ParseLimits& limits, Json* json);
+
+}  // namespace json_rpc
@@ -0,0 +1,308 @@
+
+#include "peer.h"
+
+#include <future>
+#include <utility>
+#include <vector>
+
+#include "error.h"
+#include "json.h"
+#include "parse_limits.h"
+
+namespace json_rpc {
+
+namespace {
+
+bool IsSpace(const char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+size_t SkipSpace(std::string_view text, size_t pos) {
+  while (pos < text.size() && IsSpace(text[pos])) {
+    ++pos;
+  }
+  return pos;
+}
+
+// Returns the position after the string starting at pos, or npos if it is not terminated.
+size_t SkipString(std::string_view text, size_t pos) {
+  for (++pos; pos < text.size(); ++pos) {
+    if (text[pos] == '\\') {
+      ++pos;
+    } else if (text[pos] == '"') {
+      return pos + 1;
+    }
+  }
+  return std::string_view::npos;
+}
+
+// Returns the position after the value starting at pos, or npos if it is not terminated. Scalars
+// are not checked, which is left to the parser.
+size_t SkipValue(std::string_view text, size_t pos) {
+  if (pos >= text.size()) {
+    return std::string_view::npos;
+  }
+  if (text[pos] == '"') {
+    return SkipString(text, pos);
+  }
+  if (text[pos] != '{' && text[pos] != '[') {
+    while (pos < text.size() && text[pos] != ',' && text[pos] != '}' && text[pos] != ']' &&
+           !IsSpace(text[pos])) {
+      ++pos;
+    }
+    return pos;
+  }
+  size_t depth = 0;
+  while (pos < text.size()) {
+    const char c = text[pos];
+    if (c == '"') {
+      pos = SkipString(text, pos);
+      if (pos == std::string_view::npos) {
+        return pos;
+      }
+      continue;
+    }
+    if (c == '{' || c == '[') {
+      ++depth;
+    } else if ((c == '}' || c == ']') && --depth == 0) {
+      return pos + 1;
+    }
+    ++pos;
+  }
+  return std::string_view::npos;
+}
+
+Error Closed() {
+  return {kInternalError, "peer closed"};
+}
+
+}  // namespace
+
+Envelope ClassifyEnvelope(std::string_view message) {
+  auto pos = SkipSpace(message, 0);
+  if (pos < message.size() && message[pos] == '[') {
+    pos = SkipSpace(message, pos + 1);
+  }
+  if (pos >= message.size() || message[pos] != '{') {
+    return Envelope::kInvalid;
+  }
+  bool response = false;
+  pos = SkipSpace(message, pos + 1);
+  while (pos < message.size() && message[pos] == '"') {
+    const auto end = SkipString(message, pos);
+    if (end == std::string_view::npos) {
+      return Envelope::kInvalid;
+    }
+    const auto name = message.substr(pos + 1, end - pos - 2);
+    if (name == kMethodName) {
+      return Envelope::kRequest;
+    }
+    response = response || name == kResultName || name == kErrorName;
+    pos = SkipSpace(message, end);
+    if (pos >= message.size() || message[pos] != ':') {
+      return Envelope::kInvalid;
+    }
+    pos = SkipValue(message, SkipSpace(message, pos + 1));
+    if (pos == std::string_view::npos) {
+      return Envelope::kInvalid;
+    }
+    pos = SkipSpace(message, pos);
+    if (pos < message.size() && message[pos] == ',') {
+      pos = SkipSpace(message, pos + 1);
+    }
+  }
+  return response ? Envelope::kResponse : Envelope::kInvalid;
+}
+
+Peer::Peer(Dispatcher* dispatcher, ChunkSink write, Scheduler* scheduler)
+    : dispatcher_(dispatcher), scheduler_(scheduler), write_(std::move(write)) {}
+
+Peer::~Peer() {
+  Close();
+}
+
+Status Peer::Receive(std::string_view message) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+      return {kInternalError, "peer closed"};
+    }
+  }
+  if (ClassifyEnvelope(message) == Envelope::kResponse) {
+    Json json;
+    auto status = ParseJsonText(message, dispatcher_->GetParseLimits(), &json);
+    if (!status.Ok()) {
+      return status;
+    }
+    if (!json.is_array()) {
+      return Deliver(std::move(json));
+    }
+    for (auto& element : json) {
+      if (auto delivered = Deliver(std::move(element)); !delivered.Ok()) {
+        status = delivered;
+      }
+    }
+    return status;
+  }
+
+  // Anything else is for the dispatcher, which answers malformed requests with an error.
+  if (scheduler_ != nullptr) {
+    return scheduler_->Submit(std::string(message), [this](std::string response) {
+      if (!response.empty() && !Write({std::move(response), nullptr})) {
+        Close();
+      }
+    });
+  }
+  auto response = dispatcher_->HandleMessage(message);
+  if (!response.empty() && !Write({std::move(response), nullptr})) {
+    Close();
+    return {kInternalError, "failed to write response"};
+  }
+  return {kSuccess, ""};
+}
+
+Status Peer::Deliver(Json&& json) {
+  Response response;
+  if (auto status = response.ParseJson(std::move(json)); !status.Ok()) {
+    return status;
+  }
+  if (response.Id().Type() != Identifier::IdType::kNumber) {
+    return {kInvalidRequest, "response does not match a call"};
+  }
+  Waiter waiter;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = waiters_.find(response.Id().IntId());
+    if (it == waiters_.end()) {
+      return {kInvalidRequest, "response does not match a call"};
+    }
+    waiter = std::move(it->second);
+    waiters_.erase(it);
+  }
+  response.SetId(std::move(waiter.id));
+  if (waiter.done) {
+    waiter.done(std::move(response));
+  }
+  return {kSuccess, ""};
+}
+
+Status Peer::Submit(const Request& request, ResponseCallback done) {
+  auto json = request.ToJson();
+  int64_t wire_id = -1;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+      return {kInternalError, "peer closed"};
+    }
+    if (!request.IsNotification()) {
+      // Registered first, since the response can arrive as soon as the request is written.
+      wire_id = next_id_++;
+      waiters_.emplace(wire_id, Waiter{request.Id(), std::move(done)});
+      json[kIdName] = wire_id;
+    }
+  }
+  std::string text;
+  AppendJson(json, &text);
+  if (Write({std::move(text), nullptr})) {
+    return {kSuccess, ""};
+  }
+  bool taken = true;
+  if (wire_id >= 0) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    taken = waiters_.erase(wire_id) != 0;
+  }
+  Close();
+  // Unless the call was failed meanwhile, in which case its callback ran.
+  return taken ? Status(kInternalError, "failed to write request") : Status(kSuccess, "");
+}
+
+Response Peer::Call(const Request& request) {
+  if (request.IsNotification()) {
+    Response response;
+    response.SetError({kInvalidRequest, "a notification has no response"});
+    return response;
+  }
+  std::promise<Response> promise;
+  const auto status =
+      Submit(request, [&promise](Response response) { promise.set_value(std::move(response)); });
+  if (!status.Ok()) {
+    Response response(request.Id());
+    response.SetError({status.Code(), status.Message()});
+    return response;
+  }
+  return promise.get_future().get();
+}
+
+void Peer::Close() {
+  std::unordered_map<int64_t, Waiter> waiters;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    waiters.swap(waiters_);
+  }
+  for (auto& [id, waiter] : waiters) {
+    Response response(std::move(waiter.id));
+    response.SetError(Closed());
+    if (waiter.done) {
+      waiter.done(std::move(response));
+    }
+  }
+}
+
+size_t Peer::Outstanding() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return waiters_.size();
+}
+
+bool Peer::Send(const SharedMessage& message) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+      return false;
+    }
+  }
+  if (!Write({std::string(), message})) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+bool Peer::Write(Outgoing message) {
+  std::unique_lock<std::mutex> lock(write_mutex_);
+  if (write_failed_) {
+    return false;
+  }
+  write_queue_.push_back(std::move(message));
+  if (writing_) {
+    // The thread draining the queue writes it.
+    return true;
+  }
+  writing_ = true;
+  std::vector<Outgoing> messages;
+  while (!write_queue_.empty()) {
+    messages.assign(std::make_move_iterator(write_queue_.begin()),
+                    std::make_move_iterator(write_queue_.end()));
+    write_queue_.clear();
+    lock.unlock();
+    bool written = true;
+    for (const auto& outgoing : messages) {
+      if (!write_(outgoing.shared ? *outgoing.shared : outgoing.text)) {
+        written = false;
+        break;
+      }
+    }
+    lock.lock();
+    if (!written) {
+      // The messages left are dropped; the calls among them fail as the peer closes.
+      write_failed_ = true;
+      write_queue_.clear();
+      writing_ = false;
+      return false;
+    }
+  }
+  writing_ = false;
+  return true;
+}
+
+}  // namespace json_rpc
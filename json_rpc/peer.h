@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "dispatcher.h"
+#include "request.h"
+#include "response.h"
+#include "result_writer.h"
+#include "scheduler.h"
+#include "status.h"
+#include "subscription.h"
+
+namespace json_rpc {
+
+/// What a message received by a Peer carries, told from the members of its top-level object, or of
+/// the first element of a batch, without parsing it.
+enum class Envelope : int {
+  /// A request or notification, with a "method" member.
+  kRequest = 0,
+  /// A response, with a "result" or "error" member and no "method".
+  kResponse = 1,
+  /// Neither, or not a JSON object or array.
+  kInvalid = 2,
+};
+
+/// @brief Tells whether a message is a request or a response. Only the member names at the top
+/// level are read; values are skipped without being parsed, and names written with escapes are
+/// not recognized.
+/// @param message The JSON text of the message.
+/// @return The kind of message.
+Envelope ClassifyEnvelope(std::string_view message);
+
+/// One end of a connection on which both sides make calls, as an MCP server asking its client for
+/// sampling or roots over the stream the client calls it on.
+///
+/// Messages read from the connection are handed to Receive(), which sorts them by their envelope:
+/// requests go to the Dispatcher, or to a Scheduler if one is given, and their responses are
+/// written back; responses are matched to the calls made with Call() or Submit(). The two
+/// directions have separate id spaces: calls get ids of the peer on the wire, so the ids of the
+/// requests of the other side never collide with them, and each caller gets its response under its
+/// own id.
+///
+/// Every message written, requests and responses alike, goes through one write queue drained by
+/// whichever thread finds it idle, so messages are never interleaved and a slow write does not hold
+/// the threads queuing behind it.
+class Peer {
+ public:
+  /// Receives the response to a call. Called on the thread running Receive(), or on the calling
+  /// thread if the call failed before it was sent.
+  using ResponseCallback = std::function<void(Response response)>;
+
+  /// @brief Constructor.
+  /// @param dispatcher The dispatcher handling the requests of the other side; it must outlive the
+  /// peer.
+  /// @param write The sink writing the JSON text of one message to the connection, returning false
+  /// if the connection failed. Called by one thread at a time.
+  /// @param scheduler The scheduler running the requests of the other side, or nullptr to run them
+  /// on the thread calling Receive(); handlers then must not wait for calls of their own. It must
+  /// be stopped before the peer is destroyed.
+  Peer(Dispatcher* dispatcher, ChunkSink write, Scheduler* scheduler = nullptr);
+
+  Peer(const Peer&) = delete;
+  Peer& operator=(const Peer&) = delete;
+
+  /// @brief Destructor, closes the peer.
+  ~Peer();
+
+  /// @brief Handles a message read from the connection.
+  /// @param message The JSON text of the message.
+  /// @return A Status object indicating failure if the peer is closed, or the message is a
+  /// response that cannot be read or matched to a call.
+  Status Receive(std::string_view message);
+
+  /// @brief Sends a call or notification to the other side.
+  /// @param request The request.
+  /// @param done The callback receiving the response to a call, unused for a notification. An error
+  /// response with kInternalError is delivered if the peer is closed before the response arrives.
+  /// @return A Status object indicating failure if the peer is closed or the write failed, in which
+  /// case done is not called.
+  Status Submit(const Request& request, ResponseCallback done);
+
+  /// @brief Makes a call and waits for its response. Must not be called from a callback, nor from
+  /// a handler run on the thread calling Receive().
+  /// @param request The request, which must not be a notification.
+  /// @return The response, an error response if the call failed.
+  Response Call(const Request& request);
+
+  /// @brief Writes a message serialized once for many connections, such as a notification
+  /// published by a SubscriptionHub, through the write queue without copying it.
+  /// @param message The message.
+  /// @return false if the peer is closed or the write failed, otherwise true.
+  bool Send(const SharedMessage& message);
+
+  /// @brief Fails the calls in flight with kInternalError and refuses later ones. Idempotent.
+  void Close();
+
+  /// @brief Gets the number of calls waiting for their response.
+  /// @return The number of calls in flight.
+  [[nodiscard]] size_t Outstanding() const;
+
+ private:
+  struct Waiter {
+    Identifier id;
+    ResponseCallback done;
+  };
+
+  // A message of this peer, or one shared with other connections.
+  struct Outgoing {
+    std::string text;
+    SharedMessage shared;
+  };
+
+  bool Write(Outgoing message);
+
+  Status Deliver(Json&& json);
+
+  Dispatcher* dispatcher_;
+  Scheduler* scheduler_;
+  ChunkSink write_;
+  mutable std::mutex mutex_;
+  std::unordered_map<int64_t, Waiter> waiters_;
+  int64_t next_id_ = 0;
+  bool closed_ = false;
+  std::mutex write_mutex_;
+  std::deque<Outgoing> write_queue_;
+  bool writing_ = false;
+  bool write_failed_ = false;
+};
+
+}  // namespace json_rpc
@@ -0,0 +1,19 @@
+
+#include "raw_json.h"
+
+#include "error.h"
+
+namespace json_rpc {
+
+Status RawJson::Validate() const {
+  // Valid JSON strings hold no raw line breaks, so any is whitespace that would split the message.
+  if (text_->find_first_of("\r\n") != std::string::npos) {
+    return {kParseError, "JSON text spans several lines"};
+  }
+  if (!Json::accept(*text_)) {
+    return {kParseError, "invalid JSON text"};
+  }
+  return {kSuccess, ""};
+}
+
+}  // namespace json_rpc
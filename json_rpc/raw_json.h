@@ -0,0 +1,63 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "json.h"
+#include "status.h"
+#include "typed_result.h"
+
+namespace json_rpc {
+
+/// A JSON value kept as the text it was serialized to, e.g. by a cache, a file or an upstream
+/// server, and spliced verbatim into the responses it is set as the result of, instead of being
+/// parsed into a Json and dumped again.
+///
+/// The text is not checked unless Validate() is called. It is written as is, so for newline
+/// delimited transports it must be on one line: compact JSON is, while pretty-printed JSON is valid
+/// but spans several lines, which Validate() rejects too.
+class RawJson {
+ public:
+  /// @brief Constructor taking the text.
+  /// @param text The JSON text of one value.
+  explicit RawJson(std::string text)
+      : text_(std::make_shared<const std::string>(std::move(text))) {}
+
+  /// @brief Constructor sharing text kept elsewhere, e.g. by a cache, without copying it.
+  /// @param text The JSON text of one value, which must not be null.
+  explicit RawJson(std::shared_ptr<const std::string> text) : text_(std::move(text)) {}
+
+  /// @brief Gets the text.
+  /// @return The JSON text.
+  [[nodiscard]] std::string_view Text() const {
+    return *text_;
+  }
+
+  /// @brief Checks that the text is one valid JSON value on a single line, without building a
+  /// Json.
+  /// @return A Status object with kParseError if the text is not valid JSON or has a line break.
+  [[nodiscard]] Status Validate() const;
+
+ private:
+  std::shared_ptr<const std::string> text_;
+};
+
+namespace internal {
+
+class RawValue final : public TypedResult {
+ public:
+  explicit RawValue(RawJson value) : value_(std::move(value)) {}
+
+  void AppendTo(std::string* out) const override {
+    out->append(value_.Text());
+  }
+
+ private:
+  RawJson value_;
+};
+
+}  // namespace internal
+
+}  // namespace json_rpc
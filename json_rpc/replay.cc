@@ -0,0 +1,101 @@
+
+#include "replay.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "error.h"
+#include "executor.h"
+
+namespace json_rpc {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Nearest-rank percentile of sorted latencies.
+ReplayReport::Duration Percentile(const std::vector<ReplayReport::Duration>& sorted,
+                                  const double percentile) {
+  const auto rank = static_cast<size_t>(std::ceil(percentile * static_cast<double>(sorted.size())));
+  return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+}  // namespace
+
+Status Replay(CaptureLog* log, Dispatcher* dispatcher, const ReplayOptions& options,
+              ReplayReport* report) {
+  if (options.qps < 0 || options.speed <= 0) {
+    return {kInvalidParams, "invalid replay pacing"};
+  }
+  std::vector<CaptureLog::Record> captured;
+  log->Rewind();
+  for (CaptureLog::Record record; log->Next(&record);) {
+    if (record.kind == CaptureLog::Kind::kRequest) {
+      captured.push_back(record);
+    }
+  }
+  if (captured.empty()) {
+    return {kInvalidParams, "no request to replay"};
+  }
+  // Several writers append out of order; stable, so requests captured at once keep their order.
+  std::stable_sort(captured.begin(), captured.end(),
+                   [](const CaptureLog::Record& a, const CaptureLog::Record& b) {
+                     return a.timestamp_ns < b.timestamp_ns;
+                   });
+  const auto count = options.requests != 0 ? options.requests : captured.size();
+
+  // The time each request is due, relative to the start.
+  std::vector<Clock::duration> due(count);
+  const auto first = captured.front().timestamp_ns;
+  const auto span = captured.back().timestamp_ns - first;
+  for (size_t i = 0; i < count; ++i) {
+    double offset_ns;
+    if (options.qps > 0) {
+      offset_ns = static_cast<double>(i) * 1e9 / options.qps;
+    } else {
+      // Later laps over the capture follow the earlier ones.
+      const auto lap = static_cast<double>(i / captured.size());
+      const auto& record = captured[i % captured.size()];
+      offset_ns = (lap * static_cast<double>(span) +
+                   static_cast<double>(record.timestamp_ns - first)) / options.speed;
+    }
+    due[i] = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::nano>(offset_ns));
+  }
+
+  std::vector<ReplayReport::Duration> latencies(count);
+  const auto start = Clock::now();
+  {
+    Executor executor(options.threads);
+    for (size_t i = 0; i < count; ++i) {
+      const auto deadline = start + due[i];
+      std::this_thread::sleep_until(deadline);
+      auto task = [dispatcher, &latencies, message = captured[i % captured.size()].data, i,
+                   deadline] {
+        dispatcher->HandleMessage(message);
+        latencies[i] = std::chrono::duration_cast<ReplayReport::Duration>(Clock::now() - deadline);
+      };
+      if (!executor.Submit(task).Ok()) {
+        // The executor is saturated: the pacing thread handles the request itself, and the
+        // requests due meanwhile are measured from their due time all the same.
+        task();
+      }
+    }
+  }
+  const auto elapsed = Clock::now() - start;
+
+  std::sort(latencies.begin(), latencies.end());
+  report->requests = count;
+  report->elapsed = std::chrono::duration_cast<ReplayReport::Duration>(elapsed);
+  report->p50 = Percentile(latencies, 0.5);
+  report->p99 = Percentile(latencies, 0.99);
+  report->p999 = Percentile(latencies, 0.999);
+  report->max = latencies.back();
+  return {kSuccess, ""};
+}
+
+}  // namespace json_rpc
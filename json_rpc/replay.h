@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+#include "capture_log.h"
+#include "dispatcher.h"
+#include "status.h"
+
+namespace json_rpc {
+
+/// Options of Replay().
+struct ReplayOptions {
+  /// Requests sent per second, or zero to keep the pacing of the capture.
+  double qps = 0;
+  /// Speed-up of the captured pacing, used when qps is zero.
+  double speed = 1;
+  /// The number of threads dispatching the requests, or zero for one per hardware thread.
+  size_t threads = 1;
+  /// The number of requests sent, looping over the captured ones, or zero to send each once.
+  size_t requests = 0;
+};
+
+/// Latencies measured by Replay().
+struct ReplayReport {
+  using Duration = std::chrono::nanoseconds;
+
+  /// The number of requests sent.
+  size_t requests = 0;
+  /// The time from the first request to the last response.
+  Duration elapsed{0};
+  /// Latency percentiles, from the time each request was due to its response.
+  Duration p50{0};
+  Duration p99{0};
+  Duration p999{0};
+  Duration max{0};
+};
+
+/// @brief Replays the requests of a capture log through a dispatcher, in process.
+///
+/// Requests are sent open-loop: each one is due at a fixed time, following the target rate or the
+/// captured timestamps, whether or not the previous ones were answered. Latency is measured from
+/// the time a request was due rather than the time it was sent, so a stall delaying the following
+/// requests counts against all of them, which corrects for coordinated omission.
+///
+/// @param log The capture log, opened for reading. It is rewound first.
+/// @param dispatcher The dispatcher handling the messages with HandleMessage().
+/// @param options The pacing of the requests.
+/// @param report Receives the latencies.
+/// @return A Status object indicating failure if the log holds no request or the options are
+/// invalid.
+Status Replay(CaptureLog* log, Dispatcher* dispatcher, const ReplayOptions& options,
+              ReplayReport* report);
+
+}  // namespace json_rpc
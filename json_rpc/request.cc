@@ -1,28 +1,81 @@
 
 #include "request.h"
 
+#include <algorithm>
+#include <utility>
+
 #include "error.h"
 #include "json_rpc_version.h"
 
 namespace json_rpc {
 
+namespace {
+
+// Longer timeouts are clamped, keeping the deadline away from overflowing the clock.
+constexpr uint64_t kMaxTimeoutMs = 365ull * 24 * 3600 * 1000;
+
+}  // namespace
+
 // to_json() request convert to json
 void to_json(Json& j, const Request& req);
 
-// from_json() request convert from json
-void from_json(const Json& j, Request& req);
+// Shared by both ParseJson(); members of a const JSON are copied, those of an rvalue one moved.
+// Members are assigned in place, so a recycled request reuses the capacity of its strings and
+// containers.
+template <typename J>
+void Request::Assign(J&& j) {
+  // MUST be exactly "2.0".
+  const auto& jsonrpc_version = j.at(kJsonRpcVersionName);
+  if (!jsonrpc_version.is_string() ||
+      jsonrpc_version.template get_ref<const std::string&>() != kJsonRpcVersion) {
+    throw std::invalid_argument("invalid json_rpc version");
+  }
 
-Request::Request(std::string jsonrpc_version, std::string method, Parameter params, Identifier id)
-    : jsonrpc_version_(std::move(jsonrpc_version)),
-      method_(std::move(method)),
-      params_(std::move(params)),
-      id_(std::move(id)) {
+  // MUST be a string.
+  const auto& method = j.at(kMethodName);
+  if (!method.is_string()) {
+    throw std::invalid_argument("invalid method");
+  }
+
+  // MAY be omitted
+  const auto params = j.find(kParamsName);
+  // If present, parameters for the rpc call MUST be provided as a Structured
+  // value. Either by-position through an Array or by-name through an Object
+  if (params != j.end() && !params->is_array() && !params->is_object()) {
+    throw std::invalid_argument("invalid params");
+  }
+
+  // MAY be omitted, an implementation-defined extension.
+  const auto timeout = j.find(kTimeoutName);
+  if (timeout != j.end() && !timeout->is_number_unsigned()) {
+    throw std::invalid_argument("invalid timeout");
+  }
+
+  jsonrpc_version_ = kJsonRpcVersion;
+  SetMethod(method.template get_ref<const std::string&>());
+  if (params != j.end()) {
+    // Binds to ParseJson(const Json&) when j is const.
+    params_.ParseJson(std::move(*params));
+  } else {
+    params_.Clear();
+  }
+  id_.Clear();
+  if (const auto id = j.find(kIdName); id != j.end()) {
+    id_.ParseJson(*id);
+  }
+  cancellation_ = CancellationToken();
+  deadline_ = Clock::time_point::max();
+  timeout_ms_ = 0;
+  if (timeout != j.end()) {
+    timeout_ms_ = std::min(timeout->template get<uint64_t>(), kMaxTimeoutMs);
+    deadline_ = Clock::now() + std::chrono::milliseconds(timeout_ms_);
+  }
 }
 
-Status Request::ParseJson(const std::string& json_str) {
-  Json json;
+template <typename J>
+Status Request::Parse(J&& json) {
   try {
-    json = Json::parse(json_str);
+    Assign(std::forward<J>(json));
   } catch (const nlohmann::detail::parse_error& e) {
     return {kParseError, "Parse error"};
   } catch (const std::exception& e) {
@@ -30,20 +83,61 @@ Status Request::ParseJson(const std::string& json_str) {
   } catch (...) {
     return {kInvalidRequest, "Invalid Request"};
   }
-  return ParseJson(json);
+  return {kSuccess, ""};
+}
+
+Request::Request(std::string jsonrpc_version, std::string method, Parameter params, Identifier id)
+    : jsonrpc_version_(std::move(jsonrpc_version)),
+      method_(std::move(method)),
+      params_(std::move(params)),
+      id_(std::move(id)) {
+  method_id_ = MethodTable::Global().Find(method_, &interned_method_);
+}
+
+Status Request::ParseJson(const std::string& json_str, const ParseLimits& limits) {
+  Json json;
+  if (auto status = ParseJsonText(json_str, limits, &json); !status.Ok()) {
+    return status;
+  }
+  return ParseJson(std::move(json));
 }
 
 Status Request::ParseJson(const Json& json) {
-  try {
-    from_json(json, *this);
-  } catch (const nlohmann::detail::parse_error& e) {
-    return {kParseError, "Parse error"};
-  } catch (const std::exception& e) {
-    return {kInvalidRequest, "Invalid Request"};
-  } catch (...) {
-    return {kInvalidRequest, "Invalid Request"};
+  return Parse(json);
+}
+
+Status Request::ParseJson(Json&& json) {
+  return Parse(std::move(json));
+}
+
+void Request::Clear() {
+  jsonrpc_version_ = kJsonRpcVersion;
+  method_.clear();
+  interned_method_ = nullptr;
+  method_id_ = kUnknownMethodId;
+  params_.Clear();
+  id_.Clear();
+  cancellation_ = CancellationToken();
+  deadline_ = Clock::time_point::max();
+  timeout_ms_ = 0;
+}
+
+void Request::SetDeadline(const Clock::time_point deadline) {
+  deadline_ = deadline;
+  timeout_ms_ = 0;
+  if (HasDeadline()) {
+    const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now());
+    timeout_ms_ = static_cast<uint64_t>(std::max<int64_t>(0, left.count()));
+  }
+}
+
+void Request::SetMethod(const std::string& method) {
+  method_id_ = MethodTable::Global().Find(method, &interned_method_);
+  if (interned_method_ != nullptr) {
+    method_.clear();
+  } else {
+    method_.assign(method);
   }
-  return {kSuccess, ""};
 }
 
 Json Request::ToJson() const {
@@ -54,44 +148,21 @@ Json Request::ToJson() const {
 
 // to_json()
 void to_json(Json& j, const Request& req) {
-  j = Json{{kJsonRpcVersionName, req.JsonrpcVersion()},
-           {kMethodName, req.Method()},
-           {kParamsName, req.Params().ToJson()}};
-
-  if (!req.IsNotification()) {
-    j[kIdName] = req.Id().ToJson();
-  }
-}
+  j = Json{{kJsonRpcVersionName, req.JsonrpcVersion()}, {kMethodName, req.Method()}};
 
-// from_json()
-void from_json(const Json& j, Request& req) {
-  // MUST be exactly "2.0".
-  const auto jsonrpc_version = j.at(kJsonRpcVersionName).get<std::string>();
-  if (jsonrpc_version != kJsonRpcVersion) {
-    throw std::invalid_argument("invalid json_rpc version");
+  // Absent params are omitted, since null is not a valid params value.
+  if (req.Params().Type() != Parameter::ParamType::kNull) {
+    j[kParamsName] = req.Params().ToJson();
   }
 
-  // MUST be a string.
-  const auto method = j.at(kMethodName).get<std::string>();
-
-  // MAY be omitted
-  Parameter params;
-  if (j.contains(kParamsName)) {
-    auto p = j.at(kParamsName);
-    // If present, parameters for the rpc call MUST be provided as a Structured
-    // value. Either by-position through an Array or by-name through an Object
-    if (!p.is_array() && !p.is_object()) {
-      throw std::invalid_argument("invalid params");
-    }
-    params.ParseJson(p);
+  if (!req.IsNotification()) {
+    j[kIdName] = req.Id().ToJson();
   }
 
-  Identifier id;
-  if (j.contains(kIdName)) {
-    id.ParseJson(j.at(kIdName));
+  // The deadline travels as a timeout, since clocks of both ends are not comparable.
+  if (req.HasDeadline()) {
+    j[kTimeoutName] = req.TimeoutMs();
   }
-
-  req = Request(jsonrpc_version, method, params, id);
 }
 
 }  // namespace json_rpc
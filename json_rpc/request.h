@@ -1,11 +1,17 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <string>
+#include <utility>
 
+#include "cancellation.h"
 #include "identifier.h"
 #include "json.h"
 #include "json_rpc_version.h"
+#include "method_table.h"
 #include "parameter.h"
+#include "parse_limits.h"
 #include "status.h"
 
 namespace json_rpc {
@@ -64,6 +70,8 @@ namespace json_rpc {
 
 class Request {
  public:
+  using Clock = std::chrono::steady_clock;
+
   /// @brief Default constructor.
   Request() = default;
 
@@ -76,24 +84,41 @@ class Request {
 
   /// @brief Parses a JSON string into a Request object.
   /// @param json_str The JSON string to parse.
-  /// @return A Status object indicating success or failure.
-  Status ParseJson(const std::string& json_str);
+  /// @param limits The limits enforced while parsing the string.
+  /// @return A Status object indicating success or failure, kInvalidRequest if a limit is exceeded.
+  Status ParseJson(const std::string& json_str, const ParseLimits& limits = ParseLimits());
 
   /// @brief Parses a JSON object into a Request object.
   /// @param json The JSON object to parse.
   /// @return A Status object indicating success or failure.
   Status ParseJson(const Json& json);
 
+  /// @brief Parses a JSON object into a Request object, moving the params out of it.
+  /// @param json The JSON object to parse.
+  /// @return A Status object indicating success or failure.
+  Status ParseJson(Json&& json);
+
+  /// @brief Resets the request to a default constructed one, keeping the capacity of its strings
+  /// and containers for the next ParseJson().
+  void Clear();
+
   /// @brief Gets the identifier of the request.
   /// @return The identifier object.
   [[nodiscard]] const Identifier& Id() const {
     return id_;
   }
 
-  /// @brief Gets the method name of the request.
+  /// @brief Gets the method name of the request. For a method interned in MethodTable::Global(),
+  /// this is the interned name rather than a copy owned by the request.
   /// @return The method name string.
   [[nodiscard]] const std::string& Method() const {
-    return method_;
+    return interned_method_ != nullptr ? *interned_method_ : method_;
+  }
+
+  /// @brief Gets the id of the method of the request, resolved when it was parsed or constructed.
+  /// @return The id of the method, or kUnknownMethodId if it was not interned by then.
+  [[nodiscard]] MethodId MethodAtom() const {
+    return method_id_;
   }
 
   /// @brief Gets the parameters of the request.
@@ -102,6 +127,14 @@ class Request {
     return params_;
   }
 
+  /// @brief Moves the parameters out of the request, leaving them empty.
+  /// @return The parameters object.
+  [[nodiscard]] Parameter TakeParams() {
+    auto params = std::move(params_);
+    params_ = Parameter();
+    return params;
+  }
+
   /// @brief Gets the JSON-RPC version of the request.
   /// @return The JSON-RPC version string.
   [[nodiscard]] const std::string& JsonrpcVersion() const {
@@ -115,7 +148,7 @@ class Request {
   /// @brief Checks if the method is an internal method (starts with "rpc.").
   /// @return true if the method is internal, otherwise false.
   [[nodiscard]] bool IsInternalMethod() const {
-    return method_.find("rpc.") != std::string::npos;
+    return Method().find("rpc.") != std::string::npos;
   }
 
   /// @brief Checks if the request is a notification (has no identifier).
@@ -124,11 +157,62 @@ class Request {
     return id_.Type() == Identifier::IdType::kNull;
   }
 
+  /// @brief Gets the cancellation token of the request while it is in flight. It is not part of
+  /// the message and is never cancelled unless a Dispatcher attached one.
+  /// @return The cancellation token.
+  [[nodiscard]] const CancellationToken& Cancellation() const {
+    return cancellation_;
+  }
+
+  /// @brief Checks if the request has a deadline.
+  /// @return true if a deadline was set, otherwise false.
+  [[nodiscard]] bool HasDeadline() const {
+    return deadline_ != Clock::time_point::max();
+  }
+
+  /// @brief Gets the time after which the caller no longer waits for the response.
+  /// @return The deadline, or Clock::time_point::max() if the request has none.
+  [[nodiscard]] Clock::time_point Deadline() const {
+    return deadline_;
+  }
+
+  /// @brief Gets the timeout sent as the kTimeoutName member: the one received, or the time left
+  /// when the deadline was set. Kept rather than derived from the clock, so a request serializes
+  /// the same every time.
+  /// @return The timeout in milliseconds, meaningful only if the request has a deadline.
+  [[nodiscard]] uint64_t TimeoutMs() const {
+    return timeout_ms_;
+  }
+
+  /// @brief Sets the deadline of the request, and the timeout sent with it to the time left.
+  /// @param deadline The deadline, or Clock::time_point::max() for none.
+  void SetDeadline(Clock::time_point deadline);
+
+  /// @brief Attaches a cancellation token to the request.
+  /// @param token The cancellation token.
+  void SetCancellation(CancellationToken token) {
+    cancellation_ = std::move(token);
+  }
+
  private:
+  template <typename J>
+  Status Parse(J&& json);
+
+  template <typename J>
+  void Assign(J&& j);
+
+  void SetMethod(const std::string& method);
+
   std::string jsonrpc_version_ = kJsonRpcVersion;
+  // Only holds the name of methods that are not interned.
   std::string method_;
+  const std::string* interned_method_ = nullptr;
+  MethodId method_id_ = kUnknownMethodId;
   Parameter params_;
   Identifier id_;
+  CancellationToken cancellation_;
+  Clock::time_point deadline_ = Clock::time_point::max();
+  uint64_t timeout_ms_ = 0;
 };
 
 }  // namespace json_rpc
@@ -1,20 +1,105 @@
 
 #include "response.h"
 
+#include <string>
+#include <utility>
+
 namespace json_rpc {
 
-Json Response::ToJson() const {
+template <typename Self>
+Json Response::Build(Self&& self) {
   Json json;
-  json[kJsonRpcVersionName] = jsonrpc_version_;
-  if (error_.Code() != ErrorCode::kSuccess) {
-    json[kErrorName] = error_.ToJson();
+  json[kJsonRpcVersionName] = self.jsonrpc_version_;
+  if (self.error_.Code() != ErrorCode::kSuccess) {
+    json[kErrorName] = self.error_.ToJson();
+  } else if (self.typed_result_ != nullptr) {
+    // Only a caller asking for a Json pays for building one from a typed result.
+    std::string result;
+    self.typed_result_->AppendTo(&result);
+    json[kResultName] = Json::parse(result);
   } else {
-    json[kResultName] = result_;
+    json[kResultName] = std::forward<Self>(self).result_;
   }
   // If there was an error in detecting the id in the Request object (e.g. Parse
   // error/Invalid Request), it MUST be Null.
-  json[kIdName] = id_.ToJson();
+  json[kIdName] = self.id_.ToJson();
   return json;
 }
 
+Json Response::ToJson() const& {
+  return Build(*this);
+}
+
+Json Response::ToJson() && {
+  return Build(std::move(*this));
+}
+
+Status Response::ParseJson(Json&& json) {
+  Clear();
+  if (!json.is_object()) {
+    return {kInvalidRequest, "response is not an object"};
+  }
+  const auto version = json.find(kJsonRpcVersionName);
+  if (version == json.end() || *version != jsonrpc_version_) {
+    return {kInvalidRequest, "invalid jsonrpc version"};
+  }
+  const auto id = json.find(kIdName);
+  if (id == json.end() || !id_.ParseJson(*id)) {
+    return {kInvalidRequest, "invalid id"};
+  }
+  const auto error = json.find(kErrorName);
+  const auto result = json.find(kResultName);
+  if ((error == json.end()) == (result == json.end())) {
+    return {kInvalidRequest, "response needs either a result or an error"};
+  }
+  if (result != json.end()) {
+    result_ = std::move(*result);
+    return {kSuccess, ""};
+  }
+  const auto code = error->find(kCodeName);
+  const auto message = error->find(kMessageName);
+  if (!error->is_object() || code == error->end() || !code->is_number_integer() ||
+      message == error->end() || !message->is_string()) {
+    return {kInvalidRequest, "invalid error object"};
+  }
+  const auto data = error->find(kDataName);
+  error_ = Error(code->get<int>(), std::move(message->get_ref<std::string&>()),
+                 data != error->end() ? std::move(*data) : Json());
+  return {kSuccess, ""};
+}
+
+void Response::AppendTo(std::string* out) const {
+  // The members in the order of ToJson().dump(), whose objects sort their keys.
+  const bool failed = error_.Code() != ErrorCode::kSuccess;
+  if (failed) {
+    out->append("{\"error\":");
+    AppendJson(error_.ToJson(), out);
+    out->append(",\"id\":");
+  } else {
+    out->append("{\"id\":");
+  }
+  switch (id_.Type()) {
+    case Identifier::IdType::kNumber:
+      internal::AppendValue(id_.IntId(), out);
+      break;
+    case Identifier::IdType::kString:
+      internal::AppendString(id_.StringId(), out);
+      break;
+    default:
+      out->append("null");
+      break;
+  }
+  out->append(",\"jsonrpc\":");
+  internal::AppendString(jsonrpc_version_, out);
+  if (!failed) {
+    out->append(",\"result\":");
+    if (typed_result_ != nullptr) {
+      typed_result_->AppendTo(out);
+    } else {
+      AppendJson(result_, out);
+    }
+  }
+  out->push_back('}');
+}
+
 }  // namespace json_rpc
\ No newline at end of file
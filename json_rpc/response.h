@@ -1,12 +1,18 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
+#include <type_traits>
+#include <utility>
 
 #include "error.h"
 #include "identifier.h"
 #include "json.h"
 #include "json_rpc_version.h"
+#include "raw_json.h"
+#include "status.h"
+#include "typed_result.h"
 
 namespace json_rpc {
 
@@ -48,7 +54,21 @@ class Response {
 
   /// @brief Converts the response to a JSON object.
   /// @return A JSON representation of the response.
-  [[nodiscard]] Json ToJson() const;
+  [[nodiscard]] Json ToJson() const&;
+
+  /// @brief Converts the response to a JSON object, moving the result into it.
+  /// @return A JSON representation of the response.
+  [[nodiscard]] Json ToJson() &&;
+
+  /// @brief Parses a JSON object received as a response, e.g. by a client, moving its result out.
+  /// @param json The JSON object to parse.
+  /// @return A Status object indicating kInvalidRequest if the object is not a valid response.
+  Status ParseJson(Json&& json);
+
+  /// @brief Serializes the response compactly, as ToJson().dump() does, appending to a string. A
+  /// typed result is written straight from its value.
+  /// @param out The string to append to.
+  void AppendTo(std::string* out) const;
 
   /// @brief Gets the JSON-RPC version.
   /// @return The JSON-RPC version string.
@@ -57,11 +77,17 @@ class Response {
   }
 
   /// @brief Gets the result of the response.
-  /// @return The result as a JSON object.
+  /// @return The result as a JSON object, null if the result is typed.
   [[nodiscard]] const Json& Result() const {
     return result_;
   }
 
+  /// @brief Moves the result out of the response, leaving it null.
+  /// @return The result as a JSON object, null if the result is typed.
+  [[nodiscard]] Json TakeResult() {
+    return std::move(result_);
+  }
+
   /// @brief Sets an error for the response.
   /// @param error The error object to set.
   void SetError(Error error) {
@@ -72,6 +98,39 @@ class Response {
   /// @param result The result as a JSON object.
   void SetResult(Json result) {
     result_ = std::move(result);
+    typed_result_.reset();
+  }
+
+  /// @brief Sets a typed result: a struct described with JSON_RPC_FIELDS, or a container or
+  /// optional of them. The value is kept as is and only written as JSON when the response is
+  /// serialized, without the allocations of building a Json from it.
+  /// @param result The result.
+  template <typename T, std::enable_if_t<internal::IsTypedResult<T>::value, int> = 0>
+  void SetResult(T result) {
+    result_ = nullptr;
+    typed_result_ = std::make_shared<internal::TypedValue<T>>(std::move(result));
+  }
+
+  /// @brief Sets a result already serialized, written verbatim when the response is serialized.
+  /// @param result The JSON text of the result.
+  /// @param validate Whether to check that the text is valid JSON first.
+  /// @return A Status object with kParseError if validation failed, in which case the result is
+  /// left unchanged.
+  Status SetResult(RawJson result, bool validate = false) {
+    if (validate) {
+      if (auto status = result.Validate(); !status.Ok()) {
+        return status;
+      }
+    }
+    result_ = nullptr;
+    typed_result_ = std::make_shared<internal::RawValue>(std::move(result));
+    return {kSuccess, ""};
+  }
+
+  /// @brief Checks if the result is typed or raw, in which case Result() is null.
+  /// @return true if the result was set with a typed value or RawJson, otherwise false.
+  [[nodiscard]] bool HasTypedResult() const {
+    return typed_result_ != nullptr;
   }
 
   /// @brief Gets the identifier of the response.
@@ -92,9 +151,23 @@ class Response {
     return error_;
   }
 
+  /// @brief Resets the response to a default constructed one, keeping the capacity of its strings.
+  void Clear() {
+    result_ = nullptr;
+    typed_result_.reset();
+    error_.Clear();
+    id_.Clear();
+  }
+
  private:
+  // Builds the JSON object of a response, copying its result or moving it from an rvalue.
+  template <typename Self>
+  static Json Build(Self&& self);
+
   std::string jsonrpc_version_ = kJsonRpcVersion;
   Json result_;
+  // Shared by copies, since it is never modified.
+  std::shared_ptr<const internal::TypedResult> typed_result_;
   Error error_;
   Identifier id_;
 };
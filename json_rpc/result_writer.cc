@@ -0,0 +1,164 @@
+
+#include "result_writer.h"
+
+#include <utility>
+
+#include "json_rpc_version.h"
+
+namespace json_rpc {
+
+namespace {
+
+Status Misuse(const char* message) {
+  return {kInternalError, message};
+}
+
+void AppendEnvelopeBegin(std::string* out, const char* member) {
+  out->append(R"({"jsonrpc":")");
+  out->append(kJsonRpcVersion);
+  out->append(R"(",")");
+  out->append(member);
+  out->append(R"(":)");
+}
+
+}  // namespace
+
+ResultWriter::ResultWriter(Identifier id, ChunkSink sink, const size_t chunk_size)
+    : id_(std::move(id)), sink_(std::move(sink)), chunk_size_(chunk_size) {
+  AppendEnvelopeBegin(&buffer_, kResultName);
+}
+
+Status ResultWriter::BeforeValue() {
+  if (finished_ || broken_) {
+    return Misuse("response already finished");
+  }
+  if (scopes_.empty()) {
+    if (has_result_) {
+      return Misuse("result already written");
+    }
+    has_result_ = true;
+    return {kSuccess, ""};
+  }
+  auto& scope = scopes_.back();
+  if (scope.object) {
+    if (!scope.expects_value) {
+      return Misuse("object member written without a key");
+    }
+    scope.expects_value = false;
+  } else {
+    if (scope.has_members) {
+      buffer_.push_back(',');
+    }
+    scope.has_members = true;
+  }
+  return {kSuccess, ""};
+}
+
+Status ResultWriter::BeginArray() {
+  if (auto status = BeforeValue(); !status.Ok()) {
+    return status;
+  }
+  scopes_.push_back({false, false, false});
+  buffer_.push_back('[');
+  return {kSuccess, ""};
+}
+
+Status ResultWriter::BeginObject() {
+  if (auto status = BeforeValue(); !status.Ok()) {
+    return status;
+  }
+  scopes_.push_back({true, false, false});
+  buffer_.push_back('{');
+  return {kSuccess, ""};
+}
+
+Status ResultWriter::End(const bool object) {
+  if (scopes_.empty() || scopes_.back().object != object || scopes_.back().expects_value) {
+    return Misuse(object ? "no object to end" : "no array to end");
+  }
+  scopes_.pop_back();
+  buffer_.push_back(object ? '}' : ']');
+  return MaybeFlush();
+}
+
+Status ResultWriter::EndArray() {
+  return End(false);
+}
+
+Status ResultWriter::EndObject() {
+  return End(true);
+}
+
+Status ResultWriter::Key(const std::string& key) {
+  if (scopes_.empty() || !scopes_.back().object || scopes_.back().expects_value) {
+    return Misuse("key written outside of an object");
+  }
+  auto& scope = scopes_.back();
+  if (scope.has_members) {
+    buffer_.push_back(',');
+  }
+  scope.has_members = true;
+  scope.expects_value = true;
+  AppendJson(key, &buffer_);
+  buffer_.push_back(':');
+  return {kSuccess, ""};
+}
+
+Status ResultWriter::Value(const Json& value) {
+  if (auto status = BeforeValue(); !status.Ok()) {
+    return status;
+  }
+  AppendJson(value, &buffer_);
+  return MaybeFlush();
+}
+
+Status ResultWriter::Finish() {
+  if (finished_ || broken_) {
+    return Misuse("response already finished");
+  }
+  if (!has_result_ || !scopes_.empty()) {
+    return Misuse("result is incomplete");
+  }
+  buffer_.append(R"(,"id":)");
+  AppendJson(id_.ToJson(), &buffer_);
+  buffer_.push_back('}');
+  finished_ = true;
+  return Flush();
+}
+
+Status ResultWriter::Fail(const Error& error) {
+  if (started_ || broken_) {
+    return {kInternalError, "result already partially sent"};
+  }
+  buffer_.clear();
+  AppendEnvelopeBegin(&buffer_, kErrorName);
+  AppendJson(error.ToJson(), &buffer_);
+  buffer_.append(R"(,"id":)");
+  AppendJson(id_.ToJson(), &buffer_);
+  buffer_.push_back('}');
+  finished_ = true;
+  return Flush();
+}
+
+Status ResultWriter::MaybeFlush() {
+  if (buffer_.size() < chunk_size_) {
+    return {kSuccess, ""};
+  }
+  return Flush();
+}
+
+Status ResultWriter::Flush() {
+  if (buffer_.empty()) {
+    return {kSuccess, ""};
+  }
+  started_ = true;
+  if (!sink_(buffer_)) {
+    broken_ = true;
+    return {kInternalError, "failed to write response"};
+  }
+  // clear() keeps the capacity, so the buffer is allocated once per response.
+  buffer_.clear();
+  return {kSuccess, ""};
+}
+
+}  // namespace json_rpc
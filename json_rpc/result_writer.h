@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "error.h"
+#include "identifier.h"
+#include "json.h"
+#include "status.h"
+
+namespace json_rpc {
+
+/// Receives serialized output chunk by chunk, e.g. to write it to a transport.
+/// Returns false if the chunk could not be delivered.
+using ChunkSink = std::function<bool(std::string_view chunk)>;
+
+/// Writes the result of a Response incrementally, for results too large to build as one Json.
+///
+/// The handler emits the result value piece by piece through Begin/End, Key and Value calls; the
+/// writer keeps the {"jsonrpc":"2.0","result":...,"id":...} envelope valid around it and hands the
+/// output to the sink whenever chunk_size bytes are buffered, so peak memory stays around one
+/// chunk and the first bytes leave before the result is complete.
+///
+/// Until the first chunk is flushed, Fail() can still replace the result with an error Response.
+/// Afterwards an error can no longer be expressed on the wire: Fail() returns an error Status and
+/// the caller is expected to close the connection.
+class ResultWriter {
+ public:
+  static constexpr size_t kDefaultChunkSize = 64 * 1024;
+
+  /// @brief Constructor.
+  /// @param id The identifier of the request being answered.
+  /// @param sink The sink receiving the serialized response.
+  /// @param chunk_size The number of bytes buffered before they are handed to the sink.
+  ResultWriter(Identifier id, ChunkSink sink, size_t chunk_size = kDefaultChunkSize);
+
+  ResultWriter(const ResultWriter&) = delete;
+  ResultWriter& operator=(const ResultWriter&) = delete;
+
+  /// @brief Starts an array value.
+  /// @return A Status object indicating failure on misuse or if the sink failed.
+  Status BeginArray();
+
+  /// @brief Ends the innermost array.
+  /// @return A Status object indicating failure on misuse or if the sink failed.
+  Status EndArray();
+
+  /// @brief Starts an object value.
+  /// @return A Status object indicating failure on misuse or if the sink failed.
+  Status BeginObject();
+
+  /// @brief Ends the innermost object.
+  /// @return A Status object indicating failure on misuse or if the sink failed.
+  Status EndObject();
+
+  /// @brief Writes the key of the next member of the innermost object.
+  /// @param key The member name.
+  /// @return A Status object indicating failure on misuse or if the sink failed.
+  Status Key(const std::string& key);
+
+  /// @brief Writes a complete value, e.g. one element of a large array.
+  /// @param value The value to write.
+  /// @return A Status object indicating failure on misuse or if the sink failed.
+  Status Value(const Json& value);
+
+  /// @brief Completes the envelope and flushes all buffered output.
+  /// @return A Status object indicating failure if the result is incomplete or the sink failed.
+  Status Finish();
+
+  /// @brief Replaces the result with an error Response, if nothing was flushed yet.
+  /// @param error The error to respond with.
+  /// @return A Status object indicating failure if output was already flushed or the sink failed.
+  Status Fail(const Error& error);
+
+  /// @brief Checks if any output was handed to the sink.
+  /// @return true if a chunk was flushed, otherwise false.
+  [[nodiscard]] bool Started() const {
+    return started_;
+  }
+
+  /// @brief Checks if the response is complete.
+  /// @return true after a successful Finish() or Fail(), otherwise false.
+  [[nodiscard]] bool Finished() const {
+    return finished_;
+  }
+
+ private:
+  struct Scope {
+    bool object = false;
+    bool has_members = false;
+    bool expects_value = false;
+  };
+
+  Status BeforeValue();
+  Status End(bool object);
+  Status MaybeFlush();
+  Status Flush();
+
+  Identifier id_;
+  ChunkSink sink_;
+  size_t chunk_size_;
+  std::string buffer_;
+  std::vector<Scope> scopes_;
+  bool has_result_ = false;
+  bool started_ = false;
+  bool finished_ = false;
+  bool broken_ = false;
+};
+
+}  // namespace json_rpc
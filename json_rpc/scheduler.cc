@@ -0,0 +1,239 @@
+
+#include "scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+#include "batch_request.h"
+#include "error.h"
+
+namespace json_rpc {
+
+struct Scheduler::Message {
+  BatchRequest batch;
+  // The serialized response of each entry of the batch, empty if it gets none.
+  std::vector<std::string> responses;
+  std::atomic<size_t> remaining{0};
+  ReplyCallback reply;
+};
+
+Scheduler::Scheduler(Dispatcher* dispatcher, const size_t threads, const size_t starvation_limit)
+    : dispatcher_(dispatcher), starvation_limit_(starvation_limit) {
+  const auto count = std::max<size_t>(1, threads);
+  workers_.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    workers_.emplace_back([this] { Run(); });
+  }
+}
+
+Scheduler::~Scheduler() {
+  Stop();
+}
+
+Status Scheduler::Submit(const std::string& message, ReplyCallback reply) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) {
+      return {kInternalError, "scheduler stopped"};
+    }
+  }
+  BatchRequest batch;
+  const auto status = batch.ParseJson(message, dispatcher_->GetParseLimits());
+  if (!status.Ok()) {
+    Response response{Identifier()};
+    response.SetError({status.Code(), status.Message()});
+    reply(response.ToJson().dump());
+    return {kSuccess, ""};
+  }
+  if (!batch.IsBatch() && batch.Requests().front().second.Ok() &&
+      batch.Requests().front().first.IsNotification()) {
+    return SubmitNotification(std::move(batch.Requests().front().first), std::move(reply));
+  }
+  auto pending = std::make_shared<Message>();
+  pending->batch = std::move(batch);
+  pending->reply = std::move(reply);
+
+  auto& requests = pending->batch.Requests();
+  pending->responses.resize(requests.size());
+  std::vector<std::pair<Priority, size_t>> tasks;
+  tasks.reserve(requests.size());
+  for (size_t i = 0; i < requests.size(); ++i) {
+    auto& [request, request_status] = requests[i];
+    if (!request_status.Ok()) {
+      Response response;
+      response.SetError({request_status.Code(), request_status.Message()});
+      AppendJson(response.ToJson(), &pending->responses[i]);
+      continue;
+    }
+    // Both start as the request arrives, so a request can be cancelled or expire while queued.
+    dispatcher_->ApplyTimeout(&request);
+    if (!request.IsNotification()) {
+      request.SetCancellation(dispatcher_->Cancellations().Register(request.Id()));
+    }
+    tasks.emplace_back(dispatcher_->GetPriority(request), i);
+  }
+  pending->remaining = tasks.size();
+  if (tasks.empty()) {
+    Complete(pending.get());
+    return {kSuccess, ""};
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) {
+      for (const auto& [priority, index] : tasks) {
+        const auto& request = requests[index].first;
+        dispatcher_->Cancellations().Unregister(request.Id(), request.Cancellation());
+      }
+      return {kInternalError, "scheduler stopped"};
+    }
+    for (const auto& [priority, index] : tasks) {
+      queues_[static_cast<size_t>(priority)].push_back({pending, index, {}, nullptr, {}});
+    }
+  }
+  if (tasks.size() == 1) {
+    ready_.notify_one();
+  } else {
+    ready_.notify_all();
+  }
+  return {kSuccess, ""};
+}
+
+Status Scheduler::SubmitNotification(Request request, ReplyCallback reply) {
+  dispatcher_->ApplyTimeout(&request);
+  const auto priority = static_cast<size_t>(dispatcher_->GetPriority(request));
+  std::string key;
+  const bool coalesced = dispatcher_->CoalescingKey(request, &key);
+  ReplyCallback replaced;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) {
+      return {kInternalError, "scheduler stopped"};
+    }
+    const auto it = coalesced ? latest_.find(key) : latest_.end();
+    if (it != latest_.end()) {
+      it->second->notification = std::move(request);
+      replaced = std::move(it->second->reply);
+      it->second->reply = std::move(reply);
+      ++coalesced_;
+    } else {
+      auto& queue = queues_[priority];
+      queue.push_back({nullptr, 0, std::move(request), std::move(reply),
+                       coalesced ? std::move(key) : std::string()});
+      if (coalesced) {
+        latest_.emplace(queue.back().coalescing_key, &queue.back());
+      }
+    }
+  }
+  if (replaced) {
+    // The replaced notification will not run, and has nothing to answer.
+    replaced(std::string());
+  } else {
+    ready_.notify_one();
+  }
+  return {kSuccess, ""};
+}
+
+void Scheduler::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  ready_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+}
+
+size_t Scheduler::QueueSize(const Priority priority) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return queues_[static_cast<size_t>(priority)].size();
+}
+
+uint64_t Scheduler::Coalesced() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return coalesced_;
+}
+
+bool Scheduler::Pop(Task* task) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  const auto first_queued = [this] {
+    return static_cast<size_t>(std::find_if(queues_.begin(), queues_.end(),
+                                            [](const auto& queue) { return !queue.empty(); }) -
+                               queues_.begin());
+  };
+  ready_.wait(lock, [&] { return stopped_ || first_queued() < kPriorityCount; });
+  size_t pick = first_queued();
+  if (pick == kPriorityCount) {
+    return false;
+  }
+  // Strict priority, unless a lower class waited too many times already.
+  for (size_t i = pick + 1; i < kPriorityCount; ++i) {
+    if (!queues_[i].empty() && skipped_[i] >= starvation_limit_) {
+      pick = i;
+      break;
+    }
+  }
+  for (size_t i = pick + 1; i < kPriorityCount; ++i) {
+    if (!queues_[i].empty()) {
+      ++skipped_[i];
+    }
+  }
+  skipped_[pick] = 0;
+  if (!queues_[pick].front().coalescing_key.empty()) {
+    latest_.erase(queues_[pick].front().coalescing_key);
+  }
+  *task = std::move(queues_[pick].front());
+  queues_[pick].pop_front();
+  return true;
+}
+
+void Scheduler::Run() {
+  Task task;
+  while (Pop(&task)) {
+    if (task.message == nullptr) {
+      dispatcher_->Notify(task.notification);
+      if (task.reply) {
+        task.reply(std::string());
+      }
+      task = Task();
+      continue;
+    }
+    auto& message = *task.message;
+    auto& request = message.batch.Requests()[task.index].first;
+    Response response;
+    if (request.Cancellation().IsCancelled()) {
+      // Cancelled while queued, it never runs.
+      dispatcher_->Cancellations().Unregister(request.Id(), request.Cancellation());
+    } else if (dispatcher_->Dispatch(std::move(request), &response)) {
+      response.AppendTo(&message.responses[task.index]);
+    }
+    if (message.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      Complete(&message);
+    }
+    task = Task();
+  }
+}
+
+void Scheduler::Complete(Message* message) {
+  std::string text;
+  if (!message->batch.IsBatch()) {
+    text = std::move(message->responses.front());
+  } else {
+    // A batch of notifications is answered with nothing at all.
+    for (const auto& response : message->responses) {
+      if (!response.empty()) {
+        text.push_back(text.empty() ? '[' : ',');
+        text.append(response);
+      }
+    }
+    if (!text.empty()) {
+      text.push_back(']');
+    }
+  }
+  message->reply(std::move(text));
+}
+
+}  // namespace json_rpc
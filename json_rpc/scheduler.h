@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "dispatcher.h"
+#include "status.h"
+
+namespace json_rpc {
+
+/// Runs the requests of incoming messages on a pool of worker threads, from one queue per Priority
+/// class of their method.
+///
+/// Queues are served by strict priority, so a burst of kBulk requests does not delay kControl
+/// ones. To keep lower classes from starving, a class that waited while a higher one was served
+/// starvation_limit times in a row is served next.
+///
+/// Requests get their cancellation token and default deadline as they are queued, so cancel
+/// notifications, which are kControl, overtake the requests they cancel, and requests expiring in
+/// a queue are answered with kRequestTimeout without running. The per-method counters and handle
+/// latencies of the Dispatcher are recorded as by Dispatcher::Dispatch().
+///
+/// A notification sent alone takes a lighter path: it is queued by itself, without the state of a
+/// message awaiting responses, and run by Dispatcher::Notify(). If its method has a Coalescing
+/// policy, it replaces the queued notification with the same key, whose reply is called at once
+/// with an empty string, so a flood of progress or log notifications cannot grow the queue.
+class Scheduler {
+ public:
+  /// Receives the JSON text of the response to a message, or an empty string if nothing must be
+  /// sent. Called on a worker thread, or on the submitting thread if the message needed no handler.
+  using ReplyCallback = std::function<void(std::string response)>;
+
+  static constexpr size_t kDefaultStarvationLimit = 16;
+
+  /// @brief Constructor, starts the worker threads.
+  /// @param dispatcher The dispatcher running the requests; it must outlive the scheduler.
+  /// @param threads The number of worker threads, at least one.
+  /// @param starvation_limit How many times in a row a waiting class lets higher ones be served.
+  explicit Scheduler(Dispatcher* dispatcher, size_t threads = 1,
+                     size_t starvation_limit = kDefaultStarvationLimit);
+
+  Scheduler(const Scheduler&) = delete;
+  Scheduler& operator=(const Scheduler&) = delete;
+
+  /// @brief Destructor, runs the queued requests and stops the worker threads.
+  ~Scheduler();
+
+  /// @brief Parses a single or batch request and queues its requests.
+  /// @param message The JSON text of the request.
+  /// @param reply The callback receiving the response once every request of the message ran.
+  /// @return A Status object indicating failure if the scheduler is stopped, in which case reply is
+  /// not called.
+  Status Submit(const std::string& message, ReplyCallback reply);
+
+  /// @brief Runs the queued requests and stops the worker threads. Later messages are refused.
+  /// Must not be called from a reply callback.
+  void Stop();
+
+  /// @brief Gets the number of requests waiting in the queue of a class.
+  /// @param priority The scheduling class.
+  /// @return The number of queued requests.
+  [[nodiscard]] size_t QueueSize(Priority priority) const;
+
+  /// @brief Gets the number of notifications replaced in a queue by a later one.
+  /// @return The number of coalesced notifications.
+  [[nodiscard]] uint64_t Coalesced() const;
+
+ private:
+  struct Message;
+
+  struct Task {
+    std::shared_ptr<Message> message;
+    size_t index = 0;
+    // A notification sent alone, queued without a Message, and the key it is coalesced under.
+    Request notification;
+    ReplyCallback reply;
+    std::string coalescing_key;
+  };
+
+  Status SubmitNotification(Request request, ReplyCallback reply);
+
+  void Run();
+
+  bool Pop(Task* task);
+
+  static void Complete(Message* message);
+
+  Dispatcher* dispatcher_;
+  const size_t starvation_limit_;
+  mutable std::mutex mutex_;
+  std::condition_variable ready_;
+  std::array<std::deque<Task>, kPriorityCount> queues_;
+  std::array<size_t, kPriorityCount> skipped_{};
+  // The queued notifications by coalescing key. Tasks stay in place in their deque, which only
+  // grows and shrinks at its ends.
+  std::unordered_map<std::string, Task*> latest_;
+  uint64_t coalesced_ = 0;
+  bool stopped_ = false;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace json_rpc
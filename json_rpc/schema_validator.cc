@@ -0,0 +1,700 @@
+
+#include "schema_validator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace json_rpc {
+
+namespace {
+
+enum TypeBit : uint32_t {
+  kNullBit = 1 << 0,
+  kBooleanBit = 1 << 1,
+  kIntegerBit = 1 << 2,
+  kNumberBit = 1 << 3,
+  kStringBit = 1 << 4,
+  kArrayBit = 1 << 5,
+  kObjectBit = 1 << 6,
+  kAnyType = (1 << 7) - 1,
+};
+
+constexpr size_t kUnbounded = std::numeric_limits<size_t>::max();
+constexpr double kInfinity = std::numeric_limits<double>::infinity();
+constexpr size_t kRequiredBits = 64;
+
+// Numbers without a fractional part are integers, whatever their JSON spelling.
+uint32_t TypeOf(const Json& value) {
+  if (value.is_null()) {
+    return kNullBit;
+  }
+  if (value.is_boolean()) {
+    return kBooleanBit;
+  }
+  if (value.is_number_integer()) {
+    return kIntegerBit;
+  }
+  if (value.is_number_float()) {
+    const auto number = value.get<double>();
+    return std::isfinite(number) && std::floor(number) == number ? kIntegerBit : kNumberBit;
+  }
+  if (value.is_string()) {
+    return kStringBit;
+  }
+  if (value.is_array()) {
+    return kArrayBit;
+  }
+  return kObjectBit;
+}
+
+bool ParseTypeName(const std::string& name, uint32_t* types) {
+  static const std::map<std::string, uint32_t> kTypes = {{"null", kNullBit},
+                                                         {"boolean", kBooleanBit},
+                                                         {"integer", kIntegerBit},
+                                                         {"number", kNumberBit | kIntegerBit},
+                                                         {"string", kStringBit},
+                                                         {"array", kArrayBit},
+                                                         {"object", kObjectBit}};
+  const auto it = kTypes.find(name);
+  if (it == kTypes.end()) {
+    return false;
+  }
+  *types |= it->second;
+  return true;
+}
+
+std::string TypeNames(uint32_t types) {
+  static const std::pair<uint32_t, const char*> kNames[] = {{kNullBit, "null"},
+                                                            {kBooleanBit, "boolean"},
+                                                            {kNumberBit, "number"},
+                                                            {kIntegerBit, "integer"},
+                                                            {kStringBit, "string"},
+                                                            {kArrayBit, "array"},
+                                                            {kObjectBit, "object"}};
+  std::string names;
+  for (const auto& [bit, name] : kNames) {
+    if ((types & bit) == 0 || (bit == kIntegerBit && (types & kNumberBit) != 0)) {
+      continue;
+    }
+    names += names.empty() ? name : std::string(" or ") + name;
+  }
+  return names;
+}
+
+// Length in code points, as JSON Schema counts it.
+size_t Utf8Length(const std::string& str) {
+  size_t length = 0;
+  for (const char c : str) {
+    if ((static_cast<unsigned char>(c) & 0xC0) != 0x80) {
+      ++length;
+    }
+  }
+  return length;
+}
+
+std::string EscapePointerToken(const std::string& token) {
+  std::string escaped;
+  escaped.reserve(token.size());
+  for (const char c : token) {
+    if (c == '~') {
+      escaped += "~0";
+    } else if (c == '/') {
+      escaped += "~1";
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+template <typename F>
+bool ForEachMember(const Json& object, F&& f) {
+  for (auto it = object.begin(); it != object.end(); ++it) {
+    if (!f(it.key(), it.value())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename F>
+bool ForEachMember(const std::map<std::string, Json>& object, F&& f) {
+  for (const auto& [key, value] : object) {
+    if (!f(key, value)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool HasMember(const Json& object, const std::string& key) {
+  return object.contains(key);
+}
+
+bool HasMember(const std::map<std::string, Json>& object, const std::string& key) {
+  return object.find(key) != object.end();
+}
+
+}  // namespace
+
+struct SchemaValidator::Node {
+  struct Property {
+    const Node* schema = nullptr;
+    int required_bit = -1;
+  };
+
+  [[nodiscard]] bool HasCombinators() const {
+    return ref != nullptr || !all_of.empty() || !any_of.empty() || !one_of.empty();
+  }
+
+  uint32_t types = kAnyType;
+  bool reject_all = false;
+
+  bool has_enum = false;
+  std::unordered_set<std::string> string_enum;
+  std::vector<Json> other_enum;
+
+  // Declared and required properties share one table, so each member is hashed once.
+  std::unordered_map<std::string, Property> properties;
+  std::vector<std::string> required;
+  bool additional_allowed = true;
+  const Node* additional = nullptr;
+  size_t min_properties = 0;
+  size_t max_properties = kUnbounded;
+
+  std::vector<const Node*> prefix_items;
+  const Node* items = nullptr;
+  size_t min_items = 0;
+  size_t max_items = kUnbounded;
+
+  size_t min_length = 0;
+  size_t max_length = kUnbounded;
+
+  double minimum = -kInfinity;
+  double maximum = kInfinity;
+  double exclusive_minimum = -kInfinity;
+  double exclusive_maximum = kInfinity;
+
+  const Node* ref = nullptr;
+  std::vector<const Node*> all_of;
+  std::vector<const Node*> any_of;
+  std::vector<const Node*> one_of;
+};
+
+struct SchemaValidator::Failure {
+  // Innermost segment first, segments are appended while unwinding.
+  std::vector<std::string> path;
+  std::string reason;
+};
+
+class SchemaValidator::Compiler {
+ public:
+  Compiler(const Json& root, std::vector<std::unique_ptr<Node>>* nodes)
+      : root_(root), nodes_(nodes) {
+  }
+
+  Status CompileRoot(const Node** out) {
+    auto* node = NewNode();
+    refs_["#"] = node;
+    *out = node;
+    if (auto status = CompileInto(root_, "#", node); !status.Ok()) {
+      return status;
+    }
+    return CheckCycles();
+  }
+
+ private:
+  Node* NewNode() {
+    return nodes_->emplace_back(std::make_unique<Node>()).get();
+  }
+
+  static Status Invalid(const std::string& path, const std::string& reason) {
+    return {kInvalidParams, "invalid schema at " + path + ": " + reason};
+  }
+
+  Status Compile(const Json& schema, const std::string& path, const Node** out) {
+    auto* node = NewNode();
+    *out = node;
+    return CompileInto(schema, path, node);
+  }
+
+  Status CompileList(const Json& schema, const char* key, const std::string& path,
+                     std::vector<const Node*>* out) {
+    const auto& list = schema.at(key);
+    if (!list.is_array()) {
+      return Invalid(path + "/" + key, "must be an array");
+    }
+    for (size_t i = 0; i < list.size(); ++i) {
+      const Node* node = nullptr;
+      if (auto status = Compile(list[i], path + "/" + key + "/" + std::to_string(i), &node);
+          !status.Ok()) {
+        return status;
+      }
+      out->push_back(node);
+    }
+    return {kSuccess, ""};
+  }
+
+  static Status ReadSize(const Json& schema, const char* key, const std::string& path,
+                         size_t* out) {
+    if (!schema.contains(key)) {
+      return {kSuccess, ""};
+    }
+    const auto& value = schema.at(key);
+    if (!value.is_number_unsigned() && !(value.is_number_integer() && value.get<int64_t>() >= 0)) {
+      return Invalid(path + "/" + key, "must be a non-negative integer");
+    }
+    *out = value.get<size_t>();
+    return {kSuccess, ""};
+  }
+
+  static Status ReadNumber(const Json& schema, const char* key, const std::string& path,
+                           double* out) {
+    if (!schema.contains(key)) {
+      return {kSuccess, ""};
+    }
+    const auto& value = schema.at(key);
+    if (!value.is_number()) {
+      return Invalid(path + "/" + key, "must be a number");
+    }
+    *out = value.get<double>();
+    return {kSuccess, ""};
+  }
+
+  Status ResolveRef(const Json& ref, const std::string& path, const Node** out) {
+    if (!ref.is_string() || ref.get<std::string>().rfind('#', 0) != 0) {
+      return Invalid(path, "only local references are supported");
+    }
+    const auto target = ref.get<std::string>();
+    if (const auto it = refs_.find(target); it != refs_.end()) {
+      *out = it->second;
+      return {kSuccess, ""};
+    }
+    const Json* schema = nullptr;
+    try {
+      schema = &root_.at(Json::json_pointer(target.substr(1)));
+    } catch (const std::exception& e) {
+      return Invalid(path, "unresolvable reference " + target);
+    }
+    // Registered before compiling so that recursive schemas link back to this node.
+    auto* node = NewNode();
+    refs_[target] = node;
+    *out = node;
+    return CompileInto(*schema, target, node);
+  }
+
+  // A "$ref" applies its target to the same value, and so do allOf, anyOf and oneOf. A chain of
+  // them leading back to a node would recurse forever on the first value validated.
+  Status CheckCycles() const {
+    std::unordered_map<const Node*, bool> done;
+    for (const auto& [target, node] : refs_) {
+      if (!Acyclic(node, &done)) {
+        return Invalid(target, "reference cycle without a property or item in between");
+      }
+    }
+    return {kSuccess, ""};
+  }
+
+  // Nodes map to false while they are being visited, and to true once no cycle passes them.
+  static bool Acyclic(const Node* node, std::unordered_map<const Node*, bool>* done) {
+    if (const auto [it, inserted] = done->emplace(node, false); !inserted) {
+      return it->second;
+    }
+    if (node->ref != nullptr && !Acyclic(node->ref, done)) {
+      return false;
+    }
+    for (const auto* list : {&node->all_of, &node->any_of, &node->one_of}) {
+      for (const auto* schema : *list) {
+        if (!Acyclic(schema, done)) {
+          return false;
+        }
+      }
+    }
+    done->at(node) = true;
+    return true;
+  }
+
+  Status CompileInto(const Json& schema, const std::string& path, Node* node) {
+    if (schema.is_boolean()) {
+      node->reject_all = !schema.get<bool>();
+      return {kSuccess, ""};
+    }
+    if (!schema.is_object()) {
+      return Invalid(path, "must be an object or a boolean");
+    }
+
+    if (schema.contains("type")) {
+      const auto& type = schema.at("type");
+      node->types = 0;
+      const auto types = type.is_array() ? type : Json::array({type});
+      for (const auto& name : types) {
+        if (!name.is_string() || !ParseTypeName(name.get<std::string>(), &node->types)) {
+          return Invalid(path + "/type", "unknown type " + name.dump());
+        }
+      }
+    }
+
+    if (schema.contains("enum") || schema.contains("const")) {
+      const auto values =
+          schema.contains("const") ? Json::array({schema.at("const")}) : schema.at("enum");
+      if (!values.is_array()) {
+        return Invalid(path + "/enum", "must be an array");
+      }
+      node->has_enum = true;
+      for (const auto& value : values) {
+        if (value.is_string()) {
+          node->string_enum.insert(value.get<std::string>());
+        } else {
+          node->other_enum.push_back(value);
+        }
+      }
+    }
+
+    if (schema.contains("properties")) {
+      const auto& properties = schema.at("properties");
+      if (!properties.is_object()) {
+        return Invalid(path + "/properties", "must be an object");
+      }
+      for (auto it = properties.begin(); it != properties.end(); ++it) {
+        const auto property_path = path + "/properties/" + EscapePointerToken(it.key());
+        if (auto status = Compile(it.value(), property_path, &node->properties[it.key()].schema);
+            !status.Ok()) {
+          return status;
+        }
+      }
+    }
+    if (schema.contains("required")) {
+      const auto& required = schema.at("required");
+      if (!required.is_array()) {
+        return Invalid(path + "/required", "must be an array");
+      }
+      for (const auto& name : required) {
+        if (!name.is_string()) {
+          return Invalid(path + "/required", "must only contain strings");
+        }
+        auto& property = node->properties[name.get<std::string>()];
+        if (property.required_bit < 0) {
+          property.required_bit = static_cast<int>(node->required.size());
+          node->required.push_back(name.get<std::string>());
+        }
+      }
+    }
+    if (schema.contains("additionalProperties")) {
+      const auto& additional = schema.at("additionalProperties");
+      if (additional.is_boolean()) {
+        node->additional_allowed = additional.get<bool>();
+      } else if (auto status = Compile(additional, path + "/additionalProperties",
+                                       &node->additional);
+                 !status.Ok()) {
+        return status;
+      }
+    }
+
+    if (schema.contains("prefixItems")) {
+      if (auto status = CompileList(schema, "prefixItems", path, &node->prefix_items);
+          !status.Ok()) {
+        return status;
+      }
+    }
+    if (schema.contains("items")) {
+      // The array form is the tuple validation of drafts before 2020-12.
+      auto status = schema.at("items").is_array()
+                        ? CompileList(schema, "items", path, &node->prefix_items)
+                        : Compile(schema.at("items"), path + "/items", &node->items);
+      if (!status.Ok()) {
+        return status;
+      }
+    }
+
+    for (const auto& [key, out] :
+         {std::pair<const char*, size_t*>{"minProperties", &node->min_properties},
+          {"maxProperties", &node->max_properties},
+          {"minItems", &node->min_items},
+          {"maxItems", &node->max_items},
+          {"minLength", &node->min_length},
+          {"maxLength", &node->max_length}}) {
+      if (auto status = ReadSize(schema, key, path, out); !status.Ok()) {
+        return status;
+      }
+    }
+
+    for (const auto& [key, out] : {std::pair<const char*, double*>{"minimum", &node->minimum},
+                                   {"maximum", &node->maximum}}) {
+      if (auto status = ReadNumber(schema, key, path, out); !status.Ok()) {
+        return status;
+      }
+    }
+    for (const auto& [key, inclusive, exclusive, unbounded] :
+         {std::tuple<const char*, double*, double*, double>{
+              "exclusiveMinimum", &node->minimum, &node->exclusive_minimum, -kInfinity},
+          {"exclusiveMaximum", &node->maximum, &node->exclusive_maximum, kInfinity}}) {
+      if (!schema.contains(key)) {
+        continue;
+      }
+      // Draft 4 spells the exclusive bounds as booleans modifying minimum and maximum.
+      if (schema.at(key).is_boolean()) {
+        if (schema.at(key).get<bool>()) {
+          *exclusive = *inclusive;
+          *inclusive = unbounded;
+        }
+      } else if (auto status = ReadNumber(schema, key, path, exclusive); !status.Ok()) {
+        return status;
+      }
+    }
+
+    for (const auto& [key, out] : {std::pair<const char*, std::vector<const Node*>*>{
+                                       "allOf", &node->all_of},
+                                   {"anyOf", &node->any_of},
+                                   {"oneOf", &node->one_of}}) {
+      if (!schema.contains(key)) {
+        continue;
+      }
+      if (auto status = CompileList(schema, key, path, out); !status.Ok()) {
+        return status;
+      }
+    }
+
+    if (schema.contains("$ref")) {
+      return ResolveRef(schema.at("$ref"), path + "/$ref", &node->ref);
+    }
+    return {kSuccess, ""};
+  }
+
+  const Json& root_;
+  std::vector<std::unique_ptr<Node>>* nodes_;
+  std::unordered_map<std::string, const Node*> refs_;
+};
+
+SchemaValidator::SchemaValidator() = default;
+
+SchemaValidator::~SchemaValidator() = default;
+
+SchemaValidator::SchemaValidator(SchemaValidator&&) noexcept = default;
+
+SchemaValidator& SchemaValidator::operator=(SchemaValidator&&) noexcept = default;
+
+Status SchemaValidator::Compile(const Json& schema) {
+  std::vector<std::unique_ptr<Node>> nodes;
+  const Node* root = nullptr;
+  if (auto status = Compiler(schema, &nodes).CompileRoot(&root); !status.Ok()) {
+    return status;
+  }
+  nodes_ = std::move(nodes);
+  root_ = root;
+  return {kSuccess, ""};
+}
+
+namespace {
+
+bool Fail(std::string* out, std::string reason) {
+  *out = std::move(reason);
+  return false;
+}
+
+}  // namespace
+
+template <typename Members>
+bool SchemaValidator::ValidateObject(const Node& node, const Members& members,
+                                     Failure* failure) const {
+  if (members.size() < node.min_properties) {
+    return Fail(&failure->reason,
+                "expected at least " + std::to_string(node.min_properties) + " properties");
+  }
+  if (members.size() > node.max_properties) {
+    return Fail(&failure->reason,
+                "expected at most " + std::to_string(node.max_properties) + " properties");
+  }
+
+  uint64_t seen_required = 0;
+  const bool valid = ForEachMember(members, [&](const std::string& key, const Json& value) {
+    const Node* schema = node.additional;
+    if (const auto it = node.properties.find(key); it != node.properties.end()) {
+      const auto& property = it->second;
+      if (property.required_bit >= 0 && property.required_bit < static_cast<int>(kRequiredBits)) {
+        seen_required |= uint64_t{1} << property.required_bit;
+      }
+      schema = property.schema;
+    } else if (!node.additional_allowed) {
+      failure->path.push_back(key);
+      return Fail(&failure->reason, "additional property is not allowed");
+    }
+    if (schema != nullptr && !ValidateValue(*schema, value, failure)) {
+      failure->path.push_back(key);
+      return false;
+    }
+    return true;
+  });
+  if (!valid) {
+    return false;
+  }
+
+  for (size_t bit = 0; bit < node.required.size(); ++bit) {
+    const bool present = bit < kRequiredBits ? (seen_required >> bit) & 1
+                                             : HasMember(members, node.required[bit]);
+    if (!present) {
+      failure->path.push_back(node.required[bit]);
+      return Fail(&failure->reason, "required property is missing");
+    }
+  }
+  return true;
+}
+
+template <typename Items>
+bool SchemaValidator::ValidateArray(const Node& node, const Items& items, Failure* failure) const {
+  if (items.size() < node.min_items) {
+    return Fail(&failure->reason, "expected at least " + std::to_string(node.min_items) + " items");
+  }
+  if (items.size() > node.max_items) {
+    return Fail(&failure->reason, "expected at most " + std::to_string(node.max_items) + " items");
+  }
+  for (size_t i = 0; i < items.size(); ++i) {
+    const Node* schema = i < node.prefix_items.size() ? node.prefix_items[i] : node.items;
+    if (schema != nullptr && !ValidateValue(*schema, items[i], failure)) {
+      failure->path.push_back(std::to_string(i));
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SchemaValidator::ValidateValue(const Node& node, const Json& value, Failure* failure) const {
+  if (node.reject_all) {
+    return Fail(&failure->reason, "no value is allowed");
+  }
+  if ((node.types & TypeOf(value)) == 0) {
+    return Fail(&failure->reason, "expected " + TypeNames(node.types));
+  }
+  if (node.has_enum) {
+    const bool found =
+        value.is_string()
+            ? node.string_enum.count(value.get_ref<const std::string&>()) != 0
+            : std::find(node.other_enum.begin(), node.other_enum.end(), value) !=
+                  node.other_enum.end();
+    if (!found) {
+      return Fail(&failure->reason, "value is not one of the allowed values");
+    }
+  }
+
+  if (value.is_object()) {
+    if (!ValidateObject(node, value, failure)) {
+      return false;
+    }
+  } else if (value.is_array()) {
+    if (!ValidateArray(node, value, failure)) {
+      return false;
+    }
+  } else if (value.is_string()) {
+    const auto length = Utf8Length(value.get_ref<const std::string&>());
+    if (length < node.min_length) {
+      return Fail(&failure->reason,
+                  "expected at least " + std::to_string(node.min_length) + " characters");
+    }
+    if (length > node.max_length) {
+      return Fail(&failure->reason,
+                  "expected at most " + std::to_string(node.max_length) + " characters");
+    }
+  } else if (value.is_number()) {
+    const auto number = value.get<double>();
+    if (number < node.minimum || number <= node.exclusive_minimum) {
+      return Fail(&failure->reason, "value is below the minimum");
+    }
+    if (number > node.maximum || number >= node.exclusive_maximum) {
+      return Fail(&failure->reason, "value is above the maximum");
+    }
+  }
+
+  return !node.HasCombinators() || ValidateCombinators(node, value, failure);
+}
+
+bool SchemaValidator::ValidateCombinators(const Node& node, const Json& value,
+                                          Failure* failure) const {
+  if (node.ref != nullptr && !ValidateValue(*node.ref, value, failure)) {
+    return false;
+  }
+  for (const auto* schema : node.all_of) {
+    if (!ValidateValue(*schema, value, failure)) {
+      return false;
+    }
+  }
+  if (!node.any_of.empty()) {
+    Failure ignored;
+    const bool any = std::any_of(node.any_of.begin(), node.any_of.end(), [&](const Node* schema) {
+      return ValidateValue(*schema, value, &ignored);
+    });
+    if (!any) {
+      return Fail(&failure->reason, "value does not match any schema of anyOf");
+    }
+  }
+  if (!node.one_of.empty()) {
+    Failure ignored;
+    const auto matches = std::count_if(node.one_of.begin(), node.one_of.end(),
+                                       [&](const Node* schema) {
+                                         return ValidateValue(*schema, value, &ignored);
+                                       });
+    if (matches != 1) {
+      return Fail(&failure->reason, "value must match exactly one schema of oneOf");
+    }
+  }
+  return true;
+}
+
+Error SchemaValidator::ToError(Failure* failure) {
+  std::string path;
+  for (auto it = failure->path.rbegin(); it != failure->path.rend(); ++it) {
+    path += "/" + EscapePointerToken(*it);
+  }
+  return {kInvalidParams, "Invalid params", {{"path", path}, {"reason", failure->reason}}};
+}
+
+Error SchemaValidator::Validate(const Json& value) const {
+  if (root_ == nullptr) {
+    return {};
+  }
+  Failure failure;
+  if (!ValidateValue(*root_, value, &failure)) {
+    return ToError(&failure);
+  }
+  return {};
+}
+
+Error SchemaValidator::Validate(const Parameter& params) const {
+  if (root_ == nullptr) {
+    return {};
+  }
+  const auto& node = *root_;
+  const bool as_object = params.Type() == Parameter::ParamType::kMap ||
+                         (params.Type() == Parameter::ParamType::kNull &&
+                          (node.types & kObjectBit) != 0);
+  // Enums and combinators are rare at the root of params; they are checked on a JSON copy rather
+  // than duplicating them for the containers of Parameter.
+  if (node.has_enum || node.HasCombinators()) {
+    if (params.Type() != Parameter::ParamType::kNull) {
+      return Validate(params.ToJson());
+    }
+    return Validate(as_object ? Json::object() : Json::array());
+  }
+
+  Failure failure;
+  bool valid = false;
+  if (node.reject_all) {
+    valid = Fail(&failure.reason, "no value is allowed");
+  } else if (as_object) {
+    valid = (node.types & kObjectBit) != 0
+                ? ValidateObject(node, params.Map(), &failure)
+                : Fail(&failure.reason, "expected " + TypeNames(node.types));
+  } else {
+    valid = (node.types & kArrayBit) != 0
+                ? ValidateArray(node, params.Array(), &failure)
+                : Fail(&failure.reason, "expected " + TypeNames(node.types));
+  }
+  return valid ? Error() : ToError(&failure);
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "error.h"
+#include "json.h"
+#include "parameter.h"
+#include "status.h"
+
+namespace json_rpc {
+
+/// A JSON Schema compiled once into a validator tree, used to check the params of a method.
+///
+/// Compilation resolves everything that would otherwise be interpreted on every call: types become
+/// bit masks, object properties and required keys become one hash table that is probed once per
+/// member, string enums become hash sets, and local "$ref"s are linked to their target node.
+///
+/// Supported keywords: type, enum, const, properties, required, additionalProperties,
+/// minProperties, maxProperties, items, prefixItems, minItems, maxItems, minLength, maxLength,
+/// minimum, maximum, exclusiveMinimum, exclusiveMaximum, allOf, anyOf, oneOf, and "$ref" to
+/// "#/$defs/..." or "#/definitions/...". Other keywords are annotations and are ignored.
+///
+/// A compiled validator is immutable and may be shared between threads.
+class SchemaValidator {
+ public:
+  /// @brief Default constructor, accepts any value.
+  SchemaValidator();
+
+  ~SchemaValidator();
+
+  SchemaValidator(SchemaValidator&&) noexcept;
+  SchemaValidator& operator=(SchemaValidator&&) noexcept;
+
+  /// @brief Compiles a JSON Schema.
+  /// @param schema The schema to compile.
+  /// @return A Status object indicating success, or a kInvalidParams failure naming the offending
+  /// schema location. Schemas whose "$ref"s form a cycle that validates the same value again, such
+  /// as {"$ref": "#"}, are rejected.
+  Status Compile(const Json& schema);
+
+  /// @brief Validates the params of a request. Omitted params are validated as an empty object or
+  /// array, whichever the schema allows.
+  /// @param params The params to validate.
+  /// @return A kSuccess error, or a kInvalidParams error whose data holds the JSON Pointer "path"
+  /// of the offending value and the "reason" it was rejected.
+  [[nodiscard]] Error Validate(const Parameter& params) const;
+
+  /// @brief Validates a JSON value.
+  /// @param value The value to validate.
+  /// @return A kSuccess error, or a kInvalidParams error as for Validate(const Parameter&).
+  [[nodiscard]] Error Validate(const Json& value) const;
+
+ private:
+  struct Node;
+  struct Failure;
+  class Compiler;
+
+  template <typename Members>
+  bool ValidateObject(const Node& node, const Members& members, Failure* failure) const;
+
+  template <typename Items>
+  bool ValidateArray(const Node& node, const Items& items, Failure* failure) const;
+
+  bool ValidateValue(const Node& node, const Json& value, Failure* failure) const;
+
+  bool ValidateCombinators(const Node& node, const Json& value, Failure* failure) const;
+
+  static Error ToError(Failure* failure);
+
+  std::vector<std::unique_ptr<Node>> nodes_;
+  const Node* root_ = nullptr;
+};
+
+}  // namespace json_rpc
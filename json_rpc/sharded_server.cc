@@ -0,0 +1,510 @@
+
+#include "sharded_server.h"
+
+#include <algorithm>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+#include "error.h"
+#include "response.h"
+#include "thread_affinity.h"
+
+namespace json_rpc {
+
+struct ShardedServer::Connection {
+  // Identifies the connection in a capture log: the shard index in the high 16 bits.
+  uint64_t id = 0;
+  // Bytes read and not handled yet, the first input_size of input; the rest is room to read into.
+  std::string input;
+  size_t input_size = 0;
+  std::string output;
+  // Bytes of output already written.
+  size_t written = 0;
+  bool writing = false;
+  // Cleared once the connection no longer waits for input.
+  bool reading = true;
+  // Set once the connection is dropped after the pending output, e.g. when the peer half-closed.
+  bool closing = false;
+  // The codec negotiated by a hello frame.
+  Codec codec = Codec::kNone;
+  // The last decompressed message, whose capacity is reused.
+  std::string message;
+};
+
+struct ShardedServer::Shard {
+  size_t index = 0;
+  Dispatcher dispatcher;
+  int listen_fd = -1;
+  bool owns_listen_fd = false;
+  int epoll_fd = -1;
+  int wake_fd = -1;
+  std::thread thread;
+  std::unordered_map<int, Connection> connections;
+  CaptureLog* capture = nullptr;
+  CompressionOptions compression;
+  uint64_t accepted = 0;
+};
+
+void ShardedServer::SetCaptureLog(CaptureLog* log) {
+  for (auto& shard : shards_) {
+    shard->capture = log;
+  }
+}
+
+void ShardedServer::SetCompression(const CompressionOptions& options) {
+  for (auto& shard : shards_) {
+    shard->compression = options;
+  }
+}
+
+#ifdef __linux__
+
+namespace {
+
+constexpr int kBacklog = 1024;
+constexpr int kMaxEvents = 64;
+constexpr size_t kReadSize = 64 * 1024;
+
+Status SystemError(const std::string& what) {
+  return {kInternalError, what + ": " + std::strerror(errno)};
+}
+
+}  // namespace
+
+ShardedServer::ShardedServer(size_t shards, const ShardSetup setup, const bool pin_threads)
+    : pin_threads_(pin_threads) {
+  if (shards == 0) {
+    shards = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < shards; ++i) {
+    auto shard = std::make_unique<Shard>();
+    shard->index = i;
+    if (setup) {
+      setup(i, &shard->dispatcher);
+    }
+    shards_.push_back(std::move(shard));
+  }
+}
+
+ShardedServer::~ShardedServer() {
+  Stop();
+}
+
+Dispatcher& ShardedServer::GetDispatcher(const size_t shard) {
+  return shards_.at(shard)->dispatcher;
+}
+
+Status ShardedServer::StartTcp(const std::string& host, const uint16_t port) {
+  if (started_) {
+    return {kInternalError, "server started already"};
+  }
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+    return {kInvalidParams, "invalid host: " + host};
+  }
+  port_ = port;
+  for (auto& shard : shards_) {
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      Stop();
+      return SystemError("socket");
+    }
+    shard->listen_fd = fd;
+    shard->owns_listen_fd = true;
+    const int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0) {
+      Stop();
+      return SystemError("SO_REUSEPORT");
+    }
+    // The first shard may let the kernel pick the port, the others join it.
+    address.sin_port = htons(port_);
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+      Stop();
+      return SystemError("bind");
+    }
+    if (port_ == 0) {
+      socklen_t length = sizeof(address);
+      getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length);
+      port_ = ntohs(address.sin_port);
+    }
+    if (listen(fd, kBacklog) != 0) {
+      Stop();
+      return SystemError("listen");
+    }
+  }
+  return Launch();
+}
+
+Status ShardedServer::StartUnix(const std::string& path) {
+  if (started_) {
+    return {kInternalError, "server started already"};
+  }
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    return {kInvalidParams, "socket path too long: " + path};
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  shared_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (shared_fd_ < 0) {
+    return SystemError("socket");
+  }
+  unlink(path.c_str());
+  if (bind(shared_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(shared_fd_, kBacklog) != 0) {
+    const auto status = SystemError("bind");
+    Stop();
+    return status;
+  }
+  unix_path_ = path;
+  for (auto& shard : shards_) {
+    shard->listen_fd = shared_fd_;
+  }
+  return Launch();
+}
+
+Status ShardedServer::Launch() {
+  for (auto& shard : shards_) {
+    shard->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    shard->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (shard->epoll_fd < 0 || shard->wake_fd < 0) {
+      const auto status = SystemError("epoll");
+      Stop();
+      return status;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = shard->wake_fd;
+    epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, shard->wake_fd, &event);
+    // A shared listening socket wakes one shard per connection rather than all of them.
+    event.events = shard->owns_listen_fd ? EPOLLIN : EPOLLIN | EPOLLEXCLUSIVE;
+    event.data.fd = shard->listen_fd;
+    if (epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, shard->listen_fd, &event) != 0) {
+      const auto status = SystemError("epoll_ctl");
+      Stop();
+      return status;
+    }
+  }
+  started_ = true;
+  for (auto& shard : shards_) {
+    shard->thread = std::thread(&ShardedServer::Run, shard.get());
+    if (pin_threads_) {
+      internal::PinThread(&shard->thread, shard->index);
+    }
+  }
+  return {kSuccess, ""};
+}
+
+void ShardedServer::Stop() {
+  for (auto& shard : shards_) {
+    if (shard->thread.joinable()) {
+      const uint64_t one = 1;
+      static_cast<void>(write(shard->wake_fd, &one, sizeof(one)));
+      shard->thread.join();
+    }
+    for (const auto& [fd, connection] : shard->connections) {
+      close(fd);
+    }
+    shard->connections.clear();
+    for (auto* fd : {&shard->epoll_fd, &shard->wake_fd}) {
+      if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+      }
+    }
+    if (shard->owns_listen_fd && shard->listen_fd >= 0) {
+      close(shard->listen_fd);
+    }
+    shard->listen_fd = -1;
+    shard->owns_listen_fd = false;
+  }
+  if (shared_fd_ >= 0) {
+    close(shared_fd_);
+    shared_fd_ = -1;
+  }
+  if (!unix_path_.empty()) {
+    unlink(unix_path_.c_str());
+    unix_path_.clear();
+  }
+  started_ = false;
+}
+
+void ShardedServer::Run(Shard* shard) {
+  epoll_event events[kMaxEvents];
+  for (;;) {
+    const int count = epoll_wait(shard->epoll_fd, events, kMaxEvents, -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    for (int i = 0; i < count; ++i) {
+      const int fd = events[i].data.fd;
+      if (fd == shard->wake_fd) {
+        return;
+      }
+      if (fd == shard->listen_fd) {
+        Accept(shard);
+        continue;
+      }
+      const auto it = shard->connections.find(fd);
+      if (it == shard->connections.end()) {
+        continue;
+      }
+      auto* connection = &it->second;
+      bool open = (events[i].events & EPOLLERR) == 0;
+      if (open && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) != 0) {
+        open = Read(shard, fd, connection);
+      }
+      if (open && (events[i].events & EPOLLOUT) != 0) {
+        open = Flush(shard, fd, connection);
+      }
+      if (!open) {
+        Close(shard, fd);
+      }
+    }
+  }
+}
+
+void ShardedServer::Accept(Shard* shard) {
+  for (;;) {
+    const int fd = accept4(shard->listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      // EAGAIN once the backlog is empty, or another shard took the connection.
+      return;
+    }
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = fd;
+    if (epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      close(fd);
+      continue;
+    }
+    shard->connections[fd].id = (static_cast<uint64_t>(shard->index) << 48) | ++shard->accepted;
+  }
+}
+
+bool ShardedServer::Read(Shard* shard, const int fd, Connection* connection) {
+  bool open = true;
+  auto& input = connection->input;
+  auto& input_size = connection->input_size;
+  for (;;) {
+    // Only grown when short of room, so the buffer is not cleared for every read.
+    if (input.size() - input_size < kReadSize) {
+      input.resize(input_size + kReadSize);
+    }
+    const auto room = input.size() - input_size;
+    const auto n = read(fd, input.data() + input_size, room);
+    if (n > 0) {
+      input_size += static_cast<size_t>(n);
+      // A short read drained the socket; epoll reports what arrives later.
+      if (static_cast<size_t>(n) < room) {
+        break;
+      }
+      continue;
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      open = false;
+      break;
+    }
+    if (errno != EINTR) {
+      break;
+    }
+  }
+
+  if (connection->closing) {
+    input_size = 0;
+  }
+  const auto max_size = shard->dispatcher.GetParseLimits().max_message_bytes;
+  const std::string_view view(input.data(), input_size);
+  size_t begin = 0;
+  while (begin < view.size() && !connection->closing) {
+    if (view[begin] == kFrameMarker) {
+      Codec codec;
+      size_t size;
+      if (!ParseFrameHeader(view.substr(begin), &codec, &size)) {
+        break;
+      }
+      // A frame is limited by its compressed size here and its decompressed size below.
+      if (size > max_size) {
+        Reject(connection, {kInvalidRequest, "Invalid Request: message too large"}, true);
+        break;
+      }
+      if (view.size() - begin - kFrameHeaderSize < size) {
+        break;
+      }
+      const auto payload = view.substr(begin + kFrameHeaderSize, size);
+      begin += kFrameHeaderSize + size;
+      if (codec == Codec::kNone) {
+        Hello(shard, connection, payload);
+      } else if (const auto status = Decompress(codec, payload, max_size, &connection->message);
+                 status.Ok()) {
+        Handle(shard, connection, connection->message);
+      } else {
+        Reject(connection, status, false);
+      }
+      continue;
+    }
+    const auto end = view.find('\n', begin);
+    if (end == std::string_view::npos) {
+      if (view.size() - begin > max_size) {
+        // The end of the message cannot be told apart from the next ones without reading all of
+        // it, so the connection is dropped once the error is sent.
+        Reject(connection, {kInvalidRequest, "Invalid Request: message too large"}, true);
+      }
+      break;
+    }
+    auto length = end - begin;
+    if (length > 0 && view[begin + length - 1] == '\r') {
+      --length;
+    }
+    if (length > 0) {
+      Handle(shard, connection, view.substr(begin, length));
+    }
+    begin = end + 1;
+  }
+  if (connection->closing) {
+    input_size = 0;
+  } else if (begin != 0) {
+    std::memmove(input.data(), input.data() + begin, input_size - begin);
+    input_size -= begin;
+  }
+  // Responses to the last requests of a half-closed connection are still sent.
+  connection->closing = connection->closing || !open;
+  return Flush(shard, fd, connection);
+}
+
+void ShardedServer::Handle(Shard* shard, Connection* connection, const std::string_view message) {
+  if (shard->capture != nullptr) {
+    shard->capture->Append(CaptureLog::Kind::kRequest, connection->id, message);
+  }
+  const auto response = shard->dispatcher.HandleMessage(message);
+  if (response.empty()) {
+    return;
+  }
+  if (shard->capture != nullptr) {
+    shard->capture->Append(CaptureLog::Kind::kResponse, connection->id, response);
+  }
+  AppendMessage(connection->codec, response, shard->compression, &connection->output);
+}
+
+void ShardedServer::Hello(Shard* shard, Connection* connection, const std::string_view codecs) {
+  connection->codec = Codec::kNone;
+  if (shard->compression.enabled) {
+    for (const auto codec : codecs) {
+      if (CodecSupported(static_cast<Codec>(codec))) {
+        connection->codec = static_cast<Codec>(codec);
+        break;
+      }
+    }
+  }
+  const bool picked = connection->codec != Codec::kNone;
+  AppendFrameHeader(Codec::kNone, picked ? 1 : 0, &connection->output);
+  if (picked) {
+    connection->output.push_back(static_cast<char>(connection->codec));
+  }
+}
+
+void ShardedServer::Reject(Connection* connection, const Status& status, const bool close) {
+  Response response{Identifier()};
+  response.SetError({status.Code(), status.Message()});
+  connection->output.append(response.ToJson().dump());
+  connection->output.push_back('\n');
+  connection->closing = connection->closing || close;
+}
+
+bool ShardedServer::Flush(Shard* shard, const int fd, Connection* connection) {
+  auto& output = connection->output;
+  while (connection->written < output.size()) {
+    const auto n = send(fd, output.data() + connection->written,
+                        output.size() - connection->written, MSG_NOSIGNAL);
+    if (n > 0) {
+      connection->written += static_cast<size_t>(n);
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    } else {
+      return false;
+    }
+  }
+  const bool pending = connection->written < output.size();
+  if (!pending) {
+    output.clear();
+    connection->written = 0;
+  }
+  // Only wait for the socket to drain while there is something left to write, and stop waiting
+  // for input once closing: a half-closed socket stays readable and would wake the loop forever.
+  const bool reading = !connection->closing;
+  if (pending != connection->writing || reading != connection->reading) {
+    epoll_event event{};
+    event.events = reading ? EPOLLIN | EPOLLRDHUP : 0;
+    if (pending) {
+      event.events |= EPOLLOUT;
+    }
+    event.data.fd = fd;
+    epoll_ctl(shard->epoll_fd, EPOLL_CTL_MOD, fd, &event);
+    connection->writing = pending;
+    connection->reading = reading;
+  }
+  return pending || !connection->closing;
+}
+
+void ShardedServer::Close(Shard* shard, const int fd) {
+  epoll_ctl(shard->epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  shard->connections.erase(fd);
+}
+
+#else
+
+ShardedServer::ShardedServer(size_t shards, const ShardSetup setup, const bool pin_threads)
+    : pin_threads_(pin_threads) {
+  for (size_t i = 0; i < std::max<size_t>(1, shards); ++i) {
+    shards_.push_back(std::make_unique<Shard>());
+    if (setup) {
+      setup(i, &shards_.back()->dispatcher);
+    }
+  }
+}
+
+ShardedServer::~ShardedServer() = default;
+
+Dispatcher& ShardedServer::GetDispatcher(const size_t shard) {
+  return shards_.at(shard)->dispatcher;
+}
+
+Status ShardedServer::StartTcp(const std::string& host, const uint16_t port) {
+  return {kInternalError, "ShardedServer is only supported on Linux"};
+}
+
+Status ShardedServer::StartUnix(const std::string& path) {
+  return {kInternalError, "ShardedServer is only supported on Linux"};
+}
+
+void ShardedServer::Stop() {}
+
+#endif
+
+}  // namespace json_rpc
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "capture_log.h"
+#include "compression.h"
+#include "dispatcher.h"
+#include "status.h"
+
+namespace json_rpc {
+
+/// Shared-nothing server running one event loop per shard, usually one shard per core.
+///
+/// Every shard owns its listening socket, its epoll instance, its connections and its own
+/// Dispatcher, set up by the caller for each shard. A connection is served start to end by the
+/// shard that accepted it, so nothing on the request path is shared between shards: no lock, no
+/// queue and no counter.
+///
+/// On TCP, each shard binds its own socket to the same port with SO_REUSEPORT and the kernel
+/// spreads incoming connections across them. Unix sockets have no SO_REUSEPORT; the shards share
+/// one listening socket instead, registered with EPOLLEXCLUSIVE so that a connection wakes a single
+/// shard.
+///
+/// Messages are newline-delimited JSON: each line of a connection is a single or batch request,
+/// answered by one line unless nothing must be sent. Large messages may be compressed into frames
+/// instead, see SetCompression(). Only supported on Linux.
+class ShardedServer {
+ public:
+  /// Registers the methods of the dispatcher of one shard; called once per shard by Start*().
+  using ShardSetup = std::function<void(size_t shard, Dispatcher* dispatcher)>;
+
+  /// @brief Constructor.
+  /// @param shards The number of shards, or zero for one per hardware thread.
+  /// @param setup The callback registering the methods of each shard.
+  /// @param pin_threads Whether the thread of shard i is bound to CPU i modulo the number of CPUs.
+  ShardedServer(size_t shards, ShardSetup setup, bool pin_threads = false);
+
+  ShardedServer(const ShardedServer&) = delete;
+  ShardedServer& operator=(const ShardedServer&) = delete;
+
+  /// @brief Destructor, stops the server.
+  ~ShardedServer();
+
+  /// @brief Listens on a TCP address and starts the shards.
+  /// @param host The IPv4 address to bind, such as "127.0.0.1" or "0.0.0.0".
+  /// @param port The port to bind, or zero for one picked by the kernel, see Port().
+  /// @return A Status object indicating failure if the address cannot be bound or the server was
+  /// started already.
+  Status StartTcp(const std::string& host, uint16_t port);
+
+  /// @brief Listens on a Unix socket and starts the shards. An existing file at the path is
+  /// replaced.
+  /// @param path The path of the socket.
+  /// @return A Status object indicating failure if the path cannot be bound or the server was
+  /// started already.
+  Status StartUnix(const std::string& path);
+
+  /// @brief Records the messages of every connection into a capture log, see Replay(). Must be
+  /// called before Start*().
+  /// @param log The capture log, created for appending, which must outlive the server; or nullptr
+  /// to stop capturing.
+  void SetCaptureLog(CaptureLog* log);
+
+  /// @brief Enables compressing large messages on the connections negotiating it with a hello
+  /// frame, see Codec. Must be called before Start*().
+  /// @param options The compression options.
+  void SetCompression(const CompressionOptions& options);
+
+  /// @brief Stops the shards and closes every connection. Idempotent.
+  void Stop();
+
+  /// @brief Gets the TCP port the server listens on.
+  /// @return The port, or zero if the server does not listen on TCP.
+  [[nodiscard]] uint16_t Port() const {
+    return port_;
+  }
+
+  /// @brief Gets the number of shards.
+  /// @return The number of shards.
+  [[nodiscard]] size_t Shards() const {
+    return shards_.size();
+  }
+
+  /// @brief Gets the dispatcher of a shard, for instance to read its metrics.
+  /// @param shard The shard index.
+  /// @return The dispatcher of the shard.
+  [[nodiscard]] Dispatcher& GetDispatcher(size_t shard);
+
+ private:
+  struct Connection;
+  struct Shard;
+
+  Status Launch();
+
+  static void Run(Shard* shard);
+
+  static void Accept(Shard* shard);
+
+  static bool Read(Shard* shard, int fd, Connection* connection);
+
+  static void Handle(Shard* shard, Connection* connection, std::string_view message);
+
+  static void Hello(Shard* shard, Connection* connection, std::string_view codecs);
+
+  static void Reject(Connection* connection, const Status& status, bool close);
+
+  static bool Flush(Shard* shard, int fd, Connection* connection);
+
+  static void Close(Shard* shard, int fd);
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  const bool pin_threads_;
+  bool started_ = false;
+  uint16_t port_ = 0;
+  std::string unix_path_;
+  // The listening socket shared by the shards on a Unix socket.
+  int shared_fd_ = -1;
+};
+
+}  // namespace json_rpc
@@ -0,0 +1,494 @@
+
+#include "shm_transport.h"
+
+#include <cstring>
+#include <new>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#endif
+
+#include "error.h"
+#include "parse_limits.h"
+
+namespace json_rpc {
+
+// The positions are byte counts since the creation of the ring, so that they never wrap in
+// practice and head - tail is the number of bytes in use. Each side only writes its own position,
+// its waiting flag and the sequence number it waits on is bumped by the other side.
+struct ShmRing::Header {
+  alignas(64) std::atomic<uint64_t> head{0};
+  std::atomic<uint32_t> writer_waiting{0};
+  std::atomic<uint32_t> space_seq{0};
+  alignas(64) std::atomic<uint64_t> tail{0};
+  std::atomic<uint32_t> reader_waiting{0};
+  std::atomic<uint32_t> data_seq{0};
+  alignas(64) std::atomic<uint32_t> closed{0};
+};
+
+#ifdef __linux__
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kSpins = 64;
+constexpr uint32_t kWrapMarker = UINT32_MAX;
+constexpr size_t kLengthSize = sizeof(uint32_t);
+constexpr char kMagic[8] = {'J', 'R', 'P', 'C', 'S', 'H', 'M', '1'};
+constexpr size_t kChannelHeaderSize = 64;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "shared memory atomics must be lock-free");
+
+size_t Align(const size_t size) {
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+
+// Sleeps while the word holds the value, at most the timeout. The word is in memory shared between
+// processes, so the futex is not private.
+void FutexWait(std::atomic<uint32_t>* word, const uint32_t value, const Clock::duration timeout) {
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+  timespec relative{};
+  relative.tv_sec = static_cast<time_t>(ns / 1000000000);
+  relative.tv_nsec = static_cast<long>(ns % 1000000000);
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, value, &relative, nullptr, 0);
+}
+
+void FutexWake(std::atomic<uint32_t>* word) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+// Wakes the other side if it announced it is waiting. The waiting flag is read after the position
+// was published, and the waiter sets the flag before reading the position, both sequentially
+// consistent, so either the waiter sees the new position or this sees the flag.
+void Notify(std::atomic<uint32_t>* waiting, std::atomic<uint32_t>* seq) {
+  if (waiting->load(std::memory_order_seq_cst) != 0) {
+    seq->fetch_add(1, std::memory_order_seq_cst);
+    FutexWake(seq);
+  }
+}
+
+// Waits until ready() returns true, spinning first. Returns false if the ring is closed or the
+// deadline passes first.
+template <typename Ready>
+bool Wait(std::atomic<uint32_t>* waiting, std::atomic<uint32_t>* seq,
+          const std::atomic<uint32_t>& closed, const Clock::time_point deadline, Ready ready) {
+  for (int i = 0; i < kSpins; ++i) {
+    if (ready()) {
+      return true;
+    }
+    if (closed.load(std::memory_order_acquire) != 0) {
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  for (;;) {
+    waiting->store(1, std::memory_order_seq_cst);
+    const auto value = seq->load(std::memory_order_seq_cst);
+    const bool done = ready();
+    if (done || closed.load(std::memory_order_acquire) != 0 || Clock::now() >= deadline) {
+      waiting->store(0, std::memory_order_relaxed);
+      return done;
+    }
+    FutexWait(seq, value, deadline - Clock::now());
+  }
+}
+
+// Timeouts of a year or more never expire, which keeps now + timeout from overflowing.
+Clock::time_point Deadline(const std::chrono::milliseconds timeout) {
+  if (timeout >= std::chrono::hours(24 * 365)) {
+    return Clock::time_point::max();
+  }
+  return Clock::now() + timeout;
+}
+
+}  // namespace
+
+bool ShmRing::TryWrite(const std::string_view message) {
+  const auto size = Align(kLengthSize + message.size());
+  const auto head = header_->head.load(std::memory_order_relaxed);
+  const auto used = head - header_->tail.load(std::memory_order_seq_cst);
+  const auto offset = head % capacity_;
+  // A message wrapping around also takes the rest of the ring before it.
+  const auto skip = capacity_ - offset < size ? capacity_ - offset : 0;
+  if (capacity_ - used < skip + size) {
+    return false;
+  }
+  if (skip != 0) {
+    std::memcpy(data_ + offset, &kWrapMarker, kLengthSize);
+  }
+  char* record = data_ + (head + skip) % capacity_;
+  const auto length = static_cast<uint32_t>(message.size());
+  std::memcpy(record, &length, kLengthSize);
+  std::memcpy(record + kLengthSize, message.data(), message.size());
+  header_->head.store(head + skip + size, std::memory_order_seq_cst);
+  Notify(&header_->reader_waiting, &header_->data_seq);
+  return true;
+}
+
+Status ShmRing::Write(const std::string_view message, const std::chrono::milliseconds timeout) {
+  if (Align(kLengthSize + message.size()) > capacity_) {
+    return {kInvalidRequest, "message larger than the ring"};
+  }
+  if (header_->closed.load(std::memory_order_acquire) != 0) {
+    return {kInternalError, "ring closed"};
+  }
+  if (Wait(&header_->writer_waiting, &header_->space_seq, header_->closed, Deadline(timeout),
+           [this, message] { return TryWrite(message); })) {
+    return {kSuccess, ""};
+  }
+  if (header_->closed.load(std::memory_order_acquire) != 0) {
+    return {kInternalError, "ring closed"};
+  }
+  return {kRequestTimeout, "ring full"};
+}
+
+bool ShmRing::TryRead(std::string_view* message) {
+  auto tail = header_->tail.load(std::memory_order_relaxed);
+  const auto head = header_->head.load(std::memory_order_seq_cst);
+  if (tail == head) {
+    return false;
+  }
+  // The positions and lengths come from memory the other process writes, so they are checked
+  // before anything is read through them, and a ring found corrupt is closed.
+  const auto corrupt = [this] {
+    Close();
+    return false;
+  };
+  if (head - tail > capacity_ || tail % 8 != 0) {
+    return corrupt();
+  }
+  auto offset = tail % capacity_;
+  uint32_t length;
+  std::memcpy(&length, data_ + offset, kLengthSize);
+  if (length == kWrapMarker) {
+    tail += capacity_ - offset;
+    offset = 0;
+    if (tail == head || head - tail > capacity_) {
+      return corrupt();
+    }
+    std::memcpy(&length, data_, kLengthSize);
+  }
+  if (length > capacity_ - offset - kLengthSize || Align(kLengthSize + length) > head - tail) {
+    return corrupt();
+  }
+  *message = std::string_view(data_ + offset + kLengthSize, length);
+  read_end_ = tail + Align(kLengthSize + length);
+  return true;
+}
+
+bool ShmRing::Read(std::string_view* message, const std::chrono::milliseconds timeout) {
+  return Wait(&header_->reader_waiting, &header_->data_seq, header_->closed, Deadline(timeout),
+              [this, message] { return TryRead(message); });
+}
+
+void ShmRing::Release() {
+  header_->tail.store(read_end_, std::memory_order_seq_cst);
+  Notify(&header_->writer_waiting, &header_->space_seq);
+}
+
+void ShmRing::Close() {
+  header_->closed.store(1, std::memory_order_release);
+  header_->data_seq.fetch_add(1, std::memory_order_seq_cst);
+  header_->space_seq.fetch_add(1, std::memory_order_seq_cst);
+  FutexWake(&header_->data_seq);
+  FutexWake(&header_->space_seq);
+}
+
+bool ShmRing::Closed() const {
+  return header_->closed.load(std::memory_order_acquire) != 0;
+}
+
+size_t ShmRing::HeaderSize() {
+  return sizeof(Header);
+}
+
+ShmChannel::~ShmChannel() {
+  if (memory_ != nullptr) {
+    munmap(memory_, size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  if (!owned_name_.empty()) {
+    shm_unlink(owned_name_.c_str());
+  }
+}
+
+Status ShmChannel::Map(const size_t size) {
+  void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (memory == MAP_FAILED) {
+    return {kInternalError, std::string("cannot map channel: ") + std::strerror(errno)};
+  }
+  memory_ = memory;
+  size_ = size;
+  return {kSuccess, ""};
+}
+
+Status ShmChannel::Create(const std::string& name, size_t capacity) {
+  if (memory_ != nullptr) {
+    return {kInternalError, "channel already open"};
+  }
+  capacity = Align(std::max<size_t>(capacity, 64));
+  fd_ = name.empty() ? memfd_create("json_rpc_shm_channel", MFD_CLOEXEC)
+                     : shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd_ < 0) {
+    return {kInternalError, "cannot create channel " + name + ": " + std::strerror(errno)};
+  }
+  if (!name.empty()) {
+    owned_name_ = name;
+  }
+  const auto ring_size = ShmRing::HeaderSize() + capacity;
+  const auto size = kChannelHeaderSize + 2 * ring_size;
+  if (ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+    return {kInternalError, std::string("cannot size channel: ") + std::strerror(errno)};
+  }
+  if (auto status = Map(size); !status.Ok()) {
+    return status;
+  }
+  auto* memory = static_cast<char*>(memory_);
+  std::memcpy(memory + sizeof(kMagic), &capacity, sizeof(capacity));
+  auto* requests = new (memory + kChannelHeaderSize) ShmRing::Header();
+  auto* responses = new (memory + kChannelHeaderSize + ring_size) ShmRing::Header();
+  requests_ = std::make_unique<ShmRing>(requests, reinterpret_cast<char*>(requests + 1), capacity);
+  responses_ =
+      std::make_unique<ShmRing>(responses, reinterpret_cast<char*>(responses + 1), capacity);
+  // The magic goes last: a process opening the channel by name sees it initialized or not at all.
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(memory, kMagic, sizeof(kMagic));
+  return {kSuccess, ""};
+}
+
+Status ShmChannel::Open(const std::string& name) {
+  const int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+  if (fd < 0) {
+    return {kInternalError, "cannot open channel " + name + ": " + std::strerror(errno)};
+  }
+  return Open(fd);
+}
+
+Status ShmChannel::Open(const int fd) {
+  if (memory_ != nullptr) {
+    close(fd);
+    return {kInternalError, "channel already open"};
+  }
+  fd_ = fd;
+  struct stat stat {};
+  if (fstat(fd_, &stat) != 0 || static_cast<size_t>(stat.st_size) < kChannelHeaderSize) {
+    return {kInvalidParams, "not a channel"};
+  }
+  if (auto status = Map(static_cast<size_t>(stat.st_size)); !status.Ok()) {
+    return status;
+  }
+  auto* memory = static_cast<char*>(memory_);
+  uint64_t capacity = 0;
+  std::memcpy(&capacity, memory + sizeof(kMagic), sizeof(capacity));
+  const auto ring_size = ShmRing::HeaderSize() + capacity;
+  if (std::memcmp(memory, kMagic, sizeof(kMagic)) != 0 ||
+      kChannelHeaderSize + 2 * ring_size != size_) {
+    return {kInvalidParams, "not a channel"};
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  auto* requests = reinterpret_cast<ShmRing::Header*>(memory + kChannelHeaderSize);
+  auto* responses = reinterpret_cast<ShmRing::Header*>(memory + kChannelHeaderSize + ring_size);
+  requests_ = std::make_unique<ShmRing>(requests, reinterpret_cast<char*>(requests + 1), capacity);
+  responses_ =
+      std::make_unique<ShmRing>(responses, reinterpret_cast<char*>(responses + 1), capacity);
+  return {kSuccess, ""};
+}
+
+void ShmChannel::Close() {
+  if (requests_ != nullptr) {
+    requests_->Close();
+    responses_->Close();
+  }
+}
+
+namespace {
+
+// Answers a request whose response does not fit in the ring, keeping the id of a single response.
+std::string TooLargeResponse(const std::string& response) {
+  const auto json = Json::parse(response, nullptr, false);
+  Json id = nullptr;
+  if (json.is_object() && json.contains("id")) {
+    id = json.at("id");
+  }
+  return Json{{"jsonrpc", "2.0"},
+              {"error", {{"code", kInternalError}, {"message", "response too large"}}},
+              {"id", std::move(id)}}
+      .dump();
+}
+
+}  // namespace
+
+ShmServer::~ShmServer() {
+  Stop();
+}
+
+Status ShmServer::Serve(ShmChannel* channel) {
+  if (stopped_.load(std::memory_order_acquire)) {
+    return {kInternalError, "server stopped"};
+  }
+  threads_.emplace_back(&ShmServer::Run, this, channel);
+  return {kSuccess, ""};
+}
+
+void ShmServer::Stop() {
+  stopped_.store(true, std::memory_order_release);
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
+}
+
+void ShmServer::Run(ShmChannel* channel) {
+  // Stop() is noticed within this time by an idle channel.
+  constexpr std::chrono::milliseconds kPoll(100);
+  auto& requests = channel->Requests();
+  auto& responses = channel->Responses();
+  while (!stopped_.load(std::memory_order_acquire)) {
+    std::string_view message;
+    if (!requests.Read(&message, kPoll)) {
+      if (requests.Closed()) {
+        // Also wakes a client waiting for a response, such as after the requests were corrupt.
+        channel->Close();
+        return;
+      }
+      continue;
+    }
+    // The request is parsed straight from the ring, and only released once handled.
+    auto response = dispatcher_->HandleMessage(message);
+    requests.Release();
+    // Notifications are answered with an empty message, which keeps the responses in step.
+    bool too_large = false;
+    while (!stopped_.load(std::memory_order_acquire)) {
+      const auto status = responses.Write(response, kPoll);
+      if (status.Ok()) {
+        break;
+      }
+      if (status.Code() == kInvalidRequest && !too_large) {
+        response = TooLargeResponse(response);
+        too_large = true;
+        continue;
+      }
+      if (status.Code() != kRequestTimeout) {
+        channel->Close();
+        return;
+      }
+    }
+  }
+}
+
+Status ShmClient::Send(const std::string_view message, const std::chrono::milliseconds timeout,
+                       std::string_view* response) {
+  if (auto status = channel_->Requests().Write(message, timeout); !status.Ok()) {
+    return status;
+  }
+  if (!channel_->Responses().Read(response, timeout)) {
+    if (channel_->Responses().Closed()) {
+      return {kInternalError, "channel closed"};
+    }
+    // A late response could not be told apart from the next one.
+    channel_->Close();
+    return {kRequestTimeout, "no response, channel closed"};
+  }
+  return {kSuccess, ""};
+}
+
+Status ShmClient::Call(const std::string_view message, std::string* response,
+                       const std::chrono::milliseconds timeout) {
+  std::string_view view;
+  if (auto status = Send(message, timeout, &view); !status.Ok()) {
+    return status;
+  }
+  response->assign(view);
+  channel_->Responses().Release();
+  return {kSuccess, ""};
+}
+
+Status ShmClient::Call(const std::string_view message, Json* response,
+                       const std::chrono::milliseconds timeout) {
+  std::string_view view;
+  if (auto status = Send(message, timeout, &view); !status.Ok()) {
+    return status;
+  }
+  Status status{kSuccess, ""};
+  if (view.empty()) {
+    *response = nullptr;
+  } else {
+    status = ParseJsonText(view, ParseLimits(), response);
+  }
+  channel_->Responses().Release();
+  return status;
+}
+
+#else
+
+Status ShmRing::Write(std::string_view message, std::chrono::milliseconds timeout) {
+  return {kInternalError, "shared memory transport is only supported on Linux"};
+}
+
+bool ShmRing::Read(std::string_view* message, std::chrono::milliseconds timeout) {
+  return false;
+}
+
+void ShmRing::Release() {}
+
+void ShmRing::Close() {}
+
+bool ShmRing::Closed() const {
+  return true;
+}
+
+size_t ShmRing::HeaderSize() {
+  return sizeof(Header);
+}
+
+ShmChannel::~ShmChannel() = default;
+
+Status ShmChannel::Create(const std::string& name, size_t capacity) {
+  return {kInternalError, "shared memory transport is only supported on Linux"};
+}
+
+Status ShmChannel::Open(const std::string& name) {
+  return {kInternalError, "shared memory transport is only supported on Linux"};
+}
+
+Status ShmChannel::Open(int fd) {
+  return {kInternalError, "shared memory transport is only supported on Linux"};
+}
+
+void ShmChannel::Close() {}
+
+ShmServer::~ShmServer() = default;
+
+Status ShmServer::Serve(ShmChannel* channel) {
+  return {kInternalError, "shared memory transport is only supported on Linux"};
+}
+
+void ShmServer::Stop() {}
+
+Status ShmClient::Call(std::string_view message, std::string* response,
+                       std::chrono::milliseconds timeout) {
+  return {kInternalError, "shared memory transport is only supported on Linux"};
+}
+
+Status ShmClient::Call(std::string_view message, Json* response,
+                       std::chrono::milliseconds timeout) {
+  return {kInternalError, "shared memory transport is only supported on Linux"};
+}
+
+#endif
+
+}  // namespace json_rpc
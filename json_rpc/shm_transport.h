@@ -0,0 +1,220 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "dispatcher.h"
+#include "json.h"
+#include "status.h"
+
+namespace json_rpc {
+
+/// Single-producer single-consumer ring of messages in shared memory.
+///
+/// Each message is a 4-byte length followed by its bytes, padded to 8 bytes, and always contiguous:
+/// a message that does not fit before the end of the ring is preceded by a marker telling the
+/// reader to wrap around. The reader gets a view of the message in the ring itself, valid until it
+/// releases it, so the message can be parsed without being copied out. What the reader finds in
+/// the shared memory is checked before it is used: a ring whose positions or lengths are out of
+/// bounds is closed rather than read.
+///
+/// Both sides spin briefly and then sleep on a futex in the shared memory, which the other side
+/// only wakes when it knows a waiter is there, so a busy ring takes no system call per message.
+/// Only supported on Linux.
+class ShmRing {
+ public:
+  /// The part of a ring in shared memory before its data; opaque to users.
+  struct Header;
+
+  /// @brief Constructor, over memory laid out by ShmChannel.
+  /// @param header The header of the ring.
+  /// @param data The data of the ring.
+  /// @param capacity The size of the data, a multiple of 8.
+  ShmRing(Header* header, char* data, size_t capacity)
+      : header_(header), data_(data), capacity_(capacity) {}
+
+  /// @brief Appends a message, waiting for space if the ring is full. Called by the writer only.
+  /// @param message The message.
+  /// @param timeout The longest time to wait for space.
+  /// @return A Status object indicating failure if the message can never fit, the ring is closed
+  /// or there was no space before the timeout.
+  Status Write(std::string_view message, std::chrono::milliseconds timeout);
+
+  /// @brief Gets the next message, waiting for one if the ring is empty. Called by the reader only.
+  /// @param message Receives a view of the message in the ring, valid until Release().
+  /// @param timeout The longest time to wait for a message.
+  /// @return Whether a message was read, false if the ring is closed, found corrupt, or empty after
+  /// the timeout.
+  bool Read(std::string_view* message, std::chrono::milliseconds timeout);
+
+  /// @brief Releases the message last read, letting the writer reuse its space.
+  void Release();
+
+  /// @brief Closes the ring, waking both sides. Messages already written can still be read.
+  void Close();
+
+  /// @brief Gets whether the ring is closed.
+  /// @return Whether the ring is closed.
+  [[nodiscard]] bool Closed() const;
+
+  /// @brief Gets the size of the header of a ring, a multiple of 64.
+  /// @return The size of the header.
+  static size_t HeaderSize();
+
+ private:
+  bool TryWrite(std::string_view message);
+
+  bool TryRead(std::string_view* message);
+
+  Header* header_;
+  char* data_;
+  size_t capacity_;
+  // The position after the message last read.
+  uint64_t read_end_ = 0;
+};
+
+/// A pair of ShmRings in one shared memory object, carrying the requests of one client to a server
+/// and the responses back. Every request is answered by exactly one response, which is empty for a
+/// notification, so responses come back in the order of the requests.
+///
+/// The memory object is created anonymous with memfd_create(), to be inherited by a child process
+/// or passed over a Unix socket, or named with shm_open() for unrelated processes.
+///
+/// A message, request or response, is at most the capacity of a ring less 4 bytes.
+class ShmChannel {
+ public:
+  static constexpr size_t kDefaultCapacity = 1024 * 1024;
+
+  ShmChannel() = default;
+
+  ShmChannel(const ShmChannel&) = delete;
+  ShmChannel& operator=(const ShmChannel&) = delete;
+
+  /// @brief Destructor, unmaps the channel. A named channel is removed by the process creating it.
+  ~ShmChannel();
+
+  /// @brief Creates a channel.
+  /// @param name The name of the shared memory object, such as "/my-sidecar", or empty for an
+  /// anonymous one.
+  /// @param capacity The size of each ring, rounded up to a multiple of 8, which bounds the size of
+  /// a message.
+  /// @return A Status object indicating failure if the memory cannot be created or mapped.
+  Status Create(const std::string& name, size_t capacity = kDefaultCapacity);
+
+  /// @brief Opens a named channel created by another process.
+  /// @param name The name of the shared memory object.
+  /// @return A Status object indicating failure if the memory cannot be opened or is not a channel.
+  Status Open(const std::string& name);
+
+  /// @brief Opens a channel from a descriptor, such as one inherited or received from the process
+  /// creating it. The channel takes ownership of the descriptor.
+  /// @param fd The descriptor of the shared memory object.
+  /// @return A Status object indicating failure if the memory cannot be mapped or is not a channel.
+  Status Open(int fd);
+
+  /// @brief Gets the descriptor of the shared memory object.
+  /// @return The descriptor, or -1 if the channel is not open.
+  [[nodiscard]] int Fd() const {
+    return fd_;
+  }
+
+  /// @brief Gets the ring of the requests.
+  /// @return The ring written by the client and read by the server.
+  [[nodiscard]] ShmRing& Requests() {
+    return *requests_;
+  }
+
+  /// @brief Gets the ring of the responses.
+  /// @return The ring written by the server and read by the client.
+  [[nodiscard]] ShmRing& Responses() {
+    return *responses_;
+  }
+
+  /// @brief Closes both rings, waking the client and the server.
+  void Close();
+
+ private:
+  Status Map(size_t size);
+
+  int fd_ = -1;
+  void* memory_ = nullptr;
+  size_t size_ = 0;
+  // The name to remove, for a named channel created by this process.
+  std::string owned_name_;
+  std::unique_ptr<ShmRing> requests_;
+  std::unique_ptr<ShmRing> responses_;
+};
+
+/// Serves ShmChannels with a Dispatcher, on one thread per channel. Requests are parsed in place
+/// from the shared memory. A response larger than the ring is replaced by a kInternalError
+/// "response too large" error; a channel that cannot be answered at all is closed.
+class ShmServer {
+ public:
+  /// @brief Constructor.
+  /// @param dispatcher The dispatcher handling the requests, which must outlive the server.
+  explicit ShmServer(Dispatcher* dispatcher) : dispatcher_(dispatcher) {}
+
+  ShmServer(const ShmServer&) = delete;
+  ShmServer& operator=(const ShmServer&) = delete;
+
+  /// @brief Destructor, stops the server.
+  ~ShmServer();
+
+  /// @brief Starts serving a channel.
+  /// @param channel The channel, which must outlive the server.
+  /// @return A Status object indicating failure if the server is stopped.
+  Status Serve(ShmChannel* channel);
+
+  /// @brief Stops serving every channel, without closing them. Idempotent.
+  void Stop();
+
+ private:
+  void Run(ShmChannel* channel);
+
+  Dispatcher* dispatcher_;
+  std::atomic<bool> stopped_{false};
+  std::vector<std::thread> threads_;
+};
+
+/// Client of a ShmChannel. Not thread-safe: one client per channel, making one call at a time.
+class ShmClient {
+ public:
+  static constexpr std::chrono::milliseconds kDefaultTimeout{30000};
+
+  /// @brief Constructor.
+  /// @param channel The channel, which must outlive the client.
+  explicit ShmClient(ShmChannel* channel) : channel_(channel) {}
+
+  /// @brief Sends a message and waits for its response.
+  /// @param message A single or batch request, or notification.
+  /// @param response Receives the response, empty for a notification.
+  /// @param timeout The longest time to wait for space and for the response.
+  /// @return A Status object indicating failure if the channel is closed or the server did not
+  /// answer before the timeout.
+  Status Call(std::string_view message, std::string* response,
+              std::chrono::milliseconds timeout = kDefaultTimeout);
+
+  /// @brief Sends a message and parses its response in place from the shared memory.
+  /// @param message A single or batch request, or notification.
+  /// @param response Receives the parsed response, null for a notification.
+  /// @param timeout The longest time to wait for space and for the response.
+  /// @return A Status object indicating failure if the channel is closed, the server did not
+  /// answer before the timeout, or the response is not valid JSON.
+  Status Call(std::string_view message, Json* response,
+              std::chrono::milliseconds timeout = kDefaultTimeout);
+
+ private:
+  Status Send(std::string_view message, std::chrono::milliseconds timeout,
+              std::string_view* response);
+
+  ShmChannel* channel_;
+};
+
+}  // namespace json_rpc
@@ -0,0 +1,137 @@
+
+#include "subscription.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#include "json.h"
+
+namespace json_rpc {
+
+SharedMessage SerializeShared(const Request& request) {
+  auto text = std::make_shared<std::string>();
+  AppendJson(request.ToJson(), text.get());
+  return text;
+}
+
+SubscriptionHub::SubscriptionId SubscriptionHub::Subscribe(const std::string& topic,
+                                                           MessageSink sink) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto id = next_id_++;
+  auto subscriber = std::make_shared<Subscriber>();
+  subscriber->id = id;
+  subscriber->topic = topic;
+  subscriber->sink = std::move(sink);
+  auto& entry = topics_[topic];
+  // The copy leaves out the ended subscriptions.
+  auto subscribers = std::make_shared<SubscriberList>();
+  if (entry.subscribers) {
+    subscribers->reserve(entry.subscribers->size() - entry.inactive + 1);
+    std::copy_if(entry.subscribers->begin(), entry.subscribers->end(),
+                 std::back_inserter(*subscribers), [](const auto& subscriber) {
+                   return subscriber->active.load(std::memory_order_relaxed);
+                 });
+  }
+  subscribers->push_back(subscriber);
+  entry.subscribers = std::move(subscribers);
+  entry.inactive = 0;
+  subscriptions_.emplace(id, std::move(subscriber));
+  return id;
+}
+
+bool SubscriptionHub::Unsubscribe(const SubscriptionId id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto subscription = subscriptions_.find(id);
+  if (subscription == subscriptions_.end()) {
+    return false;
+  }
+  const auto topic = subscription->second->topic;
+  Remove(id);
+  Prune(topic);
+  return true;
+}
+
+bool SubscriptionHub::Remove(const SubscriptionId id) {
+  const auto subscription = subscriptions_.find(id);
+  if (subscription == subscriptions_.end()) {
+    return false;
+  }
+  auto& subscriber = *subscription->second;
+  subscriber.active.store(false, std::memory_order_relaxed);
+  ++topics_.at(subscriber.topic).inactive;
+  subscriptions_.erase(subscription);
+  return true;
+}
+
+void SubscriptionHub::Prune(const std::string& topic) {
+  const auto it = topics_.find(topic);
+  if (it == topics_.end()) {
+    return;
+  }
+  auto& entry = it->second;
+  const auto size = entry.subscribers->size();
+  if (entry.inactive == size) {
+    topics_.erase(it);
+    return;
+  }
+  if (entry.inactive * 2 < size) {
+    return;
+  }
+  auto subscribers = std::make_shared<SubscriberList>();
+  subscribers->reserve(size - entry.inactive);
+  std::copy_if(entry.subscribers->begin(), entry.subscribers->end(),
+               std::back_inserter(*subscribers), [](const auto& subscriber) {
+                 return subscriber->active.load(std::memory_order_relaxed);
+               });
+  entry.subscribers = std::move(subscribers);
+  entry.inactive = 0;
+}
+
+size_t SubscriptionHub::Publish(const std::string& topic, const Request& notification) {
+  // Only serialized once someone listens.
+  if (Subscribers(topic) == 0) {
+    return 0;
+  }
+  return Publish(topic, SerializeShared(notification));
+}
+
+size_t SubscriptionHub::Publish(const std::string& topic, const SharedMessage& message) {
+  std::shared_ptr<const SubscriberList> subscribers;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = topics_.find(topic);
+    if (it == topics_.end()) {
+      return 0;
+    }
+    subscribers = it->second.subscribers;
+  }
+  size_t taken = 0;
+  std::vector<SubscriptionId> gone;
+  for (const auto& subscriber : *subscribers) {
+    if (!subscriber->active.load(std::memory_order_relaxed)) {
+      continue;
+    }
+    if (subscriber->sink(message)) {
+      ++taken;
+    } else {
+      gone.push_back(subscriber->id);
+    }
+  }
+  if (!gone.empty()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto id : gone) {
+      Remove(id);
+    }
+    Prune(topic);
+  }
+  return taken;
+}
+
+size_t SubscriptionHub::Subscribers(const std::string& topic) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = topics_.find(topic);
+  return it == topics_.end() ? 0 : it->second.subscribers->size() - it->second.inactive;
+}
+
+}  // namespace json_rpc
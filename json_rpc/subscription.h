@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "request.h"
+
+namespace json_rpc {
+
+/// The JSON text of a message serialized once and shared, immutable, by every connection writing
+/// it.
+using SharedMessage = std::shared_ptr<const std::string>;
+
+/// @brief Serializes a request into a message that can be handed to any number of connections.
+/// @param request The request, usually a notification.
+/// @return The shared JSON text of the request.
+SharedMessage SerializeShared(const Request& request);
+
+/// Topics that connections subscribe to, such as the resources of an MCP server, and on which
+/// notifications are broadcast to every subscriber.
+///
+/// A notification is serialized once per Publish() and every subscriber gets the same buffer, so
+/// broadcasting to thousands of connections costs one serialization and a reference count each.
+/// The subscribers of a topic are kept in an immutable list replaced on every subscription, so
+/// publishing reads it without holding a lock while the sinks run; subscribing costs a copy of the
+/// list. Ending a subscription only marks the subscriber, skipped from then on, and the list is
+/// rebuilt without the ended ones once they are half of it, so ending n subscriptions costs O(n).
+///
+/// All methods may be called from any number of threads at once.
+class SubscriptionHub {
+ public:
+  using SubscriptionId = uint64_t;
+
+  /// Hands a message to the write queue of a subscriber, e.g. Peer::Send(). Returns false if the
+  /// subscriber is gone, which ends the subscription. Should return quickly, since the subscribers
+  /// of a topic are served one after the other.
+  using MessageSink = std::function<bool(const SharedMessage& message)>;
+
+  /// @brief Subscribes to a topic.
+  /// @param topic The topic.
+  /// @param sink The sink receiving the messages published on the topic.
+  /// @return The id of the subscription.
+  SubscriptionId Subscribe(const std::string& topic, MessageSink sink);
+
+  /// @brief Ends a subscription.
+  /// @param id The id of the subscription.
+  /// @return false if there is no such subscription, otherwise true.
+  bool Unsubscribe(SubscriptionId id);
+
+  /// @brief Serializes a notification once and hands it to every subscriber of a topic.
+  /// @param topic The topic.
+  /// @param notification The notification.
+  /// @return The number of subscribers that took the message.
+  size_t Publish(const std::string& topic, const Request& notification);
+
+  /// @brief Hands a serialized message to every subscriber of a topic.
+  /// @param topic The topic.
+  /// @param message The message.
+  /// @return The number of subscribers that took the message.
+  size_t Publish(const std::string& topic, const SharedMessage& message);
+
+  /// @brief Gets the number of subscribers of a topic.
+  /// @param topic The topic.
+  /// @return The number of subscriptions to the topic.
+  [[nodiscard]] size_t Subscribers(const std::string& topic) const;
+
+ private:
+  struct Subscriber {
+    SubscriptionId id;
+    std::string topic;
+    MessageSink sink;
+    // Cleared when the subscription ends, before the subscriber leaves the list of its topic.
+    std::atomic<bool> active{true};
+  };
+
+  using SubscriberList = std::vector<std::shared_ptr<Subscriber>>;
+
+  struct Topic {
+    std::shared_ptr<const SubscriberList> subscribers;
+    // The subscribers of the list whose subscription ended.
+    size_t inactive = 0;
+  };
+
+  // Ends a subscription, leaving the list of its topic to Prune(). Called with the mutex held.
+  bool Remove(SubscriptionId id);
+
+  // Rebuilds the list of a topic once half of it ended, or drops the topic once all of it did.
+  // Called with the mutex held.
+  void Prune(const std::string& topic);
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Topic> topics_;
+  std::unordered_map<SubscriptionId, std::shared_ptr<Subscriber>> subscriptions_;
+  SubscriptionId next_id_ = 1;
+};
+
+}  // namespace json_rpc
@@ -0,0 +1,44 @@
+
+#include "thread_affinity.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace json_rpc {
+
+namespace internal {
+
+void PinThread(std::thread* thread, const size_t index) {
+#ifdef __linux__
+  // The CPUs the process may run on rather than the first ones of the machine.
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return;
+  }
+  const auto count = static_cast<size_t>(CPU_COUNT(&allowed));
+  if (count == 0) {
+    return;
+  }
+  auto skip = index % count;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (!CPU_ISSET(cpu, &allowed) || skip-- != 0) {
+      continue;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(thread->native_handle(), sizeof(set), &set);
+    return;
+  }
+#else
+  static_cast<void>(thread);
+  static_cast<void>(index);
+#endif
+}
+
+}  // namespace internal
+
+}  // namespace json_rpc
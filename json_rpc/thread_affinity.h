@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <thread>
+
+namespace json_rpc {
+
+namespace internal {
+
+/// @brief Pins a thread to one CPU, spreading threads by index over the CPUs the process may run
+/// on, e.g. as restricted by taskset or a cgroup. Does nothing off Linux.
+/// @param thread The thread to pin.
+/// @param index The index of the thread among those pinned together.
+void PinThread(std::thread* thread, size_t index);
+
+}  // namespace internal
+
+}  // namespace json_rpc
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace json_rpc {
+
+/// Hierarchical timer wheel holding a value of type T per timer.
+///
+/// Time is cut into ticks. Four levels of 256 slots each cover 2^32 ticks, about 49 days with
+/// the default 1 ms tick; a timer lands in the level matching how far away it is and cascades to
+/// the lower level as the wheel turns. Scheduling, cancelling and expiring a timer are O(1),
+/// however many timers are pending, and turning the wheel skips over empty slots. Timers further
+/// away than the wheel covers wait in its last slot and are placed again when it is reached.
+///
+/// The values of expired timers are handed back by Advance() rather than run, so the caller may
+/// act on them outside of whatever lock guards the wheel. Not thread-safe.
+template <typename T>
+class TimerWheel {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using TimerId = uint64_t;
+
+  /// @brief Constructor.
+  /// @param tick The resolution of the wheel; deadlines are rounded up to it.
+  /// @param now The time the wheel starts at.
+  explicit TimerWheel(const Clock::duration tick = std::chrono::milliseconds(1),
+                      const Clock::time_point now = Clock::now())
+      : tick_(tick), origin_(now) {
+    heads_.fill(kNil);
+  }
+
+  /// @brief Schedules a timer.
+  /// @param deadline The time the timer expires at; a past deadline expires on the next Advance().
+  /// @param value The value handed back when the timer expires.
+  /// @return The identifier of the timer, for Cancel().
+  TimerId Schedule(const Clock::time_point deadline, T value) {
+    uint32_t index;
+    if (free_ != kNil) {
+      index = free_;
+      free_ = nodes_[index].next;
+    } else {
+      index = static_cast<uint32_t>(nodes_.size());
+      nodes_.emplace_back();
+    }
+    auto& node = nodes_[index];
+    node.value = std::move(value);
+    node.expiry = ToTick(deadline);
+    node.live = true;
+    Place(index);
+    ++size_;
+    return (static_cast<TimerId>(node.generation) << 32) | index;
+  }
+
+  /// @brief Cancels a pending timer.
+  /// @param id The identifier returned by Schedule().
+  /// @return true if the timer was pending, false if it expired or was cancelled already.
+  bool Cancel(const TimerId id) {
+    const auto index = static_cast<uint32_t>(id);
+    if (index >= nodes_.size() || !nodes_[index].live ||
+        nodes_[index].generation != static_cast<uint32_t>(id >> 32)) {
+      return false;
+    }
+    Unlink(index);
+    Release(index);
+    return true;
+  }
+
+  /// @brief Turns the wheel up to a time and collects the values of the timers expired by then.
+  /// @param now The current time.
+  /// @param expired Receives the values of the expired timers, in no particular order.
+  void Advance(const Clock::time_point now, std::vector<T>* expired) {
+    Expire(kDueSlot, expired);
+    const auto target = static_cast<uint64_t>(std::max<Clock::rep>(0, (now - origin_) / tick_));
+    while (current_ < target) {
+      // Ticks where no slot is due or cascades are skipped, so idle stretches cost nothing.
+      const auto next = NextEvent();
+      if (next > target) {
+        current_ = target;
+        break;
+      }
+      current_ = next;
+      // Lower levels cascade first, so timers coming down from higher ones find their slots
+      // already emptied.
+      for (int level = 1; level < kLevels; ++level) {
+        if (SlotOf(current_, level - 1) != 0) {
+          break;
+        }
+        Cascade(level * kSlots + SlotOf(current_, level));
+      }
+      Expire(SlotOf(current_, 0), expired);
+      // Timers cascading down exactly on their expiry tick were placed as due.
+      Expire(kDueSlot, expired);
+    }
+  }
+
+  /// @brief Gets the number of pending timers.
+  /// @return The number of pending timers.
+  [[nodiscard]] size_t Size() const {
+    return size_;
+  }
+
+ private:
+  static constexpr int kLevelBits = 8;
+  static constexpr int kLevels = 4;
+  static constexpr uint32_t kSlots = 1u << kLevelBits;
+  static constexpr uint32_t kDueSlot = kLevels * kSlots;
+  static constexpr uint32_t kNil = UINT32_MAX;
+
+  struct Node {
+    T value{};
+    uint64_t expiry = 0;
+    uint32_t prev = kNil;
+    uint32_t next = kNil;
+    uint32_t slot = kNil;
+    uint32_t generation = 0;
+    bool live = false;
+  };
+
+  static uint32_t SlotOf(const uint64_t tick, const int level) {
+    return static_cast<uint32_t>(tick >> (level * kLevelBits)) & (kSlots - 1);
+  }
+
+  /// The first tick after the current one at which a non-empty slot is reached, on any level.
+  [[nodiscard]] uint64_t NextEvent() const {
+    uint64_t next = UINT64_MAX;
+    for (int level = 0; level < kLevels; ++level) {
+      const int shift = level * kLevelBits;
+      auto tick = ((current_ >> shift) + 1) << shift;
+      for (uint32_t i = 0; i < kSlots && tick < next; ++i, tick += uint64_t{1} << shift) {
+        if (heads_[level * kSlots + SlotOf(tick, level)] != kNil) {
+          next = tick;
+          break;
+        }
+      }
+    }
+    return next;
+  }
+
+  uint64_t ToTick(const Clock::time_point deadline) const {
+    if (deadline <= origin_) {
+      return 0;
+    }
+    const auto elapsed = deadline - origin_;
+    // Rounded up, so a timer never expires before its deadline.
+    return static_cast<uint64_t>((elapsed + tick_ - Clock::duration(1)) / tick_);
+  }
+
+  void Place(const uint32_t index) {
+    auto& node = nodes_[index];
+    uint32_t slot;
+    if (node.expiry <= current_) {
+      slot = kDueSlot;
+    } else {
+      const auto delta = node.expiry - current_;
+      int level = 0;
+      while (level < kLevels - 1 && delta >> ((level + 1) * kLevelBits) != 0) {
+        ++level;
+      }
+      // Beyond the range of the top level, the timer waits in the slot reached last.
+      const auto tick = delta >> (kLevels * kLevelBits) != 0 ? current_ - 1 : node.expiry;
+      slot = level * kSlots + SlotOf(tick, level);
+    }
+    node.slot = slot;
+    node.prev = kNil;
+    node.next = heads_[slot];
+    if (node.next != kNil) {
+      nodes_[node.next].prev = index;
+    }
+    heads_[slot] = index;
+  }
+
+  void Unlink(const uint32_t index) {
+    auto& node = nodes_[index];
+    if (node.prev != kNil) {
+      nodes_[node.prev].next = node.next;
+    } else {
+      heads_[node.slot] = node.next;
+    }
+    if (node.next != kNil) {
+      nodes_[node.next].prev = node.prev;
+    }
+  }
+
+  void Release(const uint32_t index) {
+    auto& node = nodes_[index];
+    node.value = T{};
+    node.live = false;
+    ++node.generation;
+    node.next = free_;
+    free_ = index;
+    --size_;
+  }
+
+  void Cascade(const uint32_t slot) {
+    auto index = heads_[slot];
+    heads_[slot] = kNil;
+    while (index != kNil) {
+      const auto next = nodes_[index].next;
+      Place(index);
+      index = next;
+    }
+  }
+
+  void Expire(const uint32_t slot, std::vector<T>* expired) {
+    auto index = heads_[slot];
+    heads_[slot] = kNil;
+    while (index != kNil) {
+      const auto next = nodes_[index].next;
+      expired->push_back(std::move(nodes_[index].value));
+      Release(index);
+      index = next;
+    }
+  }
+
+  Clock::duration tick_;
+  Clock::time_point origin_;
+  uint64_t current_ = 0;
+  size_t size_ = 0;
+  std::vector<Node> nodes_;
+  uint32_t free_ = kNil;
+  std::array<uint32_t, kDueSlot + 1> heads_{};
+};
+
+}  // namespace json_rpc
@@ -0,0 +1,97 @@
+
+// Replays a capture log recorded with ShardedServer::SetCaptureLog() through an in-process
+// Dispatcher and prints the latency percentiles, corrected for coordinated omission.
+//
+// Every method found in the log is registered with a handler echoing its params after spinning for
+// work_us microseconds, standing in for the real handlers; embed Replay() with the real
+// Dispatcher to measure them.
+//
+// Usage: replay <log> [qps] [threads] [requests] [work_us]
+//   qps       requests per second, or 0 to keep the captured pacing (default 0)
+//   threads   dispatching threads, or 0 for one per hardware thread (default 1)
+//   requests  requests sent, looping over the log, or 0 to send each once (default 0)
+//   work_us   simulated work per request (default 0)
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+
+#include "json_rpc/batch_request.h"
+#include "json_rpc/replay.h"
+
+namespace {
+
+using json_rpc::BatchRequest;
+using json_rpc::CaptureLog;
+using json_rpc::Dispatcher;
+using json_rpc::Request;
+using json_rpc::Response;
+
+// Registers the methods of the captured requests.
+void RegisterCaptured(CaptureLog* log, const std::chrono::microseconds work,
+                      Dispatcher* dispatcher) {
+  std::set<std::string> methods;
+  for (CaptureLog::Record record; log->Next(&record);) {
+    // One per record, since parsing appends to the requests already held.
+    BatchRequest batch;
+    if (record.kind != CaptureLog::Kind::kRequest ||
+        !batch.ParseJson(std::string(record.data)).Ok()) {
+      continue;
+    }
+    for (const auto& [request, status] : batch.Requests()) {
+      if (status.Ok()) {
+        methods.insert(request.Method());
+      }
+    }
+  }
+  for (const auto& method : methods) {
+    dispatcher->RegisterMethod(method, [work](const Request& request) {
+      const auto until = std::chrono::steady_clock::now() + work;
+      while (std::chrono::steady_clock::now() < until) {
+      }
+      Response response(request.Id());
+      response.SetResult(request.Params().ToJson());
+      return response;
+    });
+  }
+}
+
+double Microseconds(const std::chrono::nanoseconds duration) {
+  return static_cast<double>(duration.count()) / 1e3;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::fprintf(stderr, "Usage: %s <log> [qps] [threads] [requests] [work_us]\n", argv[0]);
+    return 2;
+  }
+  json_rpc::ReplayOptions options;
+  options.qps = argc > 2 ? std::strtod(argv[2], nullptr) : 0;
+  options.threads = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1;
+  options.requests = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 0;
+  const std::chrono::microseconds work(argc > 5 ? std::strtoul(argv[5], nullptr, 10) : 0);
+
+  CaptureLog log;
+  if (const auto status = log.Open(argv[1]); !status.Ok()) {
+    std::fprintf(stderr, "%s\n", status.Message().c_str());
+    return 1;
+  }
+  Dispatcher dispatcher;
+  RegisterCaptured(&log, work, &dispatcher);
+
+  json_rpc::ReplayReport report;
+  if (const auto status = json_rpc::Replay(&log, &dispatcher, options, &report); !status.Ok()) {
+    std::fprintf(stderr, "%s\n", status.Message().c_str());
+    return 1;
+  }
+  const auto seconds = static_cast<double>(report.elapsed.count()) / 1e9;
+  std::printf("requests %zu in %.3f s (%.0f qps)\n", report.requests, seconds,
+              static_cast<double>(report.requests) / seconds);
+  std::printf("latency us: p50 %.1f  p99 %.1f  p999 %.1f  max %.1f\n", Microseconds(report.p50),
+              Microseconds(report.p99), Microseconds(report.p999), Microseconds(report.max));
+  return 0;
+}
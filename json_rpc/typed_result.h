@@ -0,0 +1,254 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "json.h"
+
+namespace json_rpc {
+
+/// A member of a struct written as a JSON object member by AppendJson().
+template <typename T, typename M>
+struct JsonField {
+  const char* name;
+  M T::*member;
+};
+
+/// @brief Describes a member of a struct.
+/// @param name The name of the JSON object member.
+/// @param member The pointer to the struct member.
+/// @return The field description.
+template <typename T, typename M>
+constexpr JsonField<T, M> Field(const char* name, M T::*member) {
+  return {name, member};
+}
+
+/// Describes the fields of a struct, so that it can be written as a JSON object without building a
+/// Json first. Used in the namespace of the struct, after it:
+///
+///   struct Point {
+///     int x;
+///     int y;
+///   };
+///   JSON_RPC_FIELDS(Point, x, y)
+///
+/// The macro handles up to 16 fields. It defines the function looked up for a described type, which
+/// can also be written by hand, e.g. to rename members:
+///
+///   constexpr auto JsonFields(const Point*) {
+///     return std::make_tuple(json_rpc::Field("x", &Point::x), json_rpc::Field("y", &Point::y));
+///   }
+#define JSON_RPC_FIELDS(Type, ...)                                   \
+  [[maybe_unused]] constexpr auto JsonFields(const Type*) {          \
+    return std::make_tuple(JSON_RPC_FIELDS_MAP_(Type, __VA_ARGS__)); \
+  }
+
+#define JSON_RPC_FIELD_(T, f) ::json_rpc::Field(#f, &T::f)
+#define JSON_RPC_FIELDS_1_(T, f) JSON_RPC_FIELD_(T, f)
+#define JSON_RPC_FIELDS_2_(T, f, ...) JSON_RPC_FIELD_(T, f), JSON_RPC_FIELDS_1_(T, __VA_ARGS__)
+#define JSON_RPC_FIELDS_3_(T, f, ...) JSON_RPC_FIELD_(T, f), JSON_RPC_FIELDS_2_(T, __VA_ARGS__)
+#define JSON_RPC_FIELDS_4_(T, f, ...) JSON_RPC_FIELD_(T, f), JSON_RPC_FIELDS_3_(T, __VA_ARGS__)
+#define JSON_RPC_FIELDS_5_(T, f, ...) JSON_RPC_FIELD_(T, f), JSON_RPC_FIELDS_4_(T, __VA_ARGS__)
+#define JSON_RPC_FIELDS_6_(T, f, ...) JSON_RPC_FIELD_(T, f), JSON_RPC_FIELDS_5_(T, __VA_ARGS__)
+#define JSON_RPC_FIELDS_7_(T, f, ...) JSON_RPC_FIELD_(T, f), JSON_RPC_FIELDS_6_(T, __VA_ARGS__)
+#define JSON_RPC_FIELDS_8_(T, f, ...) JSON_RPC_FIELD_(T, f), JSON_RPC_FIELDS_7_(T, __VA_ARGS__)
+#define JSON_RPC_FIELDS_9_(T, f, ...) JSON_RPC_FIELD_(T, f), JSON_RPC_FIELDS_8_(T, __VA_ARGS__)
+#define JSON_RPC_FIELDS_10_(T, f, ...) JSON_RPC_FIELD_(T, f), JSON_RPC_FIELDS_9_(T, __VA_ARGS__)
+#define JSON_RPC_FIELDS_11_(T, f, ...) JSON_RPC_FIELD_(T, f), JSON_RPC_FIELDS_10_(T, __VA_ARGS__)
+#define JSON_RPC_FIELDS_12_(T, f, ...) JSON_RPC_FIELD_(T, f), JSON_RPC_FIELDS_11_(T, __VA_ARGS__)
+#define JSON_RPC_FIELDS_13_(T, f, ...) JSON_RPC_FIELD_(T, f), JSON_RPC_FIELDS_12_(T, __VA_ARGS__)
+#define JSON_RPC_FIELDS_14_(T, f, ...) JSON_RPC_FIELD_(T, f), JSON_RPC_FIELDS_13_(T, __VA_ARGS__)
+#define JSON_RPC_FIELDS_15_(T, f, ...) JSON_RPC_FIELD_(T, f), JSON_RPC_FIELDS_14_(T, __VA_ARGS__)
+#define JSON_RPC_FIELDS_16_(T, f, ...) JSON_RPC_FIELD_(T, f), JSON_RPC_FIELDS_15_(T, __VA_ARGS__)
+#define JSON_RPC_FIELDS_PICK_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, \
+                              _16, N, ...)                                                      \
+  N
+#define JSON_RPC_FIELDS_MAP_(T, ...)                                                           \
+  JSON_RPC_FIELDS_PICK_(__VA_ARGS__, JSON_RPC_FIELDS_16_, JSON_RPC_FIELDS_15_,                 \
+                        JSON_RPC_FIELDS_14_, JSON_RPC_FIELDS_13_, JSON_RPC_FIELDS_12_,         \
+                        JSON_RPC_FIELDS_11_, JSON_RPC_FIELDS_10_, JSON_RPC_FIELDS_9_,          \
+                        JSON_RPC_FIELDS_8_, JSON_RPC_FIELDS_7_, JSON_RPC_FIELDS_6_,            \
+                        JSON_RPC_FIELDS_5_, JSON_RPC_FIELDS_4_, JSON_RPC_FIELDS_3_,            \
+                        JSON_RPC_FIELDS_2_, JSON_RPC_FIELDS_1_)(T, __VA_ARGS__)
+
+namespace internal {
+
+template <typename T, typename = void>
+struct IsDescribed : std::false_type {};
+
+template <typename T>
+struct IsDescribed<T, std::void_t<decltype(JsonFields(static_cast<const T*>(nullptr)))>>
+    : std::true_type {};
+
+template <typename T, typename = void>
+struct IsRange : std::false_type {};
+
+template <typename T>
+struct IsRange<T,
+               std::void_t<typename T::value_type, decltype(std::begin(std::declval<const T&>())),
+                           decltype(std::end(std::declval<const T&>()))>> : std::true_type {};
+
+template <typename T, typename = void>
+struct IsMap : std::false_type {};
+
+template <typename T>
+struct IsMap<T, std::void_t<typename T::key_type, typename T::mapped_type>>
+    : std::is_convertible<const typename T::key_type&, std::string_view> {};
+
+// The type of the values of a range, or of a map.
+template <typename T, typename = void>
+struct ElementType {
+  using type = typename T::value_type;
+};
+
+template <typename T>
+struct ElementType<T, std::enable_if_t<IsMap<T>::value>> {
+  using type = typename T::mapped_type;
+};
+
+template <typename T>
+struct IsOptional : std::false_type {};
+
+template <typename T>
+struct IsOptional<std::optional<T>> : std::true_type {};
+
+/// Whether T holds a described struct somewhere, making it worth writing without a Json.
+template <typename T, typename = void>
+struct IsTypedResult : IsDescribed<T> {};
+
+template <typename T>
+struct IsTypedResult<std::optional<T>> : IsTypedResult<T> {};
+
+template <typename T>
+struct IsTypedResult<T, std::enable_if_t<IsRange<T>::value && !IsDescribed<T>::value &&
+                                         !std::is_same_v<T, Json> &&
+                                         !std::is_convertible_v<const T&, std::string_view>>>
+    : IsTypedResult<typename ElementType<T>::type> {};
+
+/// @brief Appends a string as a quoted JSON string, escaped as Json::dump() does. The string is
+/// expected to be UTF-8 and is not validated.
+/// @param value The string.
+/// @param out The string to append to.
+void AppendString(std::string_view value, std::string* out);
+
+template <typename T>
+void AppendValue(const T& value, std::string* out) {
+  if constexpr (std::is_same_v<T, Json>) {
+    AppendJson(value, out);
+  } else if constexpr (std::is_same_v<T, bool>) {
+    out->append(value ? "true" : "false");
+  } else if constexpr (std::is_integral_v<T>) {
+    char buffer[24];
+    const auto end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+    out->append(buffer, end);
+  } else if constexpr (std::is_floating_point_v<T>) {
+    // The shortest representation that round trips, as Json::dump() prints a number.
+    if (!std::isfinite(value)) {
+      out->append("null");
+    } else {
+      char buffer[32];
+      const auto end =
+          std::to_chars(buffer, buffer + sizeof(buffer), static_cast<double>(value)).ptr;
+      const std::string_view number(buffer, static_cast<size_t>(end - buffer));
+      out->append(number);
+      // Integral values keep a fraction, so they are read back as floating point.
+      if (number.find_first_of(".e") == std::string_view::npos) {
+        out->append(".0");
+      }
+    }
+  } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+    AppendString(value, out);
+  } else if constexpr (std::is_same_v<T, std::nullptr_t>) {
+    out->append("null");
+  } else if constexpr (IsOptional<T>::value) {
+    if (value) {
+      AppendValue(*value, out);
+    } else {
+      out->append("null");
+    }
+  } else if constexpr (IsDescribed<T>::value) {
+    out->push_back('{');
+    bool first = true;
+    std::apply(
+        [&](const auto&... fields) {
+          ((out->append(first ? "" : ","), first = false, AppendString(fields.name, out),
+            out->push_back(':'), AppendValue(value.*(fields.member), out)),
+           ...);
+        },
+        JsonFields(static_cast<const T*>(nullptr)));
+    out->push_back('}');
+  } else if constexpr (IsMap<T>::value) {
+    out->push_back('{');
+    bool first = true;
+    for (const auto& [key, element] : value) {
+      if (!first) {
+        out->push_back(',');
+      }
+      first = false;
+      AppendString(key, out);
+      out->push_back(':');
+      AppendValue(element, out);
+    }
+    out->push_back('}');
+  } else if constexpr (IsRange<T>::value) {
+    out->push_back('[');
+    bool first = true;
+    for (const auto& element : value) {
+      if (!first) {
+        out->push_back(',');
+      }
+      first = false;
+      AppendValue(element, out);
+    }
+    out->push_back(']');
+  } else {
+    // Any other type convertible to Json, e.g. with its own to_json().
+    AppendJson(Json(value), out);
+  }
+}
+
+/// A result kept as its native type until the Response is serialized.
+class TypedResult {
+ public:
+  virtual ~TypedResult() = default;
+
+  /// @brief Appends the result as JSON text.
+  /// @param out The string to append to.
+  virtual void AppendTo(std::string* out) const = 0;
+};
+
+template <typename T>
+class TypedValue final : public TypedResult {
+ public:
+  explicit TypedValue(T value) : value_(std::move(value)) {}
+
+  void AppendTo(std::string* out) const override {
+    AppendValue(value_, out);
+  }
+
+ private:
+  T value_;
+};
+
+}  // namespace internal
+
+/// @brief Serializes a described struct, or a container or optional of them, compactly and without
+/// building a Json. Object members are written in the order of the fields, strings are escaped as
+/// Json::dump() does but not validated as UTF-8, and member types other than numbers, strings,
+/// containers and described structs go through Json.
+/// @param value The value to serialize.
+/// @param out The string to append to.
+template <typename T, std::enable_if_t<internal::IsTypedResult<T>::value, int> = 0>
+void AppendJson(const T& value, std::string* out) {
+  internal::AppendValue(value, out);
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,218 @@
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "json_rpc/batch_request.h"
+#include "json_rpc/batch_response.h"
+#include "json_rpc/object_pool.h"
+#include "json_rpc/response.h"
+#include "json_rpc/typed_result.h"
+
+namespace {
+
+std::atomic<bool> counting{false};
+std::atomic<size_t> allocations{0};
+
+}  // namespace
+
+// Counts the allocations of the whole test binary while a test asks for it. The default operator
+// delete releases with free(), so it is left alone.
+void* operator new(size_t size) {
+  if (counting.load(std::memory_order_relaxed)) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+namespace json_rpc {
+
+class AllocationTest : public ::testing::Test {
+ protected:
+  static constexpr size_t kSize = 1000;
+
+  template <typename F>
+  static size_t CountAllocations(F&& f) {
+    allocations = 0;
+    counting = true;
+    f();
+    counting = false;
+    return allocations;
+  }
+
+  // Strings too long for the small string optimization, so that every copy allocates.
+  static Json LargeValue() {
+    Json value = Json::array();
+    for (size_t i = 0; i < kSize; ++i) {
+      value.push_back(std::string(64, 'x'));
+    }
+    return value;
+  }
+
+  static Json LargeRequest(const int id) {
+    return {{"jsonrpc", "2.0"}, {"method", "m"}, {"params", LargeValue()}, {"id", id}};
+  }
+};
+
+TEST_F(AllocationTest, Request) {
+  auto json = LargeRequest(1);
+  Request request;
+  Status status(kSuccess, "");
+  EXPECT_LT(CountAllocations([&] { status = request.ParseJson(std::move(json)); }), 10);
+  ASSERT_TRUE(status.Ok());
+  EXPECT_EQ(request.Params().Array().size(), kSize);
+
+  // Parsing a const JSON has to copy the params, once: a string value allocates twice, and the
+  // array is copied into the one of the previous params.
+  const auto copied = LargeRequest(1);
+  EXPECT_GE(CountAllocations([&] { status = request.ParseJson(copied); }), 2 * kSize);
+  EXPECT_LT(CountAllocations([&] { status = request.ParseJson(copied); }), 3 * kSize);
+
+  Parameter params;
+  EXPECT_EQ(CountAllocations([&] {
+              const auto& value = request.Params().Get(0);
+              params = request.TakeParams();
+              static_cast<void>(value);
+            }),
+            0);
+  EXPECT_EQ(params.Array().size(), kSize);
+  EXPECT_EQ(request.Params().Type(), Parameter::ParamType::kNull);
+
+  // The map nodes a parameter keeps for reuse stay with it when it is copied.
+  Json object = Json::object();
+  for (size_t i = 0; i < kSize; ++i) {
+    object[std::string(32, 'k') + std::to_string(i)] = i;
+  }
+  Parameter recycled(object);
+  recycled.ParseJson(Json::array({1}));
+  EXPECT_LT(CountAllocations([&] { Parameter copy(recycled); }), 10);
+  EXPECT_LT(CountAllocations([&] { params = recycled; }), 10);
+  EXPECT_EQ(params.Array().size(), 1);
+}
+
+TEST_F(AllocationTest, PooledRequest) {
+  // Keys and strings too long for the small string optimization, and values which copy for free.
+  const std::string prefix(32, 'k');
+  Json object = Json::object();
+  for (size_t i = 0; i < 100; ++i) {
+    object[prefix + std::to_string(i)] = i;
+  }
+  const Json json = {{"jsonrpc", "2.0"},
+                     {"method", std::string(32, 'm')},
+                     {"params", object},
+                     {"id", std::string(32, 'i')}};
+
+  ObjectPool<Request> pool;
+  pool.Acquire()->ParseJson(json);
+  ASSERT_EQ(pool.Size(), 1);
+
+  // A recycled request reuses the strings and map nodes of the one parsed before.
+  Status status(kSuccess, "");
+  EXPECT_EQ(CountAllocations([&] {
+              auto request = pool.Acquire();
+              status = request->ParseJson(json);
+            }),
+            0);
+  EXPECT_TRUE(status.Ok());
+
+  auto request = pool.Acquire();
+  ASSERT_TRUE(request->ParseJson(json).Ok());
+  EXPECT_EQ(request->Params().Map().size(), 100);
+  EXPECT_EQ(request->Params().Get<size_t>(prefix + "99"), 99);
+  EXPECT_EQ(request->Id().StringId(), std::string(32, 'i'));
+}
+
+TEST_F(AllocationTest, BatchRequest) {
+  auto json = Json::array();
+  for (int id = 0; id < 10; ++id) {
+    json.push_back(LargeRequest(id));
+  }
+  BatchRequest batch;
+  Status status(kSuccess, "");
+  EXPECT_LT(CountAllocations([&] { status = batch.ParseJson(std::move(json)); }), 100);
+  ASSERT_TRUE(status.Ok());
+  ASSERT_EQ(batch.Requests().size(), 10);
+  EXPECT_EQ(batch.Requests()[9].first.Params().Array().size(), kSize);
+}
+
+TEST_F(AllocationTest, Response) {
+  BatchResponse batch;
+  batch.Reserve(10);
+  for (int id = 0; id < 10; ++id) {
+    Response response{Identifier(id)};
+    response.SetResult(LargeValue());
+    EXPECT_EQ(CountAllocations([&] { batch.AddResponse(std::move(response)); }), 0);
+  }
+
+  Json json;
+  EXPECT_LT(CountAllocations([&] { json = std::move(batch).ToJson(); }), 100);
+  ASSERT_EQ(json.size(), 10);
+  EXPECT_EQ(json[9]["result"].size(), kSize);
+
+  // A const response copies its result into the JSON once.
+  const Response copied = [] {
+    Response response{Identifier(1)};
+    response.SetResult(LargeValue());
+    return response;
+  }();
+  EXPECT_LT(CountAllocations([&] { json = copied.ToJson(); }), 3 * kSize);
+  EXPECT_EQ(json["result"].size(), kSize);
+
+  Response response{Identifier(1)};
+  response.SetResult(LargeValue());
+  Json result;
+  EXPECT_EQ(CountAllocations([&] { result = response.TakeResult(); }), 0);
+  EXPECT_EQ(result.size(), kSize);
+  EXPECT_TRUE(response.Result().is_null());
+}
+
+namespace {
+
+struct Row {
+  int64_t id;
+  std::string name;
+  double score;
+};
+JSON_RPC_FIELDS(Row, id, name, score)
+
+}  // namespace
+
+TEST_F(AllocationTest, TypedResult) {
+  std::vector<Row> rows;
+  for (size_t i = 0; i < kSize; ++i) {
+    rows.push_back({static_cast<int64_t>(i), std::string(64, 'x'), 0.5});
+  }
+  Json json = Json::array();
+  for (const auto& row : rows) {
+    json.push_back({{"id", row.id}, {"name", row.name}, {"score", row.score}});
+  }
+
+  // Written straight from the structs into a warm buffer, the response does not allocate at all,
+  // where building the same result as a Json allocates a few times per row.
+  std::string text;
+  text.reserve(128 * kSize);
+  Response response{Identifier(1)};
+  response.SetResult(std::move(rows));
+  EXPECT_EQ(CountAllocations([&] { response.AppendTo(&text); }), 0);
+  EXPECT_EQ(Json::parse(text)["result"], json);
+
+  EXPECT_GE(CountAllocations([&] {
+              Json built = Json::array();
+              for (const auto& row : json) {
+                built.push_back(
+                    {{"id", row["id"]}, {"name", row["name"]}, {"score", row["score"]}});
+              }
+            }),
+            3 * kSize);
+}
+
+}  // namespace json_rpc
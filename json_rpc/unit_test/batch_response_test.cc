@@ -1,6 +1,9 @@
 
 #include "json_rpc/batch_response.h"
 
+#include <string>
+#include <utility>
+
 #include "gtest/gtest.h"
 
 namespace json_rpc {
@@ -84,4 +87,23 @@ TEST_F(BatchResponseTest, ToJsonSingleResponse) {
   EXPECT_EQ(batch_response.ToJson(), expected_json);
 }
 
+TEST_F(BatchResponseTest, AppendTo) {
+  BatchResponse batch;
+  Response raw(Identifier(1));
+  raw.SetResult(RawJson(std::string(R"({"cached":true})")));
+  batch.AddResponse(std::move(raw));
+  Response error(Identifier("b"));
+  error.SetError({kMethodNotFound, "Method not found"});
+  batch.AddResponse(error);
+  std::string text;
+  batch.AppendTo(&text);
+  EXPECT_EQ(text, R"([{"id":1,"jsonrpc":"2.0","result":{"cached":true}},{"error":)"
+                  R"({"code":-32601,"message":"Method not found"},"id":"b","jsonrpc":"2.0"}])");
+  EXPECT_EQ(Json::parse(text), batch.ToJson());
+
+  text.clear();
+  BatchResponse().AppendTo(&text);
+  EXPECT_EQ(text, "[]");
+}
+
 }  // namespace json_rpc
\ No newline at end of file
@@ -0,0 +1,115 @@
+
+#include "json_rpc/bulk.h"
+
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace json_rpc {
+
+class BulkTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    const auto prefix = "/tmp/json_rpc_bulk_test_" + std::to_string(getpid());
+    input_path_ = prefix + ".in";
+    output_path_ = prefix + ".out";
+    dispatcher_.RegisterMethod("subtract", [](const Request& request) {
+      Response response(request.Id());
+      response.SetResult(request.Params().Get<int>(0) - request.Params().Get<int>(1));
+      return response;
+    });
+  }
+
+  void TearDown() override {
+    unlink(input_path_.c_str());
+    unlink(output_path_.c_str());
+  }
+
+  void WriteInput(const std::string& text) const {
+    std::ofstream(input_path_, std::ios::binary) << text;
+  }
+
+  [[nodiscard]] std::string ReadOutput() const {
+    std::ostringstream output;
+    output << std::ifstream(output_path_, std::ios::binary).rdbuf();
+    return output.str();
+  }
+
+  std::string input_path_;
+  std::string output_path_;
+  Dispatcher dispatcher_;
+};
+
+TEST_F(BulkTest, PreservesOrder) {
+  std::string input;
+  std::string expected;
+  for (int i = 0; i < 1000; ++i) {
+    std::string line;
+    switch (i % 5) {
+      case 0:
+        line = R"({"jsonrpc":"2.0","method":"subtract","params":[)" + std::to_string(i) +
+               R"(,1],"id":)" + std::to_string(i) + "}";
+        break;
+      case 1:
+        line = R"({"jsonrpc":"2.0","method":"subtract","params":[1,1]})";
+        break;
+      case 2:
+        line = R"([{"jsonrpc":"2.0","method":"subtract","params":[3,1],"id":"a"},)"
+               R"({"jsonrpc":"2.0","method":"missing","id":"b"}])";
+        break;
+      case 3:
+        line = "{";
+        break;
+      default:
+        line = "";
+        break;
+    }
+    input += line + (i % 2 == 0 ? "\r\n" : "\n");
+    if (!line.empty()) {
+      const auto response = dispatcher_.HandleMessage(line);
+      if (!response.empty()) {
+        expected += response + "\n";
+      }
+    }
+  }
+  // No newline at the end of the last line.
+  const std::string last = R"({"jsonrpc":"2.0","method":"subtract","params":[9,2],"id":-1})";
+  input += last;
+  expected += dispatcher_.HandleMessage(last) + "\n";
+  WriteInput(input);
+
+  BulkOptions options;
+  options.threads = 3;
+  options.chunk_bytes = 1000;
+  BulkReport report;
+  ASSERT_TRUE(ProcessNdjsonFile(input_path_, output_path_, &dispatcher_, options, &report).Ok());
+  EXPECT_EQ(report.messages, 801);
+  EXPECT_EQ(report.responses, 601);
+  EXPECT_EQ(ReadOutput(), expected);
+
+  // A single chunk.
+  options.chunk_bytes = input.size() * 2;
+  ASSERT_TRUE(ProcessNdjsonFile(input_path_, output_path_, &dispatcher_, options).Ok());
+  EXPECT_EQ(ReadOutput(), expected);
+}
+
+TEST_F(BulkTest, EmptyInput) {
+  WriteInput("");
+  BulkReport report;
+  ASSERT_TRUE(ProcessNdjsonFile(input_path_, output_path_, &dispatcher_, BulkOptions(), &report)
+                  .Ok());
+  EXPECT_EQ(report.messages, 0);
+  EXPECT_EQ(ReadOutput(), "");
+}
+
+TEST_F(BulkTest, Errors) {
+  EXPECT_FALSE(ProcessNdjsonFile(input_path_ + ".missing", output_path_, &dispatcher_).Ok());
+  WriteInput("{}\n");
+  EXPECT_FALSE(ProcessNdjsonFile(input_path_, "/nonexistent/dir/out", &dispatcher_).Ok());
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,66 @@
+
+#include "json_rpc/cancellation.h"
+
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace json_rpc {
+
+TEST(CancellationTokenTest, DefaultToken) {
+  const CancellationToken token;
+  token.Cancel();
+  EXPECT_FALSE(token.IsCancelled());
+  EXPECT_EQ(token.OnCancel([] { FAIL(); }), 0);
+}
+
+TEST(CancellationTokenTest, Cancel) {
+  const auto token = CancellationToken::Create();
+  const auto copy = token;
+  int calls = 0;
+  const auto removed = token.OnCancel([&calls] { calls += 10; });
+  token.OnCancel([&calls] { ++calls; });
+  token.RemoveCallback(removed);
+  EXPECT_FALSE(copy.IsCancelled());
+
+  copy.Cancel();
+  copy.Cancel();
+  EXPECT_TRUE(token.IsCancelled());
+  EXPECT_EQ(calls, 1);
+
+  // Registered after the fact, the callback runs at once.
+  token.OnCancel([&calls] { ++calls; });
+  EXPECT_EQ(calls, 2);
+}
+
+TEST(CancellationTokenTest, CancelFromAnotherThread) {
+  const auto token = CancellationToken::Create();
+  std::thread canceller([token] { token.Cancel(); });
+  while (!token.IsCancelled()) {
+    std::this_thread::yield();
+  }
+  canceller.join();
+}
+
+TEST(CancellationRegistryTest, Cancel) {
+  CancellationRegistry registry;
+  const auto first = registry.Register(Identifier(1));
+  const auto second = registry.Register(Identifier("1"));
+  EXPECT_EQ(registry.Size(), 2);
+
+  EXPECT_TRUE(registry.Cancel(Identifier(1)));
+  EXPECT_TRUE(first.IsCancelled());
+  EXPECT_FALSE(second.IsCancelled());
+  EXPECT_FALSE(registry.Cancel(Identifier(2)));
+
+  // A stale token does not unregister a request that reused the id.
+  const auto reused = registry.Register(Identifier(1));
+  registry.Unregister(Identifier(1), first);
+  EXPECT_EQ(registry.Size(), 2);
+  registry.Unregister(Identifier(1), reused);
+  registry.Unregister(Identifier("1"), second);
+  EXPECT_EQ(registry.Size(), 0);
+  EXPECT_FALSE(registry.Cancel(Identifier(1)));
+}
+
+}  // namespace json_rpc
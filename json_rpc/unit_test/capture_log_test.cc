@@ -0,0 +1,125 @@
+
+#include "json_rpc/capture_log.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace json_rpc {
+
+TEST(CaptureLogTest, AppendAndRead) {
+  const std::string path = "/tmp/json_rpc_capture_log_test.log";
+  CaptureLog writer;
+  ASSERT_TRUE(writer.Create(path, 4096).Ok());
+  EXPECT_FALSE(writer.Create(path).Ok());
+  EXPECT_TRUE(writer.Append(CaptureLog::Kind::kRequest, 7, R"({"id":1})", 100));
+  EXPECT_TRUE(writer.Append(CaptureLog::Kind::kResponse, 7, R"({"id":1,"result":2})", 150));
+  EXPECT_TRUE(writer.Append(CaptureLog::Kind::kRequest, 8, ""));
+  ASSERT_TRUE(writer.Close().Ok());
+  EXPECT_TRUE(writer.Close().Ok());
+  struct stat file;
+  ASSERT_EQ(stat(path.c_str(), &file), 0);
+  EXPECT_LT(file.st_size, 4096);
+
+  CaptureLog reader;
+  ASSERT_TRUE(reader.Open(path).Ok());
+  EXPECT_FALSE(reader.Append(CaptureLog::Kind::kRequest, 1, "x"));
+  CaptureLog::Record record;
+  ASSERT_TRUE(reader.Next(&record));
+  EXPECT_EQ(record.kind, CaptureLog::Kind::kRequest);
+  EXPECT_EQ(record.connection, 7);
+  EXPECT_EQ(record.timestamp_ns, 100);
+  EXPECT_EQ(record.data, R"({"id":1})");
+  ASSERT_TRUE(reader.Next(&record));
+  EXPECT_EQ(record.kind, CaptureLog::Kind::kResponse);
+  EXPECT_EQ(record.timestamp_ns, 150);
+  EXPECT_EQ(record.data, R"({"id":1,"result":2})");
+  ASSERT_TRUE(reader.Next(&record));
+  EXPECT_EQ(record.connection, 8);
+  EXPECT_NE(record.timestamp_ns, 0);
+  EXPECT_TRUE(record.data.empty());
+  EXPECT_FALSE(reader.Next(&record));
+
+  reader.Rewind();
+  ASSERT_TRUE(reader.Next(&record));
+  EXPECT_EQ(record.connection, 7);
+  reader.Close();
+  unlink(path.c_str());
+}
+
+TEST(CaptureLogTest, Full) {
+  const std::string path = "/tmp/json_rpc_capture_log_full_test.log";
+  CaptureLog writer;
+  ASSERT_TRUE(writer.Create(path, 176).Ok());
+  const std::string message(40, 'x');
+  EXPECT_TRUE(writer.Append(CaptureLog::Kind::kRequest, 1, message));
+  EXPECT_TRUE(writer.Append(CaptureLog::Kind::kRequest, 2, message));
+  EXPECT_FALSE(writer.Append(CaptureLog::Kind::kRequest, 3, message));
+  // Space is never reused once a record did not fit, even by a smaller one.
+  EXPECT_FALSE(writer.Append(CaptureLog::Kind::kRequest, 4, ""));
+  EXPECT_EQ(writer.Dropped(), 2);
+  writer.Close();
+
+  CaptureLog reader;
+  ASSERT_TRUE(reader.Open(path).Ok());
+  CaptureLog::Record record;
+  size_t records = 0;
+  while (reader.Next(&record)) {
+    EXPECT_EQ(record.data, message);
+    ++records;
+  }
+  EXPECT_EQ(records, 2);
+  unlink(path.c_str());
+}
+
+TEST(CaptureLogTest, ConcurrentAppend) {
+  const std::string path = "/tmp/json_rpc_capture_log_concurrent_test.log";
+  constexpr size_t kThreads = 4;
+  constexpr size_t kMessages = 1000;
+  CaptureLog writer;
+  ASSERT_TRUE(writer.Create(path, 1 << 20).Ok());
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&writer, t] {
+      for (size_t i = 0; i < kMessages; ++i) {
+        writer.Append(CaptureLog::Kind::kRequest, t, std::to_string(i));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  writer.Close();
+
+  CaptureLog reader;
+  ASSERT_TRUE(reader.Open(path).Ok());
+  std::vector<size_t> next(kThreads, 0);
+  CaptureLog::Record record;
+  size_t records = 0;
+  while (reader.Next(&record)) {
+    ASSERT_LT(record.connection, kThreads);
+    // Each thread's messages keep their order.
+    EXPECT_EQ(record.data, std::to_string(next[record.connection]++));
+    ++records;
+  }
+  EXPECT_EQ(records, kThreads * kMessages);
+  unlink(path.c_str());
+}
+
+TEST(CaptureLogTest, NotALog) {
+  const std::string path = "/tmp/json_rpc_capture_log_invalid_test.log";
+  CaptureLog log;
+  EXPECT_FALSE(log.Open(path + ".missing").Ok());
+  FILE* file = fopen(path.c_str(), "w");
+  fputs("not a capture log at all", file);
+  fclose(file);
+  EXPECT_FALSE(log.Open(path).Ok());
+  unlink(path.c_str());
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,160 @@
+
+#include "json_rpc/coalescing_client.h"
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "json_rpc/dispatcher.h"
+
+namespace json_rpc {
+
+class CoalescingClientTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dispatcher_.RegisterMethod("subtract", [](const Request& request) {
+      Response response(request.Id());
+      response.SetResult(request.Params().Get<int>(0) - request.Params().Get<int>(1));
+      return response;
+    });
+    dispatcher_.RegisterMethod("note", [this](const Request&) {
+      ++notes_;
+      return Response();
+    });
+  }
+
+  Transport DispatcherTransport() {
+    return [this](std::string_view message, std::string* response) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        messages_.emplace_back(message);
+      }
+      *response = dispatcher_.HandleMessage(message);
+      return Status(kSuccess, "");
+    };
+  }
+
+  static Request Subtract(int a, int b, Identifier id) {
+    return Request("2.0", "subtract", Parameter(Json::array({a, b})), std::move(id));
+  }
+
+  Dispatcher dispatcher_;
+  std::atomic<int> notes_{0};
+  std::mutex mutex_;
+  std::vector<std::string> messages_;
+};
+
+TEST_F(CoalescingClientTest, Batches) {
+  CoalescingOptions options;
+  options.window = std::chrono::seconds(1);
+  options.max_calls = 4;
+  CoalescingClient client(DispatcherTransport(), options);
+
+  // Callers picking the same ids get their own responses back, under their ids.
+  std::vector<std::promise<Response>> responses(8);
+  for (int i = 0; i < 8; ++i) {
+    ASSERT_TRUE(client
+                    .Submit(Subtract(i, 1, Identifier(i % 2)),
+                            [&responses, i](Response response) {
+                              responses[i].set_value(std::move(response));
+                            })
+                    .Ok());
+  }
+  for (int i = 0; i < 8; ++i) {
+    const auto response = responses[i].get_future().get();
+    EXPECT_EQ(response.Id().IntId(), i % 2);
+    EXPECT_EQ(response.Result(), i - 1);
+  }
+  EXPECT_EQ(client.MessagesSent(), 2);
+  std::lock_guard<std::mutex> lock(mutex_);
+  ASSERT_EQ(messages_.size(), 2);
+  EXPECT_EQ(Json::parse(messages_[0]).size(), 4);
+}
+
+TEST_F(CoalescingClientTest, Window) {
+  CoalescingOptions options;
+  options.window = std::chrono::milliseconds(50);
+  CoalescingClient client(DispatcherTransport(), options);
+
+  std::vector<std::thread> threads;
+  std::atomic<int> failures{0};
+  for (int i = 0; i < 8; ++i) {
+    threads.emplace_back([&client, &failures, i] {
+      const auto response = client.Call(Subtract(10, i, Identifier("call")));
+      if (response.Result() != 10 - i || response.Id().StringId() != "call") {
+        ++failures;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(failures, 0);
+  // The threads start within the window of the first call, unless the machine is very busy.
+  EXPECT_LT(client.MessagesSent(), 8);
+
+  // Notifications ride along without a response.
+  ASSERT_TRUE(client.Submit(Request("2.0", "note", Parameter(), Identifier()), nullptr).Ok());
+  EXPECT_EQ(client.Call(Subtract(3, 2, Identifier(9))).Result(), 1);
+  client.Stop();
+  EXPECT_EQ(notes_, 1);
+  EXPECT_TRUE(client.Submit(Subtract(1, 1, Identifier(1)), nullptr).Code() == kInternalError);
+
+  // A lone call is sent as is rather than as a batch of one.
+  CoalescingClient single(DispatcherTransport());
+  EXPECT_EQ(single.Call(Subtract(5, 2, Identifier(1))).Result(), 3);
+  std::lock_guard<std::mutex> lock(mutex_);
+  EXPECT_TRUE(Json::parse(messages_.back()).is_object());
+}
+
+TEST_F(CoalescingClientTest, Failures) {
+  CoalescingClient broken([](std::string_view, std::string*) {
+    return Status(kInternalError, "connection reset");
+  });
+  auto response = broken.Call(Subtract(1, 2, Identifier(5)));
+  EXPECT_EQ(response.Err().Code(), kInternalError);
+  EXPECT_EQ(response.Err().Message(), "connection reset");
+  EXPECT_EQ(response.Id().IntId(), 5);
+
+  // The server answers only some of the calls, or rejects the whole batch.
+  std::string reply;
+  CoalescingOptions options;
+  options.window = std::chrono::seconds(1);
+  options.max_calls = 2;
+  CoalescingClient partial(
+      [&reply](std::string_view message, std::string* response) {
+        const auto batch = Json::parse(message);
+        reply = Json::array({{{"jsonrpc", "2.0"}, {"result", 1}, {"id", batch[1]["id"]}}}).dump();
+        *response = reply;
+        return Status(kSuccess, "");
+      },
+      options);
+  std::promise<Response> first;
+  std::promise<Response> second;
+  partial.Submit(Subtract(0, 0, Identifier(1)),
+                 [&first](Response r) { first.set_value(std::move(r)); });
+  partial.Submit(Subtract(0, 0, Identifier(2)),
+                 [&second](Response r) { second.set_value(std::move(r)); });
+  response = first.get_future().get();
+  EXPECT_EQ(response.Err().Code(), kInternalError);
+  EXPECT_EQ(response.Id().IntId(), 1);
+  EXPECT_EQ(second.get_future().get().Result(), 1);
+
+  CoalescingClient rejected(
+      [](std::string_view, std::string* response) {
+        *response = R"({"jsonrpc":"2.0","error":{"code":-32600,"message":"no"},"id":null})";
+        return Status(kSuccess, "");
+      },
+      options);
+  std::promise<Response> third;
+  rejected.Submit(Subtract(0, 0, Identifier(3)),
+                  [&third](Response r) { third.set_value(std::move(r)); });
+  EXPECT_EQ(rejected.Call(Subtract(0, 0, Identifier(4))).Err().Code(), kInvalidRequest);
+  EXPECT_EQ(third.get_future().get().Err().Message(), "no");
+}
+
+}  // namespace json_rpc
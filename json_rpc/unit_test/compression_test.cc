@@ -0,0 +1,104 @@
+
+#include "json_rpc/compression.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "json_rpc/error.h"
+
+namespace json_rpc {
+
+namespace {
+
+std::string RepetitiveJson(const size_t entries) {
+  std::string json = "[";
+  for (size_t i = 0; i < entries; ++i) {
+    json += R"({"type":"text","text":"line )" + std::to_string(i) + R"("},)";
+  }
+  json.back() = ']';
+  return json;
+}
+
+}  // namespace
+
+TEST(CompressionTest, FrameHeader) {
+  std::string frame = "x";
+  AppendFrameHeader(Codec::kDeflate, 0x01020304, &frame);
+  ASSERT_EQ(frame.size(), 1 + kFrameHeaderSize);
+  EXPECT_EQ(frame[1], kFrameMarker);
+
+  Codec codec;
+  size_t size;
+  EXPECT_TRUE(ParseFrameHeader(std::string_view(frame).substr(1), &codec, &size));
+  EXPECT_EQ(codec, Codec::kDeflate);
+  EXPECT_EQ(size, 0x01020304);
+  EXPECT_FALSE(ParseFrameHeader(std::string_view(frame).substr(1, 5), &codec, &size));
+}
+
+TEST(CompressionTest, RoundTrip) {
+  const auto message = RepetitiveJson(1000);
+  std::string frame = "prefix";
+  ASSERT_TRUE(AppendCompressedFrame(Codec::kDeflate, message, 6, &frame).Ok());
+  Codec codec;
+  size_t size;
+  ASSERT_TRUE(ParseFrameHeader(std::string_view(frame).substr(6), &codec, &size));
+  EXPECT_EQ(frame.size(), 6 + kFrameHeaderSize + size);
+  // Repetitive JSON compresses well.
+  EXPECT_LT(size * 5, message.size());
+
+  const auto payload = std::string_view(frame).substr(6 + kFrameHeaderSize);
+  std::string decompressed = "stale";
+  ASSERT_TRUE(Decompress(codec, payload, 1 << 20, &decompressed).Ok());
+  EXPECT_EQ(decompressed, message);
+
+  // An empty message.
+  frame.clear();
+  ASSERT_TRUE(AppendCompressedFrame(Codec::kDeflate, "", 6, &frame).Ok());
+  ASSERT_TRUE(Decompress(Codec::kDeflate, frame.substr(kFrameHeaderSize), 0, &decompressed).Ok());
+  EXPECT_TRUE(decompressed.empty());
+}
+
+TEST(CompressionTest, AppendMessage) {
+  CompressionOptions options;
+  options.threshold = 100;
+  std::string output;
+  AppendMessage(Codec::kDeflate, "{}", options, &output);
+  EXPECT_EQ(output, "{}\n");
+
+  const auto large = RepetitiveJson(100);
+  AppendMessage(Codec::kNone, large, options, &output);
+  EXPECT_EQ(output, "{}\n" + large + "\n");
+
+  output.clear();
+  AppendMessage(Codec::kDeflate, large, options, &output);
+  ASSERT_EQ(output[0], kFrameMarker);
+  std::string message;
+  ASSERT_TRUE(Decompress(Codec::kDeflate, output.substr(kFrameHeaderSize), 1 << 20, &message).Ok());
+  EXPECT_EQ(message, large);
+}
+
+TEST(CompressionTest, DecompressLimits) {
+  const std::string message(100000, ' ');
+  std::string frame;
+  ASSERT_TRUE(AppendCompressedFrame(Codec::kDeflate, message, 9, &frame).Ok());
+  const auto payload = frame.substr(kFrameHeaderSize);
+
+  std::string decompressed;
+  EXPECT_TRUE(Decompress(Codec::kDeflate, payload, message.size(), &decompressed).Ok());
+  // A payload expanding past the limit is stopped there.
+  auto status = Decompress(Codec::kDeflate, payload, message.size() - 1, &decompressed);
+  EXPECT_EQ(status.Code(), kInvalidRequest);
+  EXPECT_TRUE(decompressed.empty());
+
+  status = Decompress(Codec::kDeflate, payload.substr(0, payload.size() / 2), 1 << 20,
+                      &decompressed);
+  EXPECT_EQ(status.Code(), kParseError);
+  status = Decompress(Codec::kDeflate, "\xff\xff\xff", 1 << 20, &decompressed);
+  EXPECT_EQ(status.Code(), kParseError);
+  status = Decompress(static_cast<Codec>(9), payload, 1 << 20, &decompressed);
+  EXPECT_EQ(status.Code(), kInvalidRequest);
+  EXPECT_FALSE(CodecSupported(static_cast<Codec>(9)));
+  EXPECT_FALSE(CodecSupported(Codec::kNone));
+}
+
+}  // namespace json_rpc
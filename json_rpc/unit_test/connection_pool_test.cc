@@ -0,0 +1,305 @@
+
+#include "json_rpc/connection_pool.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "json_rpc/json.h"
+#include "json_rpc/sharded_server.h"
+
+namespace json_rpc {
+
+class ConnectionPoolTest : public ::testing::Test {
+ protected:
+  // A stand-in server on a Unix socket, answering "name" with its name after a delay, and "gate"
+  // once the gate of the test opens.
+  std::unique_ptr<ShardedServer> StartServer(const std::string& name,
+                                             const std::chrono::milliseconds delay) {
+    const auto path = "/tmp/json_rpc_connection_pool_test_" + name + ".sock";
+    const auto setup = [name, delay, gate = gate_](size_t, Dispatcher* dispatcher) {
+      dispatcher->RegisterMethod("name", [name, delay](const Request& request) {
+        std::this_thread::sleep_for(delay);
+        Response response(request.Id());
+        response.SetResult(name);
+        return response;
+      });
+      dispatcher->RegisterMethod("gate", [gate](const Request& request) {
+        gate.wait();
+        return Response(request.Id());
+      });
+    };
+    auto server = std::make_unique<ShardedServer>(1, setup);
+    EXPECT_TRUE(server->StartUnix(path).Ok());
+    paths_.push_back(path);
+    return server;
+  }
+
+  void TearDown() override {
+    for (const auto& path : paths_) {
+      unlink(path.c_str());
+    }
+  }
+
+  // A bare listener on a Unix socket, for servers played by the test itself.
+  int Listen(const std::string& name) {
+    const auto path = "/tmp/json_rpc_connection_pool_test_" + name + ".sock";
+    unlink(path.c_str());
+    paths_.push_back(path);
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    EXPECT_GE(listener, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    EXPECT_EQ(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    EXPECT_EQ(listen(listener, 4), 0);
+    return listener;
+  }
+
+  static Request Named(const int id) {
+    return Request("2.0", "name", Parameter(), Identifier(id));
+  }
+
+  std::promise<void> open_;
+  std::shared_future<void> gate_ = open_.get_future().share();
+  std::vector<std::string> paths_;
+};
+
+TEST_F(ConnectionPoolTest, LeastOutstanding) {
+  auto a = StartServer("a", std::chrono::milliseconds(0));
+  auto b = StartServer("b", std::chrono::milliseconds(0));
+  ConnectionPool pool({Endpoint::Unix(paths_[0]), Endpoint::Unix(paths_[1])});
+
+  // Calls held by the servers spread over the four connections, two per endpoint.
+  std::vector<std::promise<Response>> held(4);
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(pool.Submit(Request("2.0", "gate", Parameter(), Identifier(i)),
+                            [&held, i](Response response) {
+                              held[i].set_value(std::move(response));
+                            })
+                    .Ok());
+  }
+  EXPECT_EQ(pool.Outstanding(0), 2);
+  EXPECT_EQ(pool.Outstanding(1), 2);
+  open_.set_value();
+  for (int i = 0; i < 4; ++i) {
+    const auto response = held[i].get_future().get();
+    EXPECT_EQ(response.Err().Code(), kSuccess);
+    EXPECT_EQ(response.Id().IntId(), i);
+  }
+  EXPECT_EQ(pool.Outstanding(0), 0);
+
+  // Idle connections take turns.
+  int from_a = 0;
+  for (int i = 0; i < 8; ++i) {
+    const auto response = pool.Call(Named(i));
+    ASSERT_EQ(response.Err().Code(), kSuccess) << response.Err().Message();
+    from_a += response.Result() == "a" ? 1 : 0;
+  }
+  EXPECT_EQ(from_a, 4);
+}
+
+TEST_F(ConnectionPoolTest, PowerOfTwoChoices) {
+  auto a = StartServer("a", std::chrono::milliseconds(0));
+  auto b = StartServer("b", std::chrono::milliseconds(0));
+  PoolOptions options;
+  options.balancing = Balancing::kPowerOfTwoChoices;
+  ConnectionPool pool({Endpoint::Unix(paths_[0]), Endpoint::Unix(paths_[1])}, options);
+
+  std::vector<std::promise<Response>> held(4);
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(pool.Submit(Request("2.0", "gate", Parameter(), Identifier(i)),
+                            [&held, i](Response response) {
+                              held[i].set_value(std::move(response));
+                            })
+                    .Ok());
+  }
+  // The less loaded of two connections never lets one connection take every call.
+  EXPECT_GE(pool.Outstanding(0), 1);
+  EXPECT_GE(pool.Outstanding(1), 1);
+  open_.set_value();
+  for (auto& response : held) {
+    EXPECT_EQ(response.get_future().get().Err().Code(), kSuccess);
+  }
+}
+
+TEST_F(ConnectionPoolTest, EjectsFailedEndpoint) {
+  auto b = StartServer("b", std::chrono::milliseconds(0));
+  PoolOptions options;
+  options.max_failures = 1;
+  ConnectionPool pool({Endpoint::Unix("/tmp/json_rpc_connection_pool_test_none.sock"),
+                       Endpoint::Unix(paths_[0])},
+                      options);
+  for (int i = 0; i < 4; ++i) {
+    const auto response = pool.Call(Named(i));
+    ASSERT_EQ(response.Err().Code(), kSuccess) << response.Err().Message();
+    EXPECT_EQ(response.Result(), "b");
+  }
+  EXPECT_TRUE(pool.Ejected(0));
+  EXPECT_FALSE(pool.Ejected(1));
+}
+
+TEST_F(ConnectionPoolTest, EjectsSlowEndpoint) {
+  auto a = StartServer("a", std::chrono::milliseconds(30));
+  auto b = StartServer("b", std::chrono::milliseconds(0));
+  PoolOptions options;
+  options.connections_per_endpoint = 1;
+  options.max_latency = std::chrono::milliseconds(10);
+  ConnectionPool pool({Endpoint::Unix(paths_[0]), Endpoint::Unix(paths_[1])}, options);
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_EQ(pool.Call(Named(i)).Err().Code(), kSuccess);
+  }
+  EXPECT_TRUE(pool.Ejected(0));
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(pool.Call(Named(i)).Result(), "b");
+  }
+}
+
+TEST_F(ConnectionPoolTest, Timeout) {
+  auto a = StartServer("a", std::chrono::milliseconds(300));
+  PoolOptions options;
+  options.timeout = std::chrono::milliseconds(50);
+  ConnectionPool pool({Endpoint::Unix(paths_[0])}, options);
+  auto response = pool.Call(Named(1));
+  EXPECT_EQ(response.Err().Code(), kRequestTimeout);
+  EXPECT_EQ(response.Id().IntId(), 1);
+
+  // The server only answers slower than the timeout.
+  options.timeout = std::chrono::seconds(5);
+  ConnectionPool patient({Endpoint::Unix(paths_[0])}, options);
+  EXPECT_EQ(patient.Call(Named(2)).Result(), "a");
+
+  pool.Stop();
+  EXPECT_EQ(pool.Submit(Named(3), nullptr).Code(), kInternalError);
+}
+
+TEST_F(ConnectionPoolTest, OneIdOnTheWire) {
+  // A bare listener, so the line is seen as written rather than as parsed.
+  const int listener = Listen("wire");
+  const auto path = paths_.back();
+  std::promise<std::string> seen;
+  std::thread server([listener, &seen]() {
+    const int fd = accept(listener, nullptr, nullptr);
+    std::string line;
+    char c;
+    while (read(fd, &c, 1) == 1 && c != '\n') {
+      line.push_back(c);
+    }
+    const auto id = Json::parse(line)[kIdName];
+    const auto reply = R"({"jsonrpc":"2.0","result":"wire","id":)" + id.dump() + "}\n";
+    EXPECT_EQ(write(fd, reply.data(), reply.size()), static_cast<ssize_t>(reply.size()));
+    seen.set_value(line);
+    close(fd);
+  });
+
+  PoolOptions options;
+  options.connections_per_endpoint = 1;
+  ConnectionPool pool({Endpoint::Unix(path)}, options);
+  const auto response = pool.Call(Named(7));
+  server.join();
+  close(listener);
+  EXPECT_EQ(response.Result(), "wire") << response.Err().Message();
+  EXPECT_EQ(response.Id().IntId(), 7);
+  const auto line = seen.get_future().get();
+  const auto first = line.find(R"("id")");
+  ASSERT_NE(first, std::string::npos) << line;
+  EXPECT_EQ(line.find(R"("id")", first + 1), std::string::npos) << line;
+}
+
+TEST_F(ConnectionPoolTest, PeerNotReading) {
+  // A server that accepts its connection and never reads from it, so its socket fills up.
+  const int listener = Listen("stuck");
+  std::promise<void> release;
+  std::thread stuck([listener, done = release.get_future()]() {
+    const int fd = accept(listener, nullptr, nullptr);
+    done.wait();
+    close(fd);
+  });
+  auto b = StartServer("b", std::chrono::milliseconds(0));
+  PoolOptions options;
+  options.connections_per_endpoint = 1;
+  options.timeout = std::chrono::seconds(2);
+  options.max_failures = 1000;
+  ConnectionPool pool({Endpoint::Unix(paths_[0]), Endpoint::Unix(paths_[1])}, options);
+
+  // Far more than the socket buffers of the stuck connection hold, yet no call blocks.
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::promise<Response>> responses(32);
+  for (int i = 0; i < 32; ++i) {
+    const Request large("2.0", "name", Parameter(Json::array({std::string(64 * 1024, 'x')})),
+                        Identifier(i));
+    ASSERT_TRUE(pool.Submit(large, [&responses, i](Response response) {
+                      responses[i].set_value(std::move(response));
+                    })
+                    .Ok());
+  }
+  EXPECT_LT(std::chrono::steady_clock::now() - start, options.timeout);
+  // The responses of the other endpoint are still read meanwhile, and new calls go there.
+  while (pool.Outstanding(1) != 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_GT(pool.Outstanding(0), 0);
+  EXPECT_EQ(pool.Call(Named(100)).Result(), "b");
+
+  int timed_out = 0;
+  for (auto& response : responses) {
+    const auto code = response.get_future().get().Err().Code();
+    EXPECT_TRUE(code == kSuccess || code == kRequestTimeout) << code;
+    timed_out += code == kRequestTimeout ? 1 : 0;
+  }
+  EXPECT_GT(timed_out, 0);
+  pool.Stop();
+  release.set_value();
+  stuck.join();
+  close(listener);
+}
+
+TEST_F(ConnectionPoolTest, Hedging) {
+  auto a = StartServer("a", std::chrono::milliseconds(0));
+  auto b = StartServer("b", std::chrono::milliseconds(50));
+  PoolOptions options;
+  options.connections_per_endpoint = 1;
+  options.hedge_percentile = 0.25;
+  {
+    // Calls of methods not known to be idempotent are never sent twice.
+    ConnectionPool pool({Endpoint::Unix(paths_[0]), Endpoint::Unix(paths_[1])}, options);
+    int from_b = 0;
+    for (int i = 0; i < 20; ++i) {
+      from_b += pool.Call(Named(i)).Result() == "b" ? 1 : 0;
+    }
+    EXPECT_EQ(from_b, 10);
+    EXPECT_EQ(pool.Hedged(), 0);
+  }
+
+  options.idempotent_methods = {"name"};
+  // A hedge skips the other connection to the slow endpoint.
+  options.connections_per_endpoint = 2;
+  ConnectionPool pool({Endpoint::Unix(paths_[0]), Endpoint::Unix(paths_[1])}, options);
+  // Half the latencies are short, so the hedging delay becomes short once enough are known.
+  for (int i = 0; i < 16; ++i) {
+    ASSERT_EQ(pool.Call(Named(i)).Err().Code(), kSuccess);
+  }
+  EXPECT_EQ(pool.Hedged(), 0);
+  for (int i = 0; i < 8; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto response = pool.Call(Named(i));
+    EXPECT_EQ(response.Result(), "a");
+    EXPECT_EQ(response.Id().IntId(), i);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(40));
+  }
+  EXPECT_GT(pool.Hedged(), 0);
+  // The attempts that lost were cancelled.
+  EXPECT_EQ(pool.Outstanding(0) + pool.Outstanding(1), 0);
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,391 @@
+
+#include "json_rpc/dispatcher.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace json_rpc {
+
+class DispatcherTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dispatcher_.RegisterMethod("subtract", [](const Request& request) {
+      Response response(request.Id());
+      response.SetResult(request.Params().Get<int>(0) - request.Params().Get<int>(1));
+      return response;
+    });
+    dispatcher_.RegisterMethod("fail", [](const Request& request) -> Response {
+      throw std::runtime_error("boom");
+    });
+  }
+
+  Dispatcher dispatcher_;
+};
+
+TEST_F(DispatcherTest, Dispatch) {
+  const Request request("2.0", "subtract", Parameter(Json::array({42, 23})), Identifier(1));
+  Response response;
+  EXPECT_TRUE(dispatcher_.Dispatch(request, &response));
+  EXPECT_EQ(response.Result(), 19);
+  EXPECT_EQ(response.Id().IntId(), 1);
+
+  EXPECT_TRUE(dispatcher_.Dispatch(
+      Request("2.0", "subtract", Parameter(Json::array({1, 2})), Identifier(2)), &response));
+  EXPECT_EQ(response.Result(), -1);
+}
+
+TEST_F(DispatcherTest, DispatchNotification) {
+  Request request("2.0", "subtract", Parameter(Json::array({42, 23})), Identifier());
+  Response response;
+  EXPECT_FALSE(dispatcher_.Dispatch(request, &response));
+}
+
+TEST_F(DispatcherTest, RegisterNotification) {
+  int progress = 0;
+  dispatcher_.RegisterNotification("progress", [&progress](const Request& request) {
+    progress = request.Params().Get<int>("value");
+    if (progress < 0) {
+      throw std::runtime_error("negative");
+    }
+  });
+  EXPECT_TRUE(dispatcher_.SetCoalescing("progress", Coalescing::kLatestWins, "token"));
+
+  Request request("2.0", "progress", Parameter(Json{{"token", 1}, {"value", 5}}), Identifier());
+  dispatcher_.Notify(request);
+  EXPECT_EQ(progress, 5);
+  EXPECT_TRUE(dispatcher_
+                  .HandleMessage(R"({"jsonrpc": "2.0", "method": "progress",
+                                     "params": {"token": 1, "value": -1}})")
+                  .empty());
+  EXPECT_EQ(progress, -1);
+  const auto stats = dispatcher_.GetMetrics().ToJson()["progress"];
+  EXPECT_EQ(stats["notifications"], 2);
+  EXPECT_EQ(stats["errors"], 1);
+
+  // Calls get an error rather than a response the handler cannot give.
+  Response response;
+  Request call("2.0", "progress", Parameter(Json{{"value", 7}}), Identifier(1));
+  EXPECT_TRUE(dispatcher_.Dispatch(call, &response));
+  EXPECT_EQ(response.Err().Code(), kInvalidRequest);
+  EXPECT_EQ(progress, -1);
+
+  std::string key;
+  std::string other;
+  EXPECT_TRUE(dispatcher_.CoalescingKey(request, &key));
+  Request next("2.0", "progress", Parameter(Json{{"token", 2}, {"value", 5}}), Identifier());
+  EXPECT_TRUE(dispatcher_.CoalescingKey(next, &other));
+  EXPECT_NE(key, other);
+  EXPECT_FALSE(dispatcher_.CoalescingKey(call, &key));
+}
+
+TEST_F(DispatcherTest, DispatchMethodNotFound) {
+  Request request("2.0", "foobar", Parameter(), Identifier("1"));
+  Response response;
+  EXPECT_TRUE(dispatcher_.Dispatch(request, &response));
+  EXPECT_EQ(response.Err().Code(), kMethodNotFound);
+  EXPECT_EQ(response.Id().StringId(), "1");
+}
+
+TEST_F(DispatcherTest, DispatchInternedMethod) {
+  // Names are interned for good, so each run of the test needs its own.
+  static int run = 0;
+  const auto method = "multiply" + std::to_string(run++);
+
+  // Built before the method is registered, so it is resolved by name when dispatched.
+  Request early("2.0", method, Parameter(Json::array({6, 7})), Identifier(1));
+  EXPECT_EQ(early.MethodAtom(), kUnknownMethodId);
+
+  Dispatcher other;
+  other.RegisterMethod(method, [](const Request& request) { return Response(request.Id()); });
+  dispatcher_.RegisterMethod(method, [](const Request& request) {
+    Response response(request.Id());
+    response.SetResult(request.Params().Get<int>(0) * request.Params().Get<int>(1));
+    return response;
+  });
+
+  Request request;
+  ASSERT_TRUE(
+      request.ParseJson(Json{{"jsonrpc", "2.0"}, {"method", method}, {"params", {6, 7}}, {"id", 2}})
+          .Ok());
+  EXPECT_EQ(request.MethodAtom(), MethodTable::Global().Find(method));
+  for (auto* req : {&early, &request}) {
+    Response response;
+    EXPECT_TRUE(dispatcher_.Dispatch(*req, &response));
+    EXPECT_EQ(response.Result(), 42);
+  }
+
+  // Interned by other dispatchers only, the method is still unknown here.
+  Dispatcher empty;
+  Response response;
+  EXPECT_TRUE(empty.Dispatch(request, &response));
+  EXPECT_EQ(response.Err().Code(), kMethodNotFound);
+}
+
+TEST_F(DispatcherTest, DispatchHandlerThrows) {
+  Request request("2.0", "fail", Parameter(), Identifier(7));
+  Response response;
+  EXPECT_TRUE(dispatcher_.Dispatch(request, &response));
+  EXPECT_EQ(response.Err().Code(), kInternalError);
+  EXPECT_EQ(response.Id().IntId(), 7);
+}
+
+TEST_F(DispatcherTest, ParamsSchema) {
+  const Json schema = {
+      {"type", "object"},
+      {"properties", {{"minuend", {{"type", "integer"}}}, {"subtrahend", {{"type", "integer"}}}}},
+      {"required", {"minuend", "subtrahend"}}};
+  ASSERT_TRUE(dispatcher_
+                  .RegisterMethod("subtract_named",
+                                  [](const Request& request) {
+                                    Response response(request.Id());
+                                    response.SetResult(request.Params().Get<int>("minuend") -
+                                                       request.Params().Get<int>("subtrahend"));
+                                    return response;
+                                  },
+                                  schema)
+                  .Ok());
+
+  Response response;
+  const Json params = {{"minuend", 42}, {"subtrahend", 23}};
+  dispatcher_.Dispatch(
+      Request("2.0", "subtract_named", Parameter(params), Identifier(1)), &response);
+  EXPECT_EQ(response.Result(), 19);
+
+  dispatcher_.Dispatch(
+      Request("2.0", "subtract_named", Parameter(Json({{"minuend", 42}})), Identifier(2)),
+      &response);
+  EXPECT_EQ(response.Err().Code(), kInvalidParams);
+  EXPECT_EQ(response.Err().Data()["path"], "/subtrahend");
+  EXPECT_EQ(response.Id().IntId(), 2);
+
+  EXPECT_EQ(dispatcher_.RegisterMethod("broken", nullptr, {{"type", 1}}).Code(), kInvalidParams);
+  dispatcher_.Dispatch(Request("2.0", "broken", Parameter(), Identifier(3)), &response);
+  EXPECT_EQ(response.Err().Code(), kMethodNotFound);
+
+  EXPECT_EQ(dispatcher_.RegisterMethod("cyclic", nullptr, {{"$ref", "#"}}).Code(), kInvalidParams);
+  dispatcher_.Dispatch(Request("2.0", "cyclic", Parameter(), Identifier(4)), &response);
+  EXPECT_EQ(response.Err().Code(), kMethodNotFound);
+}
+
+TEST_F(DispatcherTest, HandleMessage) {
+  const auto rsp = dispatcher_.HandleMessage(
+      R"({"jsonrpc": "2.0", "method": "subtract", "params": [42, 23], "id": 1})");
+  EXPECT_EQ(Json::parse(rsp), Json::parse(R"({"jsonrpc": "2.0", "result": 19, "id": 1})"));
+
+  EXPECT_TRUE(dispatcher_
+                  .HandleMessage(R"({"jsonrpc": "2.0", "method": "subtract", "params": [1, 2]})")
+                  .empty());
+
+  const auto parse_error = dispatcher_.HandleMessage(R"({"jsonrpc": "2.0", "method")");
+  EXPECT_EQ(Json::parse(parse_error)["error"]["code"], kParseError);
+}
+
+TEST_F(DispatcherTest, HandleBatchMessage) {
+  const auto rsp = dispatcher_.HandleMessage(R"([
+    {"jsonrpc": "2.0", "method": "subtract", "params": [42, 23], "id": "1"},
+    {"jsonrpc": "2.0", "method": "subtract", "params": [7, 1]},
+    {"foo": "boo"},
+    {"jsonrpc": "2.0", "method": "foo.get", "id": "5"}
+  ])");
+  EXPECT_EQ(Json::parse(rsp), Json::parse(R"([
+    {"jsonrpc": "2.0", "result": 19, "id": "1"},
+    {"jsonrpc": "2.0", "error": {"code": -32600, "message": "Invalid Request"}, "id": null},
+    {"jsonrpc": "2.0", "error": {"code": -32601, "message": "Method not found"}, "id": "5"}
+  ])"));
+
+  EXPECT_TRUE(dispatcher_
+                  .HandleMessage(R"([{"jsonrpc": "2.0", "method": "subtract", "params": [1, 2]}])")
+                  .empty());
+}
+
+TEST_F(DispatcherTest, StreamingMethod) {
+  dispatcher_.RegisterStreamingMethod("range", [](const Request& request, ResultWriter* writer) {
+    const auto count = request.Params().Get<int>("count", -1);
+    if (count < 0) {
+      return Status(kInvalidParams, "Invalid params");
+    }
+    writer->BeginArray();
+    for (int i = 0; i < count; ++i) {
+      writer->Value(i);
+    }
+    return writer->EndArray();
+  });
+  dispatcher_.SetChunkSize(16);
+
+  std::vector<std::string> chunks;
+  const auto sink = [&chunks](std::string_view chunk) {
+    chunks.emplace_back(chunk);
+    return true;
+  };
+  EXPECT_TRUE(dispatcher_
+                  .HandleMessage(R"([
+    {"jsonrpc": "2.0", "method": "range", "params": {"count": 20}, "id": 1},
+    {"jsonrpc": "2.0", "method": "range", "params": {"count": 20}},
+    {"jsonrpc": "2.0", "method": "range", "id": 2},
+    {"jsonrpc": "2.0", "method": "subtract", "params": [2, 1], "id": 3}
+  ])",
+                                 sink)
+                  .Ok());
+  EXPECT_GT(chunks.size(), 5);
+  std::string output;
+  for (const auto& chunk : chunks) {
+    output += chunk;
+  }
+  const auto json = Json::parse(output);
+  ASSERT_EQ(json.size(), 3);
+  EXPECT_EQ(json[0]["result"].size(), 20);
+  EXPECT_EQ(json[1]["error"]["code"], kInvalidParams);
+  EXPECT_EQ(json[2]["result"], 1);
+
+  Response response;
+  EXPECT_TRUE(dispatcher_.Dispatch(
+      Request("2.0", "range", Parameter(Json({{"count", 3}})), Identifier(4)), &response));
+  EXPECT_EQ(response.Result(), Json::array({0, 1, 2}));
+  EXPECT_TRUE(dispatcher_.Dispatch(Request("2.0", "range", Parameter(), Identifier(5)), &response));
+  EXPECT_EQ(response.Err().Code(), kInvalidParams);
+
+  const auto stats = dispatcher_.GetMetrics().ToJson()["range"];
+  EXPECT_EQ(stats["requests"], 4);
+  EXPECT_EQ(stats["notifications"], 1);
+  EXPECT_EQ(stats["errors"], 2);
+  // Only the responses written in chunks count as serialized.
+  EXPECT_EQ(stats["serialize"]["count"], 2);
+
+  // A handler that writes no result is answered with an error, keeping the batch valid.
+  dispatcher_.RegisterStreamingMethod(
+      "silent", [](const Request& request, ResultWriter* writer) { return Status(kSuccess, ""); });
+  const auto batch = Json::parse(dispatcher_.HandleMessage(R"([
+    {"jsonrpc": "2.0", "method": "silent", "id": 6},
+    {"jsonrpc": "2.0", "method": "subtract", "params": [2, 1], "id": 7}
+  ])"));
+  ASSERT_EQ(batch.size(), 2);
+  EXPECT_EQ(batch[0]["error"]["code"], kInternalError);
+  EXPECT_EQ(batch[0]["id"], 6);
+  EXPECT_EQ(batch[1]["result"], 1);
+}
+
+TEST_F(DispatcherTest, Cancellation) {
+  std::atomic<int> running{0};
+  dispatcher_.RegisterMethod("wait", [&running](const Request& request) {
+    ++running;
+    while (!request.Cancellation().IsCancelled()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return Response(request.Id());
+  });
+  dispatcher_.RegisterStreamingMethod("wait_stream", [&running](const Request& request,
+                                                                ResultWriter* writer) {
+    std::promise<void> cancelled;
+    request.Cancellation().OnCancel([&cancelled] { cancelled.set_value(); });
+    ++running;
+    cancelled.get_future().wait();
+    return writer->Value("late");
+  });
+
+  auto pending = std::async(std::launch::async, [this] {
+    return dispatcher_.HandleMessage(R"([
+      {"jsonrpc": "2.0", "method": "wait", "id": 1},
+      {"jsonrpc": "2.0", "method": "wait_stream", "id": "2"},
+      {"jsonrpc": "2.0", "method": "subtract", "params": [2, 1], "id": 3}
+    ])");
+  });
+  while (running != 1) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(dispatcher_.Cancellations().Size(), 1);
+  EXPECT_TRUE(dispatcher_
+                  .HandleMessage(R"({"jsonrpc": "2.0", "method": "notifications/cancelled",
+                                     "params": {"requestId": 1, "reason": "timeout"}})")
+                  .empty());
+  while (running != 2) {
+    std::this_thread::yield();
+  }
+  EXPECT_TRUE(dispatcher_
+                  .HandleMessage(
+                      R"({"jsonrpc": "2.0", "method": "$/cancelRequest", "params": {"id": "2"}})")
+                  .empty());
+
+  const auto json = Json::parse(pending.get());
+  ASSERT_EQ(json.size(), 1);
+  EXPECT_EQ(json[0]["id"], 3);
+  EXPECT_EQ(dispatcher_.Cancellations().Size(), 0);
+
+  // Unknown or finished requests are ignored.
+  EXPECT_TRUE(dispatcher_
+                  .HandleMessage(
+                      R"({"jsonrpc": "2.0", "method": "$/cancelRequest", "params": {"id": 1}})")
+                  .empty());
+  EXPECT_TRUE(
+      dispatcher_.HandleMessage(R"({"jsonrpc": "2.0", "method": "$/cancelRequest"})").empty());
+}
+
+TEST_F(DispatcherTest, Deadline) {
+  dispatcher_.RegisterMethod("sleep", [](const Request& request) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(request.Params().Get<int>(0)));
+    Response response(request.Id());
+    response.SetResult(true);
+    return response;
+  });
+  dispatcher_.RegisterMethod("spin", [this](const Request& request) {
+    while (!request.Cancellation().IsCancelled()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      dispatcher_.Tick();
+    }
+    return Response(request.Id());
+  });
+  EXPECT_TRUE(dispatcher_.SetTimeout("spin", std::chrono::milliseconds(20)));
+  EXPECT_FALSE(dispatcher_.SetTimeout("foobar", std::chrono::milliseconds(20)));
+
+  // The second entry expires while the first one runs, and is answered without running.
+  const auto rsp = Json::parse(dispatcher_.HandleMessage(R"([
+    {"jsonrpc": "2.0", "method": "sleep", "params": [30], "id": 1, "timeoutMs": 1000},
+    {"jsonrpc": "2.0", "method": "sleep", "params": [0], "id": 2, "timeoutMs": 10},
+    {"jsonrpc": "2.0", "method": "spin", "id": 3}
+  ])"));
+  ASSERT_EQ(rsp.size(), 3);
+  EXPECT_EQ(rsp[0]["result"], true);
+  EXPECT_EQ(rsp[1]["error"]["code"], kRequestTimeout);
+  EXPECT_EQ(rsp[2]["error"]["code"], kRequestTimeout);
+
+  Request request("2.0", "sleep", Parameter(Json::array({0})), Identifier(4));
+  request.SetDeadline(Request::Clock::now() - std::chrono::milliseconds(1));
+  Response response;
+  EXPECT_TRUE(dispatcher_.Dispatch(request, &response));
+  EXPECT_EQ(response.Err().Code(), kRequestTimeout);
+
+  const auto stats = dispatcher_.GetMetrics().ToJson();
+  EXPECT_EQ(stats["sleep"]["errors"], 2);
+  EXPECT_EQ(stats["spin"]["errors"], 1);
+}
+
+TEST_F(DispatcherTest, Metrics) {
+  dispatcher_.HandleMessage(
+      R"({"jsonrpc": "2.0", "method": "subtract", "params": [2, 1], "id": 1})");
+  dispatcher_.HandleMessage(R"({"jsonrpc": "2.0", "method": "subtract", "params": [2, 1]})");
+  dispatcher_.HandleMessage(R"({"jsonrpc": "2.0", "method": "fail", "id": 2})");
+  dispatcher_.HandleMessage(R"({"jsonrpc": "2.0", "method": "foobar", "id": 3})");
+
+  const auto rsp = Json::parse(
+      dispatcher_.HandleMessage(R"({"jsonrpc": "2.0", "method": "rpc.metrics", "id": 4})"));
+  const auto& result = rsp["result"];
+  EXPECT_EQ(result["subtract"]["requests"], 1);
+  EXPECT_EQ(result["subtract"]["notifications"], 1);
+  EXPECT_EQ(result["subtract"]["errors"], 0);
+  EXPECT_EQ(result["subtract"]["parse"]["count"], 2);
+  EXPECT_EQ(result["subtract"]["handle"]["count"], 2);
+  EXPECT_EQ(result["subtract"]["serialize"]["count"], 1);
+  EXPECT_EQ(result["fail"]["errors"], 1);
+  EXPECT_EQ(result[Metrics::kUnknownMethodName]["errors"], 1);
+
+  const auto stats = dispatcher_.GetMetrics().Snapshot();
+  EXPECT_EQ(stats.size(), result.size());
+}
+
+}  // namespace json_rpc
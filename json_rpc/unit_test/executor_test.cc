@@ -0,0 +1,118 @@
+
+#include "json_rpc/executor.h"
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <atomic>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "json_rpc/dispatcher.h"
+
+namespace json_rpc {
+
+TEST(ExecutorTest, RunsTasks) {
+  Executor executor(4);
+  EXPECT_EQ(executor.Threads(), 4);
+  std::atomic<int> sum{0};
+  for (int i = 1; i <= 1000; ++i) {
+    ASSERT_TRUE(executor.Submit([&sum, i] { sum += i; }).Ok());
+  }
+  executor.Stop();
+  EXPECT_EQ(sum.load(), 500500);
+  EXPECT_EQ(executor.Pending(), 0);
+  EXPECT_FALSE(executor.Submit([] {}).Ok());
+}
+
+TEST(ExecutorTest, NestedTasks) {
+  // Tasks fan out from the workers, through their own deques, and are stolen by idle ones.
+  Executor executor(3, true);
+  std::atomic<int> leaves{0};
+  std::function<void(int)> split = [&](const int depth) {
+    if (depth == 0) {
+      ++leaves;
+      return;
+    }
+    for (int i = 0; i < 4; ++i) {
+      ASSERT_TRUE(executor.Submit([&split, depth] { split(depth - 1); }).Ok());
+    }
+  };
+  ASSERT_TRUE(executor.Submit([&] { split(5); }).Ok());
+  executor.Stop();
+  EXPECT_EQ(leaves.load(), 1024);
+}
+
+#ifdef __linux__
+TEST(ExecutorTest, PinsWithinAffinityMask) {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+  Executor executor(2 * static_cast<size_t>(CPU_COUNT(&allowed)), true);
+  std::atomic<int> outside{0};
+  for (size_t i = 0; i < executor.Threads() * 4; ++i) {
+    ASSERT_TRUE(executor
+                    .Submit([&allowed, &outside] {
+                      cpu_set_t set;
+                      CPU_ZERO(&set);
+                      sched_getaffinity(0, sizeof(set), &set);
+                      CPU_AND(&set, &set, &allowed);
+                      if (CPU_COUNT(&set) != 1) {
+                        ++outside;
+                      }
+                    })
+                    .Ok());
+  }
+  executor.Stop();
+  EXPECT_EQ(outside, 0);
+}
+#endif
+
+TEST(ExecutorTest, QueueFull) {
+  std::promise<void> release;
+  std::promise<void> started;
+  // Declared last, so the worker is done with the promises before they go away.
+  Executor executor(1, false, 2);
+  ASSERT_TRUE(executor.Submit([&] {
+                        started.set_value();
+                        release.get_future().wait();
+                      })
+                  .Ok());
+  started.get_future().wait();
+  ASSERT_TRUE(executor.Submit([] {}).Ok());
+  ASSERT_TRUE(executor.Submit([] {}).Ok());
+  const auto status = executor.Submit([] {});
+  EXPECT_FALSE(status.Ok());
+  EXPECT_EQ(status.Code(), kInternalError);
+  release.set_value();
+}
+
+TEST(ExecutorTest, HandleMessages) {
+  Dispatcher dispatcher;
+  dispatcher.RegisterMethod("echo", [](const Request& request) {
+    Response response(request.Id());
+    response.SetResult(request.Params().Get(0));
+    return response;
+  });
+  Executor executor(2);
+  constexpr int kCount = 100;
+  std::vector<std::string> replies(kCount);
+  for (int i = 0; i < kCount; ++i) {
+    ASSERT_TRUE(executor
+                    .Submit([&, i] {
+                      replies[i] = dispatcher.HandleMessage(
+                          R"({"jsonrpc":"2.0","method":"echo","params":[)" + std::to_string(i) +
+                          R"(],"id":1})");
+                    })
+                    .Ok());
+  }
+  executor.Stop();
+  for (int i = 0; i < kCount; ++i) {
+    EXPECT_EQ(Json::parse(replies[i])["result"], i);
+  }
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,134 @@
+
+#include "json_rpc/interceptor.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace json_rpc {
+
+namespace {
+
+struct Trace {
+  std::vector<std::string>* events;
+  std::string name;
+
+  bool Before(const Request& request, Response* response) {
+    events->push_back(name + ".before");
+    return true;
+  }
+
+  void After(const Request& request, Response* response) {
+    events->push_back(name + ".after");
+  }
+};
+
+struct RequireToken {
+  bool Before(const Request& request, Response* response) {
+    if (request.Params().Get<std::string>("token", "") == "secret") {
+      return true;
+    }
+    response->SetError({kInvalidRequest, "Unauthorized"});
+    return false;
+  }
+};
+
+struct TagResult {
+  void After(const Request& request, Response* response) {
+    if (response->Err().Code() == kSuccess) {
+      response->SetResult({{"value", response->Result()}, {"method", request.Method()}});
+    }
+  }
+};
+
+Response Echo(const Request& request) {
+  Response response(request.Id());
+  response.SetResult(request.Params().Get<int>("value", 0));
+  return response;
+}
+
+}  // namespace
+
+TEST(InterceptorChainTest, RunsAroundHandlerInOrder) {
+  std::vector<std::string> events;
+  InterceptorChain chain(Trace{&events, "outer"}, Trace{&events, "inner"});
+  auto handler = [&events](const Request& request) {
+    events.emplace_back("handler");
+    return Echo(request);
+  };
+
+  const Request request("2.0", "echo", Parameter(Json({{"value", 3}})), Identifier(1));
+  const auto response = chain.Invoke(request, handler);
+
+  EXPECT_EQ(response.Result(), 3);
+  EXPECT_EQ(events, (std::vector<std::string>{
+                        "outer.before", "inner.before", "handler", "inner.after", "outer.after"}));
+}
+
+TEST(InterceptorChainTest, BeforeStopsTheCall) {
+  std::vector<std::string> events;
+  InterceptorChain chain(Trace{&events, "outer"}, RequireToken{}, Trace{&events, "inner"});
+  bool called = false;
+  auto handler = [&called](const Request& request) {
+    called = true;
+    return Echo(request);
+  };
+
+  const Request request("2.0", "echo", Parameter(Json({{"token", "guess"}})), Identifier(2));
+  const auto response = chain.Invoke(request, handler);
+
+  EXPECT_FALSE(called);
+  EXPECT_EQ(response.Err().Code(), kInvalidRequest);
+  EXPECT_EQ(response.Id().IntId(), 2);
+  EXPECT_EQ(events, (std::vector<std::string>{"outer.before", "outer.after"}));
+}
+
+TEST(InterceptorChainTest, AfterRunsWhenTheHandlerThrows) {
+  std::vector<std::string> events;
+  InterceptorChain chain(Trace{&events, "outer"}, RequireToken{}, Trace{&events, "inner"});
+  auto handler = [](const Request& request) -> Response {
+    throw std::runtime_error("handler failed");
+  };
+
+  const Request request("2.0", "echo", Parameter(Json({{"token", "secret"}})), Identifier(5));
+  const auto response = chain.Invoke(request, handler);
+
+  EXPECT_EQ(response.Err().Code(), kInternalError);
+  EXPECT_EQ(response.Id().IntId(), 5);
+  EXPECT_EQ(events, (std::vector<std::string>{"outer.before", "inner.before", "inner.after",
+                                              "outer.after"}));
+
+  // A throwing Before() skips its own After() only.
+  struct Throw {
+    bool Before(const Request& request, Response* response) {
+      throw std::runtime_error("before failed");
+    }
+    void After(const Request& request, Response* response) {
+      ADD_FAILURE() << "After() of a throwing Before()";
+    }
+  };
+  events.clear();
+  InterceptorChain throwing(Trace{&events, "outer"}, Throw{});
+  EXPECT_EQ(throwing.Invoke(request, handler).Err().Code(), kInternalError);
+  EXPECT_EQ(events, (std::vector<std::string>{"outer.before", "outer.after"}));
+}
+
+TEST(InterceptorChainTest, WrapForDispatcher) {
+  Dispatcher dispatcher;
+  dispatcher.RegisterMethod("echo", InterceptorChain(RequireToken{}, TagResult{}).Wrap(Echo));
+
+  Response response;
+  EXPECT_TRUE(dispatcher.Dispatch(
+      Request("2.0", "echo", Parameter(Json({{"token", "secret"}, {"value", 5}})), Identifier(3)),
+      &response));
+  EXPECT_EQ(response.Result(), Json({{"value", 5}, {"method", "echo"}}));
+  EXPECT_EQ(response.Id().IntId(), 3);
+
+  EXPECT_TRUE(dispatcher.Dispatch(
+      Request("2.0", "echo", Parameter(Json({{"value", 5}})), Identifier(4)), &response));
+  EXPECT_EQ(response.Err().Code(), kInvalidRequest);
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,61 @@
+
+#include "json_rpc/method_table.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "json_rpc/request.h"
+
+namespace json_rpc {
+
+TEST(MethodTableTest, Intern) {
+  MethodTable table;
+  EXPECT_EQ(table.Find("tools/call"), kUnknownMethodId);
+
+  const auto id = table.Intern("tools/call");
+  EXPECT_NE(id, kUnknownMethodId);
+  EXPECT_EQ(table.Intern(std::string("tools/call")), id);
+  EXPECT_NE(table.Intern("tools/list"), id);
+  EXPECT_EQ(table.Size(), 2);
+
+  const std::string* interned = nullptr;
+  EXPECT_EQ(table.Find("tools/call", &interned), id);
+  ASSERT_NE(interned, nullptr);
+  EXPECT_EQ(*interned, "tools/call");
+
+  // References to interned names survive later interning.
+  for (int i = 0; i < 1000; ++i) {
+    table.Intern("method" + std::to_string(i));
+  }
+  EXPECT_EQ(*interned, "tools/call");
+  EXPECT_EQ(table.Size(), 1002);
+  EXPECT_EQ(table.Find("method999"), 1002);
+  EXPECT_EQ(table.Find("tools/list"), id + 1);
+  EXPECT_EQ(table.Find("unknown", &interned), kUnknownMethodId);
+  EXPECT_EQ(interned, nullptr);
+}
+
+TEST(MethodTableTest, Request) {
+  const auto id = MethodTable::Global().Intern("interned/method");
+  Request request;
+  ASSERT_TRUE(request.ParseJson(Json{{"jsonrpc", "2.0"}, {"method", "interned/method"}}).Ok());
+  EXPECT_EQ(request.MethodAtom(), id);
+  EXPECT_EQ(request.Method(), "interned/method");
+
+  // Known methods are not copied into the request.
+  const std::string* interned = nullptr;
+  MethodTable::Global().Find("interned/method", &interned);
+  EXPECT_EQ(&request.Method(), interned);
+
+  ASSERT_TRUE(request.ParseJson(Json{{"jsonrpc", "2.0"}, {"method", "not/interned"}}).Ok());
+  EXPECT_EQ(request.MethodAtom(), kUnknownMethodId);
+  EXPECT_EQ(request.Method(), "not/interned");
+
+  // Copies keep referring to the interned name.
+  ASSERT_TRUE(request.ParseJson(Json{{"jsonrpc", "2.0"}, {"method", "interned/method"}}).Ok());
+  const auto copy = request;
+  EXPECT_EQ(copy.MethodAtom(), id);
+  EXPECT_EQ(&copy.Method(), interned);
+}
+
+}  // namespace json_rpc
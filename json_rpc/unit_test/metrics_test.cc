@@ -0,0 +1,101 @@
+
+#include "json_rpc/metrics.h"
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace json_rpc {
+
+TEST(LatencyHistogramTest, BucketsAreContiguous) {
+  for (uint64_t value = 0; value < 4096; ++value) {
+    const auto index = LatencyHistogram::BucketIndex(value);
+    EXPECT_LE(value, LatencyHistogram::BucketUpperBound(index));
+    if (index > 0) {
+      EXPECT_GT(value, LatencyHistogram::BucketUpperBound(index - 1));
+    }
+  }
+  EXPECT_EQ(LatencyHistogram::BucketIndex(UINT64_MAX), LatencyHistogram::kBucketCount - 1);
+}
+
+TEST(LatencyHistogramTest, Percentile) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(histogram.Percentile(0.5), 0);
+  for (uint64_t value = 1; value <= 1000; ++value) {
+    histogram.Record(value * 1000);
+  }
+  EXPECT_EQ(histogram.Count(), 1000);
+  EXPECT_EQ(histogram.Max(), 1000000);
+  const auto p50 = histogram.Percentile(0.5);
+  EXPECT_GE(p50, 500000);
+  EXPECT_LE(p50, 500000 + 500000 / LatencyHistogram::kSubBucketCount);
+  EXPECT_EQ(histogram.Percentile(1.0), 1000000);
+}
+
+TEST(MetricsTest, RegisterMethod) {
+  Metrics metrics;
+  const auto slot = metrics.RegisterMethod("subtract");
+  EXPECT_NE(slot, Metrics::kUnknownSlot);
+  EXPECT_EQ(metrics.RegisterMethod("subtract"), slot);
+
+  const auto stats = metrics.Snapshot();
+  ASSERT_EQ(stats.size(), 2);
+  EXPECT_EQ(stats[Metrics::kUnknownSlot].method, Metrics::kUnknownMethodName);
+  EXPECT_EQ(stats[slot].method, "subtract");
+  EXPECT_EQ(stats[slot].requests, 0);
+}
+
+TEST(MetricsTest, MergesThreadShards) {
+  Metrics metrics;
+  const auto slot = metrics.RegisterMethod("sum");
+  constexpr int kThreads = 4;
+  constexpr int kCalls = 1000;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&metrics, slot]() {
+      for (int i = 0; i < kCalls; ++i) {
+        metrics.RecordParse(slot, 10);
+        metrics.RecordCall(slot, i % 10 == 0, i % 100 == 0, 100);
+        metrics.RecordSerialize(slot, 20);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  const auto stats = metrics.Snapshot()[slot];
+  EXPECT_EQ(stats.requests + stats.notifications, kThreads * kCalls);
+  EXPECT_EQ(stats.notifications, kThreads * kCalls / 10);
+  EXPECT_EQ(stats.errors, kThreads * kCalls / 100);
+  EXPECT_EQ(stats.parse.Count(), kThreads * kCalls);
+  EXPECT_EQ(stats.handle.Sum(), 100 * kThreads * kCalls);
+  EXPECT_EQ(stats.serialize.Max(), 20);
+}
+
+TEST(MetricsTest, Instances) {
+  // Each Metrics at the same address starts from zero, whatever the thread recorded into the one
+  // before it.
+  for (int i = 0; i < 100; ++i) {
+    Metrics metrics;
+    metrics.RecordCall(Metrics::kUnknownSlot, false, false, 1);
+    metrics.RecordCall(Metrics::kUnknownSlot, false, false, 1);
+    EXPECT_EQ(metrics.Snapshot()[Metrics::kUnknownSlot].requests, 2);
+  }
+}
+
+TEST(MetricsTest, ToJson) {
+  Metrics metrics;
+  const auto slot = metrics.RegisterMethod("ping");
+  metrics.RecordCall(slot, false, false, 42);
+
+  const auto json = metrics.ToJson();
+  EXPECT_EQ(json["ping"]["requests"], 1);
+  EXPECT_EQ(json["ping"]["handle"]["count"], 1);
+  EXPECT_EQ(json["ping"]["handle"]["max_ns"], 42);
+  EXPECT_EQ(json[Metrics::kUnknownMethodName]["requests"], 0);
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,70 @@
+
+#include "json_rpc/mpmc_queue.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace json_rpc {
+
+TEST(MpmcQueueTest, Fifo) {
+  MpmcQueue<std::string> queue(3);
+  EXPECT_EQ(queue.Capacity(), 4);
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(queue.TryPush(std::to_string(i)));
+  }
+  std::string full = "full";
+  EXPECT_FALSE(queue.TryPush(std::move(full)));
+  EXPECT_EQ(full, "full");
+  EXPECT_EQ(queue.Size(), 4);
+
+  std::string value;
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(queue.TryPop(&value));
+    EXPECT_EQ(value, std::to_string(i));
+  }
+  EXPECT_FALSE(queue.TryPop(&value));
+}
+
+TEST(MpmcQueueTest, Concurrent) {
+  constexpr int kPerProducer = 20000;
+  constexpr int kProducers = 3;
+  MpmcQueue<int> queue(64);
+  std::vector<std::atomic<int>> taken(kPerProducer * kProducers);
+  std::atomic<int> remaining{kPerProducer * kProducers};
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < kProducers; ++p) {
+    threads.emplace_back([&, p] {
+      for (int i = 0; i < kPerProducer; ++i) {
+        while (!queue.TryPush(p * kPerProducer + i)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (int c = 0; c < 2; ++c) {
+    threads.emplace_back([&] {
+      int value;
+      while (remaining.load() > 0) {
+        if (queue.TryPop(&value)) {
+          taken[value].fetch_add(1);
+          remaining.fetch_sub(1);
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (auto& count : taken) {
+    ASSERT_EQ(count.load(), 1);
+  }
+}
+
+}  // namespace json_rpc
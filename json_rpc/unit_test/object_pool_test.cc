@@ -0,0 +1,80 @@
+
+#include "json_rpc/object_pool.h"
+
+#include "gtest/gtest.h"
+#include "json_rpc/batch_response.h"
+#include "json_rpc/request.h"
+#include "json_rpc/response.h"
+
+namespace json_rpc {
+
+TEST(ObjectPoolTest, Recycle) {
+  ObjectPool<Response> pool;
+  EXPECT_EQ(pool.Size(), 0);
+
+  auto response = pool.Acquire();
+  const auto* address = response.get();
+  response->SetId(Identifier("a long identifier of the response"));
+  response->SetResult(42);
+  response->SetError({kInternalError, "Internal error"});
+  response.reset();
+  EXPECT_EQ(pool.Size(), 1);
+
+  // The same object comes back, cleared.
+  response = pool.Acquire();
+  EXPECT_EQ(response.get(), address);
+  EXPECT_EQ(pool.Size(), 0);
+  EXPECT_TRUE(response->Result().is_null());
+  EXPECT_EQ(response->Err().Code(), kSuccess);
+  EXPECT_TRUE(response->Err().Message().empty());
+  EXPECT_EQ(response->Id().Type(), Identifier::IdType::kNull);
+  EXPECT_EQ(response->Id(), Identifier());
+}
+
+TEST(ObjectPoolTest, MaxSize) {
+  ObjectPool<BatchResponse> pool(2);
+  {
+    auto first = pool.Acquire();
+    auto second = pool.Acquire();
+    auto third = pool.Acquire();
+    first->AddResponse(Response(Identifier(1)));
+  }
+  EXPECT_EQ(pool.Size(), 2);
+
+  auto batch = pool.Acquire();
+  EXPECT_TRUE(batch->Responses().empty());
+}
+
+TEST(ObjectPoolTest, RequestReuse) {
+  ObjectPool<Request> pool;
+  auto request = pool.Acquire();
+  ASSERT_TRUE(request
+                  ->ParseJson(Json{{"jsonrpc", "2.0"},
+                                   {"method", "subtract"},
+                                   {"params", {{"minuend", 42}}},
+                                   {"id", "a long identifier of the request"},
+                                   {"timeoutMs", 1000u}})
+                  .Ok());
+  request->SetCancellation(CancellationToken::Create());
+  request.reset();
+
+  // Nothing of the previous request leaks into the next one.
+  request = pool.Acquire();
+  ASSERT_TRUE(request->ParseJson(Json{{"jsonrpc", "2.0"}, {"method", "sum"}, {"params", {1, 2}}})
+                  .Ok());
+  EXPECT_EQ(request->Method(), "sum");
+  EXPECT_EQ(request->Params().Type(), Parameter::ParamType::kArray);
+  EXPECT_FALSE(request->Params().Has("minuend"));
+  EXPECT_TRUE(request->IsNotification());
+  EXPECT_FALSE(request->HasDeadline());
+  EXPECT_FALSE(request->Cancellation().Cancellable());
+
+  // A failed parse leaves the request usable for the next one.
+  EXPECT_FALSE(request->ParseJson(Json{{"jsonrpc", "2.0"}, {"method", 1}}).Ok());
+  request->Clear();
+  EXPECT_TRUE(request->Method().empty());
+  EXPECT_EQ(request->Params().Type(), Parameter::ParamType::kNull);
+  EXPECT_EQ(request->JsonrpcVersion(), kJsonRpcVersion);
+}
+
+}  // namespace json_rpc
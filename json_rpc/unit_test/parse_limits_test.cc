@@ -0,0 +1,148 @@
+
+#include "json_rpc/parse_limits.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "json_rpc/batch_request.h"
+#include "json_rpc/dispatcher.h"
+#include "json_rpc/error.h"
+
+namespace json_rpc {
+
+namespace {
+
+std::string Nested(const size_t depth) {
+  return std::string(depth, '[') + std::string(depth, ']');
+}
+
+}  // namespace
+
+TEST(ParseLimitsTest, Default) {
+  Json json;
+  EXPECT_TRUE(ParseJsonText(R"({"a":[1,2.5,"x",true,null,{}]})", ParseLimits(), &json).Ok());
+  EXPECT_EQ(json["a"][2], "x");
+
+  const auto status = ParseJsonText("{", ParseLimits(), &json);
+  EXPECT_EQ(status.Code(), kParseError);
+}
+
+TEST(ParseLimitsTest, SameValueAsParse) {
+  const std::string text = R"([{"a":{"b":[[],[{}],{"c":-1}]},"d":18446744073709551615,"a":"last"},)"
+                           R"(1.5e300,"\u00e9\n",[null,false,[true]],{}])";
+  Json json;
+  ASSERT_TRUE(ParseJsonText(text, ParseLimits(), &json).Ok());
+  EXPECT_EQ(json, Json::parse(text));
+  EXPECT_TRUE(json[0]["d"].is_number_unsigned());
+
+  ASSERT_TRUE(ParseJsonText("42", ParseLimits(), &json).Ok());
+  EXPECT_EQ(json, 42);
+}
+
+TEST(ParseLimitsTest, MessageBytes) {
+  ParseLimits limits;
+  limits.max_message_bytes = 8;
+  Json json;
+  EXPECT_TRUE(ParseJsonText("[1,2,3]", limits, &json).Ok());
+  // Too large is reported even for text that is not valid JSON.
+  EXPECT_EQ(ParseJsonText("[1,2,3,4,5]", limits, &json).Code(), kInvalidRequest);
+  EXPECT_EQ(ParseJsonText("[1,2,3,4,", limits, &json).Code(), kInvalidRequest);
+}
+
+TEST(ParseLimitsTest, Depth) {
+  ParseLimits limits;
+  limits.max_depth = 4;
+  Json json;
+  EXPECT_TRUE(ParseJsonText(Nested(4), limits, &json).Ok());
+  EXPECT_TRUE(ParseJsonText(R"({"a":{"b":[[1]]}})", limits, &json).Ok());
+
+  auto status = ParseJsonText(Nested(5), limits, &json);
+  EXPECT_EQ(status.Code(), kInvalidRequest);
+  EXPECT_EQ(status.Message(), "Invalid Request: nesting too deep");
+  EXPECT_EQ(ParseJsonText(R"({"a":{"b":[[{}]]}})", limits, &json).Code(), kInvalidRequest);
+
+  // The default depth rejects a deeply nested message without exhausting the stack.
+  status = ParseJsonText(Nested(100000), ParseLimits(), &json);
+  EXPECT_EQ(status.Code(), kInvalidRequest);
+}
+
+TEST(ParseLimitsTest, BatchSize) {
+  ParseLimits limits;
+  limits.max_batch_size = 3;
+  Json json;
+  EXPECT_TRUE(ParseJsonText(R"([1,[2,3,4,5],{"a":6}])", limits, &json).Ok());
+  // Only the top-level array is a batch.
+  EXPECT_TRUE(ParseJsonText(R"({"a":[1,2,3,4]})", limits, &json).Ok());
+  const auto status = ParseJsonText("[1,2,3,4]", limits, &json);
+  EXPECT_EQ(status.Code(), kInvalidRequest);
+  EXPECT_EQ(status.Message(), "Invalid Request: batch too large");
+}
+
+TEST(ParseLimitsTest, StringLength) {
+  ParseLimits limits;
+  limits.max_string_length = 4;
+  Json json;
+  EXPECT_TRUE(ParseJsonText(R"({"abcd":"wxyz"})", limits, &json).Ok());
+  // The length is counted after unescaping.
+  EXPECT_TRUE(ParseJsonText(R"(["abc"])", limits, &json).Ok());
+
+  auto status = ParseJsonText(R"(["abcde"])", limits, &json);
+  EXPECT_EQ(status.Code(), kInvalidRequest);
+  EXPECT_EQ(status.Message(), "Invalid Request: string too long");
+  status = ParseJsonText(R"({"abcde":1})", limits, &json);
+  EXPECT_EQ(status.Code(), kInvalidRequest);
+}
+
+TEST(ParseLimitsTest, ObjectMembers) {
+  ParseLimits limits;
+  limits.max_object_members = 2;
+  Json json;
+  EXPECT_TRUE(ParseJsonText(R"({"a":{"c":1,"d":2},"b":{"e":3,"f":4}})", limits, &json).Ok());
+  const auto status = ParseJsonText(R"({"a":1,"b":2,"c":3})", limits, &json);
+  EXPECT_EQ(status.Code(), kInvalidRequest);
+  EXPECT_EQ(status.Message(), "Invalid Request: too many object members");
+}
+
+TEST(ParseLimitsTest, SyntaxErrorBeforeLimit) {
+  ParseLimits limits;
+  limits.max_batch_size = 2;
+  Json json;
+  // The syntax error comes before the third entry, so the text is reported as invalid JSON.
+  EXPECT_EQ(ParseJsonText("[1,2 3]", limits, &json).Code(), kParseError);
+  EXPECT_EQ(ParseJsonText("[1,2,3 4]", limits, &json).Code(), kInvalidRequest);
+}
+
+TEST(ParseLimitsTest, BatchRequest) {
+  ParseLimits limits;
+  limits.max_batch_size = 1;
+  BatchRequest batch;
+  const std::string text = R"([{"jsonrpc":"2.0","method":"a","id":1},)"
+                           R"({"jsonrpc":"2.0","method":"b","id":2}])";
+  EXPECT_TRUE(batch.ParseJson(text).Ok());
+  EXPECT_EQ(batch.Requests().size(), 2);
+  EXPECT_EQ(batch.ParseJson(text, limits).Code(), kInvalidRequest);
+}
+
+TEST(ParseLimitsTest, Dispatcher) {
+  Dispatcher dispatcher;
+  dispatcher.RegisterMethod("echo", [](const Request& request) {
+    Response response(request.Id());
+    response.SetResult(request.Params().ToJson());
+    return response;
+  });
+  ParseLimits limits;
+  limits.max_depth = 3;
+  dispatcher.SetParseLimits(limits);
+  EXPECT_EQ(dispatcher.GetParseLimits().max_depth, 3);
+
+  auto response = Json::parse(
+      dispatcher.HandleMessage(R"({"jsonrpc":"2.0","method":"echo","params":[[1]],"id":1})"));
+  EXPECT_EQ(response["result"], Json::parse("[[1]]"));
+
+  response = Json::parse(
+      dispatcher.HandleMessage(R"({"jsonrpc":"2.0","method":"echo","params":[[[1]]],"id":1})"));
+  EXPECT_EQ(response["error"]["code"], kInvalidRequest);
+  EXPECT_TRUE(response["id"].is_null());
+}
+
+}  // namespace json_rpc
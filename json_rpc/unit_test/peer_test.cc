@@ -0,0 +1,170 @@
+
+#include "json_rpc/peer.h"
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace json_rpc {
+
+// One direction of a connection: messages written to it are read by a thread and handed to a peer.
+class Pipe {
+ public:
+  ~Pipe() {
+    Close();
+  }
+
+  // Stops reading, before the peer reading goes away.
+  void Close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    ready_.notify_one();
+    if (reader_.joinable()) {
+      reader_.join();
+    }
+  }
+
+  void Connect(Peer* peer) {
+    reader_ = std::thread([this, peer] {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (true) {
+        ready_.wait(lock, [this] { return closed_ || !messages_.empty(); });
+        if (messages_.empty()) {
+          return;
+        }
+        const auto message = std::move(messages_.front());
+        messages_.pop_front();
+        lock.unlock();
+        peer->Receive(message);
+        lock.lock();
+      }
+    });
+  }
+
+  ChunkSink Writer() {
+    return [this](std::string_view message) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+          return false;
+        }
+        messages_.emplace_back(message);
+      }
+      ready_.notify_one();
+      return true;
+    };
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<std::string> messages_;
+  bool closed_ = false;
+  std::thread reader_;
+};
+
+TEST(PeerTest, ClassifyEnvelope) {
+  EXPECT_EQ(ClassifyEnvelope(R"({"jsonrpc": "2.0", "method": "ping", "id": 1})"),
+            Envelope::kRequest);
+  EXPECT_EQ(ClassifyEnvelope(R"( [{"jsonrpc": "2.0", "method": "ping"}])"), Envelope::kRequest);
+  // Members of nested objects, and strings looking like members, do not count.
+  const auto nested = R"({"jsonrpc":"2.0","result":{"method":"x","s":"\",\"method\":"},"id":[{}]})";
+  EXPECT_EQ(ClassifyEnvelope(nested), Envelope::kResponse);
+  EXPECT_EQ(ClassifyEnvelope(R"([{"jsonrpc":"2.0","error":{"code":1},"id":null}])"),
+            Envelope::kResponse);
+  EXPECT_EQ(ClassifyEnvelope(R"({"jsonrpc":"2.0","id":1})"), Envelope::kInvalid);
+  EXPECT_EQ(ClassifyEnvelope(R"({"result":"unterminated)"), Envelope::kInvalid);
+  EXPECT_EQ(ClassifyEnvelope("42"), Envelope::kInvalid);
+}
+
+TEST(PeerTest, BothDirections) {
+  Pipe to_server;
+  Pipe to_client;
+  Dispatcher server_dispatcher;
+  Dispatcher client_dispatcher;
+  // The server handles calls on a worker, so that it can call the client back meanwhile.
+  Scheduler scheduler(&server_dispatcher, 2);
+  Peer server(&server_dispatcher, to_client.Writer(), &scheduler);
+  Peer client(&client_dispatcher, to_server.Writer());
+  to_server.Connect(&server);
+  to_client.Connect(&client);
+
+  client_dispatcher.RegisterMethod("sampling/createMessage", [](const Request& request) {
+    Response response(request.Id());
+    response.SetResult("sampled " + request.Params().Get<std::string>("prompt"));
+    return response;
+  });
+  server_dispatcher.RegisterMethod("tools/call", [&server](const Request& request) {
+    // Both sides use id 1, each in its own id space.
+    const auto sample = server.Call(Request(
+        "2.0", "sampling/createMessage", Parameter(Json{{"prompt", "hi"}}), Identifier(1)));
+    Response response(request.Id());
+    response.SetResult(sample.Result());
+    EXPECT_EQ(sample.Id().IntId(), 1);
+    return response;
+  });
+
+  std::vector<std::future<Response>> calls;
+  for (int i = 0; i < 4; ++i) {
+    calls.push_back(std::async(std::launch::async, [&client] {
+      return client.Call(Request("2.0", "tools/call", Parameter(), Identifier(1)));
+    }));
+  }
+  for (auto& call : calls) {
+    const auto response = call.get();
+    EXPECT_EQ(response.Result(), "sampled hi");
+    EXPECT_EQ(response.Id().IntId(), 1);
+  }
+  EXPECT_EQ(client.Outstanding(), 0);
+  EXPECT_EQ(server.Outstanding(), 0);
+
+  // Unmatched responses are reported; malformed requests are answered by the dispatcher.
+  EXPECT_EQ(client.Receive(R"({"jsonrpc":"2.0","result":1,"id":99})").Code(), kInvalidRequest);
+  EXPECT_EQ(client.Call(Request("2.0", "nothing", Parameter(), Identifier("x"))).Err().Code(),
+            kMethodNotFound);
+  scheduler.Stop();
+  to_server.Close();
+  to_client.Close();
+}
+
+TEST(PeerTest, Close) {
+  Dispatcher dispatcher;
+  std::string written;
+  Peer peer(&dispatcher, [&written](std::string_view message) {
+    written.assign(message);
+    return true;
+  });
+  std::promise<Response> pending;
+  ASSERT_TRUE(peer.Submit(Request("2.0", "slow", Parameter(), Identifier("a")),
+                          [&pending](Response response) {
+                            pending.set_value(std::move(response));
+                          })
+                  .Ok());
+  EXPECT_EQ(Json::parse(written)["id"], 0);
+  EXPECT_EQ(peer.Outstanding(), 1);
+  peer.Close();
+  const auto response = pending.get_future().get();
+  EXPECT_EQ(response.Err().Code(), kInternalError);
+  EXPECT_EQ(response.Id().StringId(), "a");
+  EXPECT_FALSE(peer.Submit(Request("2.0", "slow", Parameter(), Identifier()), nullptr).Ok());
+
+  // A failed write fails the call without calling back.
+  Peer broken(&dispatcher, [](std::string_view) { return false; });
+  bool called = false;
+  EXPECT_FALSE(broken
+                   .Submit(Request("2.0", "x", Parameter(), Identifier(1)),
+                           [&called](Response) { called = true; })
+                   .Ok());
+  EXPECT_FALSE(called);
+  EXPECT_EQ(broken.Outstanding(), 0);
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,124 @@
+
+#include "json_rpc/replay.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace json_rpc {
+
+class ReplayTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = "/tmp/json_rpc_replay_test_" + std::to_string(getpid()) + ".log";
+    CaptureLog writer;
+    ASSERT_TRUE(writer.Create(path_, 1 << 16).Ok());
+    for (int i = 0; i < 10; ++i) {
+      const auto request = R"({"jsonrpc":"2.0","method":"work","id":)" + std::to_string(i) + "}";
+      // 1ms apart in the capture.
+      writer.Append(CaptureLog::Kind::kRequest, 1, request, 1000000 * (i + 1));
+      writer.Append(CaptureLog::Kind::kResponse, 1, "{}", 1000000 * (i + 1) + 500);
+    }
+    writer.Close();
+    ASSERT_TRUE(log_.Open(path_).Ok());
+
+    dispatcher_.RegisterMethod("work", [this](const Request& request) {
+      // The first request stalls.
+      if (handled_.fetch_add(1) == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(stall_ms_));
+      }
+      Response response(request.Id());
+      response.SetResult(true);
+      return response;
+    });
+  }
+
+  void TearDown() override {
+    log_.Close();
+    unlink(path_.c_str());
+  }
+
+  std::string path_;
+  CaptureLog log_;
+  Dispatcher dispatcher_;
+  std::atomic<size_t> handled_{0};
+  int stall_ms_ = 0;
+};
+
+TEST_F(ReplayTest, CapturedPacing) {
+  ReplayReport report;
+  ASSERT_TRUE(Replay(&log_, &dispatcher_, ReplayOptions(), &report).Ok());
+  EXPECT_EQ(report.requests, 10);
+  EXPECT_EQ(handled_, 10);
+  // The last request was captured 9ms after the first.
+  EXPECT_GE(report.elapsed, std::chrono::milliseconds(9));
+  EXPECT_LE(report.p50, report.p99);
+  EXPECT_LE(report.p99, report.p999);
+  EXPECT_LE(report.p999, report.max);
+
+  // Twice as fast, looping over the log.
+  ReplayOptions options;
+  options.speed = 2;
+  options.requests = 25;
+  ASSERT_TRUE(Replay(&log_, &dispatcher_, options, &report).Ok());
+  EXPECT_EQ(report.requests, 25);
+  EXPECT_EQ(handled_, 35);
+}
+
+TEST_F(ReplayTest, CoordinatedOmission) {
+  // At 1000 qps, the requests due while the first one stalls for 50ms wait behind it: their
+  // latency counts from the time they were due, not the time they were dispatched.
+  stall_ms_ = 50;
+  ReplayOptions options;
+  options.qps = 1000;
+  options.requests = 100;
+  ReplayReport report;
+  ASSERT_TRUE(Replay(&log_, &dispatcher_, options, &report).Ok());
+  EXPECT_EQ(report.requests, 100);
+  EXPECT_GE(report.max, std::chrono::milliseconds(50));
+  // Dozens of requests were due during the stall, so the tail is far above the 1ms of a closed
+  // loop that would only have sent the next request after the stall.
+  EXPECT_GE(report.p99, std::chrono::milliseconds(10));
+}
+
+TEST_F(ReplayTest, OutOfOrderCapture) {
+  // Threads capturing at once append their records out of timestamp order.
+  CaptureLog shuffled;
+  const auto path = path_ + ".shuffled";
+  ASSERT_TRUE(shuffled.Create(path, 1 << 16).Ok());
+  for (const int ms : {3, 1, 4, 2}) {
+    const auto request = R"({"jsonrpc":"2.0","method":"work","id":)" + std::to_string(ms) + "}";
+    shuffled.Append(CaptureLog::Kind::kRequest, 1, request, 1000000 * ms);
+  }
+  shuffled.Close();
+  ASSERT_TRUE(shuffled.Open(path).Ok());
+  ReplayReport report;
+  ASSERT_TRUE(Replay(&shuffled, &dispatcher_, ReplayOptions(), &report).Ok());
+  EXPECT_EQ(handled_, 4);
+  // Paced over the 3ms between the earliest and the latest record.
+  EXPECT_GE(report.elapsed, std::chrono::milliseconds(3));
+  EXPECT_LT(report.elapsed, std::chrono::seconds(1));
+  shuffled.Close();
+  unlink(path.c_str());
+}
+
+TEST_F(ReplayTest, Invalid) {
+  ReplayReport report;
+  ReplayOptions options;
+  options.speed = 0;
+  EXPECT_FALSE(Replay(&log_, &dispatcher_, options, &report).Ok());
+
+  CaptureLog empty;
+  const auto path = path_ + ".empty";
+  ASSERT_TRUE(empty.Create(path, 4096).Ok());
+  empty.Close();
+  ASSERT_TRUE(empty.Open(path).Ok());
+  EXPECT_FALSE(Replay(&empty, &dispatcher_, ReplayOptions(), &report).Ok());
+  unlink(path.c_str());
+}
+
+}  // namespace json_rpc
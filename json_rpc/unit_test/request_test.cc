@@ -1,9 +1,12 @@
 
 #include "json_rpc/request.h"
 
+#include <chrono>
 #include <string>
+#include <thread>
 
 #include "gtest/gtest.h"
+#include "json_rpc/error.h"
 
 namespace json_rpc {
 
@@ -89,4 +92,40 @@ TEST_F(RequestTest, IsNotification) {
   EXPECT_TRUE(req2.IsNotification());
 }
 
+TEST_F(RequestTest, Deadline) {
+  Request req;
+  const auto before = Request::Clock::now();
+  ASSERT_TRUE(req.ParseJson(std::string(
+                                R"({"jsonrpc": "2.0", "method": "m", "id": 1, "timeoutMs": 5000})"))
+                  .Ok());
+  ASSERT_TRUE(req.HasDeadline());
+  EXPECT_GE(req.Deadline(), before + std::chrono::milliseconds(5000));
+  EXPECT_LE(req.Deadline(), Request::Clock::now() + std::chrono::milliseconds(5000));
+
+  // The timeout received is sent on unchanged, however late.
+  const auto text = req.ToJson().dump();
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  EXPECT_EQ(req.ToJson().dump(), text);
+  EXPECT_EQ(req.ToJson()[kTimeoutName], 5000);
+
+  req.SetDeadline(Request::Clock::now() - std::chrono::seconds(1));
+  EXPECT_EQ(req.ToJson()[kTimeoutName], 0);
+
+  ASSERT_TRUE(req.ParseJson(Json({{"jsonrpc", "2.0"}, {"method", "m"}, {"id", 1}})).Ok());
+  EXPECT_FALSE(req.HasDeadline());
+  EXPECT_FALSE(req.ToJson().contains(kTimeoutName));
+
+  const Json negative = {{"jsonrpc", "2.0"}, {"method", "m"}, {"id", 1}, {kTimeoutName, -1}};
+  EXPECT_EQ(req.ParseJson(negative).Code(), kInvalidRequest);
+}
+
+TEST_F(RequestTest, ToJsonWithoutParams) {
+  const Request req("2.0", "m", Parameter(), Identifier(1));
+  const auto json = req.ToJson();
+  EXPECT_FALSE(json.contains(kParamsName));
+  Request parsed;
+  ASSERT_TRUE(parsed.ParseJson(json).Ok());
+  EXPECT_EQ(parsed.Params().Type(), Parameter::ParamType::kNull);
+}
+
 }  // namespace json_rpc
@@ -1,6 +1,9 @@
 
 #include "json_rpc/response.h"
 
+#include <memory>
+#include <string>
+
 #include "gtest/gtest.h"
 
 namespace json_rpc {
@@ -67,4 +70,55 @@ TEST_F(ResponseTest, ToJsonWithNullId) {
 
   EXPECT_EQ(response.ToJson(), expected_json);
 }
+
+TEST_F(ResponseTest, ParseJson) {
+  Response response;
+  ASSERT_TRUE(response.ParseJson(Json::parse(R"({"jsonrpc":"2.0","result":[1,2],"id":"a"})")).Ok());
+  EXPECT_EQ(response.Result(), Json({1, 2}));
+  EXPECT_EQ(response.Id().StringId(), "a");
+  EXPECT_EQ(response.Err().Code(), ErrorCode::kSuccess);
+
+  ASSERT_TRUE(response
+                  .ParseJson(Json::parse(
+                      R"({"jsonrpc":"2.0","error":{"code":-32601,"message":"m","data":1},"id":3})"))
+                  .Ok());
+  EXPECT_TRUE(response.Result().is_null());
+  EXPECT_EQ(response.Err().Code(), ErrorCode::kMethodNotFound);
+  EXPECT_EQ(response.Err().Message(), "m");
+  EXPECT_EQ(response.Err().Data(), 1);
+  EXPECT_EQ(response.Id().IntId(), 3);
+
+  for (const auto* text : {R"([])", R"({"jsonrpc":"1.0","result":1,"id":1})",
+                           R"({"jsonrpc":"2.0","result":1})", R"({"jsonrpc":"2.0","id":1})",
+                           R"({"jsonrpc":"2.0","result":1,"error":{},"id":1})",
+                           R"({"jsonrpc":"2.0","error":{"code":"x","message":"m"},"id":1})"}) {
+    EXPECT_EQ(response.ParseJson(Json::parse(text)).Code(), kInvalidRequest) << text;
+  }
+}
+
+TEST_F(ResponseTest, RawResult) {
+  Response response(Identifier(7));
+  // Spliced as is, spacing included, rather than parsed and dumped again.
+  const auto cached = std::make_shared<const std::string>(R"({"b": 1, "a": [true]})");
+  ASSERT_TRUE(response.SetResult(RawJson(cached)).Ok());
+  EXPECT_TRUE(response.HasTypedResult());
+  EXPECT_TRUE(response.Result().is_null());
+  std::string text;
+  response.AppendTo(&text);
+  EXPECT_EQ(text, R"({"id":7,"jsonrpc":"2.0","result":{"b": 1, "a": [true]}})");
+  EXPECT_EQ(response.ToJson()["result"]["a"], Json::array({true}));
+
+  EXPECT_EQ(response.SetResult(RawJson(std::string("{\"a\":")), true).Code(), kParseError);
+  text.clear();
+  response.AppendTo(&text);
+  EXPECT_EQ(text, R"({"id":7,"jsonrpc":"2.0","result":{"b": 1, "a": [true]}})");
+  // Valid, but pretty-printed over several lines that would split a newline delimited message.
+  EXPECT_EQ(response.SetResult(RawJson(Json{{"a", 1}}.dump(2)), true).Code(), kParseError);
+  EXPECT_EQ(response.SetResult(RawJson(std::string("[1,\r2]")), true).Code(), kParseError);
+  EXPECT_TRUE(response.SetResult(RawJson(std::string(R"(["\n"])")), true).Ok());
+  EXPECT_TRUE(response.SetResult(RawJson(std::string("[1,2]")), true).Ok());
+  response.SetResult(Json(3));
+  EXPECT_FALSE(response.HasTypedResult());
+}
+
 }  // namespace json_rpc
\ No newline at end of file
@@ -0,0 +1,109 @@
+
+#include "json_rpc/result_writer.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace json_rpc {
+
+class ResultWriterTest : public ::testing::Test {
+ protected:
+  ChunkSink Sink() {
+    return [this](std::string_view chunk) {
+      chunks_.emplace_back(chunk);
+      return true;
+    };
+  }
+
+  [[nodiscard]] std::string Output() const {
+    std::string output;
+    for (const auto& chunk : chunks_) {
+      output += chunk;
+    }
+    return output;
+  }
+
+  std::vector<std::string> chunks_;
+};
+
+TEST_F(ResultWriterTest, WritesEnvelope) {
+  ResultWriter writer(Identifier(1), Sink());
+  EXPECT_TRUE(writer.BeginObject().Ok());
+  EXPECT_TRUE(writer.Key("items").Ok());
+  EXPECT_TRUE(writer.BeginArray().Ok());
+  EXPECT_TRUE(writer.Value(1).Ok());
+  EXPECT_TRUE(writer.Value({{"name", "a\"b"}}).Ok());
+  EXPECT_TRUE(writer.BeginArray().Ok());
+  EXPECT_TRUE(writer.EndArray().Ok());
+  EXPECT_TRUE(writer.EndArray().Ok());
+  EXPECT_TRUE(writer.Key("done").Ok());
+  EXPECT_TRUE(writer.Value(true).Ok());
+  EXPECT_TRUE(writer.EndObject().Ok());
+  EXPECT_TRUE(writer.Finish().Ok());
+  EXPECT_TRUE(writer.Finished());
+
+  EXPECT_EQ(Json::parse(Output()), Json::parse(R"({
+      "jsonrpc": "2.0",
+      "result": {"items": [1, {"name": "a\"b"}, []], "done": true},
+      "id": 1
+  })"));
+}
+
+TEST_F(ResultWriterTest, FlushesInChunks) {
+  ResultWriter writer(Identifier("big"), Sink(), 64);
+  EXPECT_TRUE(writer.BeginArray().Ok());
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(writer.Value(i).Ok());
+  }
+  EXPECT_TRUE(writer.Started());
+  EXPECT_TRUE(writer.EndArray().Ok());
+  EXPECT_TRUE(writer.Finish().Ok());
+
+  EXPECT_GT(chunks_.size(), 3);
+  const auto json = Json::parse(Output());
+  EXPECT_EQ(json["result"].size(), 100);
+  EXPECT_EQ(json["id"], "big");
+}
+
+TEST_F(ResultWriterTest, RejectsMisuse) {
+  ResultWriter writer(Identifier(1), Sink());
+  EXPECT_FALSE(writer.EndArray().Ok());
+  EXPECT_FALSE(writer.Key("a").Ok());
+  EXPECT_TRUE(writer.BeginObject().Ok());
+  EXPECT_FALSE(writer.Value(1).Ok());
+  EXPECT_FALSE(writer.EndArray().Ok());
+  EXPECT_FALSE(writer.Finish().Ok());
+  EXPECT_TRUE(writer.EndObject().Ok());
+  EXPECT_FALSE(writer.Value(1).Ok());
+  EXPECT_TRUE(writer.Finish().Ok());
+  EXPECT_FALSE(writer.Finish().Ok());
+}
+
+TEST_F(ResultWriterTest, FailBeforeFlush) {
+  ResultWriter writer(Identifier(2), Sink());
+  EXPECT_TRUE(writer.BeginArray().Ok());
+  EXPECT_TRUE(writer.Value(1).Ok());
+  EXPECT_TRUE(writer.Fail({kInvalidParams, "Invalid params"}).Ok());
+  EXPECT_EQ(Json::parse(Output()), Json::parse(R"({
+      "jsonrpc": "2.0",
+      "error": {"code": -32602, "message": "Invalid params"},
+      "id": 2
+  })"));
+}
+
+TEST_F(ResultWriterTest, FailAfterFlush) {
+  ResultWriter writer(Identifier(3), Sink(), 1);
+  EXPECT_TRUE(writer.Value("partial").Ok());
+  EXPECT_TRUE(writer.Started());
+  EXPECT_FALSE(writer.Fail({kInternalError, "Internal error"}).Ok());
+}
+
+TEST_F(ResultWriterTest, SinkFailure) {
+  ResultWriter writer(Identifier(4), [](std::string_view chunk) { return false; }, 1);
+  EXPECT_FALSE(writer.Value(1).Ok());
+  EXPECT_FALSE(writer.Finish().Ok());
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,168 @@
+
+#include "json_rpc/scheduler.h"
+
+#include <algorithm>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace json_rpc {
+
+class SchedulerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    // Holds the single worker thread until released, so that requests pile up in the queues.
+    dispatcher_.RegisterMethod("gate", [this](const Request& request) {
+      gate_.get_future().wait();
+      return Response(request.Id());
+    });
+    for (const auto* method : {"ping", "work", "bulk"}) {
+      dispatcher_.RegisterMethod(method, [this](const Request& request) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        order_.push_back(request.Method() + request.Id().ToJson().dump());
+        Response response(request.Id());
+        response.SetResult(request.Method());
+        return response;
+      });
+    }
+    dispatcher_.SetPriority("ping", Priority::kControl);
+    dispatcher_.SetPriority("bulk", Priority::kBulk);
+  }
+
+  Status Submit(Scheduler* scheduler, const std::string& method, int id) {
+    const auto message = R"({"jsonrpc": "2.0", "method": ")" + method +
+                         R"(", "id": )" + std::to_string(id) + "}";
+    return scheduler->Submit(message, [this](std::string response) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      replies_.push_back(std::move(response));
+    });
+  }
+
+  Dispatcher dispatcher_;
+  std::promise<void> gate_;
+  std::mutex mutex_;
+  std::vector<std::string> order_;
+  std::vector<std::string> replies_;
+};
+
+TEST_F(SchedulerTest, StrictPriority) {
+  Scheduler scheduler(&dispatcher_, 1);
+  ASSERT_TRUE(Submit(&scheduler, "gate", 0).Ok());
+  while (scheduler.QueueSize(Priority::kDefault) != 0) {
+  }
+  Submit(&scheduler, "bulk", 1);
+  Submit(&scheduler, "work", 2);
+  Submit(&scheduler, "bulk", 3);
+  Submit(&scheduler, "ping", 4);
+  EXPECT_EQ(scheduler.QueueSize(Priority::kBulk), 2);
+  gate_.set_value();
+  scheduler.Stop();
+
+  EXPECT_EQ(order_, std::vector<std::string>({"ping4", "work2", "bulk1", "bulk3"}));
+  EXPECT_EQ(replies_.size(), 5);
+  EXPECT_FALSE(Submit(&scheduler, "ping", 5).Ok());
+}
+
+TEST_F(SchedulerTest, StarvationProtection) {
+  Scheduler scheduler(&dispatcher_, 1, 2);
+  Submit(&scheduler, "gate", 0);
+  while (scheduler.QueueSize(Priority::kDefault) != 0) {
+  }
+  Submit(&scheduler, "bulk", 1);
+  for (int id = 2; id < 7; ++id) {
+    Submit(&scheduler, "ping", id);
+  }
+  gate_.set_value();
+  scheduler.Stop();
+
+  EXPECT_EQ(order_,
+            std::vector<std::string>({"ping2", "ping3", "bulk1", "ping4", "ping5", "ping6"}));
+}
+
+TEST_F(SchedulerTest, CancelWhileQueued) {
+  Scheduler scheduler(&dispatcher_, 1);
+  Submit(&scheduler, "gate", 0);
+  while (scheduler.QueueSize(Priority::kDefault) != 0) {
+  }
+  Submit(&scheduler, "bulk", 1);
+  scheduler.Submit(
+      R"({"jsonrpc": "2.0", "method": "$/cancelRequest", "params": {"id": 1}})",
+      [this](std::string response) { replies_.push_back(std::move(response)); });
+  gate_.set_value();
+  scheduler.Stop();
+
+  EXPECT_TRUE(order_.empty());
+  ASSERT_EQ(replies_.size(), 3);
+  EXPECT_TRUE(replies_[1].empty());
+  EXPECT_TRUE(replies_[2].empty());
+  EXPECT_EQ(dispatcher_.Cancellations().Size(), 0);
+}
+
+TEST_F(SchedulerTest, CoalescedNotifications) {
+  std::vector<std::string> seen;
+  dispatcher_.RegisterNotification("progress", [this, &seen](const Request& request) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    seen.push_back(std::to_string(request.Params().Get<int>("token", 0)) + ":" +
+                   std::to_string(request.Params().Get<int>("value")));
+  });
+  dispatcher_.SetCoalescing("progress", Coalescing::kLatestWins, "token");
+  Scheduler scheduler(&dispatcher_, 1);
+  Submit(&scheduler, "gate", 0);
+  while (scheduler.QueueSize(Priority::kDefault) != 0) {
+  }
+  for (int value = 0; value < 10; ++value) {
+    for (int token = 1; token <= 2; ++token) {
+      const auto message = R"({"jsonrpc": "2.0", "method": "progress", "params": {"token": )" +
+                           std::to_string(token) + R"(, "value": )" + std::to_string(value) + "}}";
+      scheduler.Submit(message, [this](std::string response) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        replies_.push_back(std::move(response));
+      });
+    }
+  }
+  // Notifications without the key, and those of other methods, all run.
+  scheduler.Submit(R"({"jsonrpc": "2.0", "method": "progress", "params": {"value": 0}})",
+                   [](std::string) {});
+  Submit(&scheduler, "work", 1);
+  EXPECT_EQ(scheduler.QueueSize(Priority::kDefault), 4);
+  EXPECT_EQ(scheduler.Coalesced(), 18);
+  gate_.set_value();
+  scheduler.Stop();
+
+  EXPECT_EQ(seen, std::vector<std::string>({"1:9", "2:9", "0:0"}));
+  EXPECT_EQ(order_, std::vector<std::string>({"work1"}));
+  // Every notification got its empty reply, besides the calls.
+  ASSERT_EQ(replies_.size(), 22);
+  EXPECT_EQ(std::count(replies_.begin(), replies_.end(), std::string()), 20);
+}
+
+TEST_F(SchedulerTest, Batch) {
+  gate_.set_value();
+  Scheduler scheduler(&dispatcher_, 4);
+  std::promise<std::string> reply;
+  scheduler.Submit(R"([
+    {"jsonrpc": "2.0", "method": "bulk", "id": 1},
+    {"jsonrpc": "2.0", "method": "ping"},
+    {"foo": "boo"},
+    {"jsonrpc": "2.0", "method": "ping", "id": 2},
+    {"jsonrpc": "2.0", "method": "foobar", "id": 3}
+  ])",
+                   [&reply](std::string response) { reply.set_value(std::move(response)); });
+  const auto json = Json::parse(reply.get_future().get());
+  ASSERT_EQ(json.size(), 4);
+  EXPECT_EQ(json[0]["result"], "bulk");
+  EXPECT_EQ(json[1]["error"]["code"], kInvalidRequest);
+  EXPECT_EQ(json[2]["result"], "ping");
+  EXPECT_EQ(json[3]["error"]["code"], kMethodNotFound);
+
+  std::promise<std::string> parse_error;
+  scheduler.Submit("[", [&parse_error](std::string response) {
+    parse_error.set_value(std::move(response));
+  });
+  EXPECT_EQ(Json::parse(parse_error.get_future().get())["error"]["code"], kParseError);
+}
+
+}  // namespace json_rpc
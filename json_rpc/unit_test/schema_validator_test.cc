@@ -0,0 +1,137 @@
+
+#include "json_rpc/schema_validator.h"
+
+#include "gtest/gtest.h"
+
+namespace json_rpc {
+
+class SchemaValidatorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(validator_
+                    .Compile(Json::parse(R"({
+          "type": "object",
+          "properties": {
+            "name": {"type": "string", "minLength": 1, "maxLength": 8},
+            "count": {"type": "integer", "minimum": 0, "exclusiveMaximum": 100},
+            "mode": {"enum": ["fast", "slow", 3]},
+            "tags": {"type": "array", "items": {"type": "string"}, "maxItems": 2},
+            "point": {"$ref": "#/$defs/point"}
+          },
+          "required": ["name", "count"],
+          "additionalProperties": false,
+          "$defs": {
+            "point": {
+              "type": "array",
+              "prefixItems": [{"type": "number"}, {"type": "number"}],
+              "minItems": 2,
+              "maxItems": 2
+            }
+          }
+        })"))
+                    .Ok());
+  }
+
+  std::string FailurePath(const Json& params) const {
+    const auto error = validator_.Validate(Parameter(params));
+    EXPECT_EQ(error.Code(), kInvalidParams);
+    return error.Data().value("path", "<none>");
+  }
+
+  SchemaValidator validator_;
+};
+
+TEST_F(SchemaValidatorTest, AcceptsValidParams) {
+  const Json params = {{"name", "job"},
+                       {"count", 3.0},
+                       {"mode", 3},
+                       {"tags", {"a", "b"}},
+                       {"point", {1.5, 2}}};
+  EXPECT_EQ(validator_.Validate(Parameter(params)).Code(), kSuccess);
+  EXPECT_EQ(validator_.Validate(params).Code(), kSuccess);
+}
+
+TEST_F(SchemaValidatorTest, ReportsPath) {
+  EXPECT_EQ(FailurePath({{"name", "job"}}), "/count");
+  EXPECT_EQ(FailurePath({{"name", 1}, {"count", 1}}), "/name");
+  EXPECT_EQ(FailurePath({{"name", ""}, {"count", 1}}), "/name");
+  EXPECT_EQ(FailurePath({{"name", "job"}, {"count", 100}}), "/count");
+  EXPECT_EQ(FailurePath({{"name", "job"}, {"count", 1.5}}), "/count");
+  EXPECT_EQ(FailurePath({{"name", "job"}, {"count", 1}, {"mode", "medium"}}), "/mode");
+  EXPECT_EQ(FailurePath({{"name", "job"}, {"count", 1}, {"tags", {"a", 2}}}), "/tags/1");
+  EXPECT_EQ(FailurePath({{"name", "job"}, {"count", 1}, {"tags", {"a", "b", "c"}}}), "/tags");
+  EXPECT_EQ(FailurePath({{"name", "job"}, {"count", 1}, {"point", {1, "y"}}}), "/point/1");
+  EXPECT_EQ(FailurePath({{"name", "job"}, {"count", 1}, {"extra", true}}), "/extra");
+  EXPECT_EQ(FailurePath(Json::array({1, 2})), "");
+}
+
+TEST_F(SchemaValidatorTest, OmittedParams) {
+  EXPECT_EQ(validator_.Validate(Parameter()).Data()["path"], "/name");
+
+  SchemaValidator optional;
+  ASSERT_TRUE(optional.Compile({{"type", "object"}}).Ok());
+  EXPECT_EQ(optional.Validate(Parameter()).Code(), kSuccess);
+}
+
+TEST(SchemaValidator, DefaultAcceptsAnything) {
+  const SchemaValidator validator;
+  EXPECT_EQ(validator.Validate(Parameter(Json::array({1}))).Code(), kSuccess);
+  EXPECT_EQ(validator.Validate(Json("text")).Code(), kSuccess);
+}
+
+TEST(SchemaValidator, Combinators) {
+  SchemaValidator validator;
+  ASSERT_TRUE(validator
+                  .Compile(Json::parse(R"({
+        "type": "array",
+        "items": {"anyOf": [{"type": "string"}, {"type": "integer", "minimum": 0}]},
+        "prefixItems": [{"oneOf": [{"type": "integer"}, {"type": "number"}]}]
+      })"))
+                  .Ok());
+  EXPECT_EQ(validator.Validate(Parameter(Json::array({1.5, "a", 2}))).Code(), kSuccess);
+  EXPECT_EQ(validator.Validate(Parameter(Json::array({1}))).Code(), kInvalidParams);
+  EXPECT_EQ(validator.Validate(Parameter(Json::array({1.5, -1}))).Data()["path"], "/1");
+}
+
+TEST(SchemaValidator, RecursiveReference) {
+  SchemaValidator validator;
+  ASSERT_TRUE(validator
+                  .Compile(Json::parse(R"({
+        "type": "object",
+        "properties": {"children": {"type": "array", "items": {"$ref": "#"}}},
+        "required": ["children"]
+      })"))
+                  .Ok());
+  EXPECT_EQ(validator.Validate(Json::parse(R"({"children": [{"children": []}]})")).Code(),
+            kSuccess);
+  EXPECT_EQ(validator.Validate(Json::parse(R"({"children": [{"children": [{}]}]})")).Data(),
+            Json({{"path", "/children/0/children/0/children"},
+                  {"reason", "required property is missing"}}));
+}
+
+TEST(SchemaValidator, InvalidSchema) {
+  SchemaValidator validator;
+  EXPECT_FALSE(validator.Compile({{"type", "float"}}).Ok());
+  EXPECT_FALSE(validator.Compile({{"properties", {{"a", 1}}}}).Ok());
+  EXPECT_FALSE(validator.Compile({{"$ref", "#/$defs/missing"}}).Ok());
+  EXPECT_FALSE(validator.Compile({{"minLength", -1}}).Ok());
+  EXPECT_EQ(validator.Compile({{"type", "float"}}).Code(), kInvalidParams);
+}
+
+TEST(SchemaValidator, ReferenceCycle) {
+  SchemaValidator validator;
+  EXPECT_EQ(validator.Compile({{"$ref", "#"}}).Code(), kInvalidParams);
+  EXPECT_EQ(validator
+                .Compile(Json::parse(R"({
+        "$defs": {"a": {"$ref": "#/$defs/a"}},
+        "$ref": "#/$defs/a"
+      })"))
+                .Code(),
+            kInvalidParams);
+  EXPECT_FALSE(validator.Compile(Json::parse(R"({"anyOf": [{"type": "null"}, {"$ref": "#"}]})"))
+                   .Ok());
+  // The rejected schemas leave the validator as it was.
+  EXPECT_EQ(validator.Validate(Json(1)).Code(), kSuccess);
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,350 @@
+
+#include "json_rpc/sharded_server.h"
+
+#ifdef __linux__
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace json_rpc {
+
+class ShardedServerTest : public ::testing::Test {
+ protected:
+  static void Setup(const size_t shard, Dispatcher* dispatcher) {
+    dispatcher->RegisterMethod("shard", [shard](const Request& request) {
+      Response response(request.Id());
+      response.SetResult(shard);
+      return response;
+    });
+  }
+
+  static int ConnectTcp(const uint16_t port) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    EXPECT_EQ(connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)), 0);
+    return fd;
+  }
+
+  static int ConnectUnix(const std::string& path) {
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    EXPECT_EQ(connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)), 0);
+    return fd;
+  }
+
+  // Sends the text and reads lines until count of them arrived.
+  static std::vector<std::string> Exchange(const int fd, const std::string& text,
+                                           const size_t count) {
+    EXPECT_EQ(send(fd, text.data(), text.size(), 0), static_cast<ssize_t>(text.size()));
+    std::vector<std::string> lines;
+    std::string buffer;
+    char chunk[4096];
+    while (lines.size() < count) {
+      const auto n = recv(fd, chunk, sizeof(chunk), 0);
+      if (n <= 0) {
+        break;
+      }
+      buffer.append(chunk, static_cast<size_t>(n));
+      for (auto end = buffer.find('\n'); end != std::string::npos; end = buffer.find('\n')) {
+        lines.push_back(buffer.substr(0, end));
+        buffer.erase(0, end + 1);
+      }
+    }
+    return lines;
+  }
+
+  static std::string ReadExactly(const int fd, const size_t size) {
+    std::string data(size, '\0');
+    for (size_t read = 0; read < size;) {
+      const auto n = recv(fd, data.data() + read, size - read, 0);
+      if (n <= 0) {
+        data.resize(read);
+        break;
+      }
+      read += static_cast<size_t>(n);
+    }
+    return data;
+  }
+
+  // Reads a frame, returning its payload.
+  static std::string ReadFrame(const int fd, Codec* codec) {
+    const auto header = ReadExactly(fd, kFrameHeaderSize);
+    size_t size = 0;
+    EXPECT_EQ(header[0], kFrameMarker);
+    EXPECT_TRUE(ParseFrameHeader(header, codec, &size));
+    return ReadExactly(fd, size);
+  }
+};
+
+TEST_F(ShardedServerTest, Tcp) {
+  ShardedServer server(2, Setup);
+  ASSERT_TRUE(server.StartTcp("127.0.0.1", 0).Ok());
+  ASSERT_NE(server.Port(), 0);
+  EXPECT_EQ(server.Shards(), 2);
+  EXPECT_FALSE(server.StartTcp("127.0.0.1", 0).Ok());
+
+  std::set<int> shards;
+  for (int i = 0; i < 16; ++i) {
+    const int fd = ConnectTcp(server.Port());
+    // Pipelined: a notification, a batch, a request split across lines, and an invalid message.
+    const auto lines = Exchange(fd,
+                                R"({"jsonrpc":"2.0","method":"shard"})"
+                                "\n"
+                                R"([{"jsonrpc":"2.0","method":"shard","id":1},)"
+                                R"({"jsonrpc":"2.0","method":"shard","id":2}])"
+                                "\r\n"
+                                R"({"jsonrpc":"2.0","method":"shard","id":3})"
+                                "\n"
+                                "{\n",
+                                3);
+    ASSERT_EQ(lines.size(), 3);
+    const auto batch = Json::parse(lines[0]);
+    ASSERT_EQ(batch.size(), 2);
+    const auto single = Json::parse(lines[1]);
+    EXPECT_EQ(single["id"], 3);
+    // Connections stay on the shard that accepted them.
+    EXPECT_EQ(batch[0]["result"], single["result"]);
+    shards.insert(single["result"].get<int>());
+    EXPECT_EQ(Json::parse(lines[2])["error"]["code"], kParseError);
+    close(fd);
+  }
+  EXPECT_FALSE(shards.empty());
+  server.Stop();
+  server.Stop();
+
+  // A stopped server can be started again.
+  ASSERT_TRUE(server.StartTcp("127.0.0.1", 0).Ok());
+  const int fd = ConnectTcp(server.Port());
+  EXPECT_EQ(Exchange(fd, R"({"jsonrpc":"2.0","method":"shard","id":1})" "\n", 1).size(), 1);
+  close(fd);
+  server.Stop();
+}
+
+TEST_F(ShardedServerTest, HalfClosed) {
+  ShardedServer server(1, [](const size_t shard, Dispatcher* dispatcher) {
+    dispatcher->RegisterMethod("large", [](const Request& request) {
+      Response response(request.Id());
+      response.SetResult(std::string(4 << 20, 'x'));
+      return response;
+    });
+  });
+  ASSERT_TRUE(server.StartTcp("127.0.0.1", 0).Ok());
+
+  // The response outgrows the socket buffers, so it is still being written after the peer shut
+  // down its side; it arrives whole, and then the connection closes.
+  const int fd = ConnectTcp(server.Port());
+  const std::string request = R"({"jsonrpc":"2.0","method":"large","id":1})" "\n";
+  ASSERT_EQ(send(fd, request.data(), request.size(), 0), static_cast<ssize_t>(request.size()));
+  shutdown(fd, SHUT_WR);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  std::string received;
+  char chunk[65536];
+  for (ssize_t n; (n = recv(fd, chunk, sizeof(chunk), 0)) > 0;) {
+    received.append(chunk, static_cast<size_t>(n));
+  }
+  close(fd);
+  ASSERT_FALSE(received.empty());
+  EXPECT_EQ(received.back(), '\n');
+  EXPECT_EQ(Json::parse(received)["result"].get<std::string>().size(), 4u << 20);
+  server.Stop();
+}
+
+TEST_F(ShardedServerTest, MessageTooLarge) {
+  ShardedServer server(1, [](const size_t shard, Dispatcher* dispatcher) {
+    Setup(shard, dispatcher);
+    ParseLimits limits;
+    limits.max_message_bytes = 64;
+    dispatcher->SetParseLimits(limits);
+  });
+  ASSERT_TRUE(server.StartTcp("127.0.0.1", 0).Ok());
+
+  // A complete line over the limit is answered and the connection stays open.
+  int fd = ConnectTcp(server.Port());
+  auto lines = Exchange(fd, "[" + std::string(64, ' ') + "]\n", 1);
+  ASSERT_EQ(lines.size(), 1);
+  EXPECT_EQ(Json::parse(lines[0])["error"]["code"], kInvalidRequest);
+  lines = Exchange(fd, R"({"jsonrpc":"2.0","method":"shard","id":1})" "\n", 1);
+  ASSERT_EQ(lines.size(), 1);
+  EXPECT_EQ(Json::parse(lines[0])["id"], 1);
+  close(fd);
+
+  // An unterminated message over the limit is answered before its end, then the connection closes.
+  fd = ConnectTcp(server.Port());
+  lines = Exchange(fd, "[" + std::string(1000, ' '), 2);
+  ASSERT_EQ(lines.size(), 1);
+  EXPECT_EQ(Json::parse(lines[0])["error"]["code"], kInvalidRequest);
+  close(fd);
+  server.Stop();
+}
+
+TEST_F(ShardedServerTest, Capture) {
+  const auto path =
+      "/tmp/json_rpc_sharded_server_capture_test_" + std::to_string(getpid()) + ".log";
+  CaptureLog log;
+  ASSERT_TRUE(log.Create(path, 1 << 16).Ok());
+  ShardedServer server(1, Setup);
+  server.SetCaptureLog(&log);
+  ASSERT_TRUE(server.StartTcp("127.0.0.1", 0).Ok());
+  const int fd = ConnectTcp(server.Port());
+  const std::string request = R"({"jsonrpc":"2.0","method":"shard","id":1})";
+  ASSERT_EQ(Exchange(fd, request + "\n" + R"({"jsonrpc":"2.0","method":"shard"})" "\n", 1).size(),
+            1);
+  close(fd);
+  server.Stop();
+  log.Close();
+
+  ASSERT_TRUE(log.Open(path).Ok());
+  CaptureLog::Record record;
+  ASSERT_TRUE(log.Next(&record));
+  EXPECT_EQ(record.kind, CaptureLog::Kind::kRequest);
+  EXPECT_EQ(record.data, request);
+  const auto connection = record.connection;
+  ASSERT_TRUE(log.Next(&record));
+  EXPECT_EQ(record.kind, CaptureLog::Kind::kResponse);
+  EXPECT_EQ(Json::parse(record.data)["id"], 1);
+  EXPECT_EQ(record.connection, connection);
+  // The notification has no response.
+  ASSERT_TRUE(log.Next(&record));
+  EXPECT_EQ(record.kind, CaptureLog::Kind::kRequest);
+  EXPECT_FALSE(log.Next(&record));
+  log.Close();
+  unlink(path.c_str());
+}
+
+TEST_F(ShardedServerTest, Compression) {
+  ShardedServer server(1, [](const size_t shard, Dispatcher* dispatcher) {
+    Setup(shard, dispatcher);
+    dispatcher->RegisterMethod("echo", [](const Request& request) {
+      Response response(request.Id());
+      response.SetResult(request.Params().ToJson());
+      return response;
+    });
+  });
+  CompressionOptions options;
+  options.enabled = true;
+  options.threshold = 256;
+  server.SetCompression(options);
+  ASSERT_TRUE(server.StartTcp("127.0.0.1", 0).Ok());
+
+  Json params = Json::array();
+  for (int i = 0; i < 200; ++i) {
+    params.push_back({{"type", "text"}, {"text", "repeated tool output " + std::to_string(i)}});
+  }
+  const auto large = Json{{"jsonrpc", "2.0"}, {"method", "echo"}, {"params", params}, {"id", 1}};
+
+  const int fd = ConnectTcp(server.Port());
+  // The hello lists an unknown codec first.
+  std::string hello;
+  AppendFrameHeader(Codec::kNone, 2, &hello);
+  hello.push_back(9);
+  hello.push_back(static_cast<char>(Codec::kDeflate));
+  ASSERT_EQ(send(fd, hello.data(), hello.size(), 0), static_cast<ssize_t>(hello.size()));
+  Codec codec;
+  EXPECT_EQ(ReadFrame(fd, &codec), std::string(1, static_cast<char>(Codec::kDeflate)));
+  EXPECT_EQ(codec, Codec::kNone);
+
+  // A compressed request, followed by a line in the same write, gets a compressed response.
+  std::string message;
+  ASSERT_TRUE(AppendCompressedFrame(Codec::kDeflate, large.dump(), 6, &message).Ok());
+  message += R"({"jsonrpc":"2.0","method":"shard","id":2})" "\n";
+  ASSERT_EQ(send(fd, message.data(), message.size(), 0), static_cast<ssize_t>(message.size()));
+  const auto payload = ReadFrame(fd, &codec);
+  EXPECT_EQ(codec, Codec::kDeflate);
+  EXPECT_LT(payload.size() * 4, large.dump().size());
+  std::string response;
+  ASSERT_TRUE(Decompress(codec, payload, 1 << 20, &response).Ok());
+  EXPECT_EQ(Json::parse(response)["result"], params);
+  // Small responses stay lines.
+  auto lines = Exchange(fd, "", 1);
+  ASSERT_EQ(lines.size(), 1);
+  EXPECT_EQ(Json::parse(lines[0])["id"], 2);
+
+  // A corrupt frame is answered and the connection goes on.
+  message.clear();
+  AppendFrameHeader(Codec::kDeflate, 3, &message);
+  message += "\xff\xff\xff";
+  lines = Exchange(fd, message, 1);
+  ASSERT_EQ(lines.size(), 1);
+  EXPECT_EQ(Json::parse(lines[0])["error"]["code"], kParseError);
+  close(fd);
+
+  // Without a hello, responses are not compressed.
+  const int plain = ConnectTcp(server.Port());
+  lines = Exchange(plain, large.dump() + "\n", 1);
+  ASSERT_EQ(lines.size(), 1);
+  EXPECT_EQ(Json::parse(lines[0])["result"], params);
+  close(plain);
+  server.Stop();
+}
+
+TEST_F(ShardedServerTest, CompressionDisabled) {
+  ShardedServer server(1, Setup);
+  ASSERT_TRUE(server.StartTcp("127.0.0.1", 0).Ok());
+  const int fd = ConnectTcp(server.Port());
+  std::string hello;
+  AppendFrameHeader(Codec::kNone, 1, &hello);
+  hello.push_back(static_cast<char>(Codec::kDeflate));
+  ASSERT_EQ(send(fd, hello.data(), hello.size(), 0), static_cast<ssize_t>(hello.size()));
+  Codec codec;
+  EXPECT_TRUE(ReadFrame(fd, &codec).empty());
+  close(fd);
+  server.Stop();
+}
+
+TEST_F(ShardedServerTest, Unix) {
+  const auto path = "/tmp/json_rpc_sharded_server_test_" + std::to_string(getpid()) + ".sock";
+  ShardedServer server(2, Setup);
+  ASSERT_TRUE(server.StartUnix(path).Ok());
+  EXPECT_EQ(server.Port(), 0);
+
+  std::vector<std::thread> clients;
+  for (int c = 0; c < 4; ++c) {
+    clients.emplace_back([&] {
+      const int fd = ConnectUnix(path);
+      for (int i = 0; i < 10; ++i) {
+        const auto message =
+            R"({"jsonrpc":"2.0","method":"shard","id":)" + std::to_string(i) + "}\n";
+        const auto lines = Exchange(fd, message, 1);
+        ASSERT_EQ(lines.size(), 1);
+        EXPECT_EQ(Json::parse(lines[0])["id"], i);
+      }
+      close(fd);
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  server.Stop();
+  EXPECT_NE(access(path.c_str(), F_OK), 0);
+
+  size_t requests = 0;
+  for (size_t shard = 0; shard < server.Shards(); ++shard) {
+    for (const auto& stats : server.GetDispatcher(shard).GetMetrics().Snapshot()) {
+      if (stats.method == "shard") {
+        requests += stats.requests;
+      }
+    }
+  }
+  EXPECT_EQ(requests, 40);
+}
+
+}  // namespace json_rpc
+
+#endif
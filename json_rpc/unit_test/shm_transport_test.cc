@@ -0,0 +1,250 @@
+
+#include "json_rpc/shm_transport.h"
+
+#ifdef __linux__
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace json_rpc {
+
+namespace {
+
+constexpr std::chrono::milliseconds kNoWait{0};
+constexpr std::chrono::milliseconds kWait{5000};
+
+std::string Message(const size_t i) {
+  return std::string(i % 50, static_cast<char>('a' + i % 26)) + std::to_string(i);
+}
+
+}  // namespace
+
+class ShmTransportTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dispatcher_.RegisterMethod("subtract", [](const Request& request) {
+      Response response(request.Id());
+      response.SetResult(request.Params().Get<int>(0) - request.Params().Get<int>(1));
+      return response;
+    });
+  }
+
+  Dispatcher dispatcher_;
+};
+
+TEST_F(ShmTransportTest, Ring) {
+  ShmChannel channel;
+  ASSERT_TRUE(channel.Create("", 256).Ok());
+  auto& ring = channel.Requests();
+  std::string_view message;
+  EXPECT_FALSE(ring.Read(&message, kNoWait));
+
+  // Messages of varying sizes wrap around the ring many times.
+  for (size_t i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(ring.Write(Message(i), kNoWait).Ok());
+    ASSERT_TRUE(ring.Write(Message(i + 1), kNoWait).Ok());
+    ASSERT_TRUE(ring.Read(&message, kNoWait));
+    EXPECT_EQ(message, Message(i));
+    ring.Release();
+    ASSERT_TRUE(ring.Read(&message, kNoWait));
+    EXPECT_EQ(message, Message(i + 1));
+    ring.Release();
+  }
+
+  // Full until a message is released, on the other ring, still empty.
+  auto& responses = channel.Responses();
+  const std::string large(100, 'x');
+  ASSERT_TRUE(responses.Write(large, kNoWait).Ok());
+  ASSERT_TRUE(responses.Write(large, kNoWait).Ok());
+  EXPECT_EQ(responses.Write(large, kNoWait).Code(), kRequestTimeout);
+  ASSERT_TRUE(responses.Read(&message, kNoWait));
+  responses.Release();
+  EXPECT_TRUE(responses.Write(large, kNoWait).Ok());
+  EXPECT_FALSE(responses.Write(std::string(300, 'x'), kNoWait).Ok());
+
+  // Messages written before closing are still read.
+  responses.Close();
+  EXPECT_TRUE(responses.Closed());
+  EXPECT_FALSE(responses.Write("{}", kWait).Ok());
+  EXPECT_TRUE(responses.Read(&message, kWait));
+  responses.Release();
+  EXPECT_TRUE(responses.Read(&message, kWait));
+  responses.Release();
+  EXPECT_FALSE(responses.Read(&message, kWait));
+}
+
+TEST_F(ShmTransportTest, CorruptRing) {
+  ShmChannel channel;
+  ASSERT_TRUE(channel.Create("", 256).Ok());
+  auto& ring = channel.Requests();
+  ASSERT_TRUE(ring.Write("{}", kNoWait).Ok());
+  std::string_view message;
+  ASSERT_TRUE(ring.Read(&message, kNoWait));
+
+  // A length past the end of the ring, as a broken or hostile writer could leave, closes the ring
+  // instead of being read.
+  const uint32_t length = 1 << 20;
+  std::memcpy(const_cast<char*>(message.data()) - sizeof(length), &length, sizeof(length));
+  EXPECT_FALSE(ring.Read(&message, kNoWait));
+  EXPECT_TRUE(ring.Closed());
+}
+
+TEST_F(ShmTransportTest, ConcurrentRing) {
+  constexpr size_t kMessages = 20000;
+  ShmChannel channel;
+  ASSERT_TRUE(channel.Create("", 512).Ok());
+  auto& ring = channel.Requests();
+  std::thread writer([&ring] {
+    for (size_t i = 0; i < kMessages; ++i) {
+      ASSERT_TRUE(ring.Write(Message(i), kWait).Ok());
+    }
+  });
+  for (size_t i = 0; i < kMessages; ++i) {
+    std::string_view message;
+    ASSERT_TRUE(ring.Read(&message, kWait));
+    ASSERT_EQ(message, Message(i));
+    ring.Release();
+  }
+  writer.join();
+}
+
+TEST_F(ShmTransportTest, ServerAndClient) {
+  ShmChannel channel;
+  ASSERT_TRUE(channel.Create("").Ok());
+  ShmServer server(&dispatcher_);
+  ASSERT_TRUE(server.Serve(&channel).Ok());
+  ShmClient client(&channel);
+
+  std::string response;
+  ASSERT_TRUE(
+      client.Call(R"({"jsonrpc":"2.0","method":"subtract","params":[42,23],"id":1})", &response)
+          .Ok());
+  EXPECT_EQ(Json::parse(response)["result"], 19);
+
+  // A notification is answered with nothing, and the next response is still in step.
+  ASSERT_TRUE(
+      client.Call(R"({"jsonrpc":"2.0","method":"subtract","params":[1,1]})", &response).Ok());
+  EXPECT_TRUE(response.empty());
+
+  Json json;
+  ASSERT_TRUE(client.Call(R"([{"jsonrpc":"2.0","method":"subtract","params":[5,2],"id":2},)"
+                          R"({"jsonrpc":"2.0","method":"subtract","params":[9,2],"id":3}])",
+                          &json)
+                  .Ok());
+  ASSERT_EQ(json.size(), 2);
+  EXPECT_EQ(json[1]["result"], 7);
+  ASSERT_TRUE(client.Call("{", &json).Ok());
+  EXPECT_EQ(json["error"]["code"], kParseError);
+  ASSERT_TRUE(client.Call(R"({"jsonrpc":"2.0","method":"subtract","params":[1,1]})", &json).Ok());
+  EXPECT_TRUE(json.is_null());
+
+  server.Stop();
+  EXPECT_FALSE(server.Serve(&channel).Ok());
+}
+
+TEST_F(ShmTransportTest, CrossProcess) {
+  ShmChannel channel;
+  ASSERT_TRUE(channel.Create("").Ok());
+  ShmServer server(&dispatcher_);
+  ASSERT_TRUE(server.Serve(&channel).Ok());
+
+  const pid_t child = fork();
+  ASSERT_GE(child, 0);
+  if (child == 0) {
+    // The child opens the inherited memory object on its own, as an unrelated process would.
+    ShmChannel inherited;
+    if (!inherited.Open(dup(channel.Fd())).Ok()) {
+      _exit(2);
+    }
+    ShmClient client(&inherited);
+    for (int i = 0; i < 100; ++i) {
+      Json response;
+      const auto request = R"({"jsonrpc":"2.0","method":"subtract","params":[)" +
+                           std::to_string(i) + R"(,1],"id":)" + std::to_string(i) + "}";
+      if (!client.Call(request, &response).Ok() || response["result"] != i - 1) {
+        _exit(1);
+      }
+    }
+    _exit(0);
+  }
+  int status = 0;
+  ASSERT_EQ(waitpid(child, &status, 0), child);
+  EXPECT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+  server.Stop();
+}
+
+TEST_F(ShmTransportTest, Named) {
+  const auto name = "/json_rpc_shm_test_" + std::to_string(getpid());
+  {
+    ShmChannel channel;
+    ASSERT_TRUE(channel.Create(name, 4096).Ok());
+    ShmChannel duplicate;
+    EXPECT_FALSE(duplicate.Create(name).Ok());
+
+    ShmChannel opened;
+    ASSERT_TRUE(opened.Open(name).Ok());
+    ShmServer server(&dispatcher_);
+    ASSERT_TRUE(server.Serve(&channel).Ok());
+    ShmClient client(&opened);
+    Json response;
+    ASSERT_TRUE(
+        client.Call(R"({"jsonrpc":"2.0","method":"subtract","params":[3,1],"id":1})", &response)
+            .Ok());
+    EXPECT_EQ(response["result"], 2);
+    // Closing the channel ends the server thread.
+    opened.Close();
+  }
+  // The creator removed the name.
+  ShmChannel removed;
+  EXPECT_FALSE(removed.Open(name).Ok());
+}
+
+TEST_F(ShmTransportTest, ResponseTooLarge) {
+  dispatcher_.RegisterMethod("repeat", [](const Request& request) {
+    Response response(request.Id());
+    response.SetResult(std::string(request.Params().Get<int>(0), 'x'));
+    return response;
+  });
+  ShmChannel channel;
+  ASSERT_TRUE(channel.Create("", 4096).Ok());
+  ShmServer server(&dispatcher_);
+  ASSERT_TRUE(server.Serve(&channel).Ok());
+  ShmClient client(&channel);
+
+  // The server answers at once with an error rather than leaving the client to time out.
+  Json json;
+  ASSERT_TRUE(
+      client.Call(R"({"jsonrpc":"2.0","method":"repeat","params":[10000],"id":1})", &json, kWait)
+          .Ok());
+  EXPECT_EQ(json["error"]["code"], kInternalError);
+  EXPECT_EQ(json["error"]["message"], "response too large");
+  EXPECT_EQ(json["id"], 1);
+
+  ASSERT_TRUE(
+      client.Call(R"({"jsonrpc":"2.0","method":"repeat","params":[100],"id":2})", &json, kWait)
+          .Ok());
+  EXPECT_EQ(json["result"].get<std::string>().size(), 100);
+}
+
+TEST_F(ShmTransportTest, Timeout) {
+  ShmChannel channel;
+  ASSERT_TRUE(channel.Create("").Ok());
+  ShmClient client(&channel);
+  std::string response;
+  // No server: the call times out and the channel is closed, since the response could come late.
+  const auto status = client.Call("{}", &response, std::chrono::milliseconds(10));
+  EXPECT_EQ(status.Code(), kRequestTimeout);
+  EXPECT_TRUE(channel.Requests().Closed());
+  EXPECT_FALSE(client.Call("{}", &response, std::chrono::milliseconds(10)).Ok());
+}
+
+}  // namespace json_rpc
+
+#endif
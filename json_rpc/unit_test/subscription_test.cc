@@ -0,0 +1,121 @@
+
+#include "json_rpc/subscription.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "json_rpc/peer.h"
+
+namespace json_rpc {
+
+TEST(SubscriptionTest, SerializeOnce) {
+  SubscriptionHub hub;
+  std::vector<SharedMessage> received(1000);
+  for (size_t i = 0; i < received.size(); ++i) {
+    hub.Subscribe("resources/a", [&received, i](const SharedMessage& message) {
+      received[i] = message;
+      return true;
+    });
+  }
+  std::vector<SharedMessage> others;
+  hub.Subscribe("resources/b", [&others](const SharedMessage& message) {
+    others.push_back(message);
+    return true;
+  });
+  EXPECT_EQ(hub.Subscribers("resources/a"), 1000);
+
+  const Request notification("2.0", "notifications/resources/updated",
+                             Parameter(Json{{"uri", "file:///a"}}), Identifier());
+  EXPECT_EQ(hub.Publish("resources/a", notification), 1000);
+  // Every subscriber holds the same buffer.
+  for (const auto& message : received) {
+    EXPECT_EQ(message.get(), received.front().get());
+  }
+  EXPECT_EQ(Json::parse(*received.front()), notification.ToJson());
+  EXPECT_EQ(received.front().use_count(), 1000);
+  EXPECT_TRUE(others.empty());
+  EXPECT_EQ(hub.Publish("resources/none", notification), 0);
+}
+
+TEST(SubscriptionTest, Unsubscribe) {
+  SubscriptionHub hub;
+  int first = 0;
+  int second = 0;
+  const auto id = hub.Subscribe("topic", [&first](const SharedMessage&) {
+    ++first;
+    return true;
+  });
+  // A subscriber whose connection is gone ends its subscription.
+  hub.Subscribe("topic", [&second](const SharedMessage&) {
+    ++second;
+    return false;
+  });
+  const auto message = SerializeShared(Request("2.0", "tick", Parameter(), Identifier()));
+  EXPECT_EQ(hub.Publish("topic", message), 1);
+  EXPECT_EQ(hub.Subscribers("topic"), 1);
+  EXPECT_EQ(hub.Publish("topic", message), 1);
+  EXPECT_EQ(second, 1);
+  EXPECT_TRUE(hub.Unsubscribe(id));
+  EXPECT_FALSE(hub.Unsubscribe(id));
+  EXPECT_EQ(hub.Publish("topic", message), 0);
+  EXPECT_EQ(first, 2);
+  EXPECT_EQ(hub.Subscribers("topic"), 0);
+}
+
+TEST(SubscriptionTest, UnsubscribeMany) {
+  SubscriptionHub hub;
+  std::vector<SubscriptionHub::SubscriptionId> ids;
+  std::vector<int> received(100);
+  for (size_t i = 0; i < received.size(); ++i) {
+    ids.push_back(hub.Subscribe("topic", [&received, i](const SharedMessage&) {
+      ++received[i];
+      return true;
+    }));
+  }
+  const auto message = SerializeShared(Request("2.0", "tick", Parameter(), Identifier()));
+  // Ended subscriptions are skipped whether or not the list was rebuilt without them yet.
+  for (size_t i = 0; i < 70; ++i) {
+    EXPECT_TRUE(hub.Unsubscribe(ids[i]));
+    EXPECT_EQ(hub.Subscribers("topic"), received.size() - i - 1);
+    EXPECT_EQ(hub.Publish("topic", message), received.size() - i - 1);
+  }
+  EXPECT_EQ(received[0], 0);
+  EXPECT_EQ(received[69], 69);
+  EXPECT_EQ(received[70], 70);
+
+  // A publish finding many sinks gone ends all of their subscriptions.
+  bool open = true;
+  for (size_t i = 0; i < 20; ++i) {
+    hub.Subscribe("topic", [&open](const SharedMessage&) { return open; });
+  }
+  EXPECT_EQ(hub.Publish("topic", message), 50);
+  open = false;
+  EXPECT_EQ(hub.Publish("topic", message), 30);
+  EXPECT_EQ(hub.Subscribers("topic"), 30);
+  for (size_t i = 70; i < ids.size(); ++i) {
+    EXPECT_TRUE(hub.Unsubscribe(ids[i]));
+  }
+  EXPECT_EQ(hub.Subscribers("topic"), 0);
+  EXPECT_EQ(hub.Publish("topic", message), 0);
+}
+
+TEST(SubscriptionTest, Peers) {
+  SubscriptionHub hub;
+  Dispatcher dispatcher;
+  std::vector<std::string> written;
+  Peer peer(&dispatcher, [&written](std::string_view message) {
+    written.emplace_back(message);
+    return true;
+  });
+  hub.Subscribe("topic", [&peer](const SharedMessage& message) { return peer.Send(message); });
+  EXPECT_EQ(hub.Publish("topic", Request("2.0", "tick", Parameter(), Identifier())), 1);
+  ASSERT_EQ(written.size(), 1);
+  EXPECT_EQ(Json::parse(written[0])["method"], "tick");
+
+  peer.Close();
+  EXPECT_EQ(hub.Publish("topic", Request("2.0", "tick", Parameter(), Identifier())), 0);
+  EXPECT_EQ(hub.Subscribers("topic"), 0);
+}
+
+}  // namespace json_rpc
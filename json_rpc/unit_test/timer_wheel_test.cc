@@ -0,0 +1,94 @@
+
+#include "json_rpc/timer_wheel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace json_rpc {
+
+class TimerWheelTest : public ::testing::Test {
+ protected:
+  using Clock = TimerWheel<int>::Clock;
+
+  std::vector<int> AdvanceTo(const Clock::duration elapsed) {
+    std::vector<int> expired;
+    wheel_.Advance(origin_ + elapsed, &expired);
+    std::sort(expired.begin(), expired.end());
+    return expired;
+  }
+
+  const Clock::time_point origin_ = Clock::now();
+  TimerWheel<int> wheel_{std::chrono::milliseconds(1), origin_};
+};
+
+TEST_F(TimerWheelTest, ExpiresInOrder) {
+  using std::chrono::milliseconds;
+  wheel_.Schedule(origin_ + milliseconds(5), 5);
+  wheel_.Schedule(origin_ + milliseconds(300), 300);
+  wheel_.Schedule(origin_ + milliseconds(70000), 70000);
+  wheel_.Schedule(origin_ + std::chrono::microseconds(10500), 11);
+  EXPECT_EQ(wheel_.Size(), 4);
+
+  EXPECT_TRUE(AdvanceTo(milliseconds(4)).empty());
+  EXPECT_EQ(AdvanceTo(milliseconds(5)), std::vector<int>({5}));
+  // Deadlines are rounded up to the tick.
+  EXPECT_TRUE(AdvanceTo(milliseconds(10)).empty());
+  EXPECT_EQ(AdvanceTo(milliseconds(11)), std::vector<int>({11}));
+  EXPECT_TRUE(AdvanceTo(milliseconds(299)).empty());
+  EXPECT_EQ(AdvanceTo(milliseconds(300)), std::vector<int>({300}));
+  EXPECT_TRUE(AdvanceTo(milliseconds(69999)).empty());
+  EXPECT_EQ(AdvanceTo(milliseconds(70000)), std::vector<int>({70000}));
+  EXPECT_EQ(wheel_.Size(), 0);
+}
+
+TEST_F(TimerWheelTest, Cascades) {
+  using std::chrono::milliseconds;
+  std::vector<int> expected;
+  for (int i = 1; i <= 1 << 17; i += 97) {
+    wheel_.Schedule(origin_ + milliseconds(i), i);
+    expected.push_back(i);
+  }
+  std::vector<int> expired;
+  for (int now = 0; now <= 1 << 17; now += 1000) {
+    const auto batch = AdvanceTo(milliseconds(now));
+    for (const auto value : batch) {
+      EXPECT_LE(value, now);
+      EXPECT_GT(value, now - 1000);
+    }
+    expired.insert(expired.end(), batch.begin(), batch.end());
+  }
+  const auto rest = AdvanceTo(milliseconds(1 << 17));
+  expired.insert(expired.end(), rest.begin(), rest.end());
+  EXPECT_EQ(expired, expected);
+}
+
+TEST_F(TimerWheelTest, Cancel) {
+  using std::chrono::milliseconds;
+  const auto first = wheel_.Schedule(origin_ + milliseconds(10), 1);
+  const auto second = wheel_.Schedule(origin_ + milliseconds(10), 2);
+  EXPECT_TRUE(wheel_.Cancel(first));
+  EXPECT_FALSE(wheel_.Cancel(first));
+  // The freed node is reused, but the stale identifier does not cancel the new timer.
+  wheel_.Schedule(origin_ + milliseconds(10), 3);
+  EXPECT_FALSE(wheel_.Cancel(first));
+  EXPECT_EQ(AdvanceTo(milliseconds(10)), std::vector<int>({2, 3}));
+  EXPECT_FALSE(wheel_.Cancel(second));
+}
+
+TEST_F(TimerWheelTest, PastAndFarDeadlines) {
+  using std::chrono::hours;
+  using std::chrono::milliseconds;
+  AdvanceTo(milliseconds(50));
+  wheel_.Schedule(origin_ - milliseconds(1), 1);
+  wheel_.Schedule(origin_ + milliseconds(20), 2);
+  // Beyond the 2^32 ticks the wheel covers.
+  wheel_.Schedule(origin_ + hours(24 * 60), 3);
+  EXPECT_EQ(AdvanceTo(milliseconds(50)), std::vector<int>({1, 2}));
+  EXPECT_TRUE(AdvanceTo(hours(24 * 60) - milliseconds(1)).empty());
+  EXPECT_EQ(AdvanceTo(hours(24 * 60)), std::vector<int>({3}));
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,130 @@
+
+#include "json_rpc/typed_result.h"
+
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "json_rpc/dispatcher.h"
+#include "json_rpc/response.h"
+
+namespace json_rpc {
+
+namespace {
+
+struct Point {
+  int x;
+  double y;
+};
+JSON_RPC_FIELDS(Point, x, y)
+
+struct Item {
+  std::string name;
+  std::vector<Point> points;
+  std::optional<int64_t> count;
+  bool active;
+  Json extra;
+};
+JSON_RPC_FIELDS(Item, name, points, count, active, extra)
+
+struct Renamed {
+  unsigned value;
+};
+
+constexpr auto JsonFields(const Renamed*) {
+  return std::make_tuple(Field("v", &Renamed::value));
+}
+
+std::string Typed(const Item& item) {
+  std::string out;
+  AppendJson(item, &out);
+  return out;
+}
+
+}  // namespace
+
+class TypedResultTest : public ::testing::Test {};
+
+TEST_F(TypedResultTest, Struct) {
+  EXPECT_TRUE(internal::IsTypedResult<Point>::value);
+  EXPECT_TRUE(internal::IsTypedResult<std::vector<Point>>::value);
+  EXPECT_TRUE((internal::IsTypedResult<std::map<std::string, std::optional<Point>>>::value));
+  EXPECT_FALSE(internal::IsTypedResult<std::vector<int>>::value);
+  EXPECT_FALSE(internal::IsTypedResult<std::string>::value);
+  EXPECT_FALSE(internal::IsTypedResult<Json>::value);
+
+  const Item item{"a", {{1, 0.5}, {-2, 1e300}}, std::nullopt, true, {{"k", {1, 2}}}};
+  EXPECT_EQ(Typed(item),
+            R"({"name":"a","points":[{"x":1,"y":0.5},{"x":-2,"y":1e+300}],"count":null,)"
+            R"("active":true,"extra":{"k":[1,2]}})");
+
+  std::string out;
+  AppendJson(std::map<std::string, Renamed>{{"b", {7}}, {"a", {4294967295u}}}, &out);
+  EXPECT_EQ(out, R"({"a":{"v":4294967295},"b":{"v":7}})");
+}
+
+TEST_F(TypedResultTest, Escape) {
+  // Strings are escaped exactly as Json::dump() escapes them.
+  std::string text = "plain \"quoted\" \\ / \b\f\n\r\t \x01\x1f\x7f caf\xc3\xa9";
+  text.push_back('\0');
+  std::string out;
+  internal::AppendString(text, &out);
+  EXPECT_EQ(out, Json(text).dump());
+  EXPECT_EQ(Json::parse(out).get<std::string>(), text);
+}
+
+TEST_F(TypedResultTest, Response) {
+  Response response{Identifier("r")};
+  response.SetResult(std::vector<Point>{{1, 2}, {3, 4.25}});
+  EXPECT_TRUE(response.HasTypedResult());
+  EXPECT_TRUE(response.Result().is_null());
+
+  std::string text;
+  response.AppendTo(&text);
+  EXPECT_EQ(text, R"({"id":"r","jsonrpc":"2.0","result":[{"x":1,"y":2.0},{"x":3,"y":4.25}]})");
+  EXPECT_EQ(response.ToJson(), Json::parse(text));
+
+  // A copy shares the value; a Json result or an error replaces it.
+  const auto copy = response;
+  response.SetResult(Json(5));
+  EXPECT_FALSE(response.HasTypedResult());
+  EXPECT_TRUE(copy.HasTypedResult());
+  EXPECT_EQ(copy.ToJson()["result"][1]["y"], 4.25);
+
+  response.SetError({kInvalidParams, "bad"});
+  text.clear();
+  response.AppendTo(&text);
+  EXPECT_EQ(text, response.ToJson().dump());
+
+  response.Clear();
+  EXPECT_FALSE(response.HasTypedResult());
+}
+
+TEST_F(TypedResultTest, AppendToMatchesDump) {
+  for (const auto& id : {Identifier(), Identifier(7), Identifier("id\n")}) {
+    Response response(id);
+    response.SetResult({{"b", "\"x\""}, {"a", {1.5, nullptr, false}}});
+    std::string text;
+    response.AppendTo(&text);
+    EXPECT_EQ(text, response.ToJson().dump());
+  }
+}
+
+TEST_F(TypedResultTest, Dispatcher) {
+  Dispatcher dispatcher;
+  dispatcher.RegisterMethod("points", [](const Request& request) {
+    Response response(request.Id());
+    std::vector<Point> points;
+    for (int i = 0; i < request.Params().Get<int>(0); ++i) {
+      points.push_back({i, i / 2.0});
+    }
+    response.SetResult(std::move(points));
+    return response;
+  });
+  EXPECT_EQ(dispatcher.HandleMessage(R"({"jsonrpc":"2.0","method":"points","params":[2],"id":1})"),
+            R"({"id":1,"jsonrpc":"2.0","result":[{"x":0,"y":0.0},{"x":1,"y":0.5}]})");
+}
+
+}  // namespace json_rpc
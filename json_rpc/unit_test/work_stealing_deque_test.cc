@@ -0,0 +1,71 @@
+
+#include "json_rpc/work_stealing_deque.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace json_rpc {
+
+TEST(WorkStealingDequeTest, OwnerIsLifoThievesFifo) {
+  WorkStealingDeque<int> deque(2);
+  for (int i = 0; i < 10; ++i) {
+    deque.Push(i);
+  }
+  EXPECT_EQ(deque.Size(), 10);
+
+  int value = -1;
+  ASSERT_TRUE(deque.Pop(&value));
+  EXPECT_EQ(value, 9);
+  ASSERT_TRUE(deque.Steal(&value));
+  EXPECT_EQ(value, 0);
+  for (int i = 8; i >= 1; --i) {
+    ASSERT_TRUE(deque.Pop(&value));
+    EXPECT_EQ(value, i);
+  }
+  EXPECT_FALSE(deque.Pop(&value));
+  EXPECT_FALSE(deque.Steal(&value));
+  EXPECT_EQ(deque.Size(), 0);
+}
+
+TEST(WorkStealingDequeTest, ConcurrentSteal) {
+  constexpr int kCount = 100000;
+  WorkStealingDeque<int> deque;
+  std::vector<std::atomic<int>> taken(kCount);
+  std::atomic<bool> done{false};
+
+  std::vector<std::thread> thieves;
+  for (int i = 0; i < 3; ++i) {
+    thieves.emplace_back([&] {
+      int value;
+      while (!done.load()) {
+        if (deque.Steal(&value)) {
+          taken[value].fetch_add(1);
+        }
+      }
+    });
+  }
+  int value;
+  for (int i = 0; i < kCount; ++i) {
+    deque.Push(i);
+    if (i % 3 == 0 && deque.Pop(&value)) {
+      taken[value].fetch_add(1);
+    }
+  }
+  while (deque.Pop(&value)) {
+    taken[value].fetch_add(1);
+  }
+  done = true;
+  for (auto& thief : thieves) {
+    thief.join();
+  }
+
+  // Every value is taken exactly once, by the owner or a thief.
+  for (int i = 0; i < kCount; ++i) {
+    ASSERT_EQ(taken[i].load(), 1) << i;
+  }
+}
+
+}  // namespace json_rpc
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace json_rpc {
+
+/// Chase-Lev work-stealing deque of trivially copyable values, such as pointers to tasks.
+///
+/// The owning thread pushes and pops at the bottom, last in first out, which keeps its recent and
+/// cache-hot work local. Any other thread steals from the top, oldest first. Push and Pop only
+/// contend with thieves for the last value; Steal is a single compare-and-swap.
+///
+/// The ring grows as needed. Rings outgrown are kept until the deque is destroyed, since a thief
+/// may still be reading one, so memory only shrinks when the deque goes away.
+template <typename T>
+class WorkStealingDeque {
+  static_assert(std::is_trivially_copyable_v<T>, "values are copied through std::atomic");
+
+ public:
+  static constexpr size_t kDefaultCapacity = 256;
+
+  /// @brief Constructor.
+  /// @param capacity The initial capacity, rounded up to a power of two.
+  explicit WorkStealingDeque(const size_t capacity = kDefaultCapacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    rings_.push_back(std::make_unique<Ring>(static_cast<int64_t>(size)));
+    ring_.store(rings_.back().get(), std::memory_order_relaxed);
+  }
+
+  WorkStealingDeque(const WorkStealingDeque&) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+  /// @brief Pushes a value at the bottom. Only called by the owning thread.
+  /// @param value The value.
+  void Push(const T value) {
+    const auto bottom = bottom_.load(std::memory_order_relaxed);
+    const auto top = top_.load(std::memory_order_acquire);
+    auto* ring = ring_.load(std::memory_order_relaxed);
+    if (bottom - top >= ring->capacity) {
+      ring = Grow(ring, top, bottom);
+    }
+    ring->Put(bottom, value);
+    bottom_.store(bottom + 1, std::memory_order_release);
+  }
+
+  /// @brief Pops the value at the bottom, the one pushed last. Only called by the owning thread.
+  /// @param value Receives the value.
+  /// @return false if the deque is empty, otherwise true.
+  bool Pop(T* value) {
+    const auto bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    auto* ring = ring_.load(std::memory_order_relaxed);
+    // Sequentially consistent, so thieves see the claim on the bottom before top is read back.
+    bottom_.store(bottom, std::memory_order_seq_cst);
+    auto top = top_.load(std::memory_order_seq_cst);
+    if (top > bottom) {
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return false;
+    }
+    *value = ring->Get(bottom);
+    if (top == bottom) {
+      // The last value, which a thief may be taking at the same time.
+      const bool won = top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                                    std::memory_order_relaxed);
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  /// @brief Steals the value at the top, the oldest one. Called by any thread.
+  /// @param value Receives the value.
+  /// @return false if the deque is empty or another thread took the value first, otherwise true.
+  bool Steal(T* value) {
+    auto top = top_.load(std::memory_order_seq_cst);
+    const auto bottom = bottom_.load(std::memory_order_seq_cst);
+    if (top >= bottom) {
+      return false;
+    }
+    const auto* ring = ring_.load(std::memory_order_acquire);
+    const auto stolen = ring->Get(top);
+    if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return false;
+    }
+    *value = stolen;
+    return true;
+  }
+
+  /// @brief Gets the number of values in the deque, as seen at some point during the call.
+  /// @return The number of values.
+  [[nodiscard]] size_t Size() const {
+    const auto bottom = bottom_.load(std::memory_order_relaxed);
+    const auto top = top_.load(std::memory_order_relaxed);
+    return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+  }
+
+ private:
+  struct Ring {
+    explicit Ring(const int64_t size)
+        : capacity(size), mask(size - 1), items(new std::atomic<T>[static_cast<size_t>(size)]) {}
+
+    T Get(const int64_t index) const {
+      return items[static_cast<size_t>(index & mask)].load(std::memory_order_relaxed);
+    }
+
+    void Put(const int64_t index, const T value) {
+      items[static_cast<size_t>(index & mask)].store(value, std::memory_order_relaxed);
+    }
+
+    const int64_t capacity;
+    const int64_t mask;
+    std::unique_ptr<std::atomic<T>[]> items;
+  };
+
+  Ring* Grow(const Ring* ring, const int64_t top, const int64_t bottom) {
+    rings_.push_back(std::make_unique<Ring>(ring->capacity * 2));
+    auto* grown = rings_.back().get();
+    for (auto i = top; i < bottom; ++i) {
+      grown->Put(i, ring->Get(i));
+    }
+    ring_.store(grown, std::memory_order_release);
+    return grown;
+  }
+
+  // Kept on separate cache lines, since the owner writes bottom_ and thieves write top_.
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  alignas(64) std::atomic<Ring*> ring_{nullptr};
+  // Only touched by the owning thread.
+  std::vector<std::unique_ptr<Ring>> rings_;
+};
+
+}  // namespace json_rpc
@@ -30,4 +30,17 @@ def jsonrpc_workspace(path_prefix = "", tf_repo_name = "", **kwargs):
         strip_prefix = "googletest-release-{ver}".format(ver = com_google_googletest_ver),
         build_file = clean_dep("//third_party/gtest:BUILD"),
         urls = com_google_googletest_urls,
-    )
\ No newline at end of file
+    )
+
+    net_zlib_ver = kwargs.get("net_zlib_ver", "1.3.1")
+    net_zlib_sha256 = kwargs.get("net_zlib_sha256", "9a93b2b7dfdac77ceba5a558a580e74667dd6fede4585b91eefb60f03b72df23")
+    net_zlib_urls = [
+        "https://github.com/madler/zlib/releases/download/v{ver}/zlib-{ver}.tar.gz".format(ver = net_zlib_ver),
+    ]
+    http_archive(
+        name = "net_zlib",
+        sha256 = net_zlib_sha256,
+        strip_prefix = "zlib-{ver}".format(ver = net_zlib_ver),
+        build_file = clean_dep("//third_party/zlib:BUILD"),
+        urls = net_zlib_urls,
+    )